@@ -4,7 +4,7 @@
 #include "shared.h"
 
 // WiFi
-void management_wifi_init(void);
+bool management_wifi_init(void);
 void management_wifi_deinit(void);
 
 // Storage (SD Card)
@@ -13,6 +13,7 @@ bool sdcard_deinit(void);
 
 // Helpers
 bool management_obtain_time(void);
+bool management_time_is_set(void);
 bool management_obtain_mac_addresses(void);
 void upload_files_to_server(void);
 void init_restart_timer(void);
\ No newline at end of file
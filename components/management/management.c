@@ -7,6 +7,8 @@
 #include "esp_wifi.h"
 #include "esp_eap_client.h"
 #include "esp_event.h"
+#include "esp_timer.h"
+#include "nvs.h"
 #include "esp_log.h"
 #include "freertos/event_groups.h"
 #include "freertos/FreeRTOS.h"
@@ -14,6 +16,9 @@
 #include "driver/spi_common.h"
 #include "esp_vfs_fat.h"
 #include "esp_http_client.h"
+#include "mbedtls/sha256.h"
+#include "block_digest.h"
+#include "ring_store.h"
 
 #define MAX_RETRY      5
 
@@ -26,6 +31,18 @@ static EventGroupHandle_t s_wifi_event_group;
 
 static int s_retry_num = 0;
 
+// Last access point that gave us an IP, cached in NVS for a directed connect on the next cycle
+#define AP_CACHE_NAMESPACE "management"
+#define AP_CACHE_KEY       "last_ap"
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+} ap_cache_t;
+
+static bool s_directed = false;  // Connecting to the cached access point without a full scan
+static int64_t s_connect_start = 0;
+
 // Declare variables to store handler instances
 static esp_event_handler_instance_t instance_wifi_event;
 static esp_event_handler_instance_t instance_ip_event;
@@ -40,7 +57,37 @@ static void restart_timer_callback(TimerHandle_t xTimer) {
     esp_restart();
 }
 
-void management_wifi_init(void)
+static bool ap_cache_load(ap_cache_t *ap)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(AP_CACHE_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*ap);
+    esp_err_t rc = nvs_get_blob(nvs, AP_CACHE_KEY, ap, &len);
+    nvs_close(nvs);
+    return rc == ESP_OK && len == sizeof(*ap);
+}
+
+static void ap_cache_store(const ap_cache_t *ap)
+{
+    ap_cache_t cached;
+    if (ap_cache_load(&cached) && memcmp(&cached, ap, sizeof(cached)) == 0) {
+        return;  // Spare the flash
+    }
+
+    nvs_handle_t nvs;
+    if (nvs_open(AP_CACHE_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS, access point not cached");
+        return;
+    }
+    if (nvs_set_blob(nvs, AP_CACHE_KEY, ap, sizeof(*ap)) != ESP_OK || nvs_commit(nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to cache access point");
+    }
+    nvs_close(nvs);
+}
+
+bool management_wifi_init(void)
 {
     s_wifi_event_group = xEventGroupCreate();
 
@@ -81,6 +128,19 @@ void management_wifi_init(void)
     // Set authentication mode to WPA2 Enterprise
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_ENTERPRISE;
 
+    #ifdef CONFIG_MANAGEMENT_FAST_REASSOC
+    // Connect straight to the access point of the last cycle, scanning only its channel. The event handler falls back
+    // to a full scan if it is gone.
+    ap_cache_t ap;
+    if (ap_cache_load(&ap)) {
+        memcpy(wifi_config.sta.bssid, ap.bssid, sizeof(ap.bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.channel = ap.channel;
+        s_directed = true;
+        ESP_LOGI(TAG, "Directed connect to " MACSTR " on channel %d", MAC2STR(ap.bssid), ap.channel);
+    }
+    #endif
+
     // Set Wi-Fi mode and configuration
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
@@ -96,25 +156,28 @@ void management_wifi_init(void)
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA)); // Station mode
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config)); // Set configuration
+    s_connect_start = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start()); // Start Wi-Fi
 
     ESP_LOGI(TAG, "Wi-Fi initialization completed in management mode.");
 
-    // Wait for connection
+    // Wait for connection, bounded so a missing network costs at most the timeout of capture time
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
                                            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
                                            pdFALSE,
                                            pdFALSE,
-                                           portMAX_DELAY);
+                                           pdMS_TO_TICKS(CONFIG_MANAGEMENT_CONNECT_TIMEOUT * 1000));
 
     // Check connection result
     if (bits & WIFI_CONNECTED_BIT) {
         ESP_LOGI(TAG, "Connected to SSID:%s", CONFIG_MANAGEMENT_WIFI_SSID);
+        return true;
     } else if (bits & WIFI_FAIL_BIT) {
         ESP_LOGE(TAG, "Failed to connect to SSID:%s", CONFIG_MANAGEMENT_WIFI_SSID);
     } else {
-        ESP_LOGE(TAG, "Unexpected event");
+        ESP_LOGE(TAG, "No IP from SSID:%s within %d s", CONFIG_MANAGEMENT_WIFI_SSID, CONFIG_MANAGEMENT_CONNECT_TIMEOUT);
     }
+    return false;
 }
 
 void management_wifi_deinit(void)
@@ -175,6 +238,15 @@ bool management_obtain_time(void)
     return false;
 }
 
+// True when the system clock holds a wall-clock time, e.g. synced in an earlier cycle and kept across the restart
+bool management_time_is_set(void)
+{
+    time_t now = time(NULL);
+    struct tm timeinfo;
+    gmtime_r(&now, &timeinfo);
+    return timeinfo.tm_year + 1900 >= 2024;
+}
+
 bool management_obtain_mac_addresses(void) {
     int rc;
 
@@ -209,7 +281,17 @@ static void management_wifi_event_handler(void *arg, esp_event_base_t event_base
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < MAX_RETRY) {
+        if (s_directed) {
+            // Cached access point is gone or refused us, scan for any access point of the SSID
+            wifi_config_t wifi_config;
+            esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+            wifi_config.sta.bssid_set = false;
+            wifi_config.sta.channel = 0;
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+            s_directed = false;
+            ESP_LOGI(TAG, "Directed connect failed, scanning for the AP");
+            esp_wifi_connect();
+        } else if (s_retry_num < MAX_RETRY) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(TAG, "Retrying to connect to the AP");
@@ -227,6 +309,20 @@ static void management_ip_event_handler(void *arg, esp_event_base_t event_base,
     if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t *event = (ip_event_got_ip_t *) event_data;
         ESP_LOGI(TAG, "Got IP Address: " IPSTR, IP2STR(&event->ip_info.ip));
+
+        wifi_ap_record_t ap_info;
+        if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+            ESP_LOGI(TAG, "Time to IP %lld ms (%s connect to " MACSTR " on channel %d)",
+                     (long long) ((esp_timer_get_time() - s_connect_start) / 1000), s_directed ? "directed" : "scanned",
+                     MAC2STR(ap_info.bssid), ap_info.primary);
+
+            #ifdef CONFIG_MANAGEMENT_FAST_REASSOC
+            ap_cache_t ap = { .channel = ap_info.primary };
+            memcpy(ap.bssid, ap_info.bssid, sizeof(ap.bssid));
+            ap_cache_store(&ap);
+            #endif
+        }
+
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
@@ -300,6 +396,252 @@ bool sdcard_deinit(void) {
     return true;
 }
 
+// Reads up to `len` bytes of an upload at `offset`, returns the number of bytes read
+typedef size_t (*upload_read_t)(void *context, uint64_t offset, uint8_t *buffer, size_t len);
+
+// Stream `content_length` bytes to the server. Returns true once the server accepted them.
+static bool upload_stream(const char *name, const char *file_type, const char *device_id,
+                          const char *auth_header_value, const char *extra_header, const char *extra_value,
+                          uint64_t content_length, upload_read_t read, void *context) {
+    // Configure HTTP client
+    esp_http_client_config_t config = {
+            .url = CONFIG_MANAGEMENT_SERVER_URL,
+            .method = HTTP_METHOD_POST,
+            .transport_type = HTTP_TRANSPORT_OVER_TCP,
+            .timeout_ms = 600000
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+
+    // Set HTTP headers
+    esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
+    esp_http_client_set_header(client, "Device-ID", device_id);
+    esp_http_client_set_header(client, "File-Type", file_type);
+    esp_http_client_set_header(client, "Authorization", auth_header_value);
+    if (extra_header) {
+        esp_http_client_set_header(client, extra_header, extra_value);
+    }
+
+    // Start HTTP connection and write headers
+    esp_err_t err = esp_http_client_open(client, content_length);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+        esp_http_client_cleanup(client);
+        return false;
+    }
+
+    // Read from the source and write to HTTP client
+    size_t buffer_size = 1024 * 50;  // Adjust as needed
+    uint8_t *buffer = malloc(buffer_size);
+    if (buffer == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate buffer");
+        esp_http_client_cleanup(client);
+        return false;
+    }
+
+    uint64_t total_uploaded = 0;
+    uint64_t read_bytes = 0;
+    bool upload_failed = false;
+    int last_reported_percentage = -1;
+
+    ESP_LOGI(TAG, "Uploading: %s", name);
+    while (total_uploaded < content_length &&
+           (read_bytes = read(context, total_uploaded, buffer, buffer_size)) > 0) {
+        int wlen = esp_http_client_write(client, (char *) buffer, read_bytes);
+        if (wlen < 0) {
+            ESP_LOGE(TAG, "Error writing data to HTTP stream");
+            upload_failed = true;
+            break;
+        }
+        total_uploaded += wlen;
+
+        // Calculate and display percentage (with casting to prevent overflow)
+        int percentage = (int)((total_uploaded * 100) / content_length);
+        if (percentage != last_reported_percentage) {
+            ESP_LOGI(TAG, "Progress (%s): %d%%", name, percentage);
+            last_reported_percentage = percentage;
+        }
+    }
+    if (total_uploaded < content_length) {
+        upload_failed = true;
+    }
+    ESP_LOGI(TAG, "Upload complete for %s", name);
+
+    free(buffer);
+
+    bool uploaded = false;
+    if (!upload_failed) {
+        // Finish the HTTP request
+        esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+        if (status == 200) {
+            ESP_LOGI(TAG, "File %s uploaded successfully", name);
+            uploaded = true;
+        } else {
+            ESP_LOGE(TAG, "Failed to upload file %s, HTTP status code: %d", name, status);
+        }
+    } else {
+        ESP_LOGW(TAG, "Upload failed for file %s. Will retry later.", name);
+    }
+
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return uploaded;
+}
+
+typedef struct {
+    FILE *file;
+    uint64_t file_size;
+    const uint8_t *trailer;
+    size_t trailer_len;
+} file_upload_t;
+
+static size_t read_file(void *context, uint64_t offset, uint8_t *buffer, size_t len) {
+    file_upload_t *upload = context;
+    if (offset >= upload->file_size) {
+        size_t trailer_offset = offset - upload->file_size;
+        size_t chunk = upload->trailer_len - trailer_offset < len ? upload->trailer_len - trailer_offset : len;
+        memcpy(buffer, upload->trailer + trailer_offset, chunk);
+        return chunk;
+    }
+    return fread(buffer, 1, len, upload->file);
+}
+
+// Upload a file followed by `trailer_len` bytes of `trailer`
+static bool upload_file(const char *filepath, const char *file_type, const char *device_id,
+                        const char *auth_header_value, const char *digest,
+                        const void *trailer, size_t trailer_len) {
+    struct stat st;
+    if (stat(filepath, &st) != 0) {
+        ESP_LOGI(TAG, "File %s does not exist", filepath);
+        return false;
+    }
+    ESP_LOGI(TAG, "File %s exists, size: %ld bytes", filepath, st.st_size);
+
+    // Open file
+    file_upload_t upload = {
+            .file = fopen(filepath, "rb"),
+            .file_size = st.st_size,
+            .trailer = trailer,
+            .trailer_len = trailer_len,
+    };
+    if (upload.file == NULL) {
+        ESP_LOGE(TAG, "Failed to open file %s", filepath);
+        return false;
+    }
+
+    bool uploaded = upload_stream(filepath, file_type, device_id, auth_header_value, digest ? "Block-Digest" : NULL,
+                                  digest, (uint64_t) st.st_size + trailer_len, read_file, &upload);
+    fclose(upload.file);
+    return uploaded;
+}
+
+static size_t read_ring(void *context, uint64_t offset, uint8_t *buffer, size_t len) {
+    return ring_store_stream_read(context, offset, buffer, len);
+}
+
+// Upload the pending records of a circular store as a regular capture file, then mark them uploaded
+static void upload_ring(const char *ring_path, const char *file_type, const char *device_id,
+                        const char *auth_header_value) {
+    ring_store_t ring;
+    if (!ring_store_open(&ring, ring_path)) {
+        ESP_LOGE(TAG, "Failed to open capture store %s", ring_path);
+        return;
+    }
+
+    uint64_t size = ring_store_stream_size(&ring);
+    ESP_LOGI(TAG, "Store %s holds %llu records, %llu overwritten", ring_path,
+             (unsigned long long) ring_store_pending(&ring), (unsigned long long) ring.superblock.overwritten);
+
+    char overwritten[24];
+    snprintf(overwritten, sizeof(overwritten), "%llu", (unsigned long long) ring.superblock.overwritten);
+    if (ring_store_pending(&ring) > 0 &&
+        upload_stream(ring_path, file_type, device_id, auth_header_value, "Overwritten-Records", overwritten,
+                      size, read_ring, &ring)) {
+        if (!ring_store_release(&ring)) {
+            ESP_LOGE(TAG, "Failed to release uploaded records of %s", ring_path);
+        }
+    }
+
+    ring_store_close(&ring);
+}
+
+#ifdef CONFIG_SNIFFER_STORE_RAW
+static size_t read_log(void *context, uint64_t offset, uint8_t *buffer, size_t len) {
+    return sector_log_stream_read(context, offset, buffer, len);
+}
+
+// Upload the pending records of a raw sector log as a regular capture file, then mark them uploaded
+static void upload_log(bool l2, const char *file_type, const char *device_id, const char *auth_header_value) {
+    const char *name = l2 ? "l2.log" : "csi.log";
+    sector_device_t device;
+    sector_device_sdmmc(&device, card);
+
+    uint64_t start;
+    uint64_t sectors;
+    sector_log_t log;
+    if (!raw_log_region(&device, l2, &start, &sectors) || !sector_log_open(&log, &device, start)) {
+        ESP_LOGI(TAG, "No %s capture log", file_type);
+        return;
+    }
+
+    uint64_t size = sector_log_stream_size(&log);
+    ESP_LOGI(TAG, "Log %s holds %llu records, %llu overwritten, %llu recovered", name,
+             (unsigned long long) sector_log_pending(&log), (unsigned long long) log.checkpoint.overwritten,
+             (unsigned long long) log.recovered);
+
+    char overwritten[24];
+    snprintf(overwritten, sizeof(overwritten), "%llu", (unsigned long long) log.checkpoint.overwritten);
+    if (sector_log_pending(&log) > 0 &&
+        upload_stream(name, file_type, device_id, auth_header_value, "Overwritten-Records", overwritten,
+                      size, read_log, &log)) {
+        if (!sector_log_release(&log)) {
+            ESP_LOGE(TAG, "Failed to release uploaded records of %s", name);
+        }
+    }
+
+    sector_log_close(&log);
+}
+#endif
+
+// Bring the manifest of a capture file up to date and compute the SHA-256 over its block CRCs, including the
+// trailing partial block whose CRC is returned in `tail_crc`. Only the manifest and the tail of the capture are read.
+static bool digest_manifest(const char *filepath, const char *manifest_path, char *digest, size_t digest_size,
+                            uint32_t *tail_crc, size_t *tail_len) {
+    block_digest_t block_digest;
+    if (!block_digest_open(&block_digest, filepath, manifest_path)) {
+        ESP_LOGE(TAG, "Failed to open digest manifest %s", manifest_path);
+        return false;
+    }
+    *tail_crc = ~block_digest.crc;
+    *tail_len = block_digest.fill > 0 ? sizeof(*tail_crc) : 0;
+    uint32_t blocks = block_digest.blocks + (block_digest.fill > 0 ? 1 : 0);
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    uint8_t buffer[512];
+    size_t read_bytes;
+    fseek(block_digest.manifest, sizeof(manifest_header_t), SEEK_SET);
+    while ((read_bytes = fread(buffer, 1, sizeof(buffer), block_digest.manifest)) > 0) {
+        mbedtls_sha256_update(&sha, buffer, read_bytes);
+    }
+    mbedtls_sha256_update(&sha, (const unsigned char *) tail_crc, *tail_len);
+    block_digest_close(&block_digest);
+
+    uint8_t hash[32];
+    mbedtls_sha256_finish(&sha, hash);
+    mbedtls_sha256_free(&sha);
+
+    int offset = snprintf(digest, digest_size, "crc32c-%d;blocks=%lu;sha-256=", BLOCK_DIGEST_SIZE,
+                          (unsigned long) blocks);
+    for (int i = 0; i < 32 && offset + 2 < (int) digest_size; i++) {
+        offset += snprintf(digest + offset, digest_size - offset, "%02x", hash[i]);
+    }
+    return true;
+}
+
 void upload_files_to_server(void) {
     // Obtain MAC address (Device ID)
     char device_id[18];
@@ -311,111 +653,62 @@ void upload_files_to_server(void) {
     char auth_header_value[128];
     snprintf(auth_header_value, sizeof(auth_header_value), "Basic %s", CONFIG_MANAGEMENT_SERVER_BASIC_AUTH);
 
-    // Define files to upload
-    const char *files_to_upload[] = {"/sdcard/l2.bin", "/sdcard/csi.bin"};
-    const char *file_types[] = {"l2", "csi"};
+    // Define files to upload, capture files are preceded by their digest manifest when the writer keeps one
+    const char *files_to_upload[] = {"/sdcard/l2.bin", "/sdcard/csi.bin", "/sdcard/summary.bin", "/sdcard/joined.bin"};
+    const char *file_types[] = {"l2", "csi", "summary", "joined"};
+    const char *manifests[] = {"/sdcard/l2.man", "/sdcard/csi.man", NULL, "/sdcard/joined.man"};
+    const char *manifest_types[] = {"l2-manifest", "csi-manifest", NULL, "joined-manifest"};
+    const char *rings[] = {"/sdcard/l2.rng", "/sdcard/csi.rng", NULL, NULL};
 
-    for (int i = 0; i < 2; i++) {
+    for (size_t i = 0; i < sizeof(files_to_upload) / sizeof(files_to_upload[0]); i++) {
         const char *filepath = files_to_upload[i];
-        const char *file_type = file_types[i];
+        const char *manifest_path = manifests[i];
 
+        // Captures kept in a circular store are read from the store, files left from before it are still sent
         struct stat st;
-        if (stat(filepath, &st) == 0) {
-            ESP_LOGI(TAG, "File %s exists, size: %ld bytes", filepath, st.st_size);
+        if (rings[i] && stat(rings[i], &st) == 0) {
+            upload_ring(rings[i], file_types[i], device_id, auth_header_value);
+        }
 
-            // Open file
-            FILE *file = fopen(filepath, "rb");
-            if (file == NULL) {
-                ESP_LOGE(TAG, "Failed to open file %s", filepath);
-                continue;
-            }
+        #ifdef CONFIG_SNIFFER_STORE_RAW
+        // Captures written to raw sector logs
+        if (rings[i]) {
+            upload_log(i == 0, file_types[i], device_id, auth_header_value);
+        }
+        #endif
 
-            // Configure HTTP client
-            esp_http_client_config_t config = {
-                    .url = CONFIG_MANAGEMENT_SERVER_URL,
-                    .method = HTTP_METHOD_POST,
-                    .transport_type = HTTP_TRANSPORT_OVER_TCP,
-                    .timeout_ms = 600000
-            };
-
-            esp_http_client_handle_t client = esp_http_client_init(&config);
-
-            // Set HTTP headers
-            esp_http_client_set_header(client, "Content-Type", "application/octet-stream");
-            esp_http_client_set_header(client, "Device-ID", device_id);
-            esp_http_client_set_header(client, "File-Type", file_type);
-            esp_http_client_set_header(client, "Authorization", auth_header_value);
-
-            // Start HTTP connection and write headers
-            esp_err_t err = esp_http_client_open(client, st.st_size);
-            if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-                esp_http_client_cleanup(client);
-                fclose(file);
-                continue;
-            }
+        if (stat(filepath, &st) != 0) {
+            ESP_LOGI(TAG, "File %s does not exist", filepath);
+            continue;
+        }
 
-            // Read from file and write to HTTP client
-            size_t buffer_size = 1024 * 50;  // Adjust as needed
-            uint8_t *buffer = malloc(buffer_size);
-            if (buffer == NULL) {
-                ESP_LOGE(TAG, "Failed to allocate buffer");
-                esp_http_client_cleanup(client);
-                fclose(file);
+        // The same digest is sent with the manifest and the capture, so the server can verify the capture
+        // against the manifest and recognise re-uploads
+        char digest[128];
+        bool has_digest = false;
+        if (manifest_path && stat(manifest_path, &st) == 0) {
+            uint32_t tail_crc;
+            size_t tail_len;
+            has_digest = digest_manifest(filepath, manifest_path, digest, sizeof(digest), &tail_crc, &tail_len);
+            if (has_digest && !upload_file(manifest_path, manifest_types[i], device_id, auth_header_value, digest,
+                                           &tail_crc, tail_len)) {
                 continue;
             }
+        }
 
-            uint64_t total_uploaded = 0;
-            uint64_t read_bytes = 0;
-            bool upload_failed = false;
-            int last_reported_percentage = -1;
-
-            ESP_LOGI(TAG, "Uploading: %s", filepath);
-            while ((read_bytes = fread(buffer, 1, buffer_size, file)) > 0) {
-                int wlen = esp_http_client_write(client, (char *) buffer, read_bytes);
-                if (wlen < 0) {
-                    ESP_LOGE(TAG, "Error writing data to HTTP stream");
-                    upload_failed = true;
-                    break;
-                }
-                total_uploaded += wlen;
-
-                // Calculate and display percentage (with casting to prevent overflow)
-                int percentage = (int)((total_uploaded * 100) / (uint64_t)st.st_size);
-                if (percentage != last_reported_percentage) {
-                    ESP_LOGI(TAG, "Progress (%s): %d%%", filepath, percentage);
-                    last_reported_percentage = percentage;
-                }
-            }
-            ESP_LOGI(TAG, "Upload complete for %s", filepath);
-
-            free(buffer);
-            fclose(file);
-
-            if (!upload_failed) {
-                // Finish the HTTP request
-                esp_http_client_fetch_headers(client);
-                int status = esp_http_client_get_status_code(client);
-                if (status == 200) {
-                    ESP_LOGI(TAG, "File %s uploaded successfully", filepath);
-
-                    // Delete the file after successful upload
-                    if (unlink(filepath) == 0) {
-                        ESP_LOGI(TAG, "File %s deleted after upload", filepath);
-                    } else {
-                        ESP_LOGE(TAG, "Failed to delete file %s", filepath);
-                    }
-                } else {
-                    ESP_LOGE(TAG, "Failed to upload file %s, HTTP status code: %d", filepath, status);
-                }
-            } else {
-                ESP_LOGW(TAG, "Upload failed for file %s. Will retry later.", filepath);
-            }
+        if (!upload_file(filepath, file_types[i], device_id, auth_header_value, has_digest ? digest : NULL,
+                         NULL, 0)) {
+            continue;
+        }
 
-            esp_http_client_close(client);
-            esp_http_client_cleanup(client);
+        // Delete the file after successful upload
+        if (unlink(filepath) == 0) {
+            ESP_LOGI(TAG, "File %s deleted after upload", filepath);
         } else {
-            ESP_LOGI(TAG, "File %s does not exist", filepath);
+            ESP_LOGE(TAG, "Failed to delete file %s", filepath);
+        }
+        if (has_digest && unlink(manifest_path) != 0) {
+            ESP_LOGE(TAG, "Failed to delete file %s", manifest_path);
         }
     }
 }
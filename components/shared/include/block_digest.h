@@ -0,0 +1,31 @@
+#ifndef BLOCK_DIGEST_H
+#define BLOCK_DIGEST_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "capture_format.h"
+
+#define CRC32C_INIT 0xFFFFFFFF
+
+// Running CRC-32C of a capture file, one CRC per BLOCK_DIGEST_SIZE block appended to its manifest as the block
+// fills up. Uploads send the manifest so the file never has to be re-read to hash it.
+typedef struct {
+    FILE *manifest;
+    uint32_t crc;      // Unfinalized CRC of the current partial block
+    uint32_t fill;     // Bytes in the current partial block
+    uint32_t blocks;   // Complete blocks in the manifest
+} block_digest_t;
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len);
+
+// Open the manifest of `data_path`, repairing it if the data file grew past it (e.g. after a crash)
+bool block_digest_open(block_digest_t *digest, const char *data_path, const char *manifest_path);
+
+// Account for bytes appended to the data file
+void block_digest_update(block_digest_t *digest, const void *data, size_t len);
+
+void block_digest_close(block_digest_t *digest);
+
+#endif // BLOCK_DIGEST_H
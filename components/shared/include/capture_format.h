@@ -0,0 +1,341 @@
+#ifndef CAPTURE_FORMAT_H
+#define CAPTURE_FORMAT_H
+
+// On-card record layouts. Kept free of ESP-IDF includes so host tools can decode captures with the same definitions.
+
+#include <stdint.h>
+#include <string.h>
+
+#define CSI_DATA_LEN 128 // Adjust based on your needs
+
+// Capture record schemas. Each layout is described once as a field list, X(record, type, name, dimension) with an
+// empty dimension for scalars. The packed structs below are generated from the lists, so the firmware encodes a
+// record by filling the struct directly. Host tools generate their field decoders from the same lists.
+#define CAPTURE_DECLARE_FIELD(record, type, name, dimension) type name dimension;
+
+// Packet data structure
+#define CAPTURED_PACKET_FIELDS(X) \
+    X(captured_packet_t, uint64_t, timestamp, )     /* Wall-clock time (ms) */ \
+    X(captured_packet_t, uint8_t, frame_type, )     /* Main frame type (0 = MGMT, 1 = CTRL, 2 = DATA) */ \
+    X(captured_packet_t, uint8_t, frame_subtype, ) \
+    X(captured_packet_t, int8_t, rssi, ) \
+    X(captured_packet_t, uint8_t, channel, ) \
+    X(captured_packet_t, uint16_t, header_len, ) \
+    X(captured_packet_t, uint8_t, header, [36]) \
+    X(captured_packet_t, uint16_t, payload_len, ) \
+    X(captured_packet_t, uint8_t, payload, [128])
+
+typedef struct __attribute__((packed)) {
+    CAPTURED_PACKET_FIELDS(CAPTURE_DECLARE_FIELD)
+} captured_packet_t;
+
+// CSI packet data structure
+#define CSI_PACKET_FIELDS(X) \
+    X(csi_packet_t, uint64_t, timestamp, )          /* Wall-clock time (s) */ \
+    X(csi_packet_t, uint8_t, mac, [6]) \
+    X(csi_packet_t, int8_t, rssi, ) \
+    X(csi_packet_t, uint8_t, channel, ) \
+    X(csi_packet_t, uint16_t, csi_len, ) \
+    X(csi_packet_t, uint8_t, csi_data, [CSI_DATA_LEN])
+
+typedef struct __attribute__((packed)) {
+    CSI_PACKET_FIELDS(CAPTURE_DECLARE_FIELD)
+} csi_packet_t;
+
+// Joined capture ("L2CS"): an L2 record of a frame followed by the CSI the same frame produced. MAC, RSSI, channel
+// and timestamp are stored once, in the L2 record; host decoders can read the prefix as a plain L2 record.
+#define JOINED_PACKET_FIELDS(X) \
+    X(joined_packet_t, uint16_t, csi_len, ) \
+    X(joined_packet_t, uint8_t, csi_data, [CSI_DATA_LEN])
+
+typedef struct __attribute__((packed)) {
+    captured_packet_t frame;
+    JOINED_PACKET_FIELDS(CAPTURE_DECLARE_FIELD)
+} joined_packet_t;
+
+// Dictionary coded L2 capture ("L2DC"): file_header_t, then a uint32_t segment size, then segments of that many
+// bytes. Every segment starts with an empty dictionary and holds whole records, so decoding can start at any segment
+// boundary; a type byte of L2_DICT_PAD fills the rest of a segment. Information elements that recur in management
+// frames are defined once per segment (l2_dict_define_t followed by the element) and referenced by their ID in the
+// frame records that follow.
+typedef enum {
+    L2_DICT_PAD = 0,
+    L2_DICT_DEFINE = 1,
+    L2_DICT_FRAME = 2,
+} l2_dict_record_type_t;
+
+// Frame record, followed by the header bytes up to the first information element (all `header_len` of them if the
+// frame has none) and `encoded_len` bytes of tokens for the rest of header and payload. A token is the ID of a
+// dictionary entry, or L2_DICT_LITERAL followed by a length byte and that many frame bytes.
+#define L2_DICT_FRAME_FIELDS(X) \
+    X(l2_dict_frame_t, uint8_t, type, )             /* L2_DICT_FRAME */ \
+    X(l2_dict_frame_t, uint64_t, timestamp, )       /* Wall-clock time (ms) */ \
+    X(l2_dict_frame_t, uint8_t, frame_type, ) \
+    X(l2_dict_frame_t, uint8_t, frame_subtype, ) \
+    X(l2_dict_frame_t, int8_t, rssi, ) \
+    X(l2_dict_frame_t, uint8_t, channel, ) \
+    X(l2_dict_frame_t, uint8_t, header_len, ) \
+    X(l2_dict_frame_t, uint8_t, payload_len, )      /* Length of the payload after expanding the tokens */ \
+    X(l2_dict_frame_t, uint8_t, encoded_len, )
+
+typedef struct __attribute__((packed)) {
+    L2_DICT_FRAME_FIELDS(CAPTURE_DECLARE_FIELD)
+} l2_dict_frame_t;
+
+// Definition record, followed by `len` bytes. IDs are assigned in order from 0 within a segment.
+typedef struct __attribute__((packed)) {
+    uint8_t type;    // L2_DICT_DEFINE
+    uint8_t id;
+    uint8_t len;
+} l2_dict_define_t;
+
+#define L2_DICT_LITERAL 0xFF
+#define L2_DICT_MAX_ENTRIES 255  // IDs 0-254, 0xFF introduces a literal
+
+// Projected L2 capture ("L2PR"): file_header_t, then a uint32_t schema (bitmask of PROJECTION_FIELD_*), then
+// fixed-size records of projected_packet_t followed by the enabled fields in the order of their bits.
+// X(field, bit, offset, size): each field is a copy of `size` bytes at `offset` of the 802.11 MAC header, zero when
+// the frame's header is too short to carry it.
+#define PROJECTION_FIELDS(X) \
+    X(FLAGS,    0,  1, 1)  /* Frame control flags (to/from DS, retry, power management, ...) */ \
+    X(DURATION, 1,  2, 2)  /* Duration/ID */ \
+    X(SEQUENCE, 2, 22, 2)  /* Sequence control (fragment in bits 0-3, sequence in 4-15) */ \
+    X(ADDR1,    3,  4, 6)  /* Receiver address */ \
+    X(ADDR2,    4, 10, 6)  /* Transmitter address */ \
+    X(ADDR3,    5, 16, 6)  /* BSSID / source / destination, depending on to/from DS */
+
+#define PROJECTION_DECLARE_BIT(field, bit, offset, size) PROJECTION_FIELD_##field = 1 << bit,
+enum {
+    PROJECTION_FIELDS(PROJECTION_DECLARE_BIT)
+};
+
+#define PROJECTED_PACKET_FIELDS(X) \
+    X(projected_packet_t, uint64_t, timestamp, )    /* Wall-clock time (ms) */ \
+    X(projected_packet_t, uint8_t, frame_type, )    /* Frame type in bits 4-5, subtype in bits 0-3 */ \
+    X(projected_packet_t, int8_t, rssi, ) \
+    X(projected_packet_t, uint8_t, channel, )
+
+typedef struct __attribute__((packed)) {
+    PROJECTED_PACKET_FIELDS(CAPTURE_DECLARE_FIELD)
+} projected_packet_t;
+
+#define PROJECTION_ADD_SIZE(field, bit, offset, size) + size
+#define PROJECTION_ADD_SELECTED_SIZE(field, bit, offset, size) + ((schema & PROJECTION_FIELD_##field) ? size : 0)
+#define PROJECTION_MAX_RECORD_SIZE (sizeof(projected_packet_t) PROJECTION_FIELDS(PROJECTION_ADD_SIZE))
+
+static inline uint32_t projection_record_size(uint32_t schema) {
+    return sizeof(projected_packet_t) PROJECTION_FIELDS(PROJECTION_ADD_SELECTED_SIZE);
+}
+
+// Encode the fields of `schema` from a MAC header of `header_len` bytes. With a constant schema, only the enabled
+// copies are compiled in.
+#define PROJECTION_ENCODE_FIELD(field, bit, offset, size) \
+    if (schema & PROJECTION_FIELD_##field) { \
+        if (offset + size <= header_len) { \
+            memcpy(out, header + offset, size); \
+        } else { \
+            memset(out, 0, size); \
+        } \
+        out += size; \
+    }
+
+static inline uint8_t *projection_encode(uint32_t schema, const uint8_t *header, uint32_t header_len, uint8_t *out) {
+    PROJECTION_FIELDS(PROJECTION_ENCODE_FIELD)
+    return out;
+}
+
+// Decode the fields of `schema` back to their place in a zeroed MAC header of at least 24 bytes
+#define PROJECTION_DECODE_FIELD(field, bit, offset, size) \
+    if (schema & PROJECTION_FIELD_##field) { \
+        memcpy(header + offset, in, size); \
+        in += size; \
+    }
+
+static inline const uint8_t *projection_decode(uint32_t schema, const uint8_t *in, uint8_t *header) {
+    PROJECTION_FIELDS(PROJECTION_DECODE_FIELD)
+    return in;
+}
+
+// File header for capture file
+#define FILE_HEADER_FIELDS(X) \
+    X(file_header_t, char, identifier, [4])         /* e.g., "L2PK" or "CSIP" */ \
+    X(file_header_t, uint32_t, version, )           /* e.g., 1 */ \
+    X(file_header_t, uint64_t, start_time, )        /* Unix timestamp when capture started */ \
+    X(file_header_t, uint8_t, wifi_mac, [6])        /* Wi-Fi MAC address */ \
+    X(file_header_t, uint8_t, bt_mac, [6])          /* Bluetooth MAC address */
+
+typedef struct __attribute__((packed)) {
+    FILE_HEADER_FIELDS(CAPTURE_DECLARE_FIELD)
+} file_header_t;
+
+// Capture file formats, X(format, identifier, version, oldest, record). The firmware writes `version`, host
+// decoders read every version from `oldest` on and reject files from newer firmware. A layout change bumps the
+// version here, together with the field list above.
+#define CAPTURE_FORMATS(X) \
+    X(L2_RAW,       "L2PK", 2, 2, captured_packet_t) \
+    X(L2_PROJECTED, "L2PR", 1, 1, projected_packet_t) \
+    X(CSI,          "CSIP", 1, 1, csi_packet_t) \
+    X(JOINED,       "L2CS", 1, 1, joined_packet_t) \
+    X(L2_DICT,      "L2DC", 1, 1, l2_dict_frame_t)
+
+#define CAPTURE_DECLARE_FORMAT(format, identifier, version, oldest, record) CAPTURE_FORMAT_##format,
+typedef enum {
+    CAPTURE_FORMATS(CAPTURE_DECLARE_FORMAT)
+    CAPTURE_FORMAT_COUNT
+} capture_format_t;
+
+#define CAPTURE_DECLARE_VERSION(format, identifier, version, oldest, record) CAPTURE_VERSION_##format = version,
+enum {
+    CAPTURE_FORMATS(CAPTURE_DECLARE_VERSION)
+};
+
+typedef struct {
+    char identifier[5];
+    uint32_t version;
+    uint32_t oldest;
+    uint32_t record_size;  // Fixed part of the record: projection fields follow it in "L2PR", tokens in "L2DC"
+} capture_format_info_t;
+
+#define CAPTURE_FORMAT_INFO(format, identifier, version, oldest, record) \
+    { identifier, version, oldest, sizeof(record) },
+
+static inline const capture_format_info_t *capture_format_info(capture_format_t format) {
+    static const capture_format_info_t formats[] = { CAPTURE_FORMATS(CAPTURE_FORMAT_INFO) };
+    return &formats[format];
+}
+
+// Format of a file header identifier, CAPTURE_FORMAT_COUNT when unknown
+static inline capture_format_t capture_format_find(const char identifier[4]) {
+    for (int format = 0; format < CAPTURE_FORMAT_COUNT; format++) {
+        if (memcmp(capture_format_info((capture_format_t) format)->identifier, identifier, 4) == 0) {
+            return (capture_format_t) format;
+        }
+    }
+    return CAPTURE_FORMAT_COUNT;
+}
+
+// Block digest manifest ("BCRC", l2.man / csi.man): the header is followed by one CRC-32C per block of the
+// capture file, in file order. The CRC of a trailing partial block is only sent with the upload.
+#define BLOCK_DIGEST_SIZE 4096
+
+typedef struct __attribute__((packed)) {
+    char identifier[4];   // "BCRC"
+    uint32_t version;     // 1
+    uint32_t block_size;  // BLOCK_DIGEST_SIZE
+} manifest_header_t;
+
+// Header of every record in the summary stream ("SUMM"), followed by `length` bytes of body
+typedef struct __attribute__((packed)) {
+    uint16_t type;        // One of summary_record_type_t
+    uint16_t length;      // Length of the record body
+    uint64_t timestamp;   // Wall-clock time (ms) when the record was produced
+} summary_record_header_t;
+
+typedef enum {
+    SUMMARY_RECORD_HLL = 1,
+    SUMMARY_RECORD_STATS = 2,
+    SUMMARY_RECORD_CSI_SOURCES = 3,
+    SUMMARY_RECORD_TSF_SYNC = 4,
+    SUMMARY_RECORD_SURVEY = 5,
+    SUMMARY_RECORD_LATENCY = 6,
+    SUMMARY_RECORD_BEACONS = 7,
+} summary_record_type_t;
+
+// HyperLogLog sketch of one window, followed by 2^precision one-byte registers
+typedef struct __attribute__((packed)) {
+    uint8_t source;          // 0 = transmitter MAC, 1 = probe request fingerprint
+    uint8_t precision;
+    uint16_t window_minutes;
+    uint64_t window_start;   // Wall-clock time (ms) when the window started
+    uint32_t estimate;       // Estimated unique count, registers allow the server to merge sketches
+} hll_summary_t;
+
+// Sniffer counters since boot. New counters are only ever appended, the record length tells which are present.
+typedef struct __attribute__((packed)) {
+    uint32_t l2_received;    // Frames seen by the L2 callback
+    uint32_t l2_enqueued;
+    uint32_t l2_queue_full;  // Frames lost because the L2 queue was full
+    uint32_t l2_duplicates;  // Retries of a recently seen (transmitter, receiver, TID, sequence, fragment)
+    uint32_t csi_received;
+    uint32_t csi_enqueued;
+    uint32_t csi_queue_full;
+    uint32_t l2_shed_payload;   // Load shedding level 1: frames stored without their payload
+    uint32_t l2_shed_sampled;   // Level 2: data frames dropped by 1-in-N sampling
+    uint32_t l2_shed_non_mgmt;  // Level 3: control and data frames dropped, only management frames kept
+    uint32_t csi_rate_limited;  // CSI frames rejected by the per-source token buckets
+    uint32_t l2_overwritten;    // Records overwritten in a full circular store before they were uploaded
+    uint32_t csi_overwritten;
+    uint32_t l2_beacons_summarised;  // Beacons counted in the beacon aggregates instead of being stored
+    uint32_t joined_enqueued;        // Frames stored as one joined L2 + CSI record
+    uint32_t joined_queue_full;
+    uint32_t join_l2_unmatched;      // L2 records stored alone, no CSI of the same frame arrived in time
+    uint32_t join_csi_unmatched;     // CSI records stored alone, no L2 record of the same frame arrived in time
+} stats_summary_t;
+
+// Per-source CSI rate limiter counters, followed by `count` csi_source_counters_t
+typedef struct __attribute__((packed)) {
+    uint16_t count;
+} csi_sources_summary_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mac[6];
+    uint32_t admitted;  // Since the source entered the limiter table
+    uint32_t rejected;
+} csi_source_counters_t;
+
+// Beacon of a reference AP, pairing the AP clock (TSF) with the sniffer clocks. Once per AP and channel dwell.
+typedef struct __attribute__((packed)) {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+    uint32_t dwell;          // Channel dwell counter since boot
+    uint64_t tsf;            // Beacon timestamp field (µs, AP clock)
+    uint64_t rx_timestamp;   // rx_ctrl.timestamp (µs, local Wi-Fi clock)
+    uint64_t wall_clock;     // Wall-clock time (µs) in the callback, the clock of capture record timestamps
+} tsf_sync_summary_t;
+
+// Survey of one channel dwell: estimated airtime, frame counts and a noise floor histogram
+#define SURVEY_NOISE_BINS 16
+#define SURVEY_NOISE_MIN  (-112)  // dBm, lower edge of the first bin; the first and last bins are open-ended
+#define SURVEY_NOISE_STEP 2       // dB per bin
+
+typedef struct __attribute__((packed)) {
+    uint32_t dwell;          // Channel dwell counter since boot
+    uint8_t channel;
+    uint32_t duration_ms;    // Length of the dwell, airtime_us / (1000 * duration_ms) is the utilisation
+    uint32_t airtime_us;     // Estimated airtime of the received frames
+    uint32_t frames[4];      // Management, control, data, other
+    uint32_t unknown_rate;   // Frames without an airtime estimate
+    uint16_t noise_floor[SURVEY_NOISE_BINS];
+} survey_summary_t;
+
+// Capture latency of one stream and stage over a statistics interval, a record holds one entry per pair with data
+typedef struct __attribute__((packed)) {
+    uint8_t stream;   // 0 = L2, 1 = CSI, 2 = joined L2 + CSI
+    uint8_t stage;    // Measured from the enqueue: 0 = dequeued, 1 = written, 2 = synced to the card
+    uint32_t count;
+    uint32_t p50;     // µs, upper edge of the histogram bucket
+    uint32_t p99;
+    uint32_t max;
+} latency_entry_t;
+
+// Beacons of one window, followed by `count` beacon_aggregate_t. Per BSSID, the first beacon of the window and
+// every beacon with changed IEs are stored in full in the L2 capture, the others are only counted here.
+typedef struct __attribute__((packed)) {
+    uint64_t window_start;   // Wall-clock time (ms) when the window started
+    uint32_t window_seconds;
+    uint32_t untracked;      // Beacons of BSSIDs that did not fit the table, all stored in full
+    uint16_t count;
+} beacon_summary_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t bssid[6];
+    uint8_t channel;         // Channel of the last beacon
+    int8_t rssi_min;
+    int8_t rssi_max;
+    int8_t rssi_mean;
+    uint16_t beacons;        // All beacons of the window, including the stored ones
+    uint16_t stored;
+} beacon_aggregate_t;
+
+#endif // CAPTURE_FORMAT_H
@@ -0,0 +1,34 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 64-bit finalizer from MurmurHash3, spreads every input bit over the whole word
+static inline uint64_t hash_mix64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Hash of a 48-bit MAC address
+static inline uint64_t hash_mac(const uint8_t mac[6]) {
+    uint64_t value = ((uint64_t) mac[0] << 40) | ((uint64_t) mac[1] << 32) | ((uint64_t) mac[2] << 24) |
+                     ((uint64_t) mac[3] << 16) | ((uint64_t) mac[4] << 8) | (uint64_t) mac[5];
+    return hash_mix64(value);
+}
+
+// Hash of an arbitrary byte string (FNV-1a folded through the Murmur finalizer)
+static inline uint64_t hash_bytes(const uint8_t *data, size_t len, uint64_t seed) {
+    uint64_t value = 0xcbf29ce484222325ULL ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        value ^= data[i];
+        value *= 0x100000001b3ULL;
+    }
+    return hash_mix64(value);
+}
+
+#endif // HASH_H
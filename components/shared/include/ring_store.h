@@ -0,0 +1,67 @@
+#ifndef RING_STORE_H
+#define RING_STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RING_STORE_SUPERBLOCK_SLOT 512    // Two superblock copies, one per slot
+#define RING_STORE_DATA_START      4096
+#define RING_STORE_MAX_HEADER      64
+
+// Superblock of a circular capture store. Commits alternate between the two copies, the valid copy with the
+// highest generation wins, so a power loss during a commit falls back to the previous one.
+typedef struct __attribute__((packed)) {
+    char identifier[4];       // "RING"
+    uint32_t version;         // 1
+    uint64_t generation;
+    uint32_t segment_size;
+    uint32_t segment_count;
+    uint32_t record_size;
+    uint32_t header_len;
+    uint8_t header[RING_STORE_MAX_HEADER];  // Capture file header sent in front of the records on upload
+    uint64_t head;            // Sequence number of the oldest segment not yet uploaded
+    uint64_t tail;            // Sequence number of the segment being written, stored at tail % segment_count
+    uint32_t tail_records;    // Committed records in the tail segment
+    uint64_t overwritten;     // Records overwritten before they were uploaded
+    uint32_t crc;             // CRC-32C of the fields above
+} ring_superblock_t;
+
+// Fixed-size, preallocated store of fixed-size records in segments. When full, the oldest segment that was not
+// uploaded yet is overwritten. Appends never allocate clusters and card usage is bounded by the store size.
+typedef struct {
+    FILE *file;
+    ring_superblock_t superblock;
+    uint32_t segment_capacity;  // Records per segment
+    bool positioned;            // File position is at the next append
+    bool formatted;             // The store was (re)created by ring_store_create
+} ring_store_t;
+
+// Open an existing store, or create and preallocate one of `size` bytes. An existing store with a different
+// geometry is recreated. The capture header is replaced while the store holds no records.
+bool ring_store_create(ring_store_t *ring, const char *path, uint64_t size, uint32_t segment_size,
+                       uint32_t record_size, const void *header, uint32_t header_len);
+
+// Open an existing store, e.g. to upload it
+bool ring_store_open(ring_store_t *ring, const char *path);
+
+void ring_store_close(ring_store_t *ring);
+
+// Append one record. Returns the number of records overwritten to make room (usually 0), or -1 on error.
+int ring_store_append(ring_store_t *ring, const void *record);
+
+// Make appended records durable: sync the data, then write the other superblock copy
+bool ring_store_commit(ring_store_t *ring);
+
+// Records not uploaded yet
+uint64_t ring_store_pending(const ring_store_t *ring);
+
+// The pending records as a capture file (header followed by the records in order)
+uint64_t ring_store_stream_size(const ring_store_t *ring);
+size_t ring_store_stream_read(ring_store_t *ring, uint64_t offset, void *buffer, size_t len);
+
+// Mark all pending records as uploaded, writing continues in a fresh segment
+bool ring_store_release(ring_store_t *ring);
+
+#endif // RING_STORE_H
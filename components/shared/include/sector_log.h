@@ -0,0 +1,114 @@
+#ifndef SECTOR_LOG_H
+#define SECTOR_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SECTOR_SIZE               512
+#define SECTOR_LOG_CHECKPOINT     1   // Two checkpoint copies in sectors 1 and 2 of the region
+#define SECTOR_LOG_DATA_START     8   // First block, 4 KiB into the region
+#define SECTOR_LOG_MAX_HEADER     64
+
+// Raw sector access to a card, or to a disk image on the host
+typedef struct {
+    bool (*read)(void *context, uint64_t sector, uint32_t count, void *buffer);
+    bool (*write)(void *context, uint64_t sector, uint32_t count, const void *buffer);
+    void *context;
+    uint64_t sector_count;
+} sector_device_t;
+
+// Sector 0 of a log region, written when the log is formatted
+typedef struct __attribute__((packed)) {
+    char identifier[4];       // "SLOG"
+    uint32_t version;         // 1
+    uint32_t log_id;          // Random per format, blocks of an earlier log in the same region never match
+    uint64_t region_sectors;  // Size of the region, the next region starts behind it
+    uint32_t block_sectors;
+    uint32_t record_size;
+    uint32_t header_len;
+    uint8_t header[SECTOR_LOG_MAX_HEADER];  // Capture file header sent in front of the records on upload
+    uint32_t crc;             // CRC-32C of the fields above
+} sector_log_superblock_t;
+
+// Position of the log, written alternately to the two checkpoint sectors. The valid copy with the highest
+// generation wins; blocks written after it are found again by rolling forward over the block sequence.
+typedef struct __attribute__((packed)) {
+    char identifier[4];       // "SLCP"
+    uint64_t generation;
+    uint64_t head;            // Sequence number of the oldest block not yet uploaded
+    uint64_t tail;            // Sequence number of the block being filled, stored at tail % block_count
+    uint32_t tail_records;    // Records of the tail block written at this checkpoint
+    uint32_t tail_crc;        // CRC-32C of those records, they survive a torn rewrite of the tail block
+    uint64_t overwritten;     // Records overwritten before they were uploaded
+    uint32_t crc;             // CRC-32C of the fields above
+} sector_log_checkpoint_t;
+
+// Start of every block, followed by `records` records; records never span blocks
+typedef struct __attribute__((packed)) {
+    char identifier[4];       // "SLBK"
+    uint32_t log_id;
+    uint64_t sequence;
+    uint32_t records;
+    uint32_t crc;             // CRC-32C of the fields above and the records
+} sector_log_block_t;
+
+// Log-structured capture store on raw sectors, bypassing the file system. Records are collected in a RAM block
+// that is written with one multi-sector write when full. Like ring_store, the oldest block not uploaded yet is
+// overwritten when the region is full.
+typedef struct {
+    sector_device_t device;
+    uint64_t start;             // First sector of the region
+    sector_log_superblock_t superblock;
+    sector_log_checkpoint_t checkpoint;
+    uint64_t block_count;
+    uint32_t block_capacity;    // Records per block
+    uint8_t *block;             // Tail block
+    bool block_dirty;           // Records were appended since the tail block was last written
+    uint8_t *cache;             // Last block read for uploads
+    uint64_t cache_sequence;
+    bool cache_valid;
+    bool formatted;             // The log was (re)formatted by sector_log_create
+    uint64_t recovered;         // Records found behind the checkpoint when opening
+} sector_log_t;
+
+// Open the log of the region at `start`, or format one of `sectors` sectors. A log with a different geometry is
+// reformatted. The capture header is replaced while the log holds no records.
+bool sector_log_create(sector_log_t *log, const sector_device_t *device, uint64_t start, uint64_t sectors,
+                       uint32_t block_sectors, uint32_t record_size, const void *header, uint32_t header_len);
+
+// Open an existing log, e.g. to upload it
+bool sector_log_open(sector_log_t *log, const sector_device_t *device, uint64_t start);
+
+void sector_log_close(sector_log_t *log);
+
+// Append one record. Returns the number of records overwritten to make room (usually 0), or -1 on error.
+int sector_log_append(sector_log_t *log, const void *record);
+
+// Make appended records durable: write the partial tail block, then a checkpoint
+bool sector_log_commit(sector_log_t *log);
+
+// Records not uploaded yet
+uint64_t sector_log_pending(const sector_log_t *log);
+
+// The pending records as a capture file (header followed by the records in order)
+uint64_t sector_log_stream_size(const sector_log_t *log);
+size_t sector_log_stream_read(sector_log_t *log, uint64_t offset, void *buffer, size_t len);
+
+// Mark all pending records as uploaded, writing continues in a fresh block
+bool sector_log_release(sector_log_t *log);
+
+// First sector behind the last MBR partition, 4 KiB aligned. 0 when sector 0 holds no partition table, e.g. a
+// card formatted without partitions, which leaves no room for a log.
+uint64_t sector_log_free_start(const sector_device_t *device);
+
+#ifdef ESP_PLATFORM
+#include <sdmmc_cmd.h>
+void sector_device_sdmmc(sector_device_t *device, sdmmc_card_t *card);
+#else
+// Disk image file standing in for a card on the host
+bool sector_device_image_open(sector_device_t *device, const char *path);
+void sector_device_image_close(sector_device_t *device);
+#endif
+
+#endif // SECTOR_LOG_H
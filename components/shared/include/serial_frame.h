@@ -0,0 +1,55 @@
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Frames of the serial capture stream. Each frame is COBS encoded and enclosed in 0x00 delimiters, so a receiver
+// resynchronises at the next delimiter after line noise or interleaved console output. Before encoding, a frame is
+// serial_frame_header_t, the payload and a CRC-32C of both.
+#define SERIAL_FRAME_MAX_PAYLOAD  512
+#define SERIAL_FRAME_MAX_RAW      (sizeof(serial_frame_header_t) + SERIAL_FRAME_MAX_PAYLOAD + sizeof(uint32_t))
+#define SERIAL_FRAME_MAX_ENCODED  (SERIAL_FRAME_MAX_RAW + SERIAL_FRAME_MAX_RAW / 254 + 3)
+
+typedef enum {
+    SERIAL_FRAME_HEADER = 0,   // Capture file header of the stream, repeated so late receivers can start
+    SERIAL_FRAME_RECORD = 1,   // One capture record
+} serial_frame_kind_t;
+
+typedef enum {
+    SERIAL_STREAM_L2 = 0,
+    SERIAL_STREAM_CSI = 1,
+} serial_stream_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t kind;
+    uint8_t stream;
+    uint32_t sequence;         // Records sent on the stream before this frame; gaps are lost records
+} serial_frame_header_t;
+
+typedef struct {
+    serial_frame_header_t header;
+    const uint8_t *payload;    // Points into the decoder, valid until it is fed again
+    size_t payload_len;
+} serial_frame_t;
+
+typedef struct {
+    uint8_t buffer[SERIAL_FRAME_MAX_ENCODED];
+    size_t fill;
+    bool overflow;             // The frame did not fit, it is dropped at its delimiter
+    uint64_t errors;           // Frames dropped for bad encoding, length or CRC
+} serial_frame_decoder_t;
+
+// Encode a frame into `out` (at least SERIAL_FRAME_MAX_ENCODED bytes), returns its length including delimiters
+size_t serial_frame_encode(serial_frame_kind_t kind, serial_stream_t stream, uint32_t sequence, const void *payload,
+                           size_t payload_len, uint8_t *out);
+
+void serial_frame_decoder_init(serial_frame_decoder_t *decoder);
+
+// Consume bytes from `*data` up to `end` until a valid frame completes. Returns true with the frame, with `*data`
+// behind its delimiter, or false once all bytes are consumed.
+bool serial_frame_decode(serial_frame_decoder_t *decoder, const uint8_t **data, const uint8_t *end,
+                         serial_frame_t *frame);
+
+#endif // SERIAL_FRAME_H
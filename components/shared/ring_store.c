@@ -0,0 +1,272 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "ring_store.h"
+#include "block_digest.h"
+#ifdef ESP_PLATFORM
+#include "esp_idf_version.h"
+#include "esp_vfs_fat.h"
+#include "shared.h"
+
+// Contiguous FATFS files need ESP-IDF 5.2, earlier versions take the fallback
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+#define RING_STORE_CONTIGUOUS 1
+#endif
+#endif
+
+static uint32_t superblock_crc(const ring_superblock_t *superblock)
+{
+    return ~crc32c_update(CRC32C_INIT, superblock, offsetof(ring_superblock_t, crc));
+}
+
+static bool superblock_valid(const ring_superblock_t *superblock)
+{
+    return memcmp(superblock->identifier, "RING", 4) == 0 && superblock->version == 1 &&
+           superblock->crc == superblock_crc(superblock) && superblock->segment_count > 0 &&
+           superblock->record_size > 0 && superblock->segment_size >= superblock->record_size &&
+           superblock->header_len <= RING_STORE_MAX_HEADER && superblock->head <= superblock->tail &&
+           superblock->tail - superblock->head < superblock->segment_count;
+}
+
+// Load the newest valid superblock copy
+static bool load_superblock(ring_store_t *ring)
+{
+    bool found = false;
+
+    for (int slot = 0; slot < 2; slot++) {
+        ring_superblock_t copy;
+        if (fseek(ring->file, (long) slot * RING_STORE_SUPERBLOCK_SLOT, SEEK_SET) != 0 ||
+            fread(&copy, sizeof(copy), 1, ring->file) != 1 || !superblock_valid(&copy)) {
+            continue;
+        }
+        if (!found || copy.generation > ring->superblock.generation) {
+            ring->superblock = copy;
+            found = true;
+        }
+    }
+
+    if (found) {
+        ring->segment_capacity = ring->superblock.segment_size / ring->superblock.record_size;
+        ring->positioned = false;
+    }
+    return found;
+}
+
+// Reserve the whole store up front, contiguous where FATFS allows it
+static bool preallocate(const char *path, uint64_t size)
+{
+    #ifdef RING_STORE_CONTIGUOUS
+    unlink(path);
+    if (esp_vfs_fat_create_contiguous_file(MOUNT_POINT, path, size, true) == ESP_OK) {
+        return true;
+    }
+    #endif
+
+    // Fall back to extending the file, FATFS allocates the cluster chain once
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool extended = fseek(file, (long) (size - 1), SEEK_SET) == 0 && fputc(0, file) != EOF;
+    return fclose(file) == 0 && extended;
+}
+
+bool ring_store_create(ring_store_t *ring, const char *path, uint64_t size, uint32_t segment_size,
+                       uint32_t record_size, const void *header, uint32_t header_len)
+{
+    uint32_t segment_count = size > RING_STORE_DATA_START ?
+                             (uint32_t) ((size - RING_STORE_DATA_START) / segment_size) : 0;
+    if (segment_count < 2 || record_size == 0 || record_size > segment_size || header_len > RING_STORE_MAX_HEADER) {
+        return false;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+
+    // Reuse a store of the same geometry, keeping records that were not uploaded yet
+    if (ring_store_open(ring, path)) {
+        ring_superblock_t *superblock = &ring->superblock;
+        if (superblock->segment_size == segment_size && superblock->segment_count == segment_count &&
+            superblock->record_size == record_size) {
+            if (ring_store_pending(ring) == 0) {
+                memcpy(superblock->header, header, header_len);
+                superblock->header_len = header_len;
+                if (!ring_store_commit(ring)) {
+                    ring_store_close(ring);
+                    return false;
+                }
+            }
+            return true;
+        }
+        ring_store_close(ring);
+    }
+
+    if (!preallocate(path, RING_STORE_DATA_START + (uint64_t) segment_count * segment_size)) {
+        return false;
+    }
+    ring->file = fopen(path, "r+b");
+    if (ring->file == NULL) {
+        return false;
+    }
+
+    ring_superblock_t *superblock = &ring->superblock;
+    memset(superblock, 0, sizeof(*superblock));
+    memcpy(superblock->identifier, "RING", 4);
+    superblock->version = 1;
+    superblock->segment_size = segment_size;
+    superblock->segment_count = segment_count;
+    superblock->record_size = record_size;
+    superblock->header_len = header_len;
+    memcpy(superblock->header, header, header_len);
+    ring->segment_capacity = segment_size / record_size;
+    ring->formatted = true;
+
+    // Commit both copies so a stale superblock of an earlier store can never win
+    if (!ring_store_commit(ring) || !ring_store_commit(ring)) {
+        ring_store_close(ring);
+        return false;
+    }
+    return true;
+}
+
+bool ring_store_open(ring_store_t *ring, const char *path)
+{
+    memset(ring, 0, sizeof(*ring));
+
+    ring->file = fopen(path, "r+b");
+    if (ring->file == NULL) {
+        return false;
+    }
+    if (!load_superblock(ring)) {
+        ring_store_close(ring);
+        return false;
+    }
+    return true;
+}
+
+void ring_store_close(ring_store_t *ring)
+{
+    if (ring->file) {
+        fclose(ring->file);
+        ring->file = NULL;
+    }
+}
+
+static long record_offset(const ring_store_t *ring, uint64_t segment, uint32_t record)
+{
+    const ring_superblock_t *superblock = &ring->superblock;
+    return (long) (RING_STORE_DATA_START + (segment % superblock->segment_count) * superblock->segment_size +
+                   (uint64_t) record * superblock->record_size);
+}
+
+int ring_store_append(ring_store_t *ring, const void *record)
+{
+    ring_superblock_t *superblock = &ring->superblock;
+    int overwritten = 0;
+
+    if (superblock->tail_records == ring->segment_capacity) {
+        // Move on to the next segment, giving up the oldest one if the store is full. The new head is committed
+        // before its segment is overwritten.
+        superblock->tail++;
+        superblock->tail_records = 0;
+        if (superblock->tail - superblock->head >= superblock->segment_count) {
+            superblock->head++;
+            superblock->overwritten += ring->segment_capacity;
+            overwritten = (int) ring->segment_capacity;
+        }
+        if (!ring_store_commit(ring)) {
+            return -1;
+        }
+    }
+
+    if (!ring->positioned) {
+        if (fseek(ring->file, record_offset(ring, superblock->tail, superblock->tail_records), SEEK_SET) != 0) {
+            return -1;
+        }
+        ring->positioned = true;
+    }
+
+    if (fwrite(record, superblock->record_size, 1, ring->file) != 1) {
+        ring->positioned = false;
+        return -1;
+    }
+    superblock->tail_records++;
+    return overwritten;
+}
+
+bool ring_store_commit(ring_store_t *ring)
+{
+    ring_superblock_t *superblock = &ring->superblock;
+
+    if (fflush(ring->file) != 0 || fsync(fileno(ring->file)) != 0) {
+        return false;
+    }
+
+    superblock->generation++;
+    superblock->crc = superblock_crc(superblock);
+
+    ring->positioned = false;
+    long slot = (long) (superblock->generation % 2) * RING_STORE_SUPERBLOCK_SLOT;
+    return fseek(ring->file, slot, SEEK_SET) == 0 && fwrite(superblock, sizeof(*superblock), 1, ring->file) == 1 &&
+           fflush(ring->file) == 0 && fsync(fileno(ring->file)) == 0;
+}
+
+uint64_t ring_store_pending(const ring_store_t *ring)
+{
+    const ring_superblock_t *superblock = &ring->superblock;
+    return (superblock->tail - superblock->head) * ring->segment_capacity + superblock->tail_records;
+}
+
+uint64_t ring_store_stream_size(const ring_store_t *ring)
+{
+    return ring->superblock.header_len + ring_store_pending(ring) * ring->superblock.record_size;
+}
+
+size_t ring_store_stream_read(ring_store_t *ring, uint64_t offset, void *buffer, size_t len)
+{
+    const ring_superblock_t *superblock = &ring->superblock;
+    uint64_t stream_size = ring_store_stream_size(ring);
+    uint8_t *out = buffer;
+    size_t done = 0;
+
+    ring->positioned = false;
+    while (done < len && offset < stream_size) {
+        size_t chunk;
+        if (offset < superblock->header_len) {
+            chunk = superblock->header_len - offset;
+            if (chunk > len - done) {
+                chunk = len - done;
+            }
+            memcpy(out + done, superblock->header + offset, chunk);
+        } else {
+            // Read up to the end of the segment holding this part of the stream
+            uint64_t index = (offset - superblock->header_len) / superblock->record_size;
+            uint32_t within = (uint32_t) ((offset - superblock->header_len) % superblock->record_size);
+            uint64_t segment = superblock->head + index / ring->segment_capacity;
+            uint32_t record = (uint32_t) (index % ring->segment_capacity);
+            uint32_t records = segment == superblock->tail ? superblock->tail_records : ring->segment_capacity;
+
+            chunk = (size_t) (records - record) * superblock->record_size - within;
+            if (chunk > len - done) {
+                chunk = len - done;
+            }
+            if (fseek(ring->file, record_offset(ring, segment, record) + within, SEEK_SET) != 0 ||
+                fread(out + done, chunk, 1, ring->file) != 1) {
+                break;
+            }
+        }
+        done += chunk;
+        offset += chunk;
+    }
+    return done;
+}
+
+bool ring_store_release(ring_store_t *ring)
+{
+    ring_superblock_t *superblock = &ring->superblock;
+
+    superblock->tail++;
+    superblock->head = superblock->tail;
+    superblock->tail_records = 0;
+    superblock->overwritten = 0;
+    return ring_store_commit(ring);
+}
@@ -0,0 +1,497 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sector_log.h"
+#include "block_digest.h"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#define MBR_PARTITIONS 446
+#define MBR_SIGNATURE  510
+
+static uint32_t superblock_crc(const sector_log_superblock_t *superblock)
+{
+    return ~crc32c_update(CRC32C_INIT, superblock, offsetof(sector_log_superblock_t, crc));
+}
+
+static uint32_t checkpoint_crc(const sector_log_checkpoint_t *checkpoint)
+{
+    return ~crc32c_update(CRC32C_INIT, checkpoint, offsetof(sector_log_checkpoint_t, crc));
+}
+
+static uint32_t block_crc(const uint8_t *block, uint32_t records, uint32_t record_size)
+{
+    uint32_t crc = crc32c_update(CRC32C_INIT, block, offsetof(sector_log_block_t, crc));
+    return ~crc32c_update(crc, block + sizeof(sector_log_block_t), (size_t) records * record_size);
+}
+
+static uint32_t block_bytes(const sector_log_t *log)
+{
+    return log->superblock.block_sectors * SECTOR_SIZE;
+}
+
+// Block buffers are handed to the card driver, which needs DMA capable memory to avoid bouncing every sector
+static uint8_t *alloc_block(uint32_t size)
+{
+    #ifdef ESP_PLATFORM
+    return heap_caps_malloc(size, MALLOC_CAP_DMA);
+    #else
+    return malloc(size);
+    #endif
+}
+
+static uint32_t new_log_id(void)
+{
+    #ifdef ESP_PLATFORM
+    return esp_random();
+    #else
+    return (uint32_t) time(NULL) * 2654435761u ^ (uint32_t) getpid();
+    #endif
+}
+
+static uint64_t block_sector(const sector_log_t *log, uint64_t sequence)
+{
+    return log->start + SECTOR_LOG_DATA_START + (sequence % log->block_count) * log->superblock.block_sectors;
+}
+
+static bool superblock_valid(const sector_log_superblock_t *superblock)
+{
+    return memcmp(superblock->identifier, "SLOG", 4) == 0 && superblock->version == 1 &&
+           superblock->crc == superblock_crc(superblock) && superblock->block_sectors > 0 &&
+           superblock->record_size > 0 && superblock->header_len <= SECTOR_LOG_MAX_HEADER &&
+           superblock->block_sectors * SECTOR_SIZE >= sizeof(sector_log_block_t) + superblock->record_size &&
+           superblock->region_sectors >= SECTOR_LOG_DATA_START + 2ULL * superblock->block_sectors;
+}
+
+static bool block_valid(const sector_log_t *log, const uint8_t *block, uint64_t sequence)
+{
+    sector_log_block_t header;
+    memcpy(&header, block, sizeof(header));
+    return memcmp(header.identifier, "SLBK", 4) == 0 && header.log_id == log->superblock.log_id &&
+           header.sequence == sequence && header.records <= log->block_capacity &&
+           header.crc == block_crc(block, header.records, log->superblock.record_size);
+}
+
+static bool write_superblock(sector_log_t *log)
+{
+    uint8_t sector[SECTOR_SIZE] = {0};
+    log->superblock.crc = superblock_crc(&log->superblock);
+    memcpy(sector, &log->superblock, sizeof(log->superblock));
+    return log->device.write(log->device.context, log->start, 1, sector);
+}
+
+// Write the used part of the tail block
+static bool write_block(sector_log_t *log)
+{
+    sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+    uint32_t record_size = log->superblock.record_size;
+
+    sector_log_block_t header;
+    memcpy(header.identifier, "SLBK", 4);
+    header.log_id = log->superblock.log_id;
+    header.sequence = checkpoint->tail;
+    header.records = checkpoint->tail_records;
+    memcpy(log->block, &header, sizeof(header));
+    header.crc = block_crc(log->block, header.records, record_size);
+    memcpy(log->block, &header, sizeof(header));
+
+    uint32_t used = sizeof(header) + checkpoint->tail_records * record_size;
+    uint32_t sectors = (used + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (!log->device.write(log->device.context, block_sector(log, checkpoint->tail), sectors, log->block)) {
+        return false;
+    }
+    log->block_dirty = false;
+    return true;
+}
+
+static bool load_checkpoint(sector_log_t *log)
+{
+    bool found = false;
+
+    for (int slot = 0; slot < 2; slot++) {
+        uint8_t sector[SECTOR_SIZE];
+        sector_log_checkpoint_t copy;
+        if (!log->device.read(log->device.context, log->start + SECTOR_LOG_CHECKPOINT + slot, 1, sector)) {
+            continue;
+        }
+        memcpy(&copy, sector, sizeof(copy));
+        if (memcmp(copy.identifier, "SLCP", 4) != 0 || copy.crc != checkpoint_crc(&copy) || copy.head > copy.tail ||
+            copy.tail - copy.head >= log->block_count || copy.tail_records > log->block_capacity) {
+            continue;
+        }
+        if (!found || copy.generation > log->checkpoint.generation) {
+            log->checkpoint = copy;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Blocks filled after the checkpoint are still on the card, follow the block sequence to the real tail
+static void roll_forward(sector_log_t *log)
+{
+    sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+    uint32_t record_size = log->superblock.record_size;
+    uint64_t checkpoint_tail = checkpoint->tail;
+    uint32_t checkpoint_records = checkpoint->tail_records;
+    uint64_t sequence = checkpoint_tail;
+
+    while (1) {
+        bool read = log->device.read(log->device.context, block_sector(log, sequence), log->superblock.block_sectors,
+                                     log->block);
+        checkpoint->tail = sequence;
+
+        if (read && block_valid(log, log->block, sequence)) {
+            sector_log_block_t header;
+            memcpy(&header, log->block, sizeof(header));
+            checkpoint->tail_records = header.records;
+            if (header.records == log->block_capacity) {
+                sequence++;
+                continue;
+            }
+            break;
+        }
+
+        // A torn rewrite of the checkpointed tail block leaves its checkpointed records intact
+        if (read && sequence == checkpoint_tail && checkpoint_records > 0 &&
+            ~crc32c_update(CRC32C_INIT, log->block + sizeof(sector_log_block_t),
+                           (size_t) checkpoint_records * record_size) == checkpoint->tail_crc) {
+            checkpoint->tail_records = checkpoint_records;
+            break;
+        }
+
+        // Nothing (more) was written to this block
+        checkpoint->tail_records = 0;
+        memset(log->block, 0, block_bytes(log));
+        break;
+    }
+
+    // The oldest blocks were overwritten if the log wrapped since the checkpoint
+    if (checkpoint->tail - checkpoint->head >= log->block_count) {
+        uint64_t head = checkpoint->tail - log->block_count + 1;
+        checkpoint->overwritten += (head - checkpoint->head) * log->block_capacity;
+        checkpoint->head = head;
+    }
+
+    uint64_t position = (checkpoint->tail - checkpoint_tail) * log->block_capacity + checkpoint->tail_records;
+    log->recovered = position > checkpoint_records ? position - checkpoint_records : 0;
+}
+
+bool sector_log_open(sector_log_t *log, const sector_device_t *device, uint64_t start)
+{
+    memset(log, 0, sizeof(*log));
+    log->device = *device;
+    log->start = start;
+
+    uint8_t sector[SECTOR_SIZE];
+    if (!device->read(device->context, start, 1, sector)) {
+        return false;
+    }
+    memcpy(&log->superblock, sector, sizeof(log->superblock));
+    if (!superblock_valid(&log->superblock) || start + log->superblock.region_sectors > device->sector_count) {
+        return false;
+    }
+
+    log->block_count = (log->superblock.region_sectors - SECTOR_LOG_DATA_START) / log->superblock.block_sectors;
+    log->block_capacity = (block_bytes(log) - sizeof(sector_log_block_t)) / log->superblock.record_size;
+    if (!load_checkpoint(log)) {
+        return false;
+    }
+
+    log->block = alloc_block(block_bytes(log));
+    if (log->block == NULL) {
+        return false;
+    }
+    roll_forward(log);
+    return true;
+}
+
+bool sector_log_create(sector_log_t *log, const sector_device_t *device, uint64_t start, uint64_t sectors,
+                       uint32_t block_sectors, uint32_t record_size, const void *header, uint32_t header_len)
+{
+    if (block_sectors == 0 || record_size == 0 || header_len > SECTOR_LOG_MAX_HEADER ||
+        block_sectors * SECTOR_SIZE < sizeof(sector_log_block_t) + record_size ||
+        sectors < SECTOR_LOG_DATA_START + 2ULL * block_sectors || start + sectors > device->sector_count) {
+        return false;
+    }
+
+    // Reuse a log of the same geometry, keeping records that were not uploaded yet
+    if (sector_log_open(log, device, start)) {
+        sector_log_superblock_t *superblock = &log->superblock;
+        if (superblock->region_sectors == sectors && superblock->block_sectors == block_sectors &&
+            superblock->record_size == record_size) {
+            if (sector_log_pending(log) == 0) {
+                memcpy(superblock->header, header, header_len);
+                superblock->header_len = header_len;
+                if (!write_superblock(log)) {
+                    sector_log_close(log);
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    sector_log_close(log);
+
+    memset(log, 0, sizeof(*log));
+    log->device = *device;
+    log->start = start;
+
+    sector_log_superblock_t *superblock = &log->superblock;
+    memcpy(superblock->identifier, "SLOG", 4);
+    superblock->version = 1;
+    superblock->log_id = new_log_id();
+    superblock->region_sectors = sectors;
+    superblock->block_sectors = block_sectors;
+    superblock->record_size = record_size;
+    superblock->header_len = header_len;
+    memcpy(superblock->header, header, header_len);
+    log->block_count = (sectors - SECTOR_LOG_DATA_START) / block_sectors;
+    log->block_capacity = (block_bytes(log) - sizeof(sector_log_block_t)) / record_size;
+    log->formatted = true;
+
+    memcpy(log->checkpoint.identifier, "SLCP", 4);
+    log->block = alloc_block(block_bytes(log));
+    if (log->block == NULL) {
+        return false;
+    }
+    memset(log->block, 0, block_bytes(log));
+
+    // Commit both checkpoint copies so a stale checkpoint of an earlier log can never win
+    if (!write_superblock(log) || !sector_log_commit(log) || !sector_log_commit(log)) {
+        sector_log_close(log);
+        return false;
+    }
+    return true;
+}
+
+void sector_log_close(sector_log_t *log)
+{
+    free(log->block);
+    free(log->cache);
+    log->block = NULL;
+    log->cache = NULL;
+}
+
+int sector_log_append(sector_log_t *log, const void *record)
+{
+    sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+    uint32_t record_size = log->superblock.record_size;
+    int overwritten = 0;
+
+    if (checkpoint->tail_records == log->block_capacity) {
+        // The full block was written when it filled, continue in the next one, giving up the oldest block if the
+        // log is full. Recovery derives the new head from the block sequence, no checkpoint is needed here.
+        checkpoint->tail++;
+        checkpoint->tail_records = 0;
+        if (checkpoint->tail - checkpoint->head >= log->block_count) {
+            checkpoint->head++;
+            checkpoint->overwritten += log->block_capacity;
+            overwritten = (int) log->block_capacity;
+        }
+    }
+
+    memcpy(log->block + sizeof(sector_log_block_t) + (size_t) checkpoint->tail_records * record_size, record,
+           record_size);
+    checkpoint->tail_records++;
+    log->block_dirty = true;
+
+    if (checkpoint->tail_records == log->block_capacity && !write_block(log)) {
+        return -1;
+    }
+    return overwritten;
+}
+
+bool sector_log_commit(sector_log_t *log)
+{
+    sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+
+    if (log->block_dirty && !write_block(log)) {
+        return false;
+    }
+
+    checkpoint->tail_crc = ~crc32c_update(CRC32C_INIT, log->block + sizeof(sector_log_block_t),
+                                          (size_t) checkpoint->tail_records * log->superblock.record_size);
+    checkpoint->generation++;
+    checkpoint->crc = checkpoint_crc(checkpoint);
+
+    uint8_t sector[SECTOR_SIZE] = {0};
+    memcpy(sector, checkpoint, sizeof(*checkpoint));
+    return log->device.write(log->device.context, log->start + SECTOR_LOG_CHECKPOINT + checkpoint->generation % 2, 1,
+                             sector);
+}
+
+uint64_t sector_log_pending(const sector_log_t *log)
+{
+    const sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+    return (checkpoint->tail - checkpoint->head) * log->block_capacity + checkpoint->tail_records;
+}
+
+uint64_t sector_log_stream_size(const sector_log_t *log)
+{
+    return log->superblock.header_len + sector_log_pending(log) * log->superblock.record_size;
+}
+
+// Block `sequence` with its records, from RAM for the tail block
+static const uint8_t *load_block(sector_log_t *log, uint64_t sequence)
+{
+    if (sequence == log->checkpoint.tail) {
+        return log->block;
+    }
+    if (log->cache_valid && log->cache_sequence == sequence) {
+        return log->cache;
+    }
+
+    if (log->cache == NULL && (log->cache = alloc_block(block_bytes(log))) == NULL) {
+        return NULL;
+    }
+    log->cache_valid = log->device.read(log->device.context, block_sector(log, sequence),
+                                        log->superblock.block_sectors, log->cache) &&
+                       block_valid(log, log->cache, sequence);
+    log->cache_sequence = sequence;
+    return log->cache_valid ? log->cache : NULL;
+}
+
+size_t sector_log_stream_read(sector_log_t *log, uint64_t offset, void *buffer, size_t len)
+{
+    const sector_log_superblock_t *superblock = &log->superblock;
+    uint64_t stream_size = sector_log_stream_size(log);
+    uint8_t *out = buffer;
+    size_t done = 0;
+
+    while (done < len && offset < stream_size) {
+        size_t chunk;
+        if (offset < superblock->header_len) {
+            chunk = superblock->header_len - offset;
+            if (chunk > len - done) {
+                chunk = len - done;
+            }
+            memcpy(out + done, superblock->header + offset, chunk);
+        } else {
+            // Read up to the end of the block holding this part of the stream
+            uint64_t index = (offset - superblock->header_len) / superblock->record_size;
+            uint32_t within = (uint32_t) ((offset - superblock->header_len) % superblock->record_size);
+            uint64_t sequence = log->checkpoint.head + index / log->block_capacity;
+            uint32_t record = (uint32_t) (index % log->block_capacity);
+            uint32_t records = sequence == log->checkpoint.tail ? log->checkpoint.tail_records : log->block_capacity;
+
+            const uint8_t *block = load_block(log, sequence);
+            if (block == NULL) {
+                break;
+            }
+            chunk = (size_t) (records - record) * superblock->record_size - within;
+            if (chunk > len - done) {
+                chunk = len - done;
+            }
+            memcpy(out + done, block + sizeof(sector_log_block_t) + (size_t) record * superblock->record_size + within,
+                   chunk);
+        }
+        done += chunk;
+        offset += chunk;
+    }
+    return done;
+}
+
+bool sector_log_release(sector_log_t *log)
+{
+    sector_log_checkpoint_t *checkpoint = &log->checkpoint;
+
+    checkpoint->tail++;
+    checkpoint->head = checkpoint->tail;
+    checkpoint->tail_records = 0;
+    checkpoint->overwritten = 0;
+    log->block_dirty = false;
+    log->cache_valid = false;
+    memset(log->block, 0, block_bytes(log));
+    return sector_log_commit(log);
+}
+
+uint64_t sector_log_free_start(const sector_device_t *device)
+{
+    uint8_t sector[SECTOR_SIZE];
+    if (!device->read(device->context, 0, 1, sector) || sector[MBR_SIGNATURE] != 0x55 ||
+        sector[MBR_SIGNATURE + 1] != 0xAA || sector[0] == 0xEB || sector[0] == 0xE9) {
+        return 0;  // No MBR, or a FAT boot sector spanning the whole card
+    }
+
+    uint64_t end = 0;
+    for (int i = 0; i < 4; i++) {
+        const uint8_t *entry = sector + MBR_PARTITIONS + i * 16;
+        if (entry[0] != 0x00 && entry[0] != 0x80) {
+            return 0;
+        }
+        if (entry[4] == 0) {
+            continue;
+        }
+        uint32_t first = (uint32_t) entry[8] | (uint32_t) entry[9] << 8 | (uint32_t) entry[10] << 16 |
+                         (uint32_t) entry[11] << 24;
+        uint32_t count = (uint32_t) entry[12] | (uint32_t) entry[13] << 8 | (uint32_t) entry[14] << 16 |
+                         (uint32_t) entry[15] << 24;
+        if ((uint64_t) first + count > end) {
+            end = (uint64_t) first + count;
+        }
+    }
+
+    end = (end + 7) & ~(uint64_t) 7;
+    return end > 0 && end < device->sector_count ? end : 0;
+}
+
+#ifdef ESP_PLATFORM
+static bool sdmmc_read(void *context, uint64_t sector, uint32_t count, void *buffer)
+{
+    return sdmmc_read_sectors((sdmmc_card_t *) context, buffer, (size_t) sector, count) == ESP_OK;
+}
+
+static bool sdmmc_write(void *context, uint64_t sector, uint32_t count, const void *buffer)
+{
+    return sdmmc_write_sectors((sdmmc_card_t *) context, buffer, (size_t) sector, count) == ESP_OK;
+}
+
+void sector_device_sdmmc(sector_device_t *device, sdmmc_card_t *card)
+{
+    device->read = sdmmc_read;
+    device->write = sdmmc_write;
+    device->context = card;
+    device->sector_count = (uint64_t) card->csd.capacity;
+}
+#else
+static bool image_read(void *context, uint64_t sector, uint32_t count, void *buffer)
+{
+    size_t len = (size_t) count * SECTOR_SIZE;
+    return pread((int) (intptr_t) context, buffer, len, (off_t) (sector * SECTOR_SIZE)) == (ssize_t) len;
+}
+
+static bool image_write(void *context, uint64_t sector, uint32_t count, const void *buffer)
+{
+    size_t len = (size_t) count * SECTOR_SIZE;
+    return pwrite((int) (intptr_t) context, buffer, len, (off_t) (sector * SECTOR_SIZE)) == (ssize_t) len;
+}
+
+bool sector_device_image_open(sector_device_t *device, const char *path)
+{
+    int fd = open(path, O_RDWR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    device->read = image_read;
+    device->write = image_write;
+    device->context = (void *) (intptr_t) fd;
+    device->sector_count = (uint64_t) st.st_size / SECTOR_SIZE;
+    return true;
+}
+
+void sector_device_image_close(sector_device_t *device)
+{
+    close((int) (intptr_t) device->context);
+}
+#endif
@@ -0,0 +1,140 @@
+#include <string.h>
+#include "serial_frame.h"
+#include "block_digest.h"
+
+// COBS encoder writing blocks of up to 254 non-zero bytes, each preceded by its length + 1
+typedef struct {
+    uint8_t *out;
+    size_t code_index;
+    size_t length;
+    uint8_t code;
+} cobs_encoder_t;
+
+static void cobs_begin(cobs_encoder_t *encoder, uint8_t *out)
+{
+    encoder->out = out;
+    encoder->code_index = 0;
+    encoder->length = 1;
+    encoder->code = 1;
+}
+
+static void cobs_put(cobs_encoder_t *encoder, const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        if (bytes[i] != 0) {
+            encoder->out[encoder->length++] = bytes[i];
+            encoder->code++;
+        }
+        if (bytes[i] == 0 || encoder->code == 0xFF) {
+            encoder->out[encoder->code_index] = encoder->code;
+            encoder->code_index = encoder->length++;
+            encoder->code = 1;
+        }
+    }
+}
+
+static size_t cobs_end(cobs_encoder_t *encoder)
+{
+    encoder->out[encoder->code_index] = encoder->code;
+    return encoder->length;
+}
+
+// Decoding in place is safe, the output never overtakes the input
+static bool cobs_decode(uint8_t *data, size_t len, size_t *decoded_len)
+{
+    size_t in = 0;
+    size_t out = 0;
+    while (in < len) {
+        uint8_t code = data[in++];
+        if (code == 0 || in + code - 1 > len) {
+            return false;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            data[out++] = data[in++];
+        }
+        if (code < 0xFF && in < len) {
+            data[out++] = 0;
+        }
+    }
+    *decoded_len = out;
+    return true;
+}
+
+size_t serial_frame_encode(serial_frame_kind_t kind, serial_stream_t stream, uint32_t sequence, const void *payload,
+                           size_t payload_len, uint8_t *out)
+{
+    serial_frame_header_t header = {
+            .kind = kind,
+            .stream = stream,
+            .sequence = sequence,
+    };
+    uint32_t crc = crc32c_update(CRC32C_INIT, &header, sizeof(header));
+    crc = ~crc32c_update(crc, payload, payload_len);
+
+    // A leading delimiter ends whatever the receiver collected before, e.g. a console line
+    cobs_encoder_t encoder;
+    out[0] = 0;
+    cobs_begin(&encoder, out + 1);
+    cobs_put(&encoder, &header, sizeof(header));
+    cobs_put(&encoder, payload, payload_len);
+    cobs_put(&encoder, &crc, sizeof(crc));
+    size_t len = 1 + cobs_end(&encoder);
+    out[len++] = 0;
+    return len;
+}
+
+void serial_frame_decoder_init(serial_frame_decoder_t *decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+static bool decode_frame(serial_frame_decoder_t *decoder, size_t len, serial_frame_t *frame)
+{
+    size_t raw_len;
+    if (!cobs_decode(decoder->buffer, len, &raw_len) ||
+        raw_len < sizeof(serial_frame_header_t) + sizeof(uint32_t)) {
+        return false;
+    }
+
+    size_t payload_len = raw_len - sizeof(serial_frame_header_t) - sizeof(uint32_t);
+    uint32_t crc;
+    memcpy(&crc, decoder->buffer + raw_len - sizeof(crc), sizeof(crc));
+    if (~crc32c_update(CRC32C_INIT, decoder->buffer, raw_len - sizeof(crc)) != crc) {
+        return false;
+    }
+
+    memcpy(&frame->header, decoder->buffer, sizeof(frame->header));
+    frame->payload = decoder->buffer + sizeof(serial_frame_header_t);
+    frame->payload_len = payload_len;
+    return true;
+}
+
+bool serial_frame_decode(serial_frame_decoder_t *decoder, const uint8_t **data, const uint8_t *end,
+                         serial_frame_t *frame)
+{
+    while (*data < end) {
+        uint8_t byte = *(*data)++;
+        if (byte != 0) {
+            if (decoder->fill < sizeof(decoder->buffer)) {
+                decoder->buffer[decoder->fill++] = byte;
+            } else {
+                decoder->overflow = true;
+            }
+            continue;
+        }
+
+        size_t fill = decoder->fill;
+        bool overflow = decoder->overflow;
+        decoder->fill = 0;
+        decoder->overflow = false;
+        if (fill == 0) {
+            continue;  // Between frames
+        }
+        if (!overflow && decode_frame(decoder, fill, frame)) {
+            return true;
+        }
+        decoder->errors++;
+    }
+    return false;
+}
@@ -5,6 +5,7 @@
 // Queue handles declared in header
 QueueHandle_t l2_packet_queue = NULL;
 QueueHandle_t csi_packet_queue = NULL;
+QueueHandle_t joined_packet_queue = NULL;
 
 uint8_t wifi_mac[6];
 uint8_t bt_mac[6];
@@ -15,4 +16,30 @@ uint64_t get_wall_clock_time() {
     struct timeval now;
     gettimeofday(&now, NULL);  // Get current time
     return (uint64_t)now.tv_sec * 1000ULL + now.tv_usec / 1000ULL;  // Convert to milliseconds
-}
\ No newline at end of file
+}
+
+#ifdef CONFIG_SNIFFER_STORE_RAW
+#ifdef CONFIG_SNIFFER_ENABLE_L2
+#define RAW_LOG_L2_SECTORS ((uint64_t) CONFIG_SNIFFER_RING_L2_SIZE * 1024 * 1024 / SECTOR_SIZE)
+#else
+#define RAW_LOG_L2_SECTORS 0
+#endif
+#ifdef CONFIG_SNIFFER_ENABLE_CSI
+#define RAW_LOG_CSI_SECTORS ((uint64_t) CONFIG_SNIFFER_RING_CSI_SIZE * 1024 * 1024 / SECTOR_SIZE)
+#else
+#define RAW_LOG_CSI_SECTORS 0
+#endif
+
+bool raw_log_region(const sector_device_t *device, bool l2, uint64_t *start, uint64_t *sectors)
+{
+    uint64_t first = CONFIG_SNIFFER_RAW_START_SECTOR ? CONFIG_SNIFFER_RAW_START_SECTOR :
+                     sector_log_free_start(device);
+    if (first == 0 || first + RAW_LOG_L2_SECTORS + RAW_LOG_CSI_SECTORS > device->sector_count) {
+        return false;
+    }
+
+    *start = l2 ? first : first + RAW_LOG_L2_SECTORS;
+    *sectors = l2 ? RAW_LOG_L2_SECTORS : RAW_LOG_CSI_SECTORS;
+    return *sectors > 0;
+}
+#endif
@@ -0,0 +1,68 @@
+#include "airtime.h"
+
+#define OFDM_SIGNAL_EXTENSION_US 6   // 2.4 GHz ERP-OFDM and HT frames
+#define OFDM_SERVICE_TAIL_BITS   22  // 16 service bits + 6 tail bits
+
+// Data bits per OFDM symbol of the non-HT rates, indexed by wifi_phy_rate_t code (0 = not OFDM)
+static const uint16_t ofdm_bits_per_symbol[16] = {
+        [0x08] = 192,  // 48 Mbit/s
+        [0x09] = 96,   // 24 Mbit/s
+        [0x0A] = 48,   // 12 Mbit/s
+        [0x0B] = 24,   // 6 Mbit/s
+        [0x0C] = 216,  // 54 Mbit/s
+        [0x0D] = 144,  // 36 Mbit/s
+        [0x0E] = 72,   // 18 Mbit/s
+        [0x0F] = 36,   // 9 Mbit/s
+};
+
+// DSSS/CCK rate in 100 kbit/s and whether the short preamble is used, indexed by wifi_phy_rate_t code
+static const struct {
+    uint8_t rate;
+    uint8_t short_preamble;
+} dsss_rates[8] = {
+        [0x00] = {10, 0},   // 1 Mbit/s long preamble
+        [0x01] = {20, 0},   // 2 Mbit/s long preamble
+        [0x02] = {55, 0},   // 5.5 Mbit/s long preamble
+        [0x03] = {110, 0},  // 11 Mbit/s long preamble
+        [0x05] = {20, 1},   // 2 Mbit/s short preamble
+        [0x06] = {55, 1},   // 5.5 Mbit/s short preamble
+        [0x07] = {110, 1},  // 11 Mbit/s short preamble
+};
+
+// Data bits per symbol of HT MCS 0-7 for one spatial stream at 20 and 40 MHz
+static const uint16_t ht_bits_per_symbol[2][8] = {
+        {26, 52, 78, 104, 156, 208, 234, 260},
+        {54, 108, 162, 216, 324, 432, 486, 540},
+};
+
+static uint32_t ofdm_symbols(uint32_t length, uint32_t bits_per_symbol)
+{
+    return (OFDM_SERVICE_TAIL_BITS + 8 * length + bits_per_symbol - 1) / bits_per_symbol;
+}
+
+uint32_t airtime_estimate_us(const airtime_phy_t *phy, uint32_t length)
+{
+    if (phy->sig_mode == 0) {
+        if (phy->rate < 8 && dsss_rates[phy->rate].rate) {
+            // PLCP preamble and header, then the payload at the DSSS/CCK rate
+            uint32_t preamble = dsss_rates[phy->rate].short_preamble ? 96 : 192;
+            return preamble + (80 * length + dsss_rates[phy->rate].rate - 1) / dsss_rates[phy->rate].rate;
+        }
+        if (phy->rate < 16 && ofdm_bits_per_symbol[phy->rate]) {
+            // Preamble 16 µs, SIGNAL 4 µs, 4 µs symbols
+            return 20 + 4 * ofdm_symbols(length, ofdm_bits_per_symbol[phy->rate]) + OFDM_SIGNAL_EXTENSION_US;
+        }
+        return 0;
+    }
+
+    // HT mixed format: legacy preamble and L-SIG 20 µs, HT-SIG 8 µs, HT-STF 4 µs, one HT-LTF per stream (4 µs,
+    // two for two streams)
+    uint32_t streams = phy->mcs / 8 + 1;
+    if (streams > 2) {
+        return 0;
+    }
+    uint32_t bits_per_symbol = ht_bits_per_symbol[phy->cwb ? 1 : 0][phy->mcs % 8] * streams;
+    uint32_t symbols = ofdm_symbols(length, bits_per_symbol);
+    uint32_t data = phy->sgi ? (symbols * 36 + 39) / 40 * 4 : symbols * 4;  // 3.6 µs symbols, padded to 4 µs
+    return 32 + 4 * streams + data + OFDM_SIGNAL_EXTENSION_US;
+}
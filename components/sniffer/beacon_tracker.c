@@ -0,0 +1,204 @@
+#include <string.h>
+#include "beacon_tracker.h"
+#include "dot11.h"
+#include "hash.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "shared.h"
+#include "summary_writer.h"
+#endif
+
+#define BEACON_IES_OFFSET (DOT11_MGMT_HEADER_LEN + 12)  // Behind timestamp, beacon interval and capability
+
+// Elements that change from beacon to beacon without a change of the AP configuration
+#define IE_TIM      5
+#define IE_BSS_LOAD 11
+
+void beacon_window_setup(beacon_window_t *window, beacon_entry_t *entries, uint32_t size, uint64_t start)
+{
+    window->entries = entries;
+    window->size = size;
+    beacon_window_reset(window, start);
+}
+
+void beacon_window_reset(beacon_window_t *window, uint64_t start)
+{
+    memset(window->entries, 0, window->size * sizeof(beacon_entry_t));
+    window->start = start;
+    window->untracked = 0;
+}
+
+// Hash of the information elements, leaving out the ones that change with every beacon
+static uint32_t hash_ies(const uint8_t *ies, uint32_t len)
+{
+    uint64_t hash = 0;
+    uint32_t offset = 0;
+    while (offset + 2 <= len) {
+        uint32_t element_len = 2 + ies[offset + 1];
+        if (offset + element_len > len) {
+            break;
+        }
+        if (ies[offset] != IE_TIM && ies[offset] != IE_BSS_LOAD) {
+            hash = hash_bytes(ies + offset, element_len, hash);
+        }
+        offset += element_len;
+    }
+    return (uint32_t) hash;
+}
+
+// Find the entry of `bssid` or claim a free one near its hash, NULL when the neighbourhood is full
+static beacon_entry_t *lookup(beacon_window_t *window, const uint8_t bssid[6])
+{
+    uint32_t start = hash_mac(bssid) % window->size;
+    for (uint32_t i = 0; i < BEACON_PROBE && i < window->size; i++) {
+        beacon_entry_t *entry = &window->entries[(start + i) % window->size];
+        if (!entry->used) {
+            memcpy(entry->bssid, bssid, 6);
+            entry->used = true;
+            return entry;
+        }
+        if (memcmp(entry->bssid, bssid, 6) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+bool beacon_window_keep(beacon_window_t *window, const uint8_t *frame, uint32_t len, int8_t rssi, uint8_t channel)
+{
+    if (len < BEACON_IES_OFFSET + DOT11_FCS_LEN || dot11_frame_type(frame) != DOT11_TYPE_MGMT ||
+        dot11_frame_subtype(frame) != DOT11_SUBTYPE_BEACON) {
+        return true;
+    }
+
+    beacon_entry_t *entry = lookup(window, frame + 16);
+    if (entry == NULL) {
+        // Table full, keep the beacon rather than lose the AP
+        window->untracked++;
+        return true;
+    }
+
+    uint32_t ie_hash = hash_ies(frame + BEACON_IES_OFFSET, len - BEACON_IES_OFFSET - DOT11_FCS_LEN);
+    bool keep = entry->beacons == 0 || entry->ie_hash != ie_hash;
+
+    if (entry->beacons == 0 || rssi < entry->rssi_min) {
+        entry->rssi_min = rssi;
+    }
+    if (entry->beacons == 0 || rssi > entry->rssi_max) {
+        entry->rssi_max = rssi;
+    }
+    entry->rssi_sum += rssi;
+    entry->channel = channel;
+    entry->ie_hash = ie_hash;
+    if (entry->beacons < UINT16_MAX) {
+        entry->beacons++;
+    }
+    if (keep && entry->stored < UINT16_MAX) {
+        entry->stored++;
+    }
+    return keep;
+}
+
+uint16_t beacon_window_aggregate(const beacon_window_t *window, beacon_aggregate_t *aggregates)
+{
+    uint16_t count = 0;
+    for (uint32_t i = 0; i < window->size; i++) {
+        const beacon_entry_t *entry = &window->entries[i];
+        if (!entry->used || entry->beacons == 0) {
+            continue;
+        }
+        beacon_aggregate_t *aggregate = &aggregates[count++];
+        memcpy(aggregate->bssid, entry->bssid, 6);
+        aggregate->channel = entry->channel;
+        aggregate->rssi_min = entry->rssi_min;
+        aggregate->rssi_max = entry->rssi_max;
+        aggregate->rssi_mean = (int8_t) (entry->rssi_sum / entry->beacons);
+        aggregate->beacons = entry->beacons;
+        aggregate->stored = entry->stored;
+    }
+    return count;
+}
+
+#ifdef ESP_PLATFORM
+static const char* TAG = "BEACON_TRACKER";
+
+// Frames still in flight from the previous window are given this long to land before it is written
+#define WINDOW_SETTLE_MS 10
+
+// Filled by the L2 callback, swapped at the end of every window
+static beacon_entry_t entries[2][CONFIG_SNIFFER_BEACON_TABLE_SIZE];
+static beacon_window_t windows[2];
+static volatile uint8_t active_window = 0;
+
+static uint8_t summary[sizeof(beacon_summary_t) + CONFIG_SNIFFER_BEACON_TABLE_SIZE * sizeof(beacon_aggregate_t)];
+
+static TaskHandle_t beacon_task_handle = NULL;
+
+// Forward declarations
+static void beacon_task(void *pvParameter);
+
+bool beacon_tracker_init(void)
+{
+    beacon_window_setup(&windows[0], entries[0], CONFIG_SNIFFER_BEACON_TABLE_SIZE, get_wall_clock_time());
+    beacon_window_setup(&windows[1], entries[1], CONFIG_SNIFFER_BEACON_TABLE_SIZE, 0);
+    active_window = 0;
+
+    if (xTaskCreate(beacon_task, "beacon_task", 3072, NULL, 3, &beacon_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create beacon tracker task");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Beacon tracker initialized, %d s windows", CONFIG_SNIFFER_BEACON_WINDOW);
+    return true;
+}
+
+void beacon_tracker_deinit(void)
+{
+    if (beacon_task_handle) {
+        vTaskDelete(beacon_task_handle);
+        beacon_task_handle = NULL;
+    }
+}
+
+bool beacon_tracker_keep(const wifi_promiscuous_pkt_t *ppkt)
+{
+    if (beacon_task_handle == NULL) {
+        return true;
+    }
+    return beacon_window_keep(&windows[active_window], ppkt->payload, ppkt->rx_ctrl.sig_len, ppkt->rx_ctrl.rssi,
+                              ppkt->rx_ctrl.channel);
+}
+
+static void write_window(const beacon_window_t *window)
+{
+    beacon_summary_t *header = (beacon_summary_t *) summary;
+    uint16_t count = beacon_window_aggregate(window, (beacon_aggregate_t *) (summary + sizeof(beacon_summary_t)));
+
+    header->window_start = window->start;
+    header->window_seconds = CONFIG_SNIFFER_BEACON_WINDOW;
+    header->untracked = window->untracked;
+    header->count = count;
+
+    summary_writer_write(SUMMARY_RECORD_BEACONS, summary,
+                         sizeof(beacon_summary_t) + count * sizeof(beacon_aggregate_t));
+}
+
+static void beacon_task(void *pvParameter)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SNIFFER_BEACON_WINDOW * 1000));
+
+        // The next window was cleared after it was last written
+        uint8_t previous = active_window;
+        windows[previous ^ 1].start = get_wall_clock_time();
+        active_window = previous ^ 1;
+
+        vTaskDelay(pdMS_TO_TICKS(WINDOW_SETTLE_MS));
+        write_window(&windows[previous]);
+        beacon_window_reset(&windows[previous], 0);
+    }
+}
+#endif
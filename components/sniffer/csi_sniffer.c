@@ -5,14 +5,36 @@
 #include "esp_wifi.h"
 #include "esp_log.h"
 #include "freertos/queue.h"
+#include "stats.h"
+#include "rate_limiter.h"
+#include "summary_writer.h"
+#include "latency.h"
+#include "frame_join.h"
 #include "shared.h"
 
 static const char* TAG = "CSI_SNIFFER";
 
+#ifdef CONFIG_SNIFFER_CSI_RATE_LIMIT
+static rate_limiter_entry_t rate_limiter_entries[CONFIG_SNIFFER_CSI_RATE_SOURCES];
+static rate_limiter_t rate_limiter;
+
+// Summary record body, kept off the statistics task stack
+static uint8_t summary_buffer[sizeof(csi_sources_summary_t) +
+                              CONFIG_SNIFFER_CSI_RATE_SOURCES * sizeof(csi_source_counters_t)];
+#endif
+
 // Forward declarations
 static void wifi_csi_rx_cb(void *ctx, wifi_csi_info_t *csi_info);
 
 void csi_sniffer_init(void) {
+    #ifdef CONFIG_SNIFFER_CSI_RATE_LIMIT
+    rate_limiter_init(&rate_limiter, rate_limiter_entries, CONFIG_SNIFFER_CSI_RATE_SOURCES, CONFIG_SNIFFER_CSI_RATE,
+                      CONFIG_SNIFFER_CSI_BURST);
+    if (!rate_limiter_set_whitelist(&rate_limiter, CONFIG_SNIFFER_CSI_RATE_WHITELIST)) {
+        ESP_LOGW(TAG, "Malformed CSI whitelist, only %lu entries used", (unsigned long) rate_limiter.whitelist_count);
+    }
+    #endif
+
     // Configure CSI collection
     wifi_csi_config_t csi_config = {
             .lltf_en = true,
@@ -42,27 +64,76 @@ void csi_sniffer_deinit(void) {
     ESP_LOGI(TAG, "CSI sniffer deinitialized");
 }
 
+void csi_sniffer_write_summary(void) {
+    #ifdef CONFIG_SNIFFER_CSI_RATE_LIMIT
+    csi_sources_summary_t *summary = (csi_sources_summary_t *) summary_buffer;
+    csi_source_counters_t *counters = (csi_source_counters_t *) (summary_buffer + sizeof(csi_sources_summary_t));
+
+    // Entries are updated concurrently by the callback, a slightly torn snapshot is acceptable
+    uint16_t count = 0;
+    for (uint32_t i = 0; i < rate_limiter.count; i++) {
+        const rate_limiter_entry_t *entry = &rate_limiter.entries[i];
+        if (!entry->used) {
+            continue;
+        }
+        memcpy(counters[count].mac, entry->mac, 6);
+        counters[count].admitted = entry->admitted;
+        counters[count].rejected = entry->rejected;
+        count++;
+    }
+    summary->count = count;
+
+    summary_writer_write(SUMMARY_RECORD_CSI_SOURCES, summary_buffer,
+                         sizeof(csi_sources_summary_t) + count * sizeof(csi_source_counters_t));
+    #endif
+}
+
 // Wi-Fi CSI RX callback
 static void wifi_csi_rx_cb(void *ctx, wifi_csi_info_t *csi_info) {
     if (!csi_info) {
         return;
     }
 
+    sniffer_stats.csi_received++;
+
+    #ifdef CONFIG_SNIFFER_CSI_RATE_LIMIT
+    // Reject before copying so over-budget sources cost only a table lookup
+    if (!rate_limiter_admit(&rate_limiter, csi_info->mac, esp_timer_get_time())) {
+        sniffer_stats.csi_rate_limited++;
+        return;
+    }
+    #endif
+
     // Minimal processing in the callback
-    csi_packet_t csi_packet;
-
-    csi_packet.timestamp = time(NULL);
-    csi_packet.channel = csi_info->rx_ctrl.channel;
-    csi_packet.rssi = csi_info->rx_ctrl.rssi;
-    memcpy(csi_packet.mac, csi_info->mac, 6);
-    csi_packet.csi_len = csi_info->len;
-    if (csi_packet.csi_len > CSI_DATA_LEN) {
-        csi_packet.csi_len = CSI_DATA_LEN;
+    uint8_t item[sizeof(csi_packet_t) + LATENCY_STAMP_SIZE];
+    csi_packet_t *csi_packet = (csi_packet_t *) item;
+
+    csi_packet->timestamp = time(NULL);
+    csi_packet->channel = csi_info->rx_ctrl.channel;
+    csi_packet->rssi = csi_info->rx_ctrl.rssi;
+    memcpy(csi_packet->mac, csi_info->mac, 6);
+    csi_packet->csi_len = csi_info->len;
+    if (csi_packet->csi_len > CSI_DATA_LEN) {
+        csi_packet->csi_len = CSI_DATA_LEN;
     }
-    memcpy(csi_packet.csi_data, csi_info->buf, csi_packet.csi_len);
+    memcpy(csi_packet->csi_data, csi_info->buf, csi_packet->csi_len);
+
+    #ifdef CONFIG_SNIFFER_LATENCY
+    latency_stamp(item + sizeof(csi_packet_t));
+    #endif
+
+    #ifdef CONFIG_SNIFFER_JOIN_CSI
+    frame_join_csi(csi_info->rx_ctrl.timestamp, csi_info->mac, item);
+    #else
+    csi_sniffer_enqueue(item);
+    #endif
+}
 
-    // Enqueue the CSI data
-    if (xQueueSendFromISR(csi_packet_queue, &csi_packet, NULL) != pdTRUE) {
+void csi_sniffer_enqueue(const uint8_t *item) {
+    if (xQueueSendFromISR(csi_packet_queue, item, NULL) != pdTRUE) {
+        sniffer_stats.csi_queue_full++;
         ESP_LOGW(TAG, "CSI Queue is full, packet is dropped");
+    } else {
+        sniffer_stats.csi_enqueued++;
     }
 }
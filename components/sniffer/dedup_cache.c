@@ -0,0 +1,38 @@
+#include <string.h>
+#include "dedup_cache.h"
+#include "hash.h"
+
+void dedup_cache_init(dedup_cache_t *cache, dedup_entry_t *entries, uint32_t count)
+{
+    cache->entries = entries;
+    cache->count = count;
+    memset(entries, 0, count * sizeof(dedup_entry_t));
+}
+
+bool dedup_cache_check(dedup_cache_t *cache, const uint8_t mac[6], const uint8_t receiver[6], uint8_t space,
+                       uint16_t sequence_control, bool retry)
+{
+    uint64_t hash = hash_mix64(hash_mac(mac) ^ hash_mac(receiver) * 31 ^ space);
+    dedup_entry_t *entry = &cache->entries[hash % cache->count];
+
+    if (!entry->used || memcmp(entry->mac, mac, 6) != 0 || memcmp(entry->receiver, receiver, 6) != 0 ||
+        entry->space != space) {
+        memcpy(entry->mac, mac, 6);
+        memcpy(entry->receiver, receiver, 6);
+        entry->space = space;
+        memset(entry->sequence_control, 0xFF, sizeof(entry->sequence_control));
+        entry->next = 0;
+        entry->used = true;
+    } else if (retry) {
+        // Only frames with the retry bit set can repeat an earlier transmission
+        for (int i = 0; i < DEDUP_CACHE_WAYS; i++) {
+            if (entry->sequence_control[i] == sequence_control) {
+                return true;
+            }
+        }
+    }
+
+    entry->sequence_control[entry->next] = sequence_control;
+    entry->next = (entry->next + 1) % DEDUP_CACHE_WAYS;
+    return false;
+}
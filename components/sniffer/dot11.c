@@ -0,0 +1,59 @@
+#include <string.h>
+#include "dot11.h"
+
+bool dot11_parse_header(const uint8_t *frame, size_t len, dot11_header_t *header)
+{
+    memset(header, 0, sizeof(*header));
+    if (len < 10) {
+        return false;
+    }
+
+    header->type = dot11_frame_type(frame);
+    header->subtype = dot11_frame_subtype(frame);
+    header->flags = frame[1];
+    header->duration = (uint16_t) (frame[2] | frame[3] << 8);
+    header->addr1 = frame + 4;
+
+    if (header->type == DOT11_TYPE_CTRL) {
+        // CTS, ACK and the control wrapper only carry the receiver, the remaining control frames add the transmitter
+        if (header->subtype == DOT11_SUBTYPE_CTS || header->subtype == DOT11_SUBTYPE_ACK ||
+            header->subtype == DOT11_SUBTYPE_CTRL_WRAPPER) {
+            header->header_len = 10;
+        } else {
+            header->header_len = 16;
+            header->addr2 = frame + 10;
+        }
+        return len >= header->header_len;
+    }
+
+    header->header_len = 24;
+    header->addr2 = frame + 10;
+    header->addr3 = frame + 16;
+    header->has_sequence = true;
+
+    if (header->type == DOT11_TYPE_DATA) {
+        if ((header->flags & (DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS)) == (DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS)) {
+            header->addr4 = frame + 24;
+            header->header_len += 6;
+        }
+        if (header->subtype & 0x08) {
+            header->has_qos = true;
+            header->header_len += 2; // QoS control
+            if (header->flags & DOT11_FLAG_ORDER) {
+                header->header_len += 4; // HT control
+            }
+        }
+    } else if (header->type == DOT11_TYPE_MGMT && (header->flags & DOT11_FLAG_ORDER)) {
+        header->header_len += 4; // HT control
+    }
+
+    if (len < header->header_len) {
+        return false;
+    }
+
+    header->sequence_control = (uint16_t) (frame[22] | frame[23] << 8);
+    if (header->has_qos) {
+        header->tid = frame[header->addr4 ? 30 : 24] & 0x0F;
+    }
+    return true;
+}
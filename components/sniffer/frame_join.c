@@ -0,0 +1,244 @@
+#include <string.h>
+#include "frame_join.h"
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+#include "latency.h"
+#include "l2_sniffer.h"
+#include "csi_sniffer.h"
+#include "stats.h"
+#include "shared.h"
+#endif
+
+void frame_join_setup(frame_join_t *join, uint32_t window_us, frame_join_emit_t emit, void *context)
+{
+    memset(join, 0, sizeof(*join));
+    join->window_us = window_us;
+    join->emit = emit;
+    join->context = context;
+}
+
+static void emit_alone(frame_join_t *join, frame_join_entry_t *entry, bool l2)
+{
+    if (l2) {
+        join->l2_unmatched++;
+        join->emit(join->context, &entry->l2, NULL, entry->stamp);
+    } else {
+        join->csi_unmatched++;
+        join->emit(join->context, NULL, &entry->csi, entry->stamp);
+    }
+    entry->used = false;
+}
+
+// Closest waiting event of the same transmitter within the window. The rx_ctrl clock wraps, differences are taken
+// signed. Callbacks of later frames may come in between, so events are not expired by rx_ctrl time but by tick.
+static frame_join_entry_t *find_match(frame_join_t *join, frame_join_entry_t *entries, uint32_t rx_time,
+                                      const uint8_t mac[6])
+{
+    frame_join_entry_t *best = NULL;
+    uint32_t best_distance = 0;
+    for (int i = 0; i < FRAME_JOIN_PENDING; i++) {
+        if (!entries[i].used || memcmp(entries[i].mac, mac, 6) != 0) {
+            continue;
+        }
+        int32_t difference = (int32_t) (rx_time - entries[i].rx_time);
+        uint32_t distance = difference < 0 ? (uint32_t) -difference : (uint32_t) difference;
+        if (distance <= join->window_us && (best == NULL || distance < best_distance)) {
+            best = &entries[i];
+            best_distance = distance;
+        }
+    }
+    return best;
+}
+
+// Free slot for a new event, storing the oldest one alone when all are taken
+static frame_join_entry_t *claim(frame_join_t *join, frame_join_entry_t *entries, bool l2)
+{
+    frame_join_entry_t *oldest = &entries[0];
+    for (int i = 0; i < FRAME_JOIN_PENDING; i++) {
+        if (!entries[i].used) {
+            return &entries[i];
+        }
+        if ((int32_t) (entries[i].rx_time - oldest->rx_time) < 0) {
+            oldest = &entries[i];
+        }
+    }
+    emit_alone(join, oldest, l2);
+    return oldest;
+}
+
+void frame_join_add_l2(frame_join_t *join, uint32_t rx_time, const uint8_t mac[6], const captured_packet_t *record,
+                       uint32_t stamp)
+{
+    frame_join_entry_t *match = find_match(join, join->csi, rx_time, mac);
+    if (match) {
+        join->matched++;
+        join->emit(join->context, record, &match->csi, match->stamp);
+        match->used = false;
+        return;
+    }
+
+    frame_join_entry_t *entry = claim(join, join->l2, true);
+    entry->used = true;
+    entry->age = 0;
+    entry->rx_time = rx_time;
+    memcpy(entry->mac, mac, 6);
+    entry->stamp = stamp;
+    entry->l2 = *record;
+}
+
+void frame_join_add_csi(frame_join_t *join, uint32_t rx_time, const uint8_t mac[6], const csi_packet_t *record,
+                        uint32_t stamp)
+{
+    frame_join_entry_t *match = find_match(join, join->l2, rx_time, mac);
+    if (match) {
+        join->matched++;
+        join->emit(join->context, &match->l2, record, match->stamp);
+        match->used = false;
+        return;
+    }
+
+    frame_join_entry_t *entry = claim(join, join->csi, false);
+    entry->used = true;
+    entry->age = 0;
+    entry->rx_time = rx_time;
+    memcpy(entry->mac, mac, 6);
+    entry->stamp = stamp;
+    entry->csi = *record;
+}
+
+void frame_join_tick(frame_join_t *join)
+{
+    for (int i = 0; i < FRAME_JOIN_PENDING; i++) {
+        if (join->l2[i].used && join->l2[i].age++ > 0) {
+            emit_alone(join, &join->l2[i], true);
+        }
+        if (join->csi[i].used && join->csi[i].age++ > 0) {
+            emit_alone(join, &join->csi[i], false);
+        }
+    }
+}
+
+void frame_join_flush(frame_join_t *join)
+{
+    for (int i = 0; i < FRAME_JOIN_PENDING; i++) {
+        if (join->l2[i].used) {
+            emit_alone(join, &join->l2[i], true);
+        }
+        if (join->csi[i].used) {
+            emit_alone(join, &join->csi[i], false);
+        }
+    }
+}
+
+#ifdef CONFIG_SNIFFER_JOIN_CSI
+static const char* TAG = "FRAME_JOIN";
+
+static frame_join_t join;
+static SemaphoreHandle_t join_mutex = NULL;
+static TaskHandle_t tick_task_handle = NULL;
+
+// Queue items are the record followed by its latency stamp, as in the capture callbacks
+static void emit(void *context, const captured_packet_t *l2, const csi_packet_t *csi, uint32_t stamp)
+{
+    (void) context;
+    if (l2 && csi) {
+        uint8_t item[sizeof(joined_packet_t) + LATENCY_STAMP_SIZE];
+        joined_packet_t *joined = (joined_packet_t *) item;
+        joined->frame = *l2;
+        joined->csi_len = csi->csi_len;
+        memcpy(joined->csi_data, csi->csi_data, sizeof(joined->csi_data));
+        memcpy(item + sizeof(joined_packet_t), &stamp, LATENCY_STAMP_SIZE);
+
+        if (xQueueSendFromISR(joined_packet_queue, item, NULL) != pdTRUE) {
+            sniffer_stats.joined_queue_full++;
+        } else {
+            sniffer_stats.joined_enqueued++;
+        }
+    } else if (l2) {
+        uint8_t item[sizeof(captured_packet_t) + LATENCY_STAMP_SIZE];
+        memcpy(item, l2, sizeof(captured_packet_t));
+        memcpy(item + sizeof(captured_packet_t), &stamp, LATENCY_STAMP_SIZE);
+        sniffer_stats.join_l2_unmatched++;
+        l2_sniffer_enqueue(item);
+    } else {
+        uint8_t item[sizeof(csi_packet_t) + LATENCY_STAMP_SIZE];
+        memcpy(item, csi, sizeof(csi_packet_t));
+        memcpy(item + sizeof(csi_packet_t), &stamp, LATENCY_STAMP_SIZE);
+        sniffer_stats.join_csi_unmatched++;
+        csi_sniffer_enqueue(item);
+    }
+}
+
+static uint32_t item_stamp(const uint8_t *stamp)
+{
+    uint32_t value = 0;
+    memcpy(&value, stamp, LATENCY_STAMP_SIZE);
+    return value;
+}
+
+static void tick_task(void *pvParameter)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(FRAME_JOIN_TICK_MS));
+        xSemaphoreTake(join_mutex, portMAX_DELAY);
+        frame_join_tick(&join);
+        xSemaphoreGive(join_mutex);
+    }
+}
+
+bool frame_join_init(void)
+{
+    frame_join_setup(&join, CONFIG_SNIFFER_JOIN_WINDOW, emit, NULL);
+
+    join_mutex = xSemaphoreCreateMutex();
+    if (join_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create join mutex");
+        return false;
+    }
+
+    if (xTaskCreate(tick_task, "frame_join_task", 3072, NULL, 3, &tick_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start join task");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Joining L2 and CSI records within %d us", CONFIG_SNIFFER_JOIN_WINDOW);
+    return true;
+}
+
+void frame_join_deinit(void)
+{
+    if (join_mutex == NULL) {
+        return;
+    }
+
+    // Holding the mutex, the tick task cannot be deleted in the middle of a tick
+    xSemaphoreTake(join_mutex, portMAX_DELAY);
+    if (tick_task_handle) {
+        vTaskDelete(tick_task_handle);
+        tick_task_handle = NULL;
+    }
+    frame_join_flush(&join);
+    xSemaphoreGive(join_mutex);
+    vSemaphoreDelete(join_mutex);
+    join_mutex = NULL;
+}
+
+void frame_join_l2(uint32_t rx_time, const uint8_t mac[6], const uint8_t *item)
+{
+    xSemaphoreTake(join_mutex, portMAX_DELAY);
+    frame_join_add_l2(&join, rx_time, mac, (const captured_packet_t *) item,
+                      item_stamp(item + sizeof(captured_packet_t)));
+    xSemaphoreGive(join_mutex);
+}
+
+void frame_join_csi(uint32_t rx_time, const uint8_t mac[6], const uint8_t *item)
+{
+    xSemaphoreTake(join_mutex, portMAX_DELAY);
+    frame_join_add_csi(&join, rx_time, mac, (const csi_packet_t *) item, item_stamp(item + sizeof(csi_packet_t)));
+    xSemaphoreGive(join_mutex);
+}
+#endif
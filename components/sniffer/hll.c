@@ -0,0 +1,64 @@
+#include <string.h>
+#include <math.h>
+#include "hll.h"
+
+void hll_init(hll_t *hll, uint8_t precision, uint8_t *registers) {
+    hll->precision = precision;
+    hll->registers = registers;
+    hll_reset(hll);
+}
+
+void hll_reset(hll_t *hll) {
+    memset(hll->registers, 0, HLL_REGISTER_COUNT(hll->precision));
+}
+
+void hll_add_hash(hll_t *hll, uint64_t hash) {
+    // Top p bits select the register, the rest gives the rank (position of the first set bit)
+    uint32_t index = (uint32_t) (hash >> (64 - hll->precision));
+    uint64_t remaining = (hash << hll->precision) | (1ULL << (hll->precision - 1)); // Guard bit bounds the rank
+    uint8_t rank = (uint8_t) (__builtin_clzll(remaining) + 1);
+
+    if (rank > hll->registers[index]) {
+        hll->registers[index] = rank;
+    }
+}
+
+void hll_merge(hll_t *dst, const hll_t *src) {
+    uint32_t count = HLL_REGISTER_COUNT(dst->precision);
+    for (uint32_t i = 0; i < count; i++) {
+        if (src->registers[i] > dst->registers[i]) {
+            dst->registers[i] = src->registers[i];
+        }
+    }
+}
+
+double hll_estimate(const hll_t *hll) {
+    uint32_t count = HLL_REGISTER_COUNT(hll->precision);
+    double m = (double) count;
+    double sum = 0.0;
+    uint32_t zeros = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        sum += ldexp(1.0, -hll->registers[i]);
+        if (hll->registers[i] == 0) {
+            zeros++;
+        }
+    }
+
+    double alpha;
+    switch (count) {
+        case 16: alpha = 0.673; break;
+        case 32: alpha = 0.697; break;
+        case 64: alpha = 0.709; break;
+        default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+    }
+
+    double estimate = alpha * m * m / sum;
+
+    // Small range correction (linear counting), 64-bit hashes need no large range correction
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / (double) zeros);
+    }
+
+    return estimate;
+}
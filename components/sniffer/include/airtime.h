@@ -0,0 +1,19 @@
+#ifndef AIRTIME_H
+#define AIRTIME_H
+
+#include <stdint.h>
+
+// PHY of a received frame, as reported in wifi_pkt_rx_ctrl_t
+typedef struct {
+    uint8_t sig_mode;   // 0 = 802.11b/g, 1 = 802.11n (HT), 3 = VHT (treated as HT)
+    uint8_t rate;       // wifi_phy_rate_t code of non-HT frames
+    uint8_t mcs;        // HT MCS index
+    uint8_t cwb;        // HT channel width, 0 = 20 MHz, 1 = 40 MHz
+    uint8_t sgi;        // HT short guard interval
+} airtime_phy_t;
+
+// Estimated on-air duration (µs) of a `length` byte PPDU payload (MAC header to FCS) in the 2.4 GHz band,
+// including the PHY preamble and the OFDM signal extension. Returns 0 for an unknown rate.
+uint32_t airtime_estimate_us(const airtime_phy_t *phy, uint32_t length);
+
+#endif // AIRTIME_H
@@ -0,0 +1,56 @@
+#ifndef BEACON_TRACKER_H
+#define BEACON_TRACKER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "capture_format.h"
+#ifdef ESP_PLATFORM
+#include "esp_wifi.h"
+#endif
+
+#define BEACON_PROBE 8   // Slots searched per BSSID before its beacons are left untracked
+
+typedef struct {
+    uint8_t bssid[6];
+    bool used;
+    uint8_t channel;
+    int8_t rssi_min;
+    int8_t rssi_max;
+    int32_t rssi_sum;
+    uint32_t ie_hash;
+    uint16_t beacons;
+    uint16_t stored;
+} beacon_entry_t;
+
+// Per-BSSID beacon tracking of one window. The first beacon of an AP and every beacon whose IEs changed are stored
+// in full, the others are only counted into a per-window aggregate. Platform independent; the firmware functions
+// below swap two windows from a task and write each finished one to the summary stream.
+typedef struct {
+    beacon_entry_t *entries;
+    uint32_t size;
+    uint64_t start;      // Wall-clock time (ms)
+    uint32_t untracked;
+} beacon_window_t;
+
+void beacon_window_setup(beacon_window_t *window, beacon_entry_t *entries, uint32_t size, uint64_t start);
+
+// Forget all BSSIDs and start a new window
+void beacon_window_reset(beacon_window_t *window, uint64_t start);
+
+// Returns false for beacons that were folded into the aggregate. `frame` is a whole frame of `len` bytes including
+// the FCS, frames other than beacons are always kept.
+bool beacon_window_keep(beacon_window_t *window, const uint8_t *frame, uint32_t len, int8_t rssi, uint8_t channel);
+
+// Fill one aggregate per tracked BSSID (up to `size` of them), returns the count
+uint16_t beacon_window_aggregate(const beacon_window_t *window, beacon_aggregate_t *aggregates);
+
+#ifdef ESP_PLATFORM
+bool beacon_tracker_init(void);
+void beacon_tracker_deinit(void);
+
+// Returns false for beacons that were folded into the aggregate and should not be enqueued, called from the L2
+// callback for every frame
+bool beacon_tracker_keep(const wifi_promiscuous_pkt_t *ppkt);
+#endif
+
+#endif // BEACON_TRACKER_H
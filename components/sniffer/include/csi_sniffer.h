@@ -1,7 +1,15 @@
 #ifndef CSI_SNIFFER_H
 #define CSI_SNIFFER_H
 
+#include <stdint.h>
+
 void csi_sniffer_init(void);
 void csi_sniffer_deinit(void);
 
+// Enqueue a CSI record followed by its latency stamp for the writer
+void csi_sniffer_enqueue(const uint8_t *item);
+
+// Append the per-source rate limiter counters to the summary stream, called from the statistics task
+void csi_sniffer_write_summary(void);
+
 #endif // CSI_SNIFFER_H
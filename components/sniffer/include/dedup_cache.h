@@ -0,0 +1,37 @@
+#ifndef DEDUP_CACHE_H
+#define DEDUP_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DEDUP_CACHE_WAYS 4  // Recent sequence control values remembered per sequence space
+
+// Sequence space of management and non-QoS data frames, QoS data frames use their TID (0-15)
+#define DEDUP_SPACE_NON_QOS 16
+
+// Recent (transmitter, receiver, sequence space, sequence, fragment) tuples, one slot per hash of the first three.
+// A transmitter numbers QoS data per receiver and TID, independently of its management and non-QoS frames, so
+// the same sequence control in another space is a different frame, as in the duplicate detection of an 802.11
+// receiver. A colliding key evicts the slot, which can only cause a missed duplicate, never a dropped original.
+typedef struct {
+    uint8_t mac[6];
+    uint8_t receiver[6];
+    uint8_t space;
+    uint8_t next;
+    bool used;
+    uint16_t sequence_control[DEDUP_CACHE_WAYS];
+} dedup_entry_t;
+
+typedef struct {
+    dedup_entry_t *entries;
+    uint32_t count;
+} dedup_cache_t;
+
+void dedup_cache_init(dedup_cache_t *cache, dedup_entry_t *entries, uint32_t count);
+
+// Returns true when a retransmitted frame repeats a recently seen tuple, otherwise remembers the tuple.
+// `receiver` is addr1, `space` the TID of QoS data frames or DEDUP_SPACE_NON_QOS.
+bool dedup_cache_check(dedup_cache_t *cache, const uint8_t mac[6], const uint8_t receiver[6], uint8_t space,
+                       uint16_t sequence_control, bool retry);
+
+#endif // DEDUP_CACHE_H
@@ -0,0 +1,83 @@
+#ifndef DOT11_H
+#define DOT11_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// 802.11 frame types (frame control bits 2-3)
+#define DOT11_TYPE_MGMT 0
+#define DOT11_TYPE_CTRL 1
+#define DOT11_TYPE_DATA 2
+
+// Management subtypes
+#define DOT11_SUBTYPE_ASSOC_REQ    0
+#define DOT11_SUBTYPE_ASSOC_RESP   1
+#define DOT11_SUBTYPE_REASSOC_REQ  2
+#define DOT11_SUBTYPE_REASSOC_RESP 3
+#define DOT11_SUBTYPE_PROBE_REQ    4
+#define DOT11_SUBTYPE_PROBE_RESP   5
+#define DOT11_SUBTYPE_BEACON       8
+
+// Control subtypes
+#define DOT11_SUBTYPE_CTRL_WRAPPER 7
+#define DOT11_SUBTYPE_CTS 12
+#define DOT11_SUBTYPE_ACK 13
+
+#define DOT11_MGMT_HEADER_LEN 24
+#define DOT11_FCS_LEN 4
+
+// Frame control flags (second byte of the frame control field)
+#define DOT11_FLAG_TO_DS      0x01
+#define DOT11_FLAG_FROM_DS    0x02
+#define DOT11_FLAG_MORE_FRAG  0x04
+#define DOT11_FLAG_RETRY      0x08
+#define DOT11_FLAG_PWR_MGMT   0x10
+#define DOT11_FLAG_MORE_DATA  0x20
+#define DOT11_FLAG_PROTECTED  0x40
+#define DOT11_FLAG_ORDER      0x80
+
+// Parsed MAC header, address pointers refer into the frame and are NULL when the frame type has no such field
+typedef struct {
+    uint8_t type;
+    uint8_t subtype;
+    uint8_t flags;
+    uint16_t duration;
+    const uint8_t *addr1;
+    const uint8_t *addr2;
+    const uint8_t *addr3;
+    const uint8_t *addr4;
+    bool has_sequence;
+    uint16_t sequence_control;  // Fragment number in bits 0-3, sequence number in bits 4-15
+    bool has_qos;               // QoS data, sequence numbers are counted per TID
+    uint8_t tid;                // Traffic identifier from the QoS control field
+    uint16_t header_len;
+} dot11_header_t;
+
+// Parse the frame control dependent MAC header. Returns false when the frame is shorter than its header.
+bool dot11_parse_header(const uint8_t *frame, size_t len, dot11_header_t *header);
+
+static inline uint8_t dot11_frame_type(const uint8_t *frame) {
+    return (frame[0] >> 2) & 0x03;
+}
+
+static inline uint8_t dot11_frame_subtype(const uint8_t *frame) {
+    return (frame[0] >> 4) & 0x0F;
+}
+
+// Returns the transmitter address (addr2) or NULL when the frame does not carry one (CTS, ACK, control wrapper,
+// short frames)
+static inline const uint8_t *dot11_transmitter(const uint8_t *frame, size_t len) {
+    if (len < 16) {
+        return NULL;
+    }
+    if (dot11_frame_type(frame) == DOT11_TYPE_CTRL) {
+        uint8_t subtype = dot11_frame_subtype(frame);
+        if (subtype == DOT11_SUBTYPE_CTS || subtype == DOT11_SUBTYPE_ACK || subtype == DOT11_SUBTYPE_CTRL_WRAPPER) {
+            return NULL;
+        }
+    }
+    return frame + 10;
+}
+
+#endif // DOT11_H
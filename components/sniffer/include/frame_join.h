@@ -0,0 +1,62 @@
+#ifndef FRAME_JOIN_H
+#define FRAME_JOIN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "capture_format.h"
+
+#define FRAME_JOIN_PENDING 8   // Events per side waiting for their counterpart
+#define FRAME_JOIN_TICK_MS 100 // Events still waiting after a full tick are stored alone
+
+// An L2 or CSI event waiting for the other callback of the same frame
+typedef struct {
+    bool used;
+    uint8_t age;           // Ticks spent waiting
+    uint32_t rx_time;      // rx_ctrl timestamp (µs), identical in both callbacks of a frame
+    uint8_t mac[6];        // Transmitter
+    uint32_t stamp;        // Latency stamp of the event
+    union {
+        captured_packet_t l2;
+        csi_packet_t csi;
+    };
+} frame_join_entry_t;
+
+// Called with both records of a matched frame, or with one of them NULL for an unmatched event. `stamp` is the
+// latency stamp of the earlier event.
+typedef void (*frame_join_emit_t)(void *context, const captured_packet_t *l2, const csi_packet_t *csi,
+                                  uint32_t stamp);
+
+// Matches the promiscuous and CSI callbacks of the same frame by transmitter and rx_ctrl timestamp. Platform
+// independent; the firmware functions below serialise the callbacks and the tick.
+typedef struct {
+    frame_join_entry_t l2[FRAME_JOIN_PENDING];
+    frame_join_entry_t csi[FRAME_JOIN_PENDING];
+    uint32_t window_us;
+    frame_join_emit_t emit;
+    void *context;
+    uint64_t matched;
+    uint64_t l2_unmatched;
+    uint64_t csi_unmatched;
+} frame_join_t;
+
+void frame_join_setup(frame_join_t *join, uint32_t window_us, frame_join_emit_t emit, void *context);
+void frame_join_add_l2(frame_join_t *join, uint32_t rx_time, const uint8_t mac[6], const captured_packet_t *record,
+                       uint32_t stamp);
+void frame_join_add_csi(frame_join_t *join, uint32_t rx_time, const uint8_t mac[6], const csi_packet_t *record,
+                        uint32_t stamp);
+
+// Store events that waited a full tick alone, so quiet channels do not hold records back
+void frame_join_tick(frame_join_t *join);
+
+// Store all waiting events alone
+void frame_join_flush(frame_join_t *join);
+
+#ifdef ESP_PLATFORM
+// Joined records go to joined_packet_queue, unmatched ones to the L2 and CSI queues as without joining
+bool frame_join_init(void);
+void frame_join_deinit(void);
+void frame_join_l2(uint32_t rx_time, const uint8_t mac[6], const uint8_t *item);
+void frame_join_csi(uint32_t rx_time, const uint8_t mac[6], const uint8_t *item);
+#endif
+
+#endif // FRAME_JOIN_H
@@ -0,0 +1,28 @@
+#ifndef HLL_H
+#define HLL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// HyperLogLog cardinality sketch over caller-provided registers (one byte per register).
+// Precision p gives 2^p registers and a standard error of about 1.04 / sqrt(2^p).
+typedef struct {
+    uint8_t precision;
+    uint8_t *registers;
+} hll_t;
+
+#define HLL_REGISTER_COUNT(precision) (1U << (precision))
+
+void hll_init(hll_t *hll, uint8_t precision, uint8_t *registers);
+void hll_reset(hll_t *hll);
+
+// Add an element by its 64-bit hash
+void hll_add_hash(hll_t *hll, uint64_t hash);
+
+// Union of two sketches with the same precision, result is stored in dst
+void hll_merge(hll_t *dst, const hll_t *src);
+
+// Estimated number of distinct elements
+double hll_estimate(const hll_t *hll);
+
+#endif // HLL_H
@@ -0,0 +1,83 @@
+#ifndef L2_DICT_H
+#define L2_DICT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "capture_format.h"
+
+#define L2_DICT_ARENA 4096        // Bytes of dictionary entries per segment
+#define L2_DICT_BUCKETS 256       // Hash buckets of the encoder's entry lookup
+#define L2_DICT_SEEN_SLOTS 512    // Hashes of elements seen once, direct mapped
+#define L2_DICT_MIN_ELEMENT 4     // Shorter elements are kept literal, a reference would save too little
+
+#define L2_DICT_MAX_HEADER 36
+#define L2_DICT_MAX_PAYLOAD 128
+#define L2_DICT_MAX_FRAME (sizeof(l2_dict_frame_t) + L2_DICT_MAX_HEADER + L2_DICT_MAX_PAYLOAD + 2)
+// Largest output of one record: the definitions of all its elements and the frame record
+#define L2_DICT_MAX_ENCODED \
+    (L2_DICT_MAX_PAYLOAD / L2_DICT_MIN_ELEMENT * sizeof(l2_dict_define_t) + L2_DICT_MAX_PAYLOAD + L2_DICT_MAX_FRAME)
+// Output buffer of l2_dict_encode: the padding of a full segment is always shorter than one record
+#define L2_DICT_MAX_OUTPUT (2 * L2_DICT_MAX_ENCODED)
+
+typedef struct {
+    uint32_t hash;
+    uint16_t offset;    // In the arena
+    uint8_t len;
+    uint8_t next;       // Next entry of the same bucket, L2_DICT_LITERAL ends the chain
+} l2_dict_entry_t;
+
+// Encoder of the "L2DC" format. Definitions and references are reset at every segment boundary; the hashes of
+// elements seen once survive, so a recurring element is defined again on its first use in a new segment.
+typedef struct {
+    uint32_t segment_size;
+    uint32_t position;       // Bytes used in the current segment
+    bool dictionary;         // false only shortens records to their length, for comparison
+    uint32_t count;
+    uint32_t arena_used;
+    l2_dict_entry_t entries[L2_DICT_MAX_ENTRIES];
+    uint8_t buckets[L2_DICT_BUCKETS];
+    uint32_t seen[L2_DICT_SEEN_SLOTS];
+    uint8_t arena[L2_DICT_ARENA];
+    uint8_t frame[L2_DICT_MAX_FRAME];
+
+    uint64_t segments;       // Segments started
+    uint64_t definitions;
+    uint64_t references;
+    uint64_t padding;        // Bytes
+    uint64_t probe_ssids;            // Probe requests naming a network
+    uint64_t probe_ssid_references;  // Of those, SSIDs replaced by a reference
+} l2_dict_encoder_t;
+
+// Start encoding behind `position` bytes of records already in the capture. Returns the number of zero bytes to
+// append first, completing a segment left partial by an earlier run.
+uint32_t l2_dict_encoder_setup(l2_dict_encoder_t *encoder, uint32_t segment_size, uint64_t position,
+                               bool dictionary);
+
+// Encode a raw L2 record into `out` (L2_DICT_MAX_OUTPUT bytes): padding that completes the current segment when
+// the record does not fit, definitions of the elements seen for the second time, then the frame record. Returns
+// the number of bytes to append.
+size_t l2_dict_encode(l2_dict_encoder_t *encoder, const captured_packet_t *record, uint8_t *out);
+
+typedef struct {
+    uint32_t segment_size;
+    uint32_t count;
+    uint32_t arena_used;
+    struct {
+        uint16_t offset;
+        uint8_t len;
+    } entries[L2_DICT_MAX_ENTRIES];
+    uint8_t arena[L2_DICT_ARENA];
+} l2_dict_decoder_t;
+
+typedef void (*l2_dict_record_cb_t)(void *context, const captured_packet_t *record);
+
+void l2_dict_decoder_setup(l2_dict_decoder_t *decoder, uint32_t segment_size);
+
+// Decode one segment into raw L2 records. `len` is shorter than the segment size only for the last segment of a
+// capture, whose trailing record may be cut off. Returns the number of records passed to `callback`, or -1 when
+// the segment is malformed; the records before the error have been passed on.
+int l2_dict_decode_segment(l2_dict_decoder_t *decoder, const uint8_t *segment, size_t len,
+                           l2_dict_record_cb_t callback, void *context);
+
+#endif // L2_DICT_H
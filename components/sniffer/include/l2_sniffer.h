@@ -1,7 +1,53 @@
 #ifndef L2_SNIFFER_H
 #define L2_SNIFFER_H
 
+#include "sdkconfig.h"
+#include "capture_format.h"
+
+#ifdef CONFIG_SNIFFER_L2_RECORD_PROJECTED
+#ifdef CONFIG_SNIFFER_PROJECT_FLAGS
+#define L2_PROJECT_FLAGS PROJECTION_FIELD_FLAGS
+#else
+#define L2_PROJECT_FLAGS 0
+#endif
+#ifdef CONFIG_SNIFFER_PROJECT_DURATION
+#define L2_PROJECT_DURATION PROJECTION_FIELD_DURATION
+#else
+#define L2_PROJECT_DURATION 0
+#endif
+#ifdef CONFIG_SNIFFER_PROJECT_SEQUENCE
+#define L2_PROJECT_SEQUENCE PROJECTION_FIELD_SEQUENCE
+#else
+#define L2_PROJECT_SEQUENCE 0
+#endif
+#ifdef CONFIG_SNIFFER_PROJECT_ADDR1
+#define L2_PROJECT_ADDR1 PROJECTION_FIELD_ADDR1
+#else
+#define L2_PROJECT_ADDR1 0
+#endif
+#ifdef CONFIG_SNIFFER_PROJECT_ADDR2
+#define L2_PROJECT_ADDR2 PROJECTION_FIELD_ADDR2
+#else
+#define L2_PROJECT_ADDR2 0
+#endif
+#ifdef CONFIG_SNIFFER_PROJECT_ADDR3
+#define L2_PROJECT_ADDR3 PROJECTION_FIELD_ADDR3
+#else
+#define L2_PROJECT_ADDR3 0
+#endif
+
+// Header fields stored per frame, written to the file header as the schema ID
+#define L2_PROJECTION_SCHEMA (L2_PROJECT_FLAGS | L2_PROJECT_DURATION | L2_PROJECT_SEQUENCE | \
+                              L2_PROJECT_ADDR1 | L2_PROJECT_ADDR2 | L2_PROJECT_ADDR3)
+#define L2_RECORD_SIZE projection_record_size(L2_PROJECTION_SCHEMA)
+#else
+#define L2_RECORD_SIZE sizeof(captured_packet_t)
+#endif
+
 void l2_sniffer_init(void);
 void l2_sniffer_deinit(void);
 
+// Enqueue an L2 record followed by its latency stamp for the writer
+void l2_sniffer_enqueue(const uint8_t *item);
+
 #endif // L2_SNIFFER_H
@@ -0,0 +1,88 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "capture_format.h"
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#endif
+
+// Queue items carry the enqueue time behind the record when latency tracking is enabled
+#ifdef CONFIG_SNIFFER_LATENCY
+#define LATENCY_STAMP_SIZE sizeof(uint32_t)
+#else
+#define LATENCY_STAMP_SIZE 0
+#endif
+
+typedef enum {
+    LATENCY_STREAM_L2,
+    LATENCY_STREAM_CSI,
+    LATENCY_STREAM_JOINED,   // L2 + CSI records of the same frame (SNIFFER_JOIN_CSI)
+    LATENCY_STREAM_COUNT,
+} latency_stream_t;
+
+// Every stage is measured from the enqueue in the capture callback
+typedef enum {
+    LATENCY_STAGE_DEQUEUE,   // Taken off the queue by the writer task
+    LATENCY_STAGE_WRITE,     // Handed to the file system
+    LATENCY_STAGE_DURABLE,   // Synced to the card
+    LATENCY_STAGE_COUNT,
+} latency_stage_t;
+
+// Log-linear histogram: values below 8 µs get a bucket each, above that every power of two is split into 8 linear
+// sub-buckets (at most 12.5% error). The last bucket collects everything from 15 * 2^22 µs (63 s) on. Platform
+// independent; the firmware functions below keep one histogram per stream and stage.
+#define LATENCY_SUB_BUCKET_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_EXPONENT 25
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 2) * LATENCY_SUB_BUCKETS)
+
+typedef struct {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint32_t max;
+} latency_histogram_t;
+
+uint32_t latency_bucket_of(uint32_t value);
+
+// Upper edge of a bucket, reported for percentiles so they are never optimistic
+uint32_t latency_bucket_limit(uint32_t bucket);
+
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t latency, uint32_t weight);
+
+// Upper edge of the bucket holding the given per-mille rank, at most the maximum
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, uint32_t permille);
+
+#ifdef ESP_PLATFORM
+// Current time (µs) in the wrapping 32-bit clock of the stamps, differences are valid for about 71 minutes
+static inline uint32_t latency_now(void)
+{
+    return (uint32_t) esp_timer_get_time();
+}
+
+static inline void latency_stamp(uint8_t *stamp)
+{
+    uint32_t now = latency_now();
+    memcpy(stamp, &now, sizeof(now));
+}
+
+static inline uint32_t latency_since(const uint8_t *stamp)
+{
+    uint32_t then;
+    memcpy(&then, stamp, sizeof(then));
+    return latency_now() - then;
+}
+
+// Count `weight` records that reached `stage` after `latency` µs. Each stream is recorded by one task only.
+void latency_record(latency_stream_t stream, latency_stage_t stage, uint32_t latency, uint32_t weight);
+
+// Percentiles of the current reporting interval
+bool latency_query(latency_stream_t stream, latency_stage_t stage, latency_entry_t *entry);
+
+// Write the percentiles of all streams and stages to the summary stream and start a new interval
+void latency_report(void);
+#endif
+
+#endif // LATENCY_H
@@ -0,0 +1,32 @@
+#ifndef LOAD_SHEDDER_H
+#define LOAD_SHEDDER_H
+
+#include <stdint.h>
+
+// Graded degradation as the capture queue fills up:
+//   above the payload watermark     payloads are dropped, headers are kept
+//   above the sample watermark      additionally only every Nth data frame is kept
+//   above the mgmt-only watermark   only management frames are kept
+typedef enum {
+    SHED_KEEP,
+    SHED_DROP_PAYLOAD,
+    SHED_DROP_SAMPLED,
+    SHED_DROP_NON_MGMT,
+} shed_action_t;
+
+typedef struct {
+    uint32_t payload_watermark;    // Queue occupancy thresholds in entries
+    uint32_t sample_watermark;
+    uint32_t mgmt_only_watermark;
+    uint32_t sample_rate;
+    uint32_t sample_counter;
+} load_shedder_t;
+
+// Watermarks are given in percent of the queue capacity
+void load_shedder_init(load_shedder_t *shedder, uint32_t capacity, uint8_t payload_percent, uint8_t sample_percent,
+                       uint8_t mgmt_only_percent, uint32_t sample_rate);
+
+// Decide what to keep of a frame of `frame_type` at the current queue occupancy
+shed_action_t load_shedder_decide(load_shedder_t *shedder, uint32_t occupancy, uint8_t frame_type);
+
+#endif // LOAD_SHEDDER_H
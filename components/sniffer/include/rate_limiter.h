@@ -0,0 +1,40 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RATE_LIMITER_PROBE 4          // Slots searched per source before evicting the least recently seen one
+#define RATE_LIMITER_MAX_WHITELIST 8
+
+// Token bucket of one source. Tokens are kept in thousandths so low rates refill smoothly.
+typedef struct {
+    uint8_t mac[6];
+    bool used;
+    bool whitelisted;
+    uint32_t tokens;
+    int64_t last_refill;  // µs
+    uint32_t admitted;    // Since the source entered the table
+    uint32_t rejected;
+} rate_limiter_entry_t;
+
+// Fixed-size table of per-source token buckets
+typedef struct {
+    rate_limiter_entry_t *entries;
+    uint32_t count;
+    uint32_t rate;        // Frames per second
+    uint32_t burst;       // Bucket depth in frames
+    uint8_t whitelist[RATE_LIMITER_MAX_WHITELIST][6];
+    uint32_t whitelist_count;
+} rate_limiter_t;
+
+void rate_limiter_init(rate_limiter_t *limiter, rate_limiter_entry_t *entries, uint32_t count, uint32_t rate,
+                       uint32_t burst);
+
+// Parse a comma separated list of MAC addresses, sources on it are never limited. Returns false on a malformed list.
+bool rate_limiter_set_whitelist(rate_limiter_t *limiter, const char *list);
+
+// Returns true if a frame from `mac` at time `now` (µs) is within its source's budget
+bool rate_limiter_admit(rate_limiter_t *limiter, const uint8_t mac[6], int64_t now);
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,14 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include "capture_format.h"
+
+// Counters since boot, updated by the capture callbacks and writer tasks
+extern stats_summary_t sniffer_stats;
+
+// Start periodic reporting of the counters to the log and the summary stream
+bool stats_init(void);
+void stats_deinit(void);
+
+#endif // STATS_H
@@ -0,0 +1,16 @@
+#ifndef SUMMARY_WRITER_H
+#define SUMMARY_WRITER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Open the summary stream on the SD card
+bool summary_writer_init(void);
+
+// Close the summary stream
+void summary_writer_deinit(void);
+
+// Append a record to the summary stream. Blocks on the SD card, do not call from Wi-Fi callbacks.
+bool summary_writer_write(uint16_t type, const void *body, uint16_t length);
+
+#endif // SUMMARY_WRITER_H
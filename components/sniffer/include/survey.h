@@ -0,0 +1,18 @@
+#ifndef SURVEY_H
+#define SURVEY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_wifi.h"
+
+// Per-channel airtime, frame counts and noise floor, written as one summary record per channel dwell
+bool survey_init(uint8_t channel);
+void survey_deinit(void);
+
+// Close the current dwell and start accumulating for `channel`, called by the channel hopping task
+void survey_new_dwell(uint8_t channel);
+
+// Account a received frame to the current dwell, called from the L2 callback
+void survey_add_frame(const wifi_promiscuous_pkt_t *ppkt, wifi_promiscuous_pkt_type_t type);
+
+#endif // SURVEY_H
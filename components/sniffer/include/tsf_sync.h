@@ -0,0 +1,20 @@
+#ifndef TSF_SYNC_H
+#define TSF_SYNC_H
+
+#include <stdbool.h>
+#include "esp_wifi.h"
+
+#define TSF_SYNC_MAX_REFERENCES 8
+
+// Pair the TSF of beacons from reference APs with the local receive time, once per AP and channel dwell.
+// Host tools fit a clock model per device from these samples to align captures of several sniffers.
+bool tsf_sync_init(void);
+void tsf_sync_deinit(void);
+
+// Start of a new channel dwell, called by the channel hopping task after switching channels
+void tsf_sync_new_dwell(void);
+
+// Sample a frame if it is a beacon of a reference AP not yet sampled in this dwell, called from the L2 callback
+void tsf_sync_add_frame(const wifi_promiscuous_pkt_t *ppkt);
+
+#endif // TSF_SYNC_H
@@ -0,0 +1,14 @@
+#ifndef UNIQUE_COUNTER_H
+#define UNIQUE_COUNTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Start the windowed unique device estimator (1, 5 and 15 minute HyperLogLog sketches)
+bool unique_counter_init(void);
+void unique_counter_deinit(void);
+
+// Feed a received 802.11 frame, called from the L2 callback
+void unique_counter_add_frame(const uint8_t *frame, uint16_t len);
+
+#endif // UNIQUE_COUNTER_H
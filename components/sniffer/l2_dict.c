@@ -0,0 +1,352 @@
+#include <string.h>
+#include "l2_dict.h"
+#include "dot11.h"
+#include "hash.h"
+
+#define NO_ENTRY L2_DICT_LITERAL
+
+// Offset of the information elements in a management frame, behind the MAC header and the fixed fields of the
+// subtype. Negative for frames without elements.
+static int elements_offset(uint8_t frame_type, uint8_t frame_subtype)
+{
+    if (frame_type != DOT11_TYPE_MGMT) {
+        return -1;
+    }
+    switch (frame_subtype) {
+        case DOT11_SUBTYPE_PROBE_REQ:
+            return DOT11_MGMT_HEADER_LEN;
+        case DOT11_SUBTYPE_ASSOC_REQ:
+            return DOT11_MGMT_HEADER_LEN + 4;   // Capability, listen interval
+        case DOT11_SUBTYPE_ASSOC_RESP:
+        case DOT11_SUBTYPE_REASSOC_RESP:
+            return DOT11_MGMT_HEADER_LEN + 6;   // Capability, status, association ID
+        case DOT11_SUBTYPE_REASSOC_REQ:
+            return DOT11_MGMT_HEADER_LEN + 10;  // Capability, listen interval, current AP
+        case DOT11_SUBTYPE_PROBE_RESP:
+        case DOT11_SUBTYPE_BEACON:
+            return DOT11_MGMT_HEADER_LEN + 12;  // Timestamp, beacon interval, capability
+        default:
+            return -1;
+    }
+}
+
+// Header bytes stored as they are, the tokens cover the frame from there on. Elements of probe and association
+// requests start inside the 36 header bytes of a record, so the tokens start at the first element.
+static uint32_t literal_header_len(uint8_t frame_type, uint8_t frame_subtype, uint32_t header_len)
+{
+    int offset = elements_offset(frame_type, frame_subtype);
+    return offset >= 0 && (uint32_t) offset < header_len ? (uint32_t) offset : header_len;
+}
+
+static void start_segment(l2_dict_encoder_t *encoder)
+{
+    encoder->position = 0;
+    encoder->count = 0;
+    encoder->arena_used = 0;
+    memset(encoder->buckets, NO_ENTRY, sizeof(encoder->buckets));
+}
+
+uint32_t l2_dict_encoder_setup(l2_dict_encoder_t *encoder, uint32_t segment_size, uint64_t position,
+                               bool dictionary)
+{
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->segment_size = segment_size < L2_DICT_MAX_ENCODED ? L2_DICT_MAX_ENCODED : segment_size;
+    encoder->dictionary = dictionary;
+
+    // The dictionary of a partial segment is gone, the next record starts a new one
+    uint32_t used = (uint32_t) (position % encoder->segment_size);
+    if (used == 0) {
+        return 0;
+    }
+    encoder->padding += encoder->segment_size - used;
+    return encoder->segment_size - used;
+}
+
+// ID of the entry holding `element`; hashes may collide, so the bytes are compared
+static int lookup(const l2_dict_encoder_t *encoder, const uint8_t *element, uint8_t len, uint32_t hash)
+{
+    for (uint8_t id = encoder->buckets[hash % L2_DICT_BUCKETS]; id != NO_ENTRY; id = encoder->entries[id].next) {
+        const l2_dict_entry_t *entry = &encoder->entries[id];
+        if (entry->hash == hash && entry->len == len && memcmp(encoder->arena + entry->offset, element, len) == 0) {
+            return id;
+        }
+    }
+    return -1;
+}
+
+// Elements become entries on their second sighting, so unique ones are not defined for nothing
+static bool seen_before(l2_dict_encoder_t *encoder, uint32_t hash)
+{
+    uint32_t *slot = &encoder->seen[hash % L2_DICT_SEEN_SLOTS];
+    if (*slot == hash) {
+        return true;
+    }
+    *slot = hash;
+    return false;
+}
+
+// Add an entry and write its definition record, -1 when the dictionary is full
+static int define(l2_dict_encoder_t *encoder, const uint8_t *element, uint8_t len, uint32_t hash, uint8_t **out)
+{
+    if (encoder->count == L2_DICT_MAX_ENTRIES || encoder->arena_used + len > L2_DICT_ARENA) {
+        return -1;
+    }
+
+    uint8_t id = (uint8_t) encoder->count++;
+    l2_dict_entry_t *entry = &encoder->entries[id];
+    entry->hash = hash;
+    entry->offset = (uint16_t) encoder->arena_used;
+    entry->len = len;
+    entry->next = encoder->buckets[hash % L2_DICT_BUCKETS];
+    encoder->buckets[hash % L2_DICT_BUCKETS] = id;
+    memcpy(encoder->arena + encoder->arena_used, element, len);
+    encoder->arena_used += len;
+
+    l2_dict_define_t definition = {.type = L2_DICT_DEFINE, .id = id, .len = len};
+    memcpy(*out, &definition, sizeof(definition));
+    memcpy(*out + sizeof(definition), element, len);
+    *out += sizeof(definition) + len;
+    encoder->definitions++;
+    return id;
+}
+
+// Payload tokens under construction, consecutive literal bytes share one literal token
+typedef struct {
+    uint8_t *tokens;
+    uint32_t len;
+    int literal;    // Index of the length byte of the open literal token, -1 when none is open
+} token_writer_t;
+
+static void put_literal(token_writer_t *writer, const uint8_t *bytes, uint32_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (writer->literal < 0) {
+        writer->tokens[writer->len++] = L2_DICT_LITERAL;
+        writer->literal = (int) writer->len;
+        writer->tokens[writer->len++] = 0;
+    }
+    memcpy(writer->tokens + writer->len, bytes, len);
+    writer->len += len;
+    writer->tokens[writer->literal] += (uint8_t) len;
+}
+
+static void put_reference(token_writer_t *writer, uint8_t id)
+{
+    writer->tokens[writer->len++] = id;
+    writer->literal = -1;
+}
+
+// Encode one record against the current dictionary, definitions first. Returns the length written to `out`.
+static size_t encode_record(l2_dict_encoder_t *encoder, const captured_packet_t *record, uint8_t *out)
+{
+    uint32_t header_len = record->header_len < L2_DICT_MAX_HEADER ? record->header_len : L2_DICT_MAX_HEADER;
+    uint32_t payload_len = record->payload_len < L2_DICT_MAX_PAYLOAD ? record->payload_len : L2_DICT_MAX_PAYLOAD;
+
+    l2_dict_frame_t frame = {
+            .type = L2_DICT_FRAME,
+            .timestamp = record->timestamp,
+            .frame_type = record->frame_type,
+            .frame_subtype = record->frame_subtype,
+            .rssi = record->rssi,
+            .channel = record->channel,
+            .header_len = (uint8_t) header_len,
+            .payload_len = (uint8_t) payload_len,
+    };
+    uint32_t literal_len = literal_header_len(record->frame_type, record->frame_subtype, header_len);
+    memcpy(encoder->frame + sizeof(frame), record->header, literal_len);
+    token_writer_t writer = {.tokens = encoder->frame + sizeof(frame) + literal_len, .len = 0, .literal = -1};
+    uint8_t *definitions = out;
+
+    // The header holds the first bytes of the frame body, so the elements are found in header and payload together
+    uint8_t body[L2_DICT_MAX_HEADER + L2_DICT_MAX_PAYLOAD];
+    memcpy(body, record->header, header_len);
+    memcpy(body + header_len, record->payload, payload_len);
+    uint32_t end = header_len + payload_len;
+
+    uint32_t done = literal_len;  // Frame bytes covered by the literal header or tokens
+    int offset = encoder->dictionary ? elements_offset(record->frame_type, record->frame_subtype) : -1;
+    if (offset >= 0) {
+        uint32_t position = (uint32_t) offset;
+        while (position + 2 <= end) {
+            uint32_t element_len = 2 + body[position + 1];
+            if (position + element_len > end) {
+                break;  // Cut off by the payload limit, or the FCS
+            }
+            uint32_t start = position;
+            const uint8_t *element = body + start;
+            position += element_len;
+            bool probe_ssid = record->frame_subtype == DOT11_SUBTYPE_PROBE_REQ && start == (uint32_t) offset &&
+                              element[0] == 0 && element[1] > 0;
+            encoder->probe_ssids += probe_ssid;
+            if (start < done || element_len < L2_DICT_MIN_ELEMENT) {
+                continue;  // Starts in the literal header bytes, or too short to be worth an entry
+            }
+
+            uint32_t hash = (uint32_t) hash_bytes(element, element_len, 0);
+            int id = lookup(encoder, element, (uint8_t) element_len, hash);
+            if (id < 0 && seen_before(encoder, hash)) {
+                id = define(encoder, element, (uint8_t) element_len, hash, &out);
+            }
+            if (id < 0) {
+                continue;
+            }
+            encoder->probe_ssid_references += probe_ssid;
+
+            put_literal(&writer, body + done, start - done);
+            put_reference(&writer, (uint8_t) id);
+            encoder->references++;
+            done = position;
+        }
+    }
+    put_literal(&writer, body + done, end - done);
+
+    frame.encoded_len = (uint8_t) writer.len;
+    memcpy(encoder->frame, &frame, sizeof(frame));
+    size_t frame_len = sizeof(frame) + literal_len + writer.len;
+    memcpy(out, encoder->frame, frame_len);
+    return (size_t) (out - definitions) + frame_len;
+}
+
+size_t l2_dict_encode(l2_dict_encoder_t *encoder, const captured_packet_t *record, uint8_t *out)
+{
+    if (encoder->position == 0) {
+        encoder->segments++;
+        start_segment(encoder);
+    }
+
+    size_t padding = 0;
+    size_t len = encode_record(encoder, record, out);
+    if (encoder->position + len > encoder->segment_size) {
+        // Pad the segment and encode the record again as the first one of the next segment
+        padding = encoder->segment_size - encoder->position;
+        memset(out, L2_DICT_PAD, padding);
+        encoder->padding += padding;
+        encoder->segments++;
+        start_segment(encoder);
+        len = encode_record(encoder, record, out + padding);
+    }
+    encoder->position += (uint32_t) len;
+    return padding + len;
+}
+
+void l2_dict_decoder_setup(l2_dict_decoder_t *decoder, uint32_t segment_size)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->segment_size = segment_size;
+}
+
+// Expand the tokens of a frame record, false when they are malformed
+static bool expand_tokens(const l2_dict_decoder_t *decoder, const uint8_t *tokens, uint32_t len, uint8_t *body,
+                          uint32_t body_len, uint32_t *expanded)
+{
+    uint32_t in = 0;
+    uint32_t out = *expanded;
+    while (in < len) {
+        const uint8_t *bytes;
+        uint32_t count;
+        if (tokens[in] == L2_DICT_LITERAL) {
+            if (in + 2 > len || in + 2 + tokens[in + 1] > len) {
+                return false;
+            }
+            count = tokens[in + 1];
+            bytes = tokens + in + 2;
+            in += 2 + count;
+        } else {
+            if (tokens[in] >= decoder->count) {
+                return false;
+            }
+            count = decoder->entries[tokens[in]].len;
+            bytes = decoder->arena + decoder->entries[tokens[in]].offset;
+            in++;
+        }
+        if (out + count > body_len) {
+            return false;
+        }
+        memcpy(body + out, bytes, count);
+        out += count;
+    }
+    *expanded = out;
+    return true;
+}
+
+int l2_dict_decode_segment(l2_dict_decoder_t *decoder, const uint8_t *segment, size_t len,
+                           l2_dict_record_cb_t callback, void *context)
+{
+    // A record running past the data is malformed in a full segment, cut off by a power loss in the last one
+    bool last = len < decoder->segment_size;
+    int records = 0;
+    size_t position = 0;
+
+    decoder->count = 0;
+    decoder->arena_used = 0;
+    while (position < len && segment[position] != L2_DICT_PAD) {
+        if (segment[position] == L2_DICT_DEFINE) {
+            l2_dict_define_t definition;
+            if (position + sizeof(definition) > len) {
+                return last ? records : -1;
+            }
+            memcpy(&definition, segment + position, sizeof(definition));
+            if (position + sizeof(definition) + definition.len > len) {
+                return last ? records : -1;
+            }
+            if (definition.id != decoder->count || decoder->count == L2_DICT_MAX_ENTRIES ||
+                decoder->arena_used + definition.len > L2_DICT_ARENA) {
+                return -1;
+            }
+            decoder->entries[definition.id].offset = (uint16_t) decoder->arena_used;
+            decoder->entries[definition.id].len = definition.len;
+            memcpy(decoder->arena + decoder->arena_used, segment + position + sizeof(definition), definition.len);
+            decoder->arena_used += definition.len;
+            decoder->count++;
+            position += sizeof(definition) + definition.len;
+            continue;
+        }
+
+        if (segment[position] != L2_DICT_FRAME) {
+            return -1;
+        }
+        l2_dict_frame_t frame;
+        if (position + sizeof(frame) > len) {
+            return last ? records : -1;
+        }
+        memcpy(&frame, segment + position, sizeof(frame));
+        uint32_t literal_len = literal_header_len(frame.frame_type, frame.frame_subtype, frame.header_len);
+        size_t frame_len = sizeof(frame) + literal_len + frame.encoded_len;
+        if (position + frame_len > len) {
+            return last ? records : -1;
+        }
+        if (frame.header_len > L2_DICT_MAX_HEADER || frame.payload_len > L2_DICT_MAX_PAYLOAD) {
+            return -1;
+        }
+
+        captured_packet_t record;
+        memset(&record, 0, sizeof(record));
+        record.timestamp = frame.timestamp;
+        record.frame_type = frame.frame_type;
+        record.frame_subtype = frame.frame_subtype;
+        record.rssi = frame.rssi;
+        record.channel = frame.channel;
+        record.header_len = frame.header_len;
+        record.payload_len = frame.payload_len;
+
+        // The tokens continue the frame behind the literal header bytes, into the payload
+        const uint8_t *data = segment + position + sizeof(frame);
+        uint8_t body[L2_DICT_MAX_HEADER + L2_DICT_MAX_PAYLOAD];
+        uint32_t body_len = frame.header_len + frame.payload_len;
+        memcpy(body, data, literal_len);
+        uint32_t expanded = literal_len;
+        if (!expand_tokens(decoder, data + literal_len, frame.encoded_len, body, body_len, &expanded) ||
+            expanded != body_len) {
+            return -1;
+        }
+        memcpy(record.header, body, frame.header_len);
+        memcpy(record.payload, body + frame.header_len, frame.payload_len);
+
+        callback(context, &record);
+        records++;
+        position += frame_len;
+    }
+    return records;
+}
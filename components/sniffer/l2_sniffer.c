@@ -7,14 +7,43 @@
 #include "esp_log.h"
 #include "freertos/queue.h"
 #include "l2_sniffer.h"
+#include "unique_counter.h"
+#include "dot11.h"
+#include "dedup_cache.h"
+#include "stats.h"
+#include "load_shedder.h"
+#include "tsf_sync.h"
+#include "survey.h"
+#include "beacon_tracker.h"
+#include "latency.h"
+#include "frame_join.h"
 #include "shared.h"
 
 static const char* TAG = "L2_SNIFFER";
 
+#ifdef CONFIG_SNIFFER_DEDUP_ENABLE
+static dedup_entry_t dedup_entries[CONFIG_SNIFFER_DEDUP_CACHE_SIZE];
+static dedup_cache_t dedup_cache;
+#endif
+
+#ifdef CONFIG_SNIFFER_LOAD_SHEDDING
+static load_shedder_t load_shedder;
+#endif
+
 // Forward declaration
 static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type);
 
 void l2_sniffer_init(void) {
+    #ifdef CONFIG_SNIFFER_DEDUP_ENABLE
+    dedup_cache_init(&dedup_cache, dedup_entries, CONFIG_SNIFFER_DEDUP_CACHE_SIZE);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_LOAD_SHEDDING
+    load_shedder_init(&load_shedder, CONFIG_SNIFFER_PACKET_QUEUE_SIZE, CONFIG_SNIFFER_SHED_PAYLOAD_WATERMARK,
+                      CONFIG_SNIFFER_SHED_SAMPLE_WATERMARK, CONFIG_SNIFFER_SHED_MGMT_ONLY_WATERMARK,
+                      CONFIG_SNIFFER_SHED_SAMPLE_RATE);
+    #endif
+
     // Register the RX callback
     ESP_ERROR_CHECK(esp_wifi_set_promiscuous_rx_cb(wifi_promiscuous_rx_cb));
 
@@ -31,52 +60,165 @@ void l2_sniffer_deinit(void) {
     ESP_LOGI(TAG, "L2 sniffer deinitialized");
 }
 
-// Wi-Fi promiscuous RX callback
-static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
-    if (!buf) {
-        return;
-    }
+#ifdef CONFIG_SNIFFER_L2_RECORD_PROJECTED
+// Keep only the parsed header fields of L2_PROJECTION_SCHEMA
+static void project_packet(const wifi_promiscuous_pkt_t *ppkt, const dot11_header_t *header, uint8_t *record) {
+    const wifi_pkt_rx_ctrl_t *rx_ctrl = &ppkt->rx_ctrl;
 
-    // Cast to the incoming packet structure
-    const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
+    projected_packet_t *packet_data = (projected_packet_t *) record;
+    packet_data->timestamp = get_wall_clock_time();
+    packet_data->frame_type = (uint8_t) (header->type << 4 | header->subtype);
+    packet_data->rssi = rx_ctrl->rssi;
+    packet_data->channel = rx_ctrl->channel;
+
+    // Fields follow in the order of their schema bits
+    projection_encode(L2_PROJECTION_SCHEMA, ppkt->payload, header->header_len, record + sizeof(projected_packet_t));
+}
+#else
+// Copy the raw header and payload bytes of a frame
+static void copy_packet(const wifi_promiscuous_pkt_t *ppkt, wifi_promiscuous_pkt_type_t type, bool keep_payload,
+                        captured_packet_t *packet_data) {
     const wifi_pkt_rx_ctrl_t *rx_ctrl = &ppkt->rx_ctrl;
 
     // Prepare captured packet data
-    captured_packet_t packet_data;
-    packet_data.timestamp = get_wall_clock_time();  // Get wall-clock timestamp with ms precision
-    packet_data.rssi = rx_ctrl->rssi;
-    packet_data.channel = rx_ctrl->channel;
+    packet_data->timestamp = get_wall_clock_time();  // Get wall-clock timestamp with ms precision
+    packet_data->rssi = rx_ctrl->rssi;
+    packet_data->channel = rx_ctrl->channel;
 
     // Extract the frame type and subtype from the first byte of the 802.11 header
     const uint8_t *packet_payload = ppkt->payload;
     uint8_t frame_control = packet_payload[0];
-    packet_data.frame_type = (frame_control >> 2) & 0x03;    // Extract the frame type (bits 2-3)
-    packet_data.frame_subtype = (frame_control >> 4) & 0x0F; // Extract the frame subtype (bits 4-7)
+    packet_data->frame_type = (frame_control >> 2) & 0x03;    // Extract the frame type (bits 2-3)
+    packet_data->frame_subtype = (frame_control >> 4) & 0x0F; // Extract the frame subtype (bits 4-7)
 
     // Determine processing based on the frame type
     if (type == WIFI_PKT_MGMT || type == WIFI_PKT_CTRL) {
         // For management and control frames, store the full payload
-        packet_data.header_len = rx_ctrl->sig_len < 36 ? rx_ctrl->sig_len : 36;
-        memcpy(packet_data.header, ppkt->payload, packet_data.header_len);
+        packet_data->header_len = rx_ctrl->sig_len < 36 ? rx_ctrl->sig_len : 36;
+        memcpy(packet_data->header, ppkt->payload, packet_data->header_len);
 
         // Calculate the payload length for control/management frames
-        packet_data.payload_len = rx_ctrl->sig_len - packet_data.header_len;
-        if (packet_data.payload_len > 128) {
-            packet_data.payload_len = 128; // Truncate if payload is larger than buffer
+        packet_data->payload_len = rx_ctrl->sig_len - packet_data->header_len;
+        if (packet_data->payload_len > 128) {
+            packet_data->payload_len = 128; // Truncate if payload is larger than buffer
+        }
+        if (!keep_payload && packet_data->payload_len > 0) {
+            packet_data->payload_len = 0;
+            sniffer_stats.l2_shed_payload++;
         }
-        memcpy(packet_data.payload, ppkt->payload + packet_data.header_len, packet_data.payload_len);
+        memcpy(packet_data->payload, ppkt->payload + packet_data->header_len, packet_data->payload_len);
 
     } else if (type == WIFI_PKT_DATA) {
         // For data frames, only store the header
-        packet_data.header_len = rx_ctrl->sig_len < 36 ? rx_ctrl->sig_len : 36;
-        memcpy(packet_data.header, ppkt->payload, packet_data.header_len);
+        packet_data->header_len = rx_ctrl->sig_len < 36 ? rx_ctrl->sig_len : 36;
+        memcpy(packet_data->header, ppkt->payload, packet_data->header_len);
 
         // Set payload length to zero for data frames, as we’re excluding it
-        packet_data.payload_len = 0;
+        packet_data->payload_len = 0;
+    }
+}
+#endif
+
+// Wi-Fi promiscuous RX callback
+static void wifi_promiscuous_rx_cb(void *buf, wifi_promiscuous_pkt_type_t type) {
+    if (!buf) {
+        return;
+    }
+
+    // Cast to the incoming packet structure
+    const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
+    const wifi_pkt_rx_ctrl_t *rx_ctrl = &ppkt->rx_ctrl;
+
+    sniffer_stats.l2_received++;
+
+    #ifdef CONFIG_SNIFFER_HLL_ENABLE
+    // Count every transmitter, including frames that would be dropped by a full queue
+    unique_counter_add_frame(ppkt->payload, rx_ctrl->sig_len);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_TSF_SYNC
+    // Sample reference AP clocks before any frame is shed
+    tsf_sync_add_frame(ppkt);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_SURVEY_MODE
+    // Survey mode only accumulates per-dwell totals, frames are never enqueued
+    survey_add_frame(ppkt, type);
+    return;
+    #endif
+
+    #ifdef CONFIG_SNIFFER_BEACON_SUMMARY
+    // Repeated beacons of an AP only go into its per-window aggregate
+    if (!beacon_tracker_keep(ppkt)) {
+        sniffer_stats.l2_beacons_summarised++;
+        return;
+    }
+    #endif
+
+    #if defined(CONFIG_SNIFFER_DEDUP_ENABLE) || defined(CONFIG_SNIFFER_L2_RECORD_PROJECTED)
+    dot11_header_t header;
+    bool parsed = dot11_parse_header(ppkt->payload, rx_ctrl->sig_len, &header);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_DEDUP_ENABLE
+    // Retransmissions repeat the addresses, TID, sequence and fragment number of a frame we already have
+    if (parsed && header.has_sequence &&
+        dedup_cache_check(&dedup_cache, header.addr2, header.addr1, header.has_qos ? header.tid : DEDUP_SPACE_NON_QOS,
+                          header.sequence_control, header.flags & DOT11_FLAG_RETRY)) {
+        sniffer_stats.l2_duplicates++;
+        #ifdef CONFIG_SNIFFER_DEDUP_DROP
+        return;
+        #endif
     }
+    #endif
+
+    shed_action_t shed_action = SHED_KEEP;
+    #ifdef CONFIG_SNIFFER_LOAD_SHEDDING
+    // Protect management frames (probe requests) from floods of data frames when the writer falls behind
+    shed_action = load_shedder_decide(&load_shedder, uxQueueMessagesWaitingFromISR(l2_packet_queue),
+                                      dot11_frame_type(ppkt->payload));
+    if (shed_action == SHED_DROP_SAMPLED) {
+        sniffer_stats.l2_shed_sampled++;
+        return;
+    }
+    if (shed_action == SHED_DROP_NON_MGMT) {
+        sniffer_stats.l2_shed_non_mgmt++;
+        return;
+    }
+    #endif
+
+    #ifdef CONFIG_SNIFFER_L2_RECORD_PROJECTED
+    uint8_t packet_data[PROJECTION_MAX_RECORD_SIZE + LATENCY_STAMP_SIZE];
+    if (!parsed) {
+        return;
+    }
+    project_packet(ppkt, &header, packet_data);
+    #else
+    uint8_t packet_data[sizeof(captured_packet_t) + LATENCY_STAMP_SIZE];
+    copy_packet(ppkt, type, shed_action != SHED_DROP_PAYLOAD, (captured_packet_t *) packet_data);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_LATENCY
+    latency_stamp(packet_data + L2_RECORD_SIZE);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_JOIN_CSI
+    // Frames with a transmitter wait briefly for the CSI of the same frame
+    const uint8_t *transmitter = dot11_transmitter(ppkt->payload, rx_ctrl->sig_len);
+    if (transmitter) {
+        frame_join_l2(rx_ctrl->timestamp, transmitter, packet_data);
+        return;
+    }
+    #endif
+
+    l2_sniffer_enqueue(packet_data);
+}
 
-    // Enqueue the packet data
-    if (xQueueSendFromISR(l2_packet_queue, &packet_data, NULL) != pdTRUE) {
+void l2_sniffer_enqueue(const uint8_t *item) {
+    if (xQueueSendFromISR(l2_packet_queue, item, NULL) != pdTRUE) {
+        sniffer_stats.l2_queue_full++;
         ESP_LOGW(TAG, "L2 Queue is full, packet is dropped");
+    } else {
+        sniffer_stats.l2_enqueued++;
     }
 }
@@ -0,0 +1,105 @@
+#include "latency.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#include "summary_writer.h"
+
+static const char* TAG = "LATENCY";
+#endif
+
+uint32_t latency_bucket_of(uint32_t value)
+{
+    if (value < LATENCY_SUB_BUCKETS) {
+        return value;
+    }
+    uint32_t exponent = 31 - __builtin_clz(value);
+    if (exponent > LATENCY_MAX_EXPONENT) {
+        return LATENCY_BUCKETS - 1;
+    }
+    uint32_t shift = exponent - LATENCY_SUB_BUCKET_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + ((value >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+uint32_t latency_bucket_limit(uint32_t bucket)
+{
+    if (bucket < LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+    if (bucket == LATENCY_BUCKETS - 1) {
+        return UINT32_MAX;
+    }
+    uint32_t shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return ((LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS + 1) << shift) - 1;
+}
+
+void latency_histogram_add(latency_histogram_t *histogram, uint32_t latency, uint32_t weight)
+{
+    histogram->buckets[latency_bucket_of(latency)] += weight;
+    histogram->count += weight;
+    if (latency > histogram->max) {
+        histogram->max = latency;
+    }
+}
+
+uint32_t latency_histogram_percentile(const latency_histogram_t *histogram, uint32_t permille)
+{
+    uint64_t rank = ((uint64_t) histogram->count * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        seen += histogram->buckets[bucket];
+        if (seen >= rank && seen > 0) {
+            uint32_t limit = latency_bucket_limit(bucket);
+            return limit < histogram->max ? limit : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+#ifdef ESP_PLATFORM
+static latency_histogram_t histograms[LATENCY_STREAM_COUNT][LATENCY_STAGE_COUNT];
+
+void latency_record(latency_stream_t stream, latency_stage_t stage, uint32_t latency, uint32_t weight)
+{
+    latency_histogram_add(&histograms[stream][stage], latency, weight);
+}
+
+bool latency_query(latency_stream_t stream, latency_stage_t stage, latency_entry_t *entry)
+{
+    // Histograms are updated concurrently by the writer tasks, a slightly torn snapshot is acceptable
+    const latency_histogram_t *histogram = &histograms[stream][stage];
+
+    entry->stream = stream;
+    entry->stage = stage;
+    entry->count = histogram->count;
+    entry->p50 = latency_histogram_percentile(histogram, 500);
+    entry->p99 = latency_histogram_percentile(histogram, 990);
+    entry->max = histogram->max;
+    return entry->count > 0;
+}
+
+void latency_report(void)
+{
+    latency_entry_t entries[LATENCY_STREAM_COUNT * LATENCY_STAGE_COUNT];
+    uint16_t count = 0;
+
+    for (int stream = 0; stream < LATENCY_STREAM_COUNT; stream++) {
+        for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++) {
+            latency_entry_t *entry = &entries[count];
+            if (!latency_query(stream, stage, entry)) {
+                continue;
+            }
+            ESP_LOGI(TAG, "%s %s: %lu records, p50 %lu us, p99 %lu us, max %lu us",
+                     stream == LATENCY_STREAM_L2 ? "L2" : stream == LATENCY_STREAM_CSI ? "CSI" : "Joined",
+                     stage == LATENCY_STAGE_DEQUEUE ? "dequeue" : stage == LATENCY_STAGE_WRITE ? "write" : "durable",
+                     (unsigned long) entry->count, (unsigned long) entry->p50, (unsigned long) entry->p99,
+                     (unsigned long) entry->max);
+            memset(&histograms[stream][stage], 0, sizeof(latency_histogram_t));
+            count++;
+        }
+    }
+
+    if (count > 0) {
+        summary_writer_write(SUMMARY_RECORD_LATENCY, entries, count * sizeof(latency_entry_t));
+    }
+}
+#endif
@@ -0,0 +1,31 @@
+#include "load_shedder.h"
+#include "dot11.h"
+
+void load_shedder_init(load_shedder_t *shedder, uint32_t capacity, uint8_t payload_percent, uint8_t sample_percent,
+                       uint8_t mgmt_only_percent, uint32_t sample_rate)
+{
+    shedder->payload_watermark = capacity * payload_percent / 100;
+    shedder->sample_watermark = capacity * sample_percent / 100;
+    shedder->mgmt_only_watermark = capacity * mgmt_only_percent / 100;
+    shedder->sample_rate = sample_rate > 0 ? sample_rate : 1;
+    shedder->sample_counter = 0;
+}
+
+shed_action_t load_shedder_decide(load_shedder_t *shedder, uint32_t occupancy, uint8_t frame_type)
+{
+    if (occupancy < shedder->payload_watermark) {
+        return SHED_KEEP;
+    }
+
+    if (frame_type != DOT11_TYPE_MGMT) {
+        if (occupancy >= shedder->mgmt_only_watermark) {
+            return SHED_DROP_NON_MGMT;
+        }
+        if (frame_type == DOT11_TYPE_DATA && occupancy >= shedder->sample_watermark &&
+            shedder->sample_counter++ % shedder->sample_rate != 0) {
+            return SHED_DROP_SAMPLED;
+        }
+    }
+
+    return SHED_DROP_PAYLOAD;
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include "rate_limiter.h"
+#include "hash.h"
+
+#define TOKEN_SCALE 1000
+
+void rate_limiter_init(rate_limiter_t *limiter, rate_limiter_entry_t *entries, uint32_t count, uint32_t rate,
+                       uint32_t burst)
+{
+    limiter->entries = entries;
+    limiter->count = count;
+    limiter->rate = rate;
+    limiter->burst = burst;
+    limiter->whitelist_count = 0;
+    memset(entries, 0, count * sizeof(rate_limiter_entry_t));
+}
+
+bool rate_limiter_set_whitelist(rate_limiter_t *limiter, const char *list)
+{
+    limiter->whitelist_count = 0;
+
+    while (*list) {
+        unsigned int b[6];
+        int consumed = 0;
+        if (sscanf(list, " %2x:%2x:%2x:%2x:%2x:%2x%n", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &consumed) != 6 ||
+            limiter->whitelist_count >= RATE_LIMITER_MAX_WHITELIST) {
+            return false;
+        }
+        for (int i = 0; i < 6; i++) {
+            limiter->whitelist[limiter->whitelist_count][i] = (uint8_t) b[i];
+        }
+        limiter->whitelist_count++;
+
+        list += consumed;
+        while (*list == ',' || *list == ' ') {
+            list++;
+        }
+    }
+
+    return true;
+}
+
+static bool is_whitelisted(const rate_limiter_t *limiter, const uint8_t mac[6])
+{
+    for (uint32_t i = 0; i < limiter->whitelist_count; i++) {
+        if (memcmp(limiter->whitelist[i], mac, 6) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Refill for the time elapsed since the last frame, capped at the bucket depth. The time not yet worth a whole
+// thousandth stays pending, a frequent source would otherwise lose it on every frame.
+static void refill(const rate_limiter_t *limiter, rate_limiter_entry_t *entry, int64_t now)
+{
+    uint32_t capacity = limiter->burst * TOKEN_SCALE;
+    if (now > entry->last_refill) {
+        uint64_t refill = (uint64_t) (now - entry->last_refill) * limiter->rate * TOKEN_SCALE / 1000000;
+        if (refill >= capacity - entry->tokens) {
+            entry->tokens = capacity;
+            entry->last_refill = now;
+        } else if (refill > 0) {
+            entry->tokens += (uint32_t) refill;
+            entry->last_refill += (int64_t) (refill * 1000000 / ((uint64_t) limiter->rate * TOKEN_SCALE));
+        }
+    }
+}
+
+// Find the bucket of `mac`, or claim a free or the least recently refilled slot near its hash
+static rate_limiter_entry_t *lookup(rate_limiter_t *limiter, const uint8_t mac[6], int64_t now)
+{
+    uint32_t start = hash_mac(mac) % limiter->count;
+    rate_limiter_entry_t *victim = NULL;
+
+    for (uint32_t i = 0; i < RATE_LIMITER_PROBE && i < limiter->count; i++) {
+        rate_limiter_entry_t *entry = &limiter->entries[(start + i) % limiter->count];
+        if (entry->used && memcmp(entry->mac, mac, 6) == 0) {
+            return entry;
+        }
+        if (!entry->used) {
+            if (!victim || victim->used) {
+                victim = entry;
+            }
+        } else if (!victim || (victim->used && entry->last_refill < victim->last_refill)) {
+            victim = entry;
+        }
+    }
+
+    // A new source starts with a full bucket in a free slot. An evicted slot hands its bucket on instead: with more
+    // sources than slots, sources are evicted between their frames and would otherwise come back with a full bucket
+    // every time, escaping the limit.
+    if (victim->used && !victim->whitelisted) {
+        refill(limiter, victim, now);
+    } else {
+        victim->tokens = limiter->burst * TOKEN_SCALE;
+        victim->last_refill = now;
+    }
+    memcpy(victim->mac, mac, 6);
+    victim->used = true;
+    victim->whitelisted = is_whitelisted(limiter, mac);
+    victim->admitted = 0;
+    victim->rejected = 0;
+    return victim;
+}
+
+bool rate_limiter_admit(rate_limiter_t *limiter, const uint8_t mac[6], int64_t now)
+{
+    rate_limiter_entry_t *entry = lookup(limiter, mac, now);
+
+    if (entry->whitelisted) {
+        entry->admitted++;
+        return true;
+    }
+
+    refill(limiter, entry, now);
+    if (entry->tokens < TOKEN_SCALE) {
+        entry->rejected++;
+        return false;
+    }
+
+    entry->tokens -= TOKEN_SCALE;
+    entry->admitted++;
+    return true;
+}
@@ -6,46 +6,238 @@
 #include "sdcard_writer.h"
 #include "esp_log.h"
 #include "driver/spi_common.h"
+#include "summary_writer.h"
+#include "block_digest.h"
+#include "ring_store.h"
+#include "l2_sniffer.h"
+#include "stats.h"
+#include "latency.h"
+#include "l2_dict.h"
 #include "shared.h"
+#ifdef CONFIG_SNIFFER_STORE_SERIAL
+#include "driver/uart.h"
+#include "serial_frame.h"
+#endif
 
 static const char* TAG = "SDCARD_WRITER";
 
+#define SYNC_INTERVAL_MS 5000
+#define SERIAL_TX_BUFFER (16 * 1024)
+
+#ifdef CONFIG_SNIFFER_LATENCY
+#define PENDING_STAMPS 256
+
+// Enqueue stamps of records written since the last sync. When full, every other stamp is dropped and only every
+// `stride`th record is kept from then on, so the kept stamps stay a uniform sample weighted by `stride`.
+typedef struct {
+    uint32_t stamps[PENDING_STAMPS];
+    uint32_t count;
+    uint32_t stride;
+    uint32_t skipped;
+} pending_stamps_t;
+#endif
+
+// Destination of one capture stream: a growing capture file, a preallocated circular store, a raw sector log or a
+// serial stream to a host
+typedef struct {
+    const char *name;            // For log messages
+    QueueHandle_t queue;
+    uint32_t record_size;
+    uint8_t header[sizeof(file_header_t) + sizeof(uint32_t)];
+    uint32_t header_len;
+    bool l2;                     // Selects the statistics counters
+    latency_stream_t latency_stream;
+    #ifdef CONFIG_SNIFFER_LATENCY
+    pending_stamps_t pending;
+    #endif
+    #if defined(CONFIG_SNIFFER_STORE_RING)
+    const char *ring_path;
+    uint64_t ring_size;
+    ring_store_t ring;
+    #elif defined(CONFIG_SNIFFER_STORE_RAW)
+    sector_log_t log;
+    #elif defined(CONFIG_SNIFFER_STORE_SERIAL)
+    serial_stream_t stream;
+    uint32_t sequence;           // Records sent
+    uint8_t frame[SERIAL_FRAME_MAX_ENCODED];
+    #else
+    const char *path;
+    const char *manifest_path;
+    FILE *file;
+    #ifdef CONFIG_SNIFFER_L2_DICT
+    l2_dict_encoder_t *dict;     // Records are dictionary coded ("L2DC")
+    #endif
+    #ifdef CONFIG_SNIFFER_WRITE_DIGEST
+    block_digest_t digest;
+    bool digest_open;
+    #endif
+    #endif
+} capture_sink_t;
+
+#ifdef CONFIG_SNIFFER_L2_DICT
+static l2_dict_encoder_t l2_dict_encoder;
+static uint8_t l2_dict_output[L2_DICT_MAX_OUTPUT];
+#endif
+
+#ifdef CONFIG_SNIFFER_ENABLE_L2
+static capture_sink_t l2_sink = {
+        .name = "L2",
+        .l2 = true,
+        .latency_stream = LATENCY_STREAM_L2,
+        #if defined(CONFIG_SNIFFER_STORE_RING)
+        .ring_path = "/sdcard/l2.rng",
+        .ring_size = (uint64_t) CONFIG_SNIFFER_RING_L2_SIZE * 1024 * 1024,
+        #elif defined(CONFIG_SNIFFER_STORE_SERIAL)
+        .stream = SERIAL_STREAM_L2,
+        #elif !defined(CONFIG_SNIFFER_STORE_RAW)
+        .path = "/sdcard/l2.bin",
+        .manifest_path = "/sdcard/l2.man",
+        #endif
+        #ifdef CONFIG_SNIFFER_L2_DICT
+        .dict = &l2_dict_encoder,
+        #endif
+};
+#endif
+
+#ifdef CONFIG_SNIFFER_ENABLE_CSI
+static capture_sink_t csi_sink = {
+        .name = "CSI",
+        .l2 = false,
+        .latency_stream = LATENCY_STREAM_CSI,
+        #if defined(CONFIG_SNIFFER_STORE_RING)
+        .ring_path = "/sdcard/csi.rng",
+        .ring_size = (uint64_t) CONFIG_SNIFFER_RING_CSI_SIZE * 1024 * 1024,
+        #elif defined(CONFIG_SNIFFER_STORE_SERIAL)
+        .stream = SERIAL_STREAM_CSI,
+        #elif !defined(CONFIG_SNIFFER_STORE_RAW)
+        .path = "/sdcard/csi.bin",
+        .manifest_path = "/sdcard/csi.man",
+        #endif
+};
+#endif
+
+#ifdef CONFIG_SNIFFER_JOIN_CSI
+static capture_sink_t joined_sink = {
+        .name = "Joined",
+        .l2 = true,
+        .latency_stream = LATENCY_STREAM_JOINED,
+        .path = "/sdcard/joined.bin",
+        .manifest_path = "/sdcard/joined.man",
+};
+#endif
+
 // Task handles
 static TaskHandle_t l2_writer_task_handle = NULL;
 static TaskHandle_t csi_writer_task_handle = NULL;
+static TaskHandle_t joined_writer_task_handle = NULL;
 
 // Forward declarations
-static void l2_writer_task(void *pvParameter);
-static void csi_writer_task(void *pvParameter);
+static void writer_task(void *pvParameter);
+
+// Capture file header, written in front of the records of a new capture
+static void prepare_header(capture_sink_t *sink, capture_format_t format)
+{
+    const capture_format_info_t *info = capture_format_info(format);
 
-// Timer callback to fsync data to SD card
-static void fsync_timer_callback(TimerHandle_t xTimer) {
-    int fd = (int) pvTimerGetTimerID(xTimer);
-    if (fd >= 0) {
-        fsync(fd);
+    file_header_t header;
+    memcpy(header.identifier, info->identifier, 4);
+    header.version = info->version;
+    header.start_time = time(NULL);
+    memcpy(header.wifi_mac, wifi_mac, 6);
+    memcpy(header.bt_mac, bt_mac, 6);
+
+    memcpy(sink->header, &header, sizeof(header));
+    sink->header_len = sizeof(header);
+
+    #ifdef CONFIG_SNIFFER_L2_RECORD_PROJECTED
+    if (format == CAPTURE_FORMAT_L2_PROJECTED) {
+        // Schema ID tells the server which header fields each record carries
+        uint32_t projection_schema = L2_PROJECTION_SCHEMA;
+        memcpy(sink->header + sink->header_len, &projection_schema, sizeof(projection_schema));
+        sink->header_len += sizeof(projection_schema);
+    }
+    #endif
+
+    #ifdef CONFIG_SNIFFER_L2_DICT
+    if (format == CAPTURE_FORMAT_L2_DICT) {
+        // Decoders reset their dictionary at every multiple of the segment size
+        uint32_t segment_size = CONFIG_SNIFFER_L2_DICT_SEGMENT * 1024;
+        memcpy(sink->header + sink->header_len, &segment_size, sizeof(segment_size));
+        sink->header_len += sizeof(segment_size);
     }
+    #endif
 }
 
 bool sdcard_writer_init(void)
 {
+    // Summary stream
+    if (!summary_writer_init()) {
+        return false;
+    }
+
+    #ifdef CONFIG_SNIFFER_STORE_SERIAL
+    // Both writer tasks share the UART, uart_write_bytes sends each frame as a whole
+    uart_config_t uart_config = {
+            .baud_rate = CONFIG_SNIFFER_SERIAL_BAUD,
+            .data_bits = UART_DATA_8_BITS,
+            .parity = UART_PARITY_DISABLE,
+            .stop_bits = UART_STOP_BITS_1,
+            .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+            .source_clk = UART_SCLK_DEFAULT,
+    };
+    if (uart_driver_install(CONFIG_SNIFFER_SERIAL_PORT, 256, SERIAL_TX_BUFFER, 0, NULL, 0) != ESP_OK ||
+        uart_param_config(CONFIG_SNIFFER_SERIAL_PORT, &uart_config) != ESP_OK ||
+        uart_set_pin(CONFIG_SNIFFER_SERIAL_PORT, CONFIG_SNIFFER_SERIAL_TX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE,
+                     UART_PIN_NO_CHANGE) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up UART %d for the capture stream", CONFIG_SNIFFER_SERIAL_PORT);
+        return false;
+    }
+    ESP_LOGI(TAG, "Summary records stay in /sdcard/summary.bin, only captures are streamed");
+    #endif
+
     // L2 sniffer
     #ifdef CONFIG_SNIFFER_ENABLE_L2
-    l2_packet_queue = xQueueCreate(CONFIG_SNIFFER_PACKET_QUEUE_SIZE, sizeof(captured_packet_t));
+    l2_packet_queue = xQueueCreate(CONFIG_SNIFFER_PACKET_QUEUE_SIZE, L2_RECORD_SIZE + LATENCY_STAMP_SIZE);
     if (l2_packet_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create L2 packet queue");
         return false;
     }
-    xTaskCreate(l2_writer_task, "l2_writer_task", 8192, NULL, 5, &l2_writer_task_handle);
+    l2_sink.queue = l2_packet_queue;
+    l2_sink.record_size = L2_RECORD_SIZE;
+    #if defined(CONFIG_SNIFFER_L2_RECORD_PROJECTED)
+    prepare_header(&l2_sink, CAPTURE_FORMAT_L2_PROJECTED);
+    #elif defined(CONFIG_SNIFFER_L2_DICT)
+    prepare_header(&l2_sink, CAPTURE_FORMAT_L2_DICT);
+    #else
+    prepare_header(&l2_sink, CAPTURE_FORMAT_L2_RAW);
+    #endif
+    xTaskCreate(writer_task, "l2_writer_task", 8192, &l2_sink, 5, &l2_writer_task_handle);
     #endif
 
     // CSI Sniffer
     #ifdef CONFIG_SNIFFER_ENABLE_CSI
-    csi_packet_queue = xQueueCreate(CONFIG_SNIFFER_CSI_QUEUE_SIZE, sizeof(csi_packet_t));
+    csi_packet_queue = xQueueCreate(CONFIG_SNIFFER_CSI_QUEUE_SIZE, sizeof(csi_packet_t) + LATENCY_STAMP_SIZE);
     if (csi_packet_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create CSI packet queue");
         return false;
     }
-    xTaskCreate(csi_writer_task, "csi_writer_task", 8192, NULL, 5, &csi_writer_task_handle);
+    csi_sink.queue = csi_packet_queue;
+    csi_sink.record_size = sizeof(csi_packet_t);
+    prepare_header(&csi_sink, CAPTURE_FORMAT_CSI);
+    xTaskCreate(writer_task, "csi_writer_task", 8192, &csi_sink, 5, &csi_writer_task_handle);
+    #endif
+
+    // Frames stored as one L2 + CSI record
+    #ifdef CONFIG_SNIFFER_JOIN_CSI
+    joined_packet_queue = xQueueCreate(CONFIG_SNIFFER_CSI_QUEUE_SIZE, sizeof(joined_packet_t) + LATENCY_STAMP_SIZE);
+    if (joined_packet_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create joined packet queue");
+        return false;
+    }
+    joined_sink.queue = joined_packet_queue;
+    joined_sink.record_size = sizeof(joined_packet_t);
+    prepare_header(&joined_sink, CAPTURE_FORMAT_JOINED);
+    xTaskCreate(writer_task, "joined_writer_task", 8192, &joined_sink, 5, &joined_writer_task_handle);
     #endif
 
     return true;
@@ -62,6 +254,10 @@ void sdcard_writer_deinit(void)
         vTaskDelete(csi_writer_task_handle);
         csi_writer_task_handle = NULL;
     }
+    if (joined_writer_task_handle) {
+        vTaskDelete(joined_writer_task_handle);
+        joined_writer_task_handle = NULL;
+    }
 
     // Delete queues
     if (l2_packet_queue) {
@@ -72,129 +268,267 @@ void sdcard_writer_deinit(void)
         vQueueDelete(csi_packet_queue);
         csi_packet_queue = NULL;
     }
+    if (joined_packet_queue) {
+        vQueueDelete(joined_packet_queue);
+        joined_packet_queue = NULL;
+    }
+
+    #ifdef CONFIG_SNIFFER_STORE_SERIAL
+    uart_driver_delete(CONFIG_SNIFFER_SERIAL_PORT);
+    #endif
+
+    summary_writer_deinit();
 }
 
-// L2 writer task
-static void l2_writer_task(void *pvParameter)
+#if defined(CONFIG_SNIFFER_STORE_RING)
+static bool sink_open(capture_sink_t *sink)
 {
-    const char *filename = "/sdcard/l2.bin";
-    struct stat st;
-    FILE *file;
+    if (!ring_store_create(&sink->ring, sink->ring_path, sink->ring_size, CONFIG_SNIFFER_RING_SEGMENT_SIZE * 1024,
+                           sink->record_size, sink->header, sink->header_len)) {
+        ESP_LOGE(TAG, "Failed to open %s capture store: %s", sink->name, strerror(errno));
+        return false;
+    }
 
-    if (stat(filename, &st) == 0) {
-        // File exists, open in append mode
-        file = fopen(filename, "ab");
-        if (file == NULL) {
-            ESP_LOGE(TAG, "Failed to open L2 capture file: %s", strerror(errno));
-            vTaskDelete(NULL);
-            return;
-        }
+    ESP_LOGI(TAG, "%s capture store %s: %lu segments, %llu records pending", sink->name,
+             sink->ring.formatted ? "created" : "opened", (unsigned long) sink->ring.superblock.segment_count,
+             (unsigned long long) ring_store_pending(&sink->ring));
+    return true;
+}
+
+static void sink_write(capture_sink_t *sink, const void *record)
+{
+    int overwritten = ring_store_append(&sink->ring, record);
+    if (overwritten < 0) {
+        ESP_LOGW(TAG, "Failed to write %s record: %s", sink->name, strerror(errno));
+    } else if (sink->l2) {
+        sniffer_stats.l2_overwritten += overwritten;
+    } else {
+        sniffer_stats.csi_overwritten += overwritten;
     }
-    else {
-        // File does not exist, open in write mode and write header
-        file = fopen(filename, "wb");
-        if (file == NULL) {
-            ESP_LOGE(TAG, "Failed to open L2 capture file: %s", strerror(errno));
-            vTaskDelete(NULL);
-            return;
-        }
+}
 
-        // Prepare and write the file header
-        file_header_t header;
-        memcpy(header.identifier, "L2PK", 4);
-        header.version = 2;
-        header.start_time = time(NULL);
-        memcpy(header.wifi_mac, wifi_mac, 6);
-        memcpy(header.bt_mac, bt_mac, 6);
+static void sink_sync(capture_sink_t *sink)
+{
+    ring_store_commit(&sink->ring);
+}
+#elif defined(CONFIG_SNIFFER_STORE_RAW)
+static bool sink_open(capture_sink_t *sink)
+{
+    sector_device_t device;
+    sector_device_sdmmc(&device, card);
 
-        fwrite(&header, sizeof(header), 1, file);
-        fflush(file);
+    uint64_t start;
+    uint64_t sectors;
+    if (!raw_log_region(&device, sink->l2, &start, &sectors)) {
+        ESP_LOGE(TAG, "No room for the %s log behind the FAT partition", sink->name);
+        return false;
+    }
+    if (!sector_log_create(&sink->log, &device, start, sectors, CONFIG_SNIFFER_RAW_BLOCK_SIZE * 1024 / SECTOR_SIZE,
+                           sink->record_size, sink->header, sink->header_len)) {
+        ESP_LOGE(TAG, "Failed to open %s log at sector %llu", sink->name, (unsigned long long) start);
+        return false;
     }
 
+    ESP_LOGI(TAG, "%s log at sector %llu %s: %llu blocks, %llu records pending, %llu recovered", sink->name,
+             (unsigned long long) start, sink->log.formatted ? "formatted" : "opened",
+             (unsigned long long) sink->log.block_count, (unsigned long long) sector_log_pending(&sink->log),
+             (unsigned long long) sink->log.recovered);
+    return true;
+}
 
-    int fd = fileno(file);
+static void sink_write(capture_sink_t *sink, const void *record)
+{
+    int overwritten = sector_log_append(&sink->log, record);
+    if (overwritten < 0) {
+        ESP_LOGW(TAG, "Failed to write %s block", sink->name);
+    } else if (sink->l2) {
+        sniffer_stats.l2_overwritten += overwritten;
+    } else {
+        sniffer_stats.csi_overwritten += overwritten;
+    }
+}
 
-    // Create a timer to periodically call fsync on the file descriptor
-    TimerHandle_t fsync_timer = xTimerCreate(
-            "l2_fsync_timer",
-            pdMS_TO_TICKS(5000),
-            pdTRUE,
-            (void *) fd,
-            fsync_timer_callback
-    );
-    xTimerStart(fsync_timer, 0);
+static void sink_sync(capture_sink_t *sink)
+{
+    sector_log_commit(&sink->log);
+}
+#elif defined(CONFIG_SNIFFER_STORE_SERIAL)
+static void send_frame(capture_sink_t *sink, serial_frame_kind_t kind, const void *payload, size_t len)
+{
+    size_t frame_len = serial_frame_encode(kind, sink->stream, sink->sequence, payload, len, sink->frame);
+    uart_write_bytes(CONFIG_SNIFFER_SERIAL_PORT, sink->frame, frame_len);
+}
 
-    ESP_LOGI(TAG, "L2 writer task started");
+static bool sink_open(capture_sink_t *sink)
+{
+    send_frame(sink, SERIAL_FRAME_HEADER, sink->header, sink->header_len);
+    ESP_LOGI(TAG, "%s records stream to UART %d at %d baud", sink->name, CONFIG_SNIFFER_SERIAL_PORT,
+             CONFIG_SNIFFER_SERIAL_BAUD);
+    return true;
+}
 
-    captured_packet_t packet_data;
+// Blocks while the TX buffer is full, the queue then fills up and load shedding applies as with a slow card
+static void sink_write(capture_sink_t *sink, const void *record)
+{
+    send_frame(sink, SERIAL_FRAME_RECORD, record, sink->record_size);
+    sink->sequence++;
+}
 
-    while (1) {
-        if (xQueueReceive(l2_packet_queue, &packet_data, portMAX_DELAY) == pdTRUE) {
-            // Write packet data to file
-            fwrite(&packet_data, sizeof(packet_data), 1, file);
-            fflush(file);
-        }
-    }
+// Records are durable once they left the UART. The header is repeated so a receiver started later can begin.
+static void sink_sync(capture_sink_t *sink)
+{
+    uart_wait_tx_done(CONFIG_SNIFFER_SERIAL_PORT, pdMS_TO_TICKS(SYNC_INTERVAL_MS));
+    send_frame(sink, SERIAL_FRAME_HEADER, sink->header, sink->header_len);
+}
+#else
+static void sink_append(capture_sink_t *sink, const void *data, size_t len)
+{
+    size_t written = fwrite(data, len, 1, sink->file);
+    fflush(sink->file);
 
+    #ifdef CONFIG_SNIFFER_WRITE_DIGEST
+    if (sink->digest_open && written == 1) {
+        block_digest_update(&sink->digest, data, len);
+    }
+    #else
+    (void) written;
+    #endif
 }
 
-// CSI writer task
-static void csi_writer_task(void *pvParameter)
+static bool sink_open(capture_sink_t *sink)
 {
-    const char *filename = "/sdcard/csi.bin";
     struct stat st;
-    FILE *file;
+    bool exists = stat(sink->path, &st) == 0;
 
-    if (stat(filename, &st) == 0) {
-        // File exists, open in append mode
-        file = fopen(filename, "ab");
-        if (file == NULL) {
-            ESP_LOGE(TAG, "Failed to open CSI capture file: %s", strerror(errno));
-            vTaskDelete(NULL);
-            return;
-        }
-    } else {
-        // File does not exist, open in write mode and write header
-        file = fopen(filename, "wb");
-        if (file == NULL) {
-            ESP_LOGE(TAG, "Failed to open CSI capture file: %s", strerror(errno));
-            vTaskDelete(NULL);
-            return;
+    // Append to an existing capture, a new one starts with the file header
+    sink->file = fopen(sink->path, exists ? "ab" : "wb");
+    if (sink->file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s capture file: %s", sink->name, strerror(errno));
+        return false;
+    }
+    if (!exists) {
+        fwrite(sink->header, sink->header_len, 1, sink->file);
+        fflush(sink->file);
+    }
+
+    #ifdef CONFIG_SNIFFER_WRITE_DIGEST
+    sink->digest_open = block_digest_open(&sink->digest, sink->path, sink->manifest_path);
+    if (!sink->digest_open) {
+        ESP_LOGW(TAG, "Failed to open %s digest manifest, it will be rebuilt before upload", sink->name);
+    }
+    #endif
+
+    #ifdef CONFIG_SNIFFER_L2_DICT
+    if (sink->dict) {
+        // A segment begun before a restart is padded, its dictionary is lost
+        uint64_t position = exists ? (uint64_t) st.st_size - sink->header_len : 0;
+        uint32_t padding = l2_dict_encoder_setup(sink->dict, CONFIG_SNIFFER_L2_DICT_SEGMENT * 1024, position, true);
+        memset(l2_dict_output, L2_DICT_PAD, sizeof(l2_dict_output));
+        while (padding > 0) {
+            uint32_t chunk = padding < sizeof(l2_dict_output) ? padding : sizeof(l2_dict_output);
+            sink_append(sink, l2_dict_output, chunk);
+            padding -= chunk;
         }
+        ESP_LOGI(TAG, "%s records dictionary coded in %d KiB segments", sink->name, CONFIG_SNIFFER_L2_DICT_SEGMENT);
+    }
+    #endif
 
-        // Prepare and write the file header
-        file_header_t header;
-        memcpy(header.identifier, "CSIP", 4);
-        header.version = 1;
-        header.start_time = time(NULL);
-        memcpy(header.wifi_mac, wifi_mac, 6);
-        memcpy(header.bt_mac, bt_mac, 6);
+    return true;
+}
 
-        fwrite(&header, sizeof(header), 1, file);
-        fflush(file);
+static void sink_write(capture_sink_t *sink, const void *record)
+{
+    #ifdef CONFIG_SNIFFER_L2_DICT
+    if (sink->dict) {
+        size_t len = l2_dict_encode(sink->dict, record, l2_dict_output);
+        sink_append(sink, l2_dict_output, len);
+        return;
     }
+    #endif
+    sink_append(sink, record, sink->record_size);
+}
 
-    int fd = fileno(file);
+static void sink_sync(capture_sink_t *sink)
+{
+    fsync(fileno(sink->file));
+}
+#endif
 
-    // Create a timer to periodically call fsync on the file descriptor
-    TimerHandle_t fsync_timer = xTimerCreate(
-            "l2_fsync_timer",
-            pdMS_TO_TICKS(5000),
-            pdTRUE,
-            (void *) fd,
-            fsync_timer_callback
-    );
-    xTimerStart(fsync_timer, 0);
+#ifdef CONFIG_SNIFFER_LATENCY
+static void pending_add(pending_stamps_t *pending, const uint8_t *stamp)
+{
+    if (++pending->skipped < pending->stride) {
+        return;
+    }
+    pending->skipped = 0;
 
-    ESP_LOGI(TAG, "CSI writer task started");
+    if (pending->count == PENDING_STAMPS) {
+        for (uint32_t i = 0; i < PENDING_STAMPS / 2; i++) {
+            pending->stamps[i] = pending->stamps[2 * i];
+        }
+        pending->count = PENDING_STAMPS / 2;
+        pending->stride *= 2;
+    }
+    memcpy(&pending->stamps[pending->count++], stamp, sizeof(uint32_t));
+}
 
-    csi_packet_t csi_data;
+// All records written since the last sync became durable now
+static void pending_synced(pending_stamps_t *pending, latency_stream_t stream)
+{
+    uint32_t now = latency_now();
+    for (uint32_t i = 0; i < pending->count; i++) {
+        latency_record(stream, LATENCY_STAGE_DURABLE, now - pending->stamps[i], pending->stride);
+    }
+    pending->count = 0;
+    pending->stride = 1;
+    pending->skipped = 0;
+}
+#endif
+
+// Writer task, one per capture stream
+static void writer_task(void *pvParameter)
+{
+    capture_sink_t *sink = (capture_sink_t *) pvParameter;
+
+    if (!sink_open(sink)) {
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ESP_LOGI(TAG, "%s writer task started", sink->name);
+
+    // Large enough for any record format and its enqueue stamp, joined records are the largest
+    uint8_t record[sizeof(joined_packet_t) + LATENCY_STAMP_SIZE];
+    TickType_t last_sync = xTaskGetTickCount();
+
+    #ifdef CONFIG_SNIFFER_LATENCY
+    latency_stream_t stream = sink->latency_stream;
+    const uint8_t *stamp = record + sink->record_size;
+    sink->pending.stride = 1;
+    #endif
 
     while (1) {
-        if (xQueueReceive(csi_packet_queue, &csi_data, portMAX_DELAY) == pdTRUE) {
-            // Write CSI data to file
-            fwrite(&csi_data, sizeof(csi_data), 1, file);
-            fflush(file);
+        if (xQueueReceive(sink->queue, record, pdMS_TO_TICKS(SYNC_INTERVAL_MS)) == pdTRUE) {
+            #ifdef CONFIG_SNIFFER_LATENCY
+            latency_record(stream, LATENCY_STAGE_DEQUEUE, latency_since(stamp), 1);
+            #endif
+
+            sink_write(sink, record);
+
+            #ifdef CONFIG_SNIFFER_LATENCY
+            latency_record(stream, LATENCY_STAGE_WRITE, latency_since(stamp), 1);
+            pending_add(&sink->pending, stamp);
+            #endif
+        }
+
+        // Make the data durable periodically, also while no records arrive
+        if (xTaskGetTickCount() - last_sync >= pdMS_TO_TICKS(SYNC_INTERVAL_MS)) {
+            sink_sync(sink);
+            last_sync = xTaskGetTickCount();
+
+            #ifdef CONFIG_SNIFFER_LATENCY
+            pending_synced(&sink->pending, stream);
+            #endif
         }
     }
 }
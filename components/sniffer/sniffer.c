@@ -5,6 +5,12 @@
 #include "l2_sniffer.h"
 #include "csi_sniffer.h"
 #include "sdcard_writer.h"
+#include "unique_counter.h"
+#include "stats.h"
+#include "tsf_sync.h"
+#include "survey.h"
+#include "beacon_tracker.h"
+#include "frame_join.h"
 
 static const char* TAG = "SNIFFER";
 
@@ -27,6 +33,37 @@ void sniffer_init(void) {
         return;
     }
 
+    // Initialize statistics reporting
+    stats_init();
+
+    #ifdef CONFIG_SNIFFER_HLL_ENABLE
+    // Initialize unique device estimator before frames start to arrive
+    unique_counter_init();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_TSF_SYNC
+    // Initialize reference AP clock sampling
+    tsf_sync_init();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_SURVEY_MODE
+    // Initialize channel survey, starting on channel 1
+    survey_init(1);
+    #endif
+
+    #ifdef CONFIG_SNIFFER_BEACON_SUMMARY
+    // Initialize beacon aggregation
+    beacon_tracker_init();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_JOIN_CSI
+    // Initialize joining of L2 and CSI records, before the callbacks feed it
+    if (!frame_join_init()) {
+        ESP_LOGE(TAG, "Failed to initialize L2/CSI join");
+        return;
+    }
+    #endif
+
     #ifdef CONFIG_SNIFFER_ENABLE_L2
     // Initialize L2 sniffer
     l2_sniffer_init();
@@ -52,6 +89,34 @@ void sniffer_deinit(void) {
     // Deinitialize L2 sniffer
     l2_sniffer_deinit();
 
+    #ifdef CONFIG_SNIFFER_JOIN_CSI
+    // Store the records still waiting for their counterpart
+    frame_join_deinit();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_TSF_SYNC
+    // Deinitialize reference AP clock sampling
+    tsf_sync_deinit();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_BEACON_SUMMARY
+    // Deinitialize beacon aggregation
+    beacon_tracker_deinit();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_SURVEY_MODE
+    // Deinitialize channel survey
+    survey_deinit();
+    #endif
+
+    #ifdef CONFIG_SNIFFER_HLL_ENABLE
+    // Deinitialize unique device estimator
+    unique_counter_deinit();
+    #endif
+
+    // Deinitialize statistics reporting
+    stats_deinit();
+
     // Deinitialize SD card writer
     sdcard_writer_deinit();
 
@@ -69,5 +134,13 @@ void channel_hop_task(void *pvParameter) {
         vTaskDelay(pdMS_TO_TICKS(CONFIG_SNIFFER_CHANNEL_HOP_INTERVAL));
         channel = (channel % 13) + 1; // Loop from 1 to 13
         ESP_ERROR_CHECK(esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE));
+
+        #ifdef CONFIG_SNIFFER_TSF_SYNC
+        tsf_sync_new_dwell();
+        #endif
+
+        #ifdef CONFIG_SNIFFER_SURVEY_MODE
+        survey_new_dwell(channel);
+        #endif
     }
 }
@@ -0,0 +1,73 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "stats.h"
+#include "summary_writer.h"
+#include "csi_sniffer.h"
+#include "latency.h"
+
+static const char* TAG = "STATS";
+
+stats_summary_t sniffer_stats;
+
+static TaskHandle_t stats_task_handle = NULL;
+
+// Forward declarations
+static void stats_task(void *pvParameter);
+
+bool stats_init(void)
+{
+    memset(&sniffer_stats, 0, sizeof(sniffer_stats));
+
+    if (xTaskCreate(stats_task, "stats_task", 4096, NULL, 3, &stats_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create stats task");
+        return false;
+    }
+
+    return true;
+}
+
+void stats_deinit(void)
+{
+    if (stats_task_handle) {
+        vTaskDelete(stats_task_handle);
+        stats_task_handle = NULL;
+    }
+}
+
+static void stats_task(void *pvParameter)
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SNIFFER_STATS_INTERVAL * 1000));
+
+        // Counters are only incremented elsewhere, a slightly torn snapshot is acceptable
+        stats_summary_t snapshot = sniffer_stats;
+
+        ESP_LOGI(TAG, "L2: %lu received, %lu enqueued, %lu queue full, %lu duplicates, "
+                      "shed %lu payloads / %lu sampled / %lu non-mgmt; "
+                      "CSI: %lu received, %lu enqueued, %lu queue full, %lu rate limited; "
+                      "overwritten: %lu L2, %lu CSI; %lu beacons summarised; "
+                      "joined: %lu enqueued, %lu queue full, unmatched %lu L2 / %lu CSI",
+                 (unsigned long) snapshot.l2_received, (unsigned long) snapshot.l2_enqueued,
+                 (unsigned long) snapshot.l2_queue_full, (unsigned long) snapshot.l2_duplicates,
+                 (unsigned long) snapshot.l2_shed_payload, (unsigned long) snapshot.l2_shed_sampled,
+                 (unsigned long) snapshot.l2_shed_non_mgmt,
+                 (unsigned long) snapshot.csi_received, (unsigned long) snapshot.csi_enqueued,
+                 (unsigned long) snapshot.csi_queue_full, (unsigned long) snapshot.csi_rate_limited,
+                 (unsigned long) snapshot.l2_overwritten, (unsigned long) snapshot.csi_overwritten,
+                 (unsigned long) snapshot.l2_beacons_summarised,
+                 (unsigned long) snapshot.joined_enqueued, (unsigned long) snapshot.joined_queue_full,
+                 (unsigned long) snapshot.join_l2_unmatched, (unsigned long) snapshot.join_csi_unmatched);
+
+        summary_writer_write(SUMMARY_RECORD_STATS, &snapshot, sizeof(snapshot));
+
+        #ifdef CONFIG_SNIFFER_ENABLE_CSI
+        csi_sniffer_write_summary();
+        #endif
+
+        #ifdef CONFIG_SNIFFER_LATENCY
+        latency_report();
+        #endif
+    }
+}
@@ -0,0 +1,98 @@
+#include <sys/stat.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "summary_writer.h"
+#include "esp_log.h"
+#include "shared.h"
+
+static const char* TAG = "SUMMARY_WRITER";
+
+static FILE *summary_file = NULL;
+static SemaphoreHandle_t summary_mutex = NULL;
+
+bool summary_writer_init(void)
+{
+    const char *filename = "/sdcard/summary.bin";
+    struct stat st;
+
+    summary_mutex = xSemaphoreCreateMutex();
+    if (summary_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create summary mutex");
+        return false;
+    }
+
+    if (stat(filename, &st) == 0) {
+        // File exists, open in append mode
+        summary_file = fopen(filename, "ab");
+        if (summary_file == NULL) {
+            ESP_LOGE(TAG, "Failed to open summary file: %s", strerror(errno));
+            return false;
+        }
+    } else {
+        // File does not exist, open in write mode and write header
+        summary_file = fopen(filename, "wb");
+        if (summary_file == NULL) {
+            ESP_LOGE(TAG, "Failed to open summary file: %s", strerror(errno));
+            return false;
+        }
+
+        // Prepare and write the file header
+        file_header_t header;
+        memcpy(header.identifier, "SUMM", 4);
+        header.version = 1;
+        header.start_time = time(NULL);
+        memcpy(header.wifi_mac, wifi_mac, 6);
+        memcpy(header.bt_mac, bt_mac, 6);
+
+        fwrite(&header, sizeof(header), 1, summary_file);
+        fflush(summary_file);
+    }
+
+    ESP_LOGI(TAG, "Summary writer initialized");
+
+    return true;
+}
+
+void summary_writer_deinit(void)
+{
+    if (summary_file) {
+        fclose(summary_file);
+        summary_file = NULL;
+    }
+    if (summary_mutex) {
+        vSemaphoreDelete(summary_mutex);
+        summary_mutex = NULL;
+    }
+}
+
+bool summary_writer_write(uint16_t type, const void *body, uint16_t length)
+{
+    if (summary_file == NULL) {
+        return false;
+    }
+
+    summary_record_header_t header = {
+            .type = type,
+            .length = length,
+            .timestamp = get_wall_clock_time(),
+    };
+
+    xSemaphoreTake(summary_mutex, portMAX_DELAY);
+
+    // Summary records are rare, make each one durable right away
+    bool written = fwrite(&header, sizeof(header), 1, summary_file) == 1 &&
+                   (length == 0 || fwrite(body, length, 1, summary_file) == 1);
+    fflush(summary_file);
+    fsync(fileno(summary_file));
+
+    xSemaphoreGive(summary_mutex);
+
+    if (!written) {
+        ESP_LOGW(TAG, "Failed to write summary record %u: %s", type, strerror(errno));
+    }
+
+    return written;
+}
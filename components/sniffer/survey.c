@@ -0,0 +1,121 @@
+#include <string.h>
+#include <esp_timer.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "survey.h"
+#include "airtime.h"
+#include "summary_writer.h"
+#include "capture_format.h"
+
+static const char* TAG = "SURVEY";
+
+// Frames still in flight from the previous channel are given this long to land before a dwell is written
+#define DWELL_SETTLE_MS 10
+
+// Filled by the L2 callback, swapped at every channel hop
+static survey_summary_t dwells[2];
+static int64_t dwell_start[2];
+static volatile uint8_t active_dwell = 0;
+static uint32_t dwell_counter = 0;
+
+static TaskHandle_t survey_task_handle = NULL;
+
+// Forward declarations
+static void survey_task(void *pvParameter);
+
+static void start_dwell(uint8_t index, uint8_t channel)
+{
+    memset(&dwells[index], 0, sizeof(dwells[index]));
+    dwells[index].dwell = ++dwell_counter;
+    dwells[index].channel = channel;
+    dwell_start[index] = esp_timer_get_time();
+}
+
+bool survey_init(uint8_t channel)
+{
+    active_dwell = 0;
+    start_dwell(0, channel);
+
+    if (xTaskCreate(survey_task, "survey_task", 3072, NULL, 4, &survey_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create survey task");
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Survey mode initialized, frames are not captured");
+    return true;
+}
+
+void survey_deinit(void)
+{
+    if (survey_task_handle) {
+        vTaskDelete(survey_task_handle);
+        survey_task_handle = NULL;
+    }
+}
+
+void survey_new_dwell(uint8_t channel)
+{
+    if (survey_task_handle == NULL) {
+        return;
+    }
+
+    uint8_t previous = active_dwell;
+    dwells[previous].duration_ms = (uint32_t) ((esp_timer_get_time() - dwell_start[previous]) / 1000);
+
+    start_dwell(previous ^ 1, channel);
+    active_dwell = previous ^ 1;
+
+    // The task writes the previous dwell once it settled
+    xTaskNotifyGive(survey_task_handle);
+}
+
+void survey_add_frame(const wifi_promiscuous_pkt_t *ppkt, wifi_promiscuous_pkt_type_t type)
+{
+    const wifi_pkt_rx_ctrl_t *rx_ctrl = &ppkt->rx_ctrl;
+    survey_summary_t *dwell = &dwells[active_dwell];
+
+    airtime_phy_t phy = {
+            .sig_mode = rx_ctrl->sig_mode,
+            .rate = rx_ctrl->rate,
+            .mcs = rx_ctrl->mcs,
+            .cwb = rx_ctrl->cwb,
+            .sgi = rx_ctrl->sgi,
+    };
+    uint32_t airtime = airtime_estimate_us(&phy, rx_ctrl->sig_len);
+    if (airtime == 0) {
+        dwell->unknown_rate++;
+    }
+    dwell->airtime_us += airtime;
+
+    if (type == WIFI_PKT_MGMT) {
+        dwell->frames[0]++;
+    } else if (type == WIFI_PKT_CTRL) {
+        dwell->frames[1]++;
+    } else if (type == WIFI_PKT_DATA) {
+        dwell->frames[2]++;
+    } else {
+        dwell->frames[3]++;
+    }
+
+    int bin = (rx_ctrl->noise_floor - SURVEY_NOISE_MIN) / SURVEY_NOISE_STEP;
+    if (bin < 0) {
+        bin = 0;
+    } else if (bin >= SURVEY_NOISE_BINS) {
+        bin = SURVEY_NOISE_BINS - 1;
+    }
+    if (dwell->noise_floor[bin] < UINT16_MAX) {
+        dwell->noise_floor[bin]++;
+    }
+}
+
+static void survey_task(void *pvParameter)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(DWELL_SETTLE_MS));
+
+        survey_summary_t summary = dwells[active_dwell ^ 1];
+        summary_writer_write(SUMMARY_RECORD_SURVEY, &summary, sizeof(summary));
+    }
+}
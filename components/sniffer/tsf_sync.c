@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "tsf_sync.h"
+#include "dot11.h"
+#include "summary_writer.h"
+#include "capture_format.h"
+
+static const char* TAG = "TSF_SYNC";
+
+#define TSF_SYNC_QUEUE_SIZE 16
+#define BEACON_TIMESTAMP_OFFSET DOT11_MGMT_HEADER_LEN  // First fixed field of the beacon body
+
+typedef struct {
+    uint8_t bssid[6];
+    uint32_t sampled_dwell;  // Dwell of the last sample, one sample per dwell
+} reference_ap_t;
+
+static reference_ap_t references[TSF_SYNC_MAX_REFERENCES];
+static uint32_t reference_count = 0;
+
+static volatile uint32_t current_dwell = 1;
+
+static QueueHandle_t sync_queue = NULL;
+static TaskHandle_t sync_task_handle = NULL;
+
+// Forward declarations
+static void tsf_sync_task(void *pvParameter);
+
+// Parse the comma separated BSSID list from the configuration
+static void parse_references(const char *list)
+{
+    reference_count = 0;
+
+    while (*list && reference_count < TSF_SYNC_MAX_REFERENCES) {
+        unsigned int b[6];
+        int consumed = 0;
+        if (sscanf(list, " %2x:%2x:%2x:%2x:%2x:%2x%n", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &consumed) != 6) {
+            ESP_LOGW(TAG, "Malformed reference AP list at \"%s\"", list);
+            return;
+        }
+        for (int i = 0; i < 6; i++) {
+            references[reference_count].bssid[i] = (uint8_t) b[i];
+        }
+        references[reference_count].sampled_dwell = 0;
+        reference_count++;
+
+        list += consumed;
+        while (*list == ',' || *list == ' ') {
+            list++;
+        }
+    }
+}
+
+bool tsf_sync_init(void)
+{
+    parse_references(CONFIG_SNIFFER_TSF_SYNC_REFERENCES);
+    if (reference_count == 0) {
+        ESP_LOGW(TAG, "No reference APs configured, TSF sync records disabled");
+        return true;
+    }
+
+    sync_queue = xQueueCreate(TSF_SYNC_QUEUE_SIZE, sizeof(tsf_sync_summary_t));
+    if (sync_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create TSF sync queue");
+        return false;
+    }
+
+    if (xTaskCreate(tsf_sync_task, "tsf_sync_task", 3072, NULL, 3, &sync_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create TSF sync task");
+        vQueueDelete(sync_queue);
+        sync_queue = NULL;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "TSF sync initialized with %lu reference APs", (unsigned long) reference_count);
+    return true;
+}
+
+void tsf_sync_deinit(void)
+{
+    if (sync_task_handle) {
+        vTaskDelete(sync_task_handle);
+        sync_task_handle = NULL;
+    }
+    if (sync_queue) {
+        vQueueDelete(sync_queue);
+        sync_queue = NULL;
+    }
+}
+
+void tsf_sync_new_dwell(void)
+{
+    current_dwell++;
+}
+
+void tsf_sync_add_frame(const wifi_promiscuous_pkt_t *ppkt)
+{
+    if (sync_queue == NULL) {
+        return;
+    }
+
+    const uint8_t *frame = ppkt->payload;
+    uint32_t len = ppkt->rx_ctrl.sig_len;
+    if (len < BEACON_TIMESTAMP_OFFSET + 8 || dot11_frame_type(frame) != DOT11_TYPE_MGMT ||
+        dot11_frame_subtype(frame) != DOT11_SUBTYPE_BEACON) {
+        return;
+    }
+
+    // Beacons are sent by the AP, address 3 is the BSSID
+    const uint8_t *bssid = frame + 16;
+    uint32_t dwell = current_dwell;
+    for (uint32_t i = 0; i < reference_count; i++) {
+        if (references[i].sampled_dwell == dwell || memcmp(references[i].bssid, bssid, 6) != 0) {
+            continue;
+        }
+
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        tsf_sync_summary_t sample;
+        memcpy(sample.bssid, bssid, 6);
+        sample.channel = ppkt->rx_ctrl.channel;
+        sample.rssi = ppkt->rx_ctrl.rssi;
+        sample.dwell = dwell;
+        memcpy(&sample.tsf, frame + BEACON_TIMESTAMP_OFFSET, 8);  // Little endian on the air and on the device
+        sample.rx_timestamp = ppkt->rx_ctrl.timestamp;
+        sample.wall_clock = (uint64_t) now.tv_sec * 1000000ULL + now.tv_usec;
+
+        if (xQueueSendFromISR(sync_queue, &sample, NULL) == pdTRUE) {
+            references[i].sampled_dwell = dwell;
+        }
+        return;
+    }
+}
+
+// Move samples from the callback to the summary stream, which must not be written from Wi-Fi callbacks
+static void tsf_sync_task(void *pvParameter)
+{
+    tsf_sync_summary_t sample;
+
+    while (1) {
+        if (xQueueReceive(sync_queue, &sample, portMAX_DELAY) == pdTRUE) {
+            summary_writer_write(SUMMARY_RECORD_TSF_SYNC, &sample, sizeof(sample));
+        }
+    }
+}
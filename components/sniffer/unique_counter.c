@@ -0,0 +1,189 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "unique_counter.h"
+#include "summary_writer.h"
+#include "hll.h"
+#include "dot11.h"
+#include "hash.h"
+#include "shared.h"
+
+static const char* TAG = "UNIQUE_COUNTER";
+
+#define MINUTE_MS (60 * 1000ULL)
+#define PRECISION CONFIG_SNIFFER_HLL_PRECISION
+#define REGISTERS HLL_REGISTER_COUNT(PRECISION)
+
+#define SOURCE_MAC 0
+#define SOURCE_FINGERPRINT 1
+#ifdef CONFIG_SNIFFER_HLL_PROBE_FINGERPRINT
+#define SOURCE_COUNT 2
+#else
+#define SOURCE_COUNT 1
+#endif
+
+#define WINDOW_COUNT 3
+static const uint16_t window_minutes[WINDOW_COUNT] = {1, 5, 15};
+
+typedef struct {
+    hll_t minute[2];             // Filled by the L2 callback, swapped every minute
+    hll_t window[WINDOW_COUNT];  // Minute sketches merged into 1, 5 and 15 minute windows
+} source_sketches_t;
+
+static uint8_t registers[SOURCE_COUNT][2 + WINDOW_COUNT][REGISTERS];
+static source_sketches_t sketches[SOURCE_COUNT];
+static uint64_t window_start[WINDOW_COUNT];
+static uint8_t record_buffer[sizeof(hll_summary_t) + REGISTERS];
+
+// Index of the minute sketch the callback writes to; the other one belongs to the rotation task
+static volatile uint8_t active_minute = 0;
+static bool initialized = false;
+
+static TaskHandle_t unique_counter_task_handle = NULL;
+
+// Forward declarations
+static void unique_counter_task(void *pvParameter);
+
+bool unique_counter_init(void)
+{
+    for (int source = 0; source < SOURCE_COUNT; source++) {
+        hll_init(&sketches[source].minute[0], PRECISION, registers[source][0]);
+        hll_init(&sketches[source].minute[1], PRECISION, registers[source][1]);
+        for (int w = 0; w < WINDOW_COUNT; w++) {
+            hll_init(&sketches[source].window[w], PRECISION, registers[source][2 + w]);
+        }
+    }
+    initialized = true;
+
+    if (xTaskCreate(unique_counter_task, "unique_counter_task", 4096, NULL, 4, &unique_counter_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create unique counter task");
+        initialized = false;
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Unique counter initialized with %u registers per sketch", REGISTERS);
+
+    return true;
+}
+
+void unique_counter_deinit(void)
+{
+    initialized = false;
+    if (unique_counter_task_handle) {
+        vTaskDelete(unique_counter_task_handle);
+        unique_counter_task_handle = NULL;
+    }
+}
+
+#ifdef CONFIG_SNIFFER_HLL_PROBE_FINGERPRINT
+// Fingerprint of a probe request built from the order and content of its capability IEs.
+// SSID and DS parameter set vary between probes of one device and are reduced to their tag.
+static uint64_t probe_fingerprint(const uint8_t *ies, size_t len)
+{
+    uint64_t fingerprint = 0;
+    size_t offset = 0;
+
+    while (offset + 2 <= len) {
+        uint8_t id = ies[offset];
+        uint8_t ie_len = ies[offset + 1];
+        if (offset + 2 + ie_len > len) {
+            break;
+        }
+
+        const uint8_t *content = ies + offset + 2;
+        size_t content_len = ie_len;
+        if (id == 0 || id == 3) {
+            content_len = 0;
+        } else if (id == 221 && content_len > 4) {
+            content_len = 4; // Vendor specific: OUI and type only
+        }
+
+        fingerprint = hash_mix64(fingerprint ^ hash_bytes(content, content_len, id));
+        offset += 2 + ie_len;
+    }
+
+    return fingerprint;
+}
+#endif
+
+void unique_counter_add_frame(const uint8_t *frame, uint16_t len)
+{
+    if (!initialized) {
+        return;
+    }
+
+    const uint8_t *transmitter = dot11_transmitter(frame, len);
+    if (transmitter == NULL) {
+        return;
+    }
+
+    uint8_t active = active_minute;
+    hll_add_hash(&sketches[SOURCE_MAC].minute[active], hash_mac(transmitter));
+
+    #ifdef CONFIG_SNIFFER_HLL_PROBE_FINGERPRINT
+    if (dot11_frame_type(frame) == DOT11_TYPE_MGMT && dot11_frame_subtype(frame) == DOT11_SUBTYPE_PROBE_REQ &&
+        len > DOT11_MGMT_HEADER_LEN + DOT11_FCS_LEN) {
+        uint64_t fingerprint = probe_fingerprint(frame + DOT11_MGMT_HEADER_LEN,
+                                                 len - DOT11_MGMT_HEADER_LEN - DOT11_FCS_LEN);
+        hll_add_hash(&sketches[SOURCE_FINGERPRINT].minute[active], fingerprint);
+    }
+    #endif
+}
+
+static void write_window(uint8_t source, int w, const hll_t *sketch)
+{
+    hll_summary_t *summary = (hll_summary_t *) record_buffer;
+    summary->source = source;
+    summary->precision = PRECISION;
+    summary->window_minutes = window_minutes[w];
+    summary->window_start = window_start[w];
+    summary->estimate = (uint32_t) (hll_estimate(sketch) + 0.5);
+    memcpy(record_buffer + sizeof(hll_summary_t), sketch->registers, REGISTERS);
+
+    summary_writer_write(SUMMARY_RECORD_HLL, record_buffer, sizeof(record_buffer));
+
+    ESP_LOGI(TAG, "Unique %s in last %u min: %lu", source == SOURCE_MAC ? "transmitters" : "probe fingerprints",
+             window_minutes[w], (unsigned long) summary->estimate);
+}
+
+// Rotates the minute sketches on wall-clock minute boundaries and emits the finished windows
+static void unique_counter_task(void *pvParameter)
+{
+    for (int w = 0; w < WINDOW_COUNT; w++) {
+        window_start[w] = get_wall_clock_time();
+    }
+
+    while (1) {
+        uint64_t now = get_wall_clock_time();
+        vTaskDelay(pdMS_TO_TICKS(MINUTE_MS - now % MINUTE_MS));
+
+        uint64_t window_end = get_wall_clock_time();
+        uint64_t minute = (window_end + MINUTE_MS / 2) / MINUTE_MS; // Tolerate waking up a tick early
+
+        // Swap the minute sketches; frames in flight may still land in the finished one, which only
+        // attributes them to the previous minute
+        uint8_t finished = active_minute;
+        active_minute = finished ^ 1;
+
+        for (int source = 0; source < SOURCE_COUNT; source++) {
+            hll_t *minute_sketch = &sketches[source].minute[finished];
+
+            for (int w = 0; w < WINDOW_COUNT; w++) {
+                hll_merge(&sketches[source].window[w], minute_sketch);
+                if (minute % window_minutes[w] == 0) {
+                    write_window(source, w, &sketches[source].window[w]);
+                    hll_reset(&sketches[source].window[w]);
+                }
+            }
+
+            hll_reset(minute_sketch);
+        }
+
+        for (int w = 0; w < WINDOW_COUNT; w++) {
+            if (minute % window_minutes[w] == 0) {
+                window_start[w] = window_end;
+            }
+        }
+    }
+}
@@ -36,15 +36,15 @@ void app_main(void)
 
     // Management Phase: Connect to Wi-Fi and synchronize time
     ESP_LOGI(TAG, "Starting Management Phase");
-    management_wifi_init();
+    bool connected = management_wifi_init();
 
     // Management Phase: Mount SD Card
     if (!sdcard_init()) {
         esp_restart();
     }
 
-    // Sync time
-    if (!management_obtain_time()) {
+    // Sync time. Without the network, capture resumes on the clock kept from the previous cycle if there is one.
+    if (connected ? !management_obtain_time() : !management_time_is_set()) {
         esp_restart();
     }
 
@@ -53,7 +53,11 @@ void app_main(void)
         esp_restart();
     }
 
-    upload_files_to_server();
+    if (connected) {
+        upload_files_to_server();
+    } else {
+        ESP_LOGW(TAG, "No network, skipping upload and resuming capture");
+    }
 
     init_restart_timer();
 
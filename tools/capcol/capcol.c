@@ -0,0 +1,318 @@
+// capcol - columnar export of L2 and CSI captures
+//
+//   capcol export <capture> <output.col> [threads]
+//   capcol stats <capture|file.col>
+//   capcol bench <directory> <records> [threads]
+//
+// `stats` prints the frame subtype histogram and mean RSSI per channel. Given a .col file it only reads the
+// columns it needs, given a raw capture it scans every record, so both paths can be compared on the same data.
+//
+// `bench` writes a synthetic L2 capture of <records> frames into <directory> (an existing file of the right size is
+// reused), exports it, runs `stats` on both files and checks that the results agree. It reports the export rate,
+// the size of the columnar file, and the records/s and bytes read of the columnar and the row scan aggregation.
+// Both read from the page cache once the files were written, so the difference is decoding work and bytes moved.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "columnar.h"
+
+#define BENCH_DEVICES 2000
+#define BENCH_WRITE_RECORDS 4096
+
+typedef struct {
+    uint64_t subtypes[4][16];
+    int64_t rssi_sum[16];
+    uint64_t rssi_count[16];
+    uint64_t bytes_read;
+} stats_t;
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) * 1e3 + (double) (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int row_stats(const char *path, stats_t *stats)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, path) != 0) {
+        return -1;
+    }
+
+    capture_record_t record;
+    int rc;
+    while ((rc = capture_reader_next(&reader, &record)) == 1) {
+        if (reader.kind == CAPTURE_KIND_L2) {
+            stats->subtypes[record.l2.frame_type & 0x03][record.l2.frame_subtype & 0x0F]++;
+            stats->rssi_sum[record.l2.channel & 0x0F] += record.l2.rssi;
+            stats->rssi_count[record.l2.channel & 0x0F]++;
+        } else {
+            stats->rssi_sum[record.csi.channel & 0x0F] += record.csi.rssi;
+            stats->rssi_count[record.csi.channel & 0x0F]++;
+        }
+    }
+
+    stats->bytes_read = reader.bytes_read;
+    capture_reader_close(&reader);
+    return rc;
+}
+
+static const columnar_chunk_t *find_chunk(const columnar_chunk_t *chunks, uint32_t count, columnar_column_t column)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (chunks[i].column == column) {
+            return &chunks[i];
+        }
+    }
+    return NULL;
+}
+
+static int column_stats(const char *path, stats_t *stats)
+{
+    columnar_reader_t reader;
+    if (columnar_open(&reader, path) != 0) {
+        return -1;
+    }
+
+    bool l2 = capture_format_find(reader.header.capture_header.identifier) != CAPTURE_FORMAT_CSI;
+    columnar_buffer_t first = {0};
+    columnar_buffer_t second = {0};
+    columnar_group_t group;
+    columnar_chunk_t chunks[16];
+    int rc;
+
+    while ((rc = columnar_next_group(&reader, &group, chunks, 16)) == 1) {
+        const columnar_chunk_t *rssi = find_chunk(chunks, group.column_count, COLUMN_RSSI);
+        const columnar_chunk_t *channels = find_chunk(chunks, group.column_count,
+                                                      l2 ? COLUMN_FRAME : COLUMN_CHANNEL);
+        if (rssi == NULL || channels == NULL) {
+            errno = EINVAL;
+            rc = -1;
+            break;
+        }
+        if (columnar_read_chunk(&reader, channels, &first) != 0 ||
+            columnar_read_chunk(&reader, rssi, &second) != 0) {
+            rc = -1;
+            break;
+        }
+
+        for (uint32_t i = 0; i < group.row_count; i++) {
+            uint8_t channel;
+            if (l2) {
+                size_t bit = (size_t) i * 10;
+                uint32_t value = first.data[bit / 8] | (uint32_t) first.data[bit / 8 + 1] << 8;
+                if (bit / 8 + 2 < first.len) {
+                    value |= (uint32_t) first.data[bit / 8 + 2] << 16;
+                }
+                value = (value >> (bit % 8)) & 0x3FF;
+                stats->subtypes[value & 0x03][(value >> 2) & 0x0F]++;
+                channel = (value >> 6) & 0x0F;
+            } else {
+                channel = first.data[i] & 0x0F;
+            }
+            stats->rssi_sum[channel] += (int8_t) second.data[i];
+            stats->rssi_count[channel]++;
+        }
+    }
+
+    stats->bytes_read = reader.bytes_read;
+    columnar_buffer_free(&first);
+    columnar_buffer_free(&second);
+    columnar_close(&reader);
+    return rc;
+}
+
+static void print_stats(const stats_t *stats)
+{
+    static const char *types[] = {"mgmt", "ctrl", "data", "ext"};
+    for (int type = 0; type < 4; type++) {
+        for (int subtype = 0; subtype < 16; subtype++) {
+            if (stats->subtypes[type][subtype]) {
+                printf("%s/%d\t%" PRIu64 "\n", types[type], subtype, stats->subtypes[type][subtype]);
+            }
+        }
+    }
+    for (int channel = 0; channel < 16; channel++) {
+        if (stats->rssi_count[channel]) {
+            printf("channel %d\t%" PRIu64 " frames\tmean RSSI %.1f dBm\n", channel, stats->rssi_count[channel],
+                   (double) stats->rssi_sum[channel] / (double) stats->rssi_count[channel]);
+        }
+    }
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+// Management, control and QoS data frames of BENCH_DEVICES transmitters with payloads of random length
+static int bench_generate(const char *path, uint64_t count)
+{
+    struct stat st;
+    if (stat(path, &st) == 0 && (uint64_t) st.st_size == sizeof(file_header_t) + count * sizeof(captured_packet_t)) {
+        return 0;
+    }
+
+    FILE *file = fopen(path, "wb");
+    captured_packet_t *records = calloc(BENCH_WRITE_RECORDS, sizeof(captured_packet_t));
+    if (file == NULL || records == NULL) {
+        if (file) {
+            fclose(file);
+        }
+        free(records);
+        return -1;
+    }
+    file_header_t header = {.version = capture_format_info(CAPTURE_FORMAT_L2_RAW)->version,
+            .start_time = 1700000000, .wifi_mac = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01}};
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+    fwrite(&header, sizeof(header), 1, file);
+
+    static const uint8_t types[8][2] = {{0, 8}, {0, 8}, {0, 4}, {0, 5}, {1, 11}, {2, 8}, {2, 8}, {2, 0}};
+    uint64_t timestamp = 1700000000000ull;
+    for (uint64_t i = 0; i < count;) {
+        uint32_t n = 0;
+        for (; n < BENCH_WRITE_RECORDS && i < count; n++, i++) {
+            captured_packet_t *record = &records[n];
+            memset(record, 0, sizeof(*record));
+            const uint8_t *type = types[random_next() % 8];
+            uint32_t device = random_next() % BENCH_DEVICES;
+            timestamp += random_next() % 3;
+            record->timestamp = timestamp;
+            record->frame_type = type[0];
+            record->frame_subtype = type[1];
+            record->rssi = (int8_t) (-35 - (int) (random_next() % 60));
+            record->channel = (uint8_t) (1 + random_next() % 13);
+            record->header_len = type[0] == 2 && type[1] == 8 ? 26 : 24;
+            record->header[0] = (uint8_t) (type[0] << 2 | type[1] << 4);
+            record->header[10] = 0x02;
+            record->header[14] = (uint8_t) (device >> 8);
+            record->header[15] = (uint8_t) device;
+            record->payload_len = type[0] == 1 ? 0 : (uint16_t) (random_next() % sizeof(record->payload));
+            for (uint16_t b = 0; b < record->payload_len; b++) {
+                record->payload[b] = (uint8_t) random_next();
+            }
+        }
+        if (fwrite(records, sizeof(captured_packet_t), n, file) != n) {
+            break;
+        }
+    }
+    free(records);
+    bool failed = ferror(file) != 0;
+    return fclose(file) == 0 && !failed ? 0 : -1;
+}
+
+static int command_bench(const char *directory, uint64_t count, int threads)
+{
+    char capture_path[4096];
+    char columnar_path[4096];
+    snprintf(capture_path, sizeof(capture_path), "%s/bench-l2.bin", directory);
+    snprintf(columnar_path, sizeof(columnar_path), "%s/bench-l2.col", directory);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (bench_generate(capture_path, count) != 0) {
+        fprintf(stderr, "capcol: %s: %s\n", capture_path, strerror(errno));
+        return 1;
+    }
+    double capture_mb = (double) (sizeof(file_header_t) + count * sizeof(captured_packet_t)) / 1e6;
+    printf("%" PRIu64 " records, %.0f MB, ready in %.1f s\n", count, capture_mb, elapsed_ms(&start) / 1e3);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (columnar_export(capture_path, columnar_path, threads) != 0) {
+        fprintf(stderr, "capcol: %s: %s\n", capture_path, strerror(errno));
+        return 1;
+    }
+    double seconds = elapsed_ms(&start) / 1e3;
+    struct stat st;
+    stat(columnar_path, &st);
+    printf("export with %d threads: %.1f s, %.2f M records/s, %.0f MB (%.0f %% of the capture)\n", threads, seconds,
+           (double) count / seconds / 1e6, (double) st.st_size / 1e6, (double) st.st_size / 1e6 / capture_mb * 100.0);
+
+    stats_t stats[2] = {0};
+    const char *paths[2] = {columnar_path, capture_path};
+    static const char *names[2] = {"columnar", "row scan"};
+    double rates[2];
+    for (int i = 0; i < 2; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if ((i == 0 ? column_stats(paths[i], &stats[i]) : row_stats(paths[i], &stats[i])) < 0) {
+            fprintf(stderr, "capcol: %s: %s\n", paths[i], strerror(errno));
+            return 1;
+        }
+        seconds = elapsed_ms(&start) / 1e3;
+        rates[i] = (double) count / seconds;
+        printf("%-8s stats: %.0f ms, %.1f M records/s, %.1f MB read\n", names[i], seconds * 1e3, rates[i] / 1e6,
+               (double) stats[i].bytes_read / 1e6);
+    }
+
+    stats[0].bytes_read = stats[1].bytes_read = 0;
+    bool agree = memcmp(&stats[0], &stats[1], sizeof(stats_t)) == 0;
+    printf("columnar %.1fx the row scan throughput, results %s\n", rates[0] / rates[1],
+           agree ? "agree" : "DIFFER");
+    return agree ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (argc >= 4 && strcmp(argv[1], "export") == 0) {
+        int threads = argc > 4 ? atoi(argv[4]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (columnar_export(argv[2], argv[3], threads) != 0) {
+            fprintf(stderr, "capcol: %s: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        fprintf(stderr, "Exported %s in %.1f ms with %d threads\n", argv[2], elapsed_ms(&start), threads);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "stats") == 0) {
+        char magic[4] = {0};
+        FILE *file = fopen(argv[2], "rb");
+        if (file == NULL || fread(magic, sizeof(magic), 1, file) != 1) {
+            fprintf(stderr, "capcol: %s: %s\n", argv[2], file ? "file too short" : strerror(errno));
+            if (file) {
+                fclose(file);
+            }
+            return 1;
+        }
+        fclose(file);
+
+        stats_t stats = {0};
+        bool columnar = memcmp(magic, "MCOL", 4) == 0;
+        int rc = columnar ? column_stats(argv[2], &stats) : row_stats(argv[2], &stats);
+        if (rc < 0) {
+            fprintf(stderr, "capcol: %s: %s\n", argv[2], strerror(errno));
+            return 1;
+        }
+        print_stats(&stats);
+        fprintf(stderr, "%" PRIu64 " bytes read, %.1f ms (%s)\n", stats.bytes_read, elapsed_ms(&start),
+                columnar ? "columnar" : "row scan");
+        return 0;
+    }
+
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "bench") == 0) {
+        uint64_t count = strtoull(argv[3], NULL, 10);
+        int threads = argc > 4 ? atoi(argv[4]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (count > 0 && threads > 0) {
+            return command_bench(argv[2], count, threads);
+        }
+    }
+
+    fprintf(stderr, "usage: capcol export <capture> <output.col> [threads]\n"
+                    "       capcol stats <capture|file.col>\n"
+                    "       capcol bench <directory> <records> [threads]\n");
+    return 2;
+}
@@ -0,0 +1,562 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "columnar.h"
+#include "hash.h"
+
+#define MAX_COLUMNS 8
+
+void columnar_buffer_free(columnar_buffer_t *buffer)
+{
+    free(buffer->data);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+static int buffer_reserve(columnar_buffer_t *buffer, size_t extra)
+{
+    if (buffer->capacity - buffer->len >= extra) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity - buffer->len < extra) {
+        capacity *= 2;
+    }
+    uint8_t *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+static int buffer_append(columnar_buffer_t *buffer, const void *data, size_t len)
+{
+    if (buffer_reserve(buffer, len) != 0) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+static int buffer_append_varint(columnar_buffer_t *buffer, uint64_t value)
+{
+    if (buffer_reserve(buffer, 10) != 0) {
+        return -1;
+    }
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        buffer->data[buffer->len++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return 0;
+}
+
+// Per row accessors, so L2 and CSI share the encoders
+typedef struct {
+    const capture_record_t *records;
+    uint32_t count;
+    capture_kind_t kind;
+} rows_t;
+
+static uint64_t row_timestamp(const rows_t *rows, uint32_t i)
+{
+    return rows->kind == CAPTURE_KIND_L2 ? rows->records[i].l2.timestamp : rows->records[i].csi.timestamp;
+}
+
+static const uint8_t *row_transmitter(const rows_t *rows, uint32_t i)
+{
+    static const uint8_t none[6];
+    if (rows->kind == CAPTURE_KIND_CSI) {
+        return rows->records[i].csi.mac;
+    }
+    const uint8_t *transmitter = capture_record_transmitter(&rows->records[i]);
+    return transmitter ? transmitter : none;
+}
+
+static int encode_timestamps(const rows_t *rows, columnar_buffer_t *out)
+{
+    uint64_t previous = 0;
+    for (uint32_t i = 0; i < rows->count; i++) {
+        int64_t delta = (int64_t) (row_timestamp(rows, i) - previous);
+        previous = row_timestamp(rows, i);
+        if (buffer_append_varint(out, ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int encode_transmitters(const rows_t *rows, columnar_buffer_t *out)
+{
+    // Open addressing MAC -> dictionary index, at most count entries
+    size_t capacity = 64;
+    while (capacity < (size_t) rows->count * 2) {
+        capacity *= 2;
+    }
+    uint32_t *slots = malloc(capacity * sizeof(uint32_t));
+    uint32_t *indexes = malloc(rows->count * sizeof(uint32_t));
+    uint8_t (*entries)[6] = malloc((size_t) rows->count * 6 + 6);
+    int rc = -1;
+    if (slots == NULL || indexes == NULL || entries == NULL) {
+        goto cleanup;
+    }
+    memset(slots, 0xFF, capacity * sizeof(uint32_t));
+
+    uint32_t entry_count = 0;
+    for (uint32_t i = 0; i < rows->count; i++) {
+        const uint8_t *mac = row_transmitter(rows, i);
+        size_t slot = (size_t) hash_mac(mac) & (capacity - 1);
+        while (slots[slot] != UINT32_MAX && memcmp(entries[slots[slot]], mac, 6) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (slots[slot] == UINT32_MAX) {
+            memcpy(entries[entry_count], mac, 6);
+            slots[slot] = entry_count++;
+        }
+        indexes[i] = slots[slot];
+    }
+
+    uint8_t width = entry_count <= 0x100 ? 1 : entry_count <= 0x10000 ? 2 : 4;
+    if (buffer_append(out, &entry_count, sizeof(entry_count)) != 0 || buffer_append(out, &width, 1) != 0 ||
+        buffer_append(out, entries, (size_t) entry_count * 6) != 0 ||
+        buffer_reserve(out, (size_t) rows->count * width) != 0) {
+        goto cleanup;
+    }
+    for (uint32_t i = 0; i < rows->count; i++) {
+        memcpy(out->data + out->len, &indexes[i], width);  // Little-endian truncation
+        out->len += width;
+    }
+    rc = 0;
+
+cleanup:
+    free(slots);
+    free(indexes);
+    free(entries);
+    return rc;
+}
+
+static int encode_frames(const rows_t *rows, columnar_buffer_t *out)
+{
+    size_t size = ((size_t) rows->count * 10 + 7) / 8;
+    if (buffer_reserve(out, size) != 0) {
+        return -1;
+    }
+    uint8_t *packed = out->data + out->len;
+    memset(packed, 0, size);
+
+    for (uint32_t i = 0; i < rows->count; i++) {
+        const captured_packet_t *packet = &rows->records[i].l2;
+        uint32_t value = (packet->frame_type & 0x03) | (packet->frame_subtype & 0x0F) << 2 |
+                         (packet->channel & 0x0F) << 6;
+        size_t bit = (size_t) i * 10;
+        value <<= bit % 8;
+        packed[bit / 8] |= (uint8_t) value;
+        packed[bit / 8 + 1] |= (uint8_t) (value >> 8);
+        if (value >> 16) {
+            packed[bit / 8 + 2] |= (uint8_t) (value >> 16);
+        }
+    }
+    out->len += size;
+    return 0;
+}
+
+static int encode_plain(const rows_t *rows, columnar_column_t column, columnar_buffer_t *out)
+{
+    if (buffer_reserve(out, rows->count) != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < rows->count; i++) {
+        const capture_record_t *record = &rows->records[i];
+        uint8_t value;
+        if (column == COLUMN_RSSI) {
+            value = (uint8_t) (rows->kind == CAPTURE_KIND_L2 ? record->l2.rssi : record->csi.rssi);
+        } else {
+            value = record->csi.channel;
+        }
+        out->data[out->len++] = value;
+    }
+    return 0;
+}
+
+static int encode_blob(const rows_t *rows, columnar_column_t column, columnar_buffer_t *out)
+{
+    for (uint32_t i = 0; i < rows->count; i++) {
+        const capture_record_t *record = &rows->records[i];
+        size_t len = column == COLUMN_HEADER ? record->l2.header_len :
+                     column == COLUMN_PAYLOAD ? record->l2.payload_len : record->csi.csi_len;
+        if (buffer_append_varint(out, len) != 0) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < rows->count; i++) {
+        const capture_record_t *record = &rows->records[i];
+        int rc;
+        if (column == COLUMN_HEADER) {
+            rc = buffer_append(out, record->l2.header, record->l2.header_len);
+        } else if (column == COLUMN_PAYLOAD) {
+            rc = buffer_append(out, record->l2.payload, record->l2.payload_len);
+        } else {
+            rc = buffer_append(out, record->csi.csi_data, record->csi.csi_len);
+        }
+        if (rc != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int columnar_encode_group(capture_kind_t kind, const capture_record_t *records, uint32_t count,
+                          columnar_buffer_t *out)
+{
+    static const columnar_column_t l2_columns[] = {
+            COLUMN_TIMESTAMP, COLUMN_TRANSMITTER, COLUMN_FRAME, COLUMN_RSSI, COLUMN_HEADER, COLUMN_PAYLOAD,
+    };
+    static const columnar_column_t csi_columns[] = {
+            COLUMN_TIMESTAMP, COLUMN_TRANSMITTER, COLUMN_RSSI, COLUMN_CHANNEL, COLUMN_CSI,
+    };
+    const columnar_column_t *columns = kind == CAPTURE_KIND_L2 ? l2_columns : csi_columns;
+    uint32_t column_count = kind == CAPTURE_KIND_L2 ? sizeof(l2_columns) / sizeof(l2_columns[0])
+                                                    : sizeof(csi_columns) / sizeof(csi_columns[0]);
+
+    rows_t rows = {.records = records, .count = count, .kind = kind};
+    columnar_chunk_t chunks[MAX_COLUMNS];
+    size_t directory_end = sizeof(columnar_group_t) + column_count * sizeof(columnar_chunk_t);
+
+    out->len = 0;
+    if (buffer_reserve(out, directory_end) != 0) {
+        return -1;
+    }
+    out->len = directory_end;
+
+    for (uint32_t c = 0; c < column_count; c++) {
+        size_t start = out->len;
+        int rc;
+        uint8_t encoding;
+
+        switch (columns[c]) {
+            case COLUMN_TIMESTAMP:
+                encoding = ENCODING_DELTA_VARINT;
+                rc = encode_timestamps(&rows, out);
+                break;
+            case COLUMN_TRANSMITTER:
+                encoding = ENCODING_DICT;
+                rc = encode_transmitters(&rows, out);
+                break;
+            case COLUMN_FRAME:
+                encoding = ENCODING_BITPACK10;
+                rc = encode_frames(&rows, out);
+                break;
+            case COLUMN_RSSI:
+            case COLUMN_CHANNEL:
+                encoding = ENCODING_PLAIN;
+                rc = encode_plain(&rows, columns[c], out);
+                break;
+            default:
+                encoding = ENCODING_BLOB;
+                rc = encode_blob(&rows, columns[c], out);
+                break;
+        }
+        if (rc != 0) {
+            return -1;
+        }
+
+        chunks[c] = (columnar_chunk_t) {
+                .column = (uint16_t) columns[c],
+                .encoding = encoding,
+                .size = (uint32_t) (out->len - start),
+                .offset = start,
+        };
+    }
+
+    columnar_group_t group = {
+            .magic = {'R', 'G', 'R', 'P'},
+            .row_count = count,
+            .column_count = column_count,
+            .size = out->len - sizeof(columnar_group_t),
+    };
+    memcpy(out->data, &group, sizeof(group));
+    memcpy(out->data + sizeof(group), chunks, column_count * sizeof(columnar_chunk_t));
+    return 0;
+}
+
+// Export pipeline: the calling thread reads row groups into slots, workers encode them and a writer thread
+// appends them in order. Slots are reused round robin, which bounds memory to the number of slots.
+typedef enum {
+    SLOT_EMPTY,
+    SLOT_FILLED,
+    SLOT_ENCODING,
+    SLOT_ENCODED,
+} slot_state_t;
+
+typedef struct {
+    slot_state_t state;
+    uint64_t sequence;
+    capture_record_t *records;
+    uint32_t count;
+    columnar_buffer_t encoded;
+} export_slot_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    export_slot_t *slots;
+    size_t slot_count;
+    capture_kind_t kind;
+    uint64_t next_to_encode;
+    uint64_t group_count;     // Total groups, known once reading finished
+    bool reading_done;
+    bool failed;
+    FILE *output;
+} export_t;
+
+static void *export_encoder(void *arg)
+{
+    export_t *export = arg;
+
+    pthread_mutex_lock(&export->lock);
+    while (true) {
+        export_slot_t *slot = &export->slots[export->next_to_encode % export->slot_count];
+        while (!export->failed && !(slot->state == SLOT_FILLED && slot->sequence == export->next_to_encode) &&
+               !(export->reading_done && export->next_to_encode >= export->group_count)) {
+            pthread_cond_wait(&export->changed, &export->lock);
+            slot = &export->slots[export->next_to_encode % export->slot_count];
+        }
+        if (export->failed || (export->reading_done && export->next_to_encode >= export->group_count)) {
+            break;
+        }
+
+        export->next_to_encode++;
+        slot->state = SLOT_ENCODING;
+        pthread_mutex_unlock(&export->lock);
+
+        int rc = columnar_encode_group(export->kind, slot->records, slot->count, &slot->encoded);
+
+        pthread_mutex_lock(&export->lock);
+        slot->state = SLOT_ENCODED;
+        if (rc != 0) {
+            export->failed = true;
+        }
+        pthread_cond_broadcast(&export->changed);
+    }
+    pthread_mutex_unlock(&export->lock);
+    return NULL;
+}
+
+static void *export_writer(void *arg)
+{
+    export_t *export = arg;
+
+    pthread_mutex_lock(&export->lock);
+    for (uint64_t sequence = 0;; sequence++) {
+        export_slot_t *slot = &export->slots[sequence % export->slot_count];
+        while (!export->failed && !(slot->state == SLOT_ENCODED && slot->sequence == sequence) &&
+               !(export->reading_done && sequence >= export->group_count)) {
+            pthread_cond_wait(&export->changed, &export->lock);
+        }
+        if (export->failed || (export->reading_done && sequence >= export->group_count)) {
+            break;
+        }
+        pthread_mutex_unlock(&export->lock);
+
+        int rc = fwrite(slot->encoded.data, slot->encoded.len, 1, export->output) == 1 ? 0 : -1;
+
+        pthread_mutex_lock(&export->lock);
+        slot->state = SLOT_EMPTY;
+        if (rc != 0) {
+            export->failed = true;
+        }
+        pthread_cond_broadcast(&export->changed);
+    }
+    pthread_mutex_unlock(&export->lock);
+    return NULL;
+}
+
+int columnar_export(const char *capture_path, const char *output_path, int threads)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, capture_path) != 0) {
+        return -1;
+    }
+
+    FILE *output = fopen(output_path, "wb");
+    if (output == NULL) {
+        capture_reader_close(&reader);
+        return -1;
+    }
+
+    columnar_header_t header = {
+            .magic = {'M', 'C', 'O', 'L'},
+            .version = COLUMNAR_VERSION,
+            .capture_header = reader.header,
+    };
+    fwrite(&header, sizeof(header), 1, output);
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    export_t export = {
+            .slot_count = (size_t) threads * 2,
+            .kind = reader.kind,
+            .output = output,
+    };
+    pthread_mutex_init(&export.lock, NULL);
+    pthread_cond_init(&export.changed, NULL);
+    export.slots = calloc(export.slot_count, sizeof(export_slot_t));
+    bool ok = export.slots != NULL;
+    for (size_t i = 0; ok && i < export.slot_count; i++) {
+        export.slots[i].records = malloc(COLUMNAR_GROUP_ROWS * sizeof(capture_record_t));
+        ok = export.slots[i].records != NULL;
+    }
+
+    pthread_t encoders[threads];
+    pthread_t writer;
+    int started = 0;
+    if (ok) {
+        pthread_create(&writer, NULL, export_writer, &export);
+        for (; started < threads; started++) {
+            pthread_create(&encoders[started], NULL, export_encoder, &export);
+        }
+    } else {
+        export.failed = true;
+    }
+
+    int rc = 0;
+    for (uint64_t sequence = 0; ok; sequence++) {
+        export_slot_t *slot = &export.slots[sequence % export.slot_count];
+
+        pthread_mutex_lock(&export.lock);
+        while (!export.failed && slot->state != SLOT_EMPTY) {
+            pthread_cond_wait(&export.changed, &export.lock);
+        }
+        bool failed = export.failed;
+        pthread_mutex_unlock(&export.lock);
+        if (failed) {
+            break;
+        }
+
+        // Slot is owned by this thread until it is marked filled
+        slot->count = 0;
+        while (slot->count < COLUMNAR_GROUP_ROWS && (rc = capture_reader_next(&reader, &slot->records[slot->count])) == 1) {
+            slot->count++;
+        }
+
+        pthread_mutex_lock(&export.lock);
+        if (slot->count > 0) {
+            slot->sequence = sequence;
+            slot->state = SLOT_FILLED;
+        }
+        if (rc <= 0) {
+            export.reading_done = true;
+            export.group_count = sequence + (slot->count > 0 ? 1 : 0);
+            if (rc < 0) {
+                export.failed = true;
+            }
+        }
+        pthread_cond_broadcast(&export.changed);
+        pthread_mutex_unlock(&export.lock);
+
+        if (rc <= 0) {
+            break;
+        }
+    }
+
+    if (ok) {
+        for (int i = 0; i < started; i++) {
+            pthread_join(encoders[i], NULL);
+        }
+        pthread_join(writer, NULL);
+    }
+
+    rc = export.failed ? -1 : 0;
+    for (size_t i = 0; export.slots && i < export.slot_count; i++) {
+        free(export.slots[i].records);
+        columnar_buffer_free(&export.slots[i].encoded);
+    }
+    free(export.slots);
+    pthread_cond_destroy(&export.changed);
+    pthread_mutex_destroy(&export.lock);
+
+    if (fclose(output) != 0) {
+        rc = -1;
+    }
+    capture_reader_close(&reader);
+    return rc;
+}
+
+int columnar_open(columnar_reader_t *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0 ||
+        pread(reader->fd, &reader->header, sizeof(reader->header), 0) != sizeof(reader->header) ||
+        memcmp(reader->header.magic, "MCOL", 4) != 0 || reader->header.version != COLUMNAR_VERSION) {
+        close(reader->fd);
+        errno = EINVAL;
+        return -1;
+    }
+    reader->file_size = (uint64_t) st.st_size;
+    reader->offset = sizeof(reader->header);
+    return 0;
+}
+
+void columnar_close(columnar_reader_t *reader)
+{
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+}
+
+int columnar_next_group(columnar_reader_t *reader, columnar_group_t *group, columnar_chunk_t *chunks,
+                        uint32_t max_chunks)
+{
+    if (reader->offset + sizeof(*group) > reader->file_size) {
+        return 0;
+    }
+    if (pread(reader->fd, group, sizeof(*group), (off_t) reader->offset) != sizeof(*group) ||
+        memcmp(group->magic, "RGRP", 4) != 0 || group->column_count > max_chunks) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t directory_size = group->column_count * sizeof(columnar_chunk_t);
+    if (pread(reader->fd, chunks, directory_size, (off_t) (reader->offset + sizeof(*group))) !=
+        (ssize_t) directory_size) {
+        errno = EINVAL;
+        return -1;
+    }
+    reader->bytes_read += sizeof(*group) + directory_size;
+
+    reader->group_start = reader->offset;
+    reader->offset += sizeof(*group) + group->size;
+    return reader->offset <= reader->file_size ? 1 : 0;
+}
+
+int columnar_read_chunk(columnar_reader_t *reader, const columnar_chunk_t *chunk, columnar_buffer_t *out)
+{
+    out->len = 0;
+    if (buffer_reserve(out, chunk->size) != 0) {
+        return -1;
+    }
+    ssize_t n = pread(reader->fd, out->data, chunk->size, (off_t) (reader->group_start + chunk->offset));
+    if (n != (ssize_t) chunk->size) {
+        errno = EINVAL;
+        return -1;
+    }
+    out->len = chunk->size;
+    reader->bytes_read += chunk->size;
+    return 0;
+}
@@ -0,0 +1,102 @@
+#ifndef COLUMNAR_H
+#define COLUMNAR_H
+
+// Columnar layout for L2 and CSI captures (.col).
+//
+//   columnar_header_t
+//   row group*:  columnar_group_t, column_count x columnar_chunk_t, column data
+//
+// Row groups hold up to COLUMNAR_GROUP_ROWS rows and are encoded independently, so a file can be written in
+// a single streaming pass and a column can be read without touching the others. Encodings, all little-endian:
+//   DELTA_VARINT  zigzag LEB128 varints, each value relative to the previous row (first row relative to 0)
+//   DICT          u32 entry count, u8 index width (1, 2 or 4), entries x 6 byte MACs, rows x index
+//   BITPACK10     frame type (2 bits) | subtype (4 bits) << 2 | channel (4 bits) << 6, 10 bits per row LSB first
+//   PLAIN         one byte per row (int8 RSSI, uint8 channel)
+//   BLOB          rows x LEB128 length, followed by the concatenated bytes
+// Records without a transmitter address use the all-zero MAC.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "capture_reader.h"
+
+#define COLUMNAR_VERSION 1
+#define COLUMNAR_GROUP_ROWS 16384
+
+typedef enum {
+    COLUMN_TIMESTAMP = 1,    // DELTA_VARINT, ms for L2, s for CSI
+    COLUMN_TRANSMITTER = 2,  // DICT
+    COLUMN_FRAME = 3,        // BITPACK10 (L2 only)
+    COLUMN_RSSI = 4,         // PLAIN
+    COLUMN_HEADER = 5,       // BLOB (L2 only)
+    COLUMN_PAYLOAD = 6,      // BLOB (L2 only)
+    COLUMN_CHANNEL = 7,      // PLAIN (CSI only, L2 keeps the channel in COLUMN_FRAME)
+    COLUMN_CSI = 8,          // BLOB (CSI only)
+} columnar_column_t;
+
+typedef enum {
+    ENCODING_DELTA_VARINT = 1,
+    ENCODING_DICT = 2,
+    ENCODING_BITPACK10 = 3,
+    ENCODING_PLAIN = 4,
+    ENCODING_BLOB = 5,
+} columnar_encoding_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];                 // "MCOL"
+    uint32_t version;
+    file_header_t capture_header;  // Header of the source capture, identifier tells L2 from CSI
+} columnar_header_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];                 // "RGRP"
+    uint32_t row_count;
+    uint32_t column_count;
+    uint32_t reserved;
+    uint64_t size;                 // Bytes following this header (directory and column data)
+} columnar_group_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t column;
+    uint8_t encoding;
+    uint8_t reserved;
+    uint32_t size;
+    uint64_t offset;               // Offset of the column data from the start of the row group header
+} columnar_chunk_t;
+
+// Growable byte buffer used for encoded columns
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t capacity;
+} columnar_buffer_t;
+
+void columnar_buffer_free(columnar_buffer_t *buffer);
+
+// Encode one row group (header, directory and columns) into `out`. Returns 0 or -1 when out of memory.
+int columnar_encode_group(capture_kind_t kind, const capture_record_t *records, uint32_t count,
+                          columnar_buffer_t *out);
+
+// Convert a capture with `threads` encoder threads. At most 2 x threads row groups are in memory at once.
+int columnar_export(const char *capture_path, const char *output_path, int threads);
+
+// Column access for queries
+typedef struct {
+    int fd;
+    columnar_header_t header;
+    uint64_t group_start;          // Offset of the current row group
+    uint64_t offset;               // Offset of the next row group
+    uint64_t file_size;
+    uint64_t bytes_read;
+} columnar_reader_t;
+
+int columnar_open(columnar_reader_t *reader, const char *path);
+void columnar_close(columnar_reader_t *reader);
+
+// Read the next row group's directory. Returns 1, 0 at the end of the file, -1 on error.
+int columnar_next_group(columnar_reader_t *reader, columnar_group_t *group, columnar_chunk_t *chunks,
+                        uint32_t max_chunks);
+
+// Read the data of one column of the current group into `out`
+int columnar_read_chunk(columnar_reader_t *reader, const columnar_chunk_t *chunk, columnar_buffer_t *out);
+
+#endif // COLUMNAR_H
@@ -0,0 +1,533 @@
+// capdict - dictionary coded L2 captures ("L2DC")
+//
+//   capdict expand <l2dc.bin> <l2.bin>
+//   capdict encode <l2.bin> <l2dc.bin> [segment-kib]
+//   capdict bench <l2.bin | frames> [segment-kib]
+//
+// `expand` turns a capture written with SNIFFER_L2_DICT back into raw records ("L2PK") for the other host tools.
+// A malformed segment is reported and skipped, decoding resumes at the next segment boundary. `encode` converts a
+// raw capture with the firmware's encoder.
+//
+// `bench` encodes the records of a raw capture, or of synthetic traffic (probe requests of devices with a few
+// preferred networks, beacons, data and control frames), with and without the dictionary. It reports the size
+// against fixed-size raw records, how many probe request SSIDs were replaced by references and the encode and decode
+// throughput, and checks that every record expands back to its original bytes (and, for synthetic traffic, that
+// SSIDs were replaced at all).
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "capture_reader.h"
+#include "dot11.h"
+#include "l2_dict.h"
+
+#define DEFAULT_SEGMENT_KIB 64
+
+typedef struct {
+    FILE *output;
+    uint64_t records;
+    bool failed;
+} expand_context_t;
+
+static void write_record(void *context, const captured_packet_t *record)
+{
+    expand_context_t *expand = context;
+    if (fwrite(record, sizeof(*record), 1, expand->output) != 1) {
+        expand->failed = true;
+    }
+    expand->records++;
+}
+
+static int command_expand(const char *input_path, const char *output_path)
+{
+    FILE *input = fopen(input_path, "rb");
+    if (input == NULL) {
+        fprintf(stderr, "capdict: %s: %s\n", input_path, strerror(errno));
+        return 1;
+    }
+
+    file_header_t header;
+    uint32_t segment_size;
+    if (fread(&header, sizeof(header), 1, input) != 1 || fread(&segment_size, sizeof(segment_size), 1, input) != 1 ||
+        capture_format_find(header.identifier) != CAPTURE_FORMAT_L2_DICT || segment_size < L2_DICT_MAX_ENCODED) {
+        fprintf(stderr, "capdict: %s is not a dictionary coded capture\n", input_path);
+        fclose(input);
+        return 1;
+    }
+    if (header.version > CAPTURE_VERSION_L2_DICT) {
+        fprintf(stderr, "capdict: %s: format version %" PRIu32 " is newer than this build\n", input_path,
+                header.version);
+        fclose(input);
+        return 1;
+    }
+
+    FILE *output = fopen(output_path, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "capdict: %s: %s\n", output_path, strerror(errno));
+        fclose(input);
+        return 1;
+    }
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+    header.version = CAPTURE_VERSION_L2_RAW;
+    fwrite(&header, sizeof(header), 1, output);
+
+    uint8_t *segment = malloc(segment_size);
+    l2_dict_decoder_t *decoder = malloc(sizeof(l2_dict_decoder_t));
+    if (segment == NULL || decoder == NULL) {
+        fprintf(stderr, "capdict: out of memory\n");
+        free(segment);
+        free(decoder);
+        fclose(input);
+        fclose(output);
+        return 1;
+    }
+    l2_dict_decoder_setup(decoder, segment_size);
+
+    expand_context_t context = {.output = output};
+    uint64_t segments = 0;
+    uint64_t malformed = 0;
+    size_t len;
+    while ((len = fread(segment, 1, segment_size, input)) > 0) {
+        if (l2_dict_decode_segment(decoder, segment, len, write_record, &context) < 0) {
+            fprintf(stderr, "capdict: segment %" PRIu64 " is malformed, skipped its remaining records\n", segments);
+            malformed++;
+        }
+        segments++;
+    }
+    int rc = ferror(input) || context.failed ? 1 : 0;
+    if (fclose(output) != 0) {
+        rc = 1;
+    }
+    fclose(input);
+    free(segment);
+    free(decoder);
+
+    printf("%" PRIu64 " records from %" PRIu64 " segments expanded, %" PRIu64 " malformed segments\n",
+           context.records, segments, malformed);
+    return rc;
+}
+
+// Raw records of a capture, in memory
+static captured_packet_t *load_capture(const char *path, uint64_t *count, file_header_t *header)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, path) != 0) {
+        fprintf(stderr, "capdict: %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (reader.format != CAPTURE_FORMAT_L2_RAW) {
+        fprintf(stderr, "capdict: %s is not a raw L2 capture\n", path);
+        capture_reader_close(&reader);
+        return NULL;
+    }
+    *header = reader.header;
+
+    uint64_t capacity = (reader.file_size - reader.data_start) / reader.record_size + 1;
+    captured_packet_t *records = malloc(capacity * sizeof(captured_packet_t));
+    if (records == NULL) {
+        fprintf(stderr, "capdict: out of memory\n");
+        capture_reader_close(&reader);
+        return NULL;
+    }
+
+    capture_record_t record;
+    *count = 0;
+    while (*count < capacity && capture_reader_next(&reader, &record) == 1) {
+        records[(*count)++] = record.l2;
+    }
+    capture_reader_close(&reader);
+    return records;
+}
+
+static int command_encode(const char *input_path, const char *output_path, uint32_t segment_size)
+{
+    file_header_t header;
+    uint64_t count;
+    captured_packet_t *records = load_capture(input_path, &count, &header);
+    if (records == NULL) {
+        return 1;
+    }
+
+    FILE *output = fopen(output_path, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "capdict: %s: %s\n", output_path, strerror(errno));
+        free(records);
+        return 1;
+    }
+
+    l2_dict_encoder_t *encoder = malloc(sizeof(l2_dict_encoder_t));
+    if (encoder == NULL) {
+        fprintf(stderr, "capdict: out of memory\n");
+        free(records);
+        fclose(output);
+        return 1;
+    }
+    l2_dict_encoder_setup(encoder, segment_size, 0, true);
+
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_DICT)->identifier, 4);
+    header.version = CAPTURE_VERSION_L2_DICT;
+    fwrite(&header, sizeof(header), 1, output);
+    fwrite(&encoder->segment_size, sizeof(encoder->segment_size), 1, output);
+
+    uint8_t out[L2_DICT_MAX_OUTPUT];
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        size_t len = l2_dict_encode(encoder, &records[i], out);
+        fwrite(out, len, 1, output);
+        bytes += len;
+    }
+    int rc = fclose(output) == 0 ? 0 : 1;
+
+    printf("%" PRIu64 " records: %" PRIu64 " bytes instead of %" PRIu64 ", %" PRIu64 " definitions, %" PRIu64
+           " references\n", count, bytes, count * sizeof(captured_packet_t), encoder->definitions,
+           encoder->references);
+    free(encoder);
+    free(records);
+    return rc;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+#define SYNTHETIC_DEVICES 400
+#define SYNTHETIC_MODELS 12
+#define SYNTHETIC_SSIDS 60
+#define SYNTHETIC_APS 40
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t model;
+    uint8_t ssids[3];      // Preferred networks, probed for by name
+} synthetic_device_t;
+
+typedef struct {
+    uint8_t frame[256];
+    uint32_t len;
+} frame_builder_t;
+
+static void put_bytes(frame_builder_t *builder, const void *bytes, uint32_t len)
+{
+    if (builder->len + len <= sizeof(builder->frame)) {
+        memcpy(builder->frame + builder->len, bytes, len);
+        builder->len += len;
+    }
+}
+
+static void put_element(frame_builder_t *builder, uint8_t id, const void *data, uint8_t len)
+{
+    put_bytes(builder, &id, 1);
+    put_bytes(builder, &len, 1);
+    put_bytes(builder, data, len);
+}
+
+// Element of `len` bytes derived from a seed, e.g. the capabilities of a device model
+static void put_seeded_element(frame_builder_t *builder, uint8_t id, uint32_t seed, uint8_t len)
+{
+    uint8_t data[255];
+    for (uint8_t i = 0; i < len; i++) {
+        data[i] = (uint8_t) ((seed + 1) * 2654435761u >> (i % 24));
+    }
+    put_element(builder, id, data, len);
+}
+
+static void put_ssid(frame_builder_t *builder, uint32_t ssid)
+{
+    char name[32];
+    int len = snprintf(name, sizeof(name), "network-%" PRIu32 "%s", ssid, ssid % 3 ? "-guest" : "");
+    put_element(builder, 0, name, (uint8_t) len);
+}
+
+static void put_header(frame_builder_t *builder, uint8_t type, uint8_t subtype, const uint8_t *addr1,
+                       const uint8_t *addr2, const uint8_t *addr3)
+{
+    uint8_t header[DOT11_MGMT_HEADER_LEN] = {(uint8_t) (subtype << 4 | type << 2)};
+    memcpy(header + 4, addr1, 6);
+    memcpy(header + 10, addr2, 6);
+    memcpy(header + 16, addr3, 6);
+    uint16_t sequence = (uint16_t) (random_next() << 4);
+    memcpy(header + 22, &sequence, 2);
+    put_bytes(builder, header, sizeof(header));
+}
+
+// Split a frame (with FCS) into a record as the promiscuous callback does
+static void to_record(const frame_builder_t *builder, uint64_t timestamp, captured_packet_t *record)
+{
+    memset(record, 0, sizeof(*record));
+    record->timestamp = timestamp;
+    record->frame_type = (builder->frame[0] >> 2) & 0x03;
+    record->frame_subtype = (builder->frame[0] >> 4) & 0x0F;
+    record->rssi = (int8_t) (-40 - (int) (random_next() % 50));
+    record->channel = (uint8_t) (1 + random_next() % 13);
+    record->header_len = (uint16_t) (builder->len < 36 ? builder->len : 36);
+    memcpy(record->header, builder->frame, record->header_len);
+    if (record->frame_type != DOT11_TYPE_DATA) {
+        uint32_t payload_len = builder->len - record->header_len;
+        record->payload_len = (uint16_t) (payload_len > 128 ? 128 : payload_len);
+        memcpy(record->payload, builder->frame + record->header_len, record->payload_len);
+    }
+}
+
+static void synthetic_records(captured_packet_t *records, uint64_t count)
+{
+    static const uint8_t broadcast[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t rates[] = {0x02, 0x04, 0x0B, 0x16, 0x0C, 0x12, 0x18, 0x24};
+    static const uint8_t extended_rates[] = {0x30, 0x48, 0x60, 0x6C};
+    static const uint8_t wps[] = {0x00, 0x50, 0xF2, 0x04, 0x10, 0x4A, 0x00, 0x01, 0x10};
+    static synthetic_device_t devices[SYNTHETIC_DEVICES];
+    static uint8_t aps[SYNTHETIC_APS][6];
+
+    for (int i = 0; i < SYNTHETIC_DEVICES; i++) {
+        for (int b = 0; b < 6; b++) {
+            devices[i].mac[b] = (uint8_t) random_next();
+        }
+        devices[i].mac[0] = (devices[i].mac[0] & 0xFC) | 0x02;  // Randomised, locally administered
+        devices[i].model = (uint8_t) (random_next() % SYNTHETIC_MODELS);
+        for (int s = 0; s < 3; s++) {
+            devices[i].ssids[s] = (uint8_t) (random_next() % SYNTHETIC_SSIDS);
+        }
+    }
+    for (int i = 0; i < SYNTHETIC_APS; i++) {
+        for (int b = 0; b < 6; b++) {
+            aps[i][b] = (uint8_t) random_next();
+        }
+        aps[i][0] &= 0xFC;
+    }
+
+    uint64_t timestamp = 1700000000000ull;
+    for (uint64_t i = 0; i < count; i++) {
+        timestamp += random_next() % 4;
+        frame_builder_t builder = {.len = 0};
+        uint32_t kind = random_next() % 100;
+        uint8_t channel = (uint8_t) (1 + random_next() % 13);
+
+        if (kind < 35) {
+            // Probe request: wildcard or preferred network, then the elements of the device model
+            const synthetic_device_t *device = &devices[random_next() % SYNTHETIC_DEVICES];
+            put_header(&builder, DOT11_TYPE_MGMT, DOT11_SUBTYPE_PROBE_REQ, broadcast, device->mac, broadcast);
+            uint32_t probe = random_next() % 4;
+            if (probe == 3) {
+                put_element(&builder, 0, NULL, 0);
+            } else {
+                put_ssid(&builder, device->ssids[probe]);
+            }
+            put_element(&builder, 1, rates, sizeof(rates));
+            put_element(&builder, 50, extended_rates, sizeof(extended_rates));
+            put_element(&builder, 3, &channel, 1);
+            put_seeded_element(&builder, 45, device->model, 26);         // HT capabilities
+            put_seeded_element(&builder, 127, device->model + 100, 8);   // Extended capabilities
+            put_seeded_element(&builder, 191, device->model + 200, 12);  // VHT capabilities
+            put_element(&builder, 221, wps, sizeof(wps));
+            put_seeded_element(&builder, 221, device->model + 300, 7);  // Vendor specific
+        } else if (kind < 45) {
+            // Beacon: changing timestamp and TIM, constant elements of the AP
+            uint32_t ap = random_next() % SYNTHETIC_APS;
+            put_header(&builder, DOT11_TYPE_MGMT, DOT11_SUBTYPE_BEACON, broadcast, aps[ap], aps[ap]);
+            uint64_t tsf = timestamp * 1000 + ap;
+            put_bytes(&builder, &tsf, sizeof(tsf));
+            put_bytes(&builder, "\x64\x00\x11\x04", 4);
+            put_ssid(&builder, ap);
+            put_element(&builder, 1, rates, sizeof(rates));
+            put_element(&builder, 3, &channel, 1);
+            uint8_t tim[4] = {(uint8_t) (random_next() % 3), 3, 0, 0};
+            put_element(&builder, 5, tim, sizeof(tim));
+            put_seeded_element(&builder, 48, ap % 3, 20);               // RSN
+            put_seeded_element(&builder, 45, ap + 400, 26);             // HT capabilities
+            put_seeded_element(&builder, 61, ap + 500, 22);             // HT operation
+            put_seeded_element(&builder, 221, ap % 4 + 600, 24);        // WMM
+        } else if (kind < 90) {
+            // Data frame, the record keeps its header only
+            const synthetic_device_t *device = &devices[random_next() % SYNTHETIC_DEVICES];
+            const uint8_t *ap = aps[random_next() % SYNTHETIC_APS];
+            put_header(&builder, DOT11_TYPE_DATA, 8, ap, device->mac, ap);
+            uint8_t body[64];
+            for (size_t b = 0; b < sizeof(body); b++) {
+                body[b] = (uint8_t) random_next();
+            }
+            put_bytes(&builder, body, sizeof(body));
+        } else {
+            // Acknowledgement
+            uint8_t ack[10] = {DOT11_SUBTYPE_ACK << 4 | DOT11_TYPE_CTRL << 2};
+            memcpy(ack + 4, devices[random_next() % SYNTHETIC_DEVICES].mac, 6);
+            put_bytes(&builder, ack, sizeof(ack));
+        }
+
+        uint32_t fcs = random_next();
+        put_bytes(&builder, &fcs, sizeof(fcs));
+        to_record(&builder, timestamp, &records[i]);
+    }
+}
+
+static bool same_record(const captured_packet_t *a, const captured_packet_t *b)
+{
+    return a->timestamp == b->timestamp && a->frame_type == b->frame_type && a->frame_subtype == b->frame_subtype &&
+           a->rssi == b->rssi && a->channel == b->channel && a->header_len == b->header_len &&
+           a->payload_len == b->payload_len && memcmp(a->header, b->header, a->header_len) == 0 &&
+           memcmp(a->payload, b->payload, a->payload_len) == 0;
+}
+
+typedef struct {
+    const captured_packet_t *expected;
+    uint64_t count;
+    uint64_t decoded;
+    uint64_t mismatches;
+} verify_context_t;
+
+static void verify_record(void *context, const captured_packet_t *record)
+{
+    verify_context_t *verify = context;
+    if (verify->decoded >= verify->count || !same_record(record, &verify->expected[verify->decoded])) {
+        verify->mismatches++;
+    }
+    verify->decoded++;
+}
+
+static double seconds_since(const struct timespec *begin)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - begin->tv_sec) + (double) (end.tv_nsec - begin->tv_nsec) / 1e9;
+}
+
+// Encode all records into `*buffer`, grown as needed. Returns the encoded size, 0 when out of memory.
+static uint64_t encode_all(l2_dict_encoder_t *encoder, const captured_packet_t *records, uint64_t count,
+                           uint8_t **buffer, uint64_t *capacity)
+{
+    uint64_t bytes = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (bytes + L2_DICT_MAX_OUTPUT > *capacity) {
+            uint8_t *grown = realloc(*buffer, *capacity * 2);
+            if (grown == NULL) {
+                return 0;
+            }
+            *buffer = grown;
+            *capacity *= 2;
+        }
+        bytes += l2_dict_encode(encoder, &records[i], *buffer + bytes);
+    }
+    return bytes;
+}
+
+static int command_bench(const char *source, uint32_t segment_size)
+{
+    uint64_t count;
+    captured_packet_t *records;
+    struct stat st;
+    bool synthetic = stat(source, &st) != 0;
+    if (!synthetic) {
+        file_header_t header;
+        records = load_capture(source, &count, &header);
+    } else {
+        count = strtoull(source, NULL, 10);
+        if (count == 0) {
+            fprintf(stderr, "capdict: %s: no such capture\n", source);
+            return 2;
+        }
+        records = malloc(count * sizeof(captured_packet_t));
+        if (records) {
+            synthetic_records(records, count);
+        }
+    }
+    l2_dict_encoder_t *encoder = malloc(sizeof(l2_dict_encoder_t));
+    l2_dict_decoder_t *decoder = malloc(sizeof(l2_dict_decoder_t));
+    uint64_t capacity = count * sizeof(captured_packet_t) + L2_DICT_MAX_OUTPUT;
+    uint8_t *buffer = records ? malloc(capacity) : NULL;
+    if (records == NULL || encoder == NULL || decoder == NULL || buffer == NULL) {
+        fprintf(stderr, "capdict: out of memory\n");
+        free(records);
+        free(encoder);
+        free(decoder);
+        free(buffer);
+        return 1;
+    }
+    uint64_t raw = count * sizeof(captured_packet_t);
+
+    l2_dict_encoder_setup(encoder, segment_size, 0, false);
+    uint64_t plain = encode_all(encoder, records, count, &buffer, &capacity);
+
+    l2_dict_encoder_setup(encoder, segment_size, 0, true);
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    uint64_t coded = encode_all(encoder, records, count, &buffer, &capacity);
+    double encode_seconds = seconds_since(&begin);
+    if (plain == 0 || coded == 0) {
+        fprintf(stderr, "capdict: out of memory\n");
+        free(records);
+        free(encoder);
+        free(decoder);
+        free(buffer);
+        return 1;
+    }
+
+    verify_context_t verify = {.expected = records, .count = count};
+    uint64_t malformed = 0;
+    l2_dict_decoder_setup(decoder, encoder->segment_size);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (uint64_t offset = 0; offset < coded; offset += encoder->segment_size) {
+        uint64_t len = coded - offset < encoder->segment_size ? coded - offset : encoder->segment_size;
+        if (l2_dict_decode_segment(decoder, buffer + offset, len, verify_record, &verify) < 0) {
+            malformed++;
+        }
+    }
+    double decode_seconds = seconds_since(&begin);
+    bool ok = verify.decoded == count && verify.mismatches == 0 && malformed == 0;
+    // The synthetic devices probe for the same few networks over and over
+    if (synthetic && encoder->probe_ssids > 0 && encoder->probe_ssid_references == 0) {
+        ok = false;
+    }
+
+    printf("%" PRIu64 " records, %" PRIu32 " KiB segments\n", count, encoder->segment_size / 1024);
+    printf("  fixed-size records:   %12" PRIu64 " bytes\n", raw);
+    printf("  actual lengths:       %12" PRIu64 " bytes (%.1f%%)\n", plain, 100.0 * (double) plain / (double) raw);
+    printf("  with dictionary:      %12" PRIu64 " bytes (%.1f%%, %.1f%% of actual lengths)\n", coded,
+           100.0 * (double) coded / (double) raw, 100.0 * (double) coded / (double) plain);
+    printf("  %" PRIu64 " segments, %" PRIu64 " definitions, %" PRIu64 " references, %" PRIu64 " padding bytes\n",
+           encoder->segments, encoder->definitions, encoder->references, encoder->padding);
+    printf("  %" PRIu64 " of %" PRIu64 " probe request SSIDs replaced by references\n", encoder->probe_ssid_references,
+           encoder->probe_ssids);
+    printf("  encode %.0f MB/s (%.2f M records/s), decode %.0f MB/s of raw records\n",
+           (double) raw / encode_seconds / 1e6, (double) count / encode_seconds / 1e6,
+           (double) raw / decode_seconds / 1e6);
+    printf("  %" PRIu64 " of %" PRIu64 " records expanded to their original bytes, %" PRIu64 " malformed segments\n",
+           verify.decoded - verify.mismatches, count, malformed);
+
+    free(records);
+    free(encoder);
+    free(decoder);
+    free(buffer);
+    return ok ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: capdict expand <l2dc.bin> <l2.bin>\n"
+                    "       capdict encode <l2.bin> <l2dc.bin> [segment-kib]\n"
+                    "       capdict bench <l2.bin | frames> [segment-kib]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && strcmp(argv[1], "expand") == 0) {
+        return command_expand(argv[2], argv[3]);
+    }
+    if ((argc == 4 || argc == 5) && strcmp(argv[1], "encode") == 0) {
+        uint32_t segment_kib = argc == 5 ? (uint32_t) strtoul(argv[4], NULL, 10) : DEFAULT_SEGMENT_KIB;
+        return command_encode(argv[2], argv[3], segment_kib * 1024);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "bench") == 0) {
+        uint32_t segment_kib = argc == 4 ? (uint32_t) strtoul(argv[3], NULL, 10) : DEFAULT_SEGMENT_KIB;
+        return command_bench(argv[2], segment_kib * 1024);
+    }
+    usage();
+    return 2;
+}
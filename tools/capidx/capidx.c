@@ -0,0 +1,385 @@
+// capidx - build and query sidecar time/MAC indexes for L2 captures
+//
+//   capidx build <capture> [index]                 Index the whole capture
+//   capidx update <capture> [index]                Append a segment for records added since the last run
+//   capidx mac <capture> <AA:BB:CC:DD:EE:FF> [index] [--scan]
+//   capidx range <capture> <from_ms> <to_ms> [index] [--scan]
+//   capidx bench <capture> <records> [devices]
+//
+// The index defaults to <capture>.idx. With --scan the query is answered by reading the whole capture instead,
+// which gives a baseline to compare bytes read and time against.
+//
+// `bench` writes a synthetic L2 capture of <records> probe requests from <devices> transmitters (default 10000,
+// an existing file of the right size is reused, 10M records are 1.8 GB), indexes it and runs MAC and time range
+// queries through the index and by full scan. Every result is checked against the known content of the capture.
+// It reports the indexing rate, the index size and the time and bytes read per query.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "capture_index.h"
+
+#define BENCH_BASE_TIME 1700000000000ull
+#define BENCH_RECORDS_PER_MS 4
+#define BENCH_WRITE_RECORDS 4096
+#define BENCH_QUERIES 32
+
+typedef struct {
+    bool by_mac;
+    uint8_t mac[6];
+    uint64_t from;
+    uint64_t to;
+    uint64_t matches;
+} query_t;
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: capidx build|update <capture> [index]\n"
+                    "       capidx mac <capture> <AA:BB:CC:DD:EE:FF> [index] [--scan]\n"
+                    "       capidx range <capture> <from_ms> <to_ms> [index] [--scan]\n"
+                    "       capidx bench <capture> <records> [devices]\n");
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) * 1e3 + (double) (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static bool query_matches(const query_t *query, const capture_record_t *record)
+{
+    if (query->by_mac) {
+        const uint8_t *transmitter = capture_record_transmitter(record);
+        return transmitter != NULL && memcmp(transmitter, query->mac, 6) == 0;
+    }
+    return record->l2.timestamp >= query->from && record->l2.timestamp < query->to;
+}
+
+static int print_record(const capture_record_t *record, void *ctx)
+{
+    query_t *query = ctx;
+    const captured_packet_t *packet = &record->l2;
+    const uint8_t *transmitter = capture_record_transmitter(record);
+    static const uint8_t none[6];
+    if (transmitter == NULL) {
+        transmitter = none;
+    }
+
+    printf("%" PRIu64 "\t%" PRIu64 "\t%02x:%02x:%02x:%02x:%02x:%02x\t%u/%u\t%u\t%d\n", packet->timestamp,
+           record->offset, transmitter[0], transmitter[1], transmitter[2], transmitter[3], transmitter[4],
+           transmitter[5], packet->frame_type, packet->frame_subtype, packet->channel, packet->rssi);
+    query->matches++;
+    return 0;
+}
+
+static int run_query(const char *capture_path, const char *index_path, query_t *query, bool scan)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, capture_path) != 0) {
+        fprintf(stderr, "capidx: %s: %s\n", capture_path, strerror(errno));
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = 0;
+
+    if (scan) {
+        capture_record_t record;
+        while ((rc = capture_reader_next(&reader, &record)) == 1) {
+            if (query_matches(query, &record)) {
+                print_record(&record, query);
+            }
+        }
+    } else {
+        capture_index_t index;
+        if (capture_index_open(&index, index_path) != 0) {
+            fprintf(stderr, "capidx: %s: %s\n", index_path, strerror(errno));
+            capture_reader_close(&reader);
+            return 1;
+        }
+        if (query->by_mac) {
+            rc = capture_index_query_mac(&index, &reader, query->mac, print_record, query);
+        } else {
+            rc = capture_index_query_range(&index, &reader, query->from, query->to, print_record, query);
+        }
+        capture_index_close(&index);
+    }
+
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " bytes read, %.1f ms (%s)\n", query->matches,
+            reader.bytes_read, elapsed_ms(&start), scan ? "full scan" : "index");
+    capture_reader_close(&reader);
+
+    if (rc < 0) {
+        fprintf(stderr, "capidx: %s: %s\n", capture_path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static void bench_mac(uint32_t device, uint8_t mac[6])
+{
+    mac[0] = 0x02;
+    mac[1] = 0xBE;
+    mac[2] = (uint8_t) (device >> 24);
+    mac[3] = (uint8_t) (device >> 16);
+    mac[4] = (uint8_t) (device >> 8);
+    mac[5] = (uint8_t) device;
+}
+
+// Record i is sent at BENCH_BASE_TIME + i / BENCH_RECORDS_PER_MS by a random device. The draws are replayed even
+// when the file already exists, to count the records of every device.
+static int bench_generate(const char *path, uint64_t count, uint32_t devices, uint64_t *per_device)
+{
+    struct stat st;
+    uint64_t size = sizeof(file_header_t) + count * sizeof(captured_packet_t);
+    bool reuse = stat(path, &st) == 0 && (uint64_t) st.st_size == size;
+
+    FILE *file = NULL;
+    captured_packet_t *records = calloc(BENCH_WRITE_RECORDS, sizeof(captured_packet_t));
+    if (records == NULL || (!reuse && (file = fopen(path, "wb")) == NULL)) {
+        free(records);
+        return -1;
+    }
+    if (file) {
+        file_header_t header = {.version = capture_format_info(CAPTURE_FORMAT_L2_RAW)->version,
+                .start_time = BENCH_BASE_TIME / 1000, .wifi_mac = {0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01}};
+        memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+        fwrite(&header, sizeof(header), 1, file);
+    }
+
+    random_state = 0x9E3779B97F4A7C15ull;
+    for (uint64_t i = 0; i < count;) {
+        uint32_t n = 0;
+        for (; n < BENCH_WRITE_RECORDS && i < count; n++, i++) {
+            uint32_t device = random_next() % devices;
+            per_device[device]++;
+            if (file == NULL) {
+                continue;
+            }
+            captured_packet_t *record = &records[n];
+            record->timestamp = BENCH_BASE_TIME + i / BENCH_RECORDS_PER_MS;
+            record->frame_type = 0;
+            record->frame_subtype = 4;
+            record->rssi = (int8_t) (-40 - (int) (i % 50));
+            record->channel = (uint8_t) (1 + i % 13);
+            record->header_len = 24;
+            record->header[0] = 0x40;
+            memset(&record->header[4], 0xFF, 6);
+            bench_mac(device, &record->header[10]);
+            record->payload_len = 8;
+            memcpy(record->payload, &i, sizeof(i));
+        }
+        if (file && fwrite(records, sizeof(captured_packet_t), n, file) != n) {
+            break;
+        }
+    }
+    free(records);
+    if (file == NULL) {
+        return 0;
+    }
+    bool failed = ferror(file) != 0;
+    return fclose(file) == 0 && !failed ? 0 : -1;
+}
+
+typedef struct {
+    query_t query;
+    uint64_t wrong;          // Records returned that do not match the query
+} bench_query_t;
+
+static int count_record(const capture_record_t *record, void *ctx)
+{
+    bench_query_t *bench = ctx;
+    bench->query.matches++;
+    bench->wrong += !query_matches(&bench->query, record);
+    return 0;
+}
+
+// Runs the query through the index, or by full scan, and checks it returned `expected` matching records
+static int bench_query(const capture_index_t *index, capture_reader_t *reader, const query_t *query,
+                       uint64_t expected, bool scan, double *seconds, uint64_t *bytes_read)
+{
+    bench_query_t bench = {.query = *query};
+    uint64_t before = reader->bytes_read;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int rc = 0;
+    if (scan) {
+        capture_record_t record;
+        capture_reader_seek(reader, reader->data_start, UINT64_MAX);
+        while ((rc = capture_reader_next(reader, &record)) == 1) {
+            if (query_matches(query, &record)) {
+                count_record(&record, &bench);
+            }
+        }
+    } else if (query->by_mac) {
+        rc = capture_index_query_mac(index, reader, query->mac, count_record, &bench);
+    } else {
+        rc = capture_index_query_range(index, reader, query->from, query->to, count_record, &bench);
+    }
+
+    *seconds += elapsed_ms(&start) / 1e3;
+    *bytes_read += reader->bytes_read - before;
+    return rc < 0 || bench.wrong > 0 || bench.query.matches != expected ? -1 : 0;
+}
+
+static int command_bench(const char *capture_path, uint64_t count, uint32_t devices)
+{
+    uint64_t *per_device = calloc(devices, sizeof(uint64_t));
+    if (per_device == NULL) {
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (bench_generate(capture_path, count, devices, per_device) != 0) {
+        fprintf(stderr, "capidx: %s: %s\n", capture_path, strerror(errno));
+        free(per_device);
+        return 1;
+    }
+    double capture_gb = (double) count * sizeof(captured_packet_t) / 1e9;
+    printf("%" PRIu64 " records from %" PRIu32 " devices, %.2f GB, ready in %.1f s\n", count, devices, capture_gb,
+           elapsed_ms(&start) / 1e3);
+
+    char index_path[4096];
+    snprintf(index_path, sizeof(index_path), "%s.idx", capture_path);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int64_t indexed = capture_index_build(capture_path, index_path, false);
+    double build_seconds = elapsed_ms(&start) / 1e3;
+    capture_reader_t reader;
+    capture_index_t index;
+    if (indexed < 0 || capture_reader_open(&reader, capture_path) != 0) {
+        fprintf(stderr, "capidx: %s: %s\n", capture_path, strerror(errno));
+        free(per_device);
+        return 1;
+    }
+    if (capture_index_open(&index, index_path) != 0) {
+        fprintf(stderr, "capidx: %s: %s\n", index_path, strerror(errno));
+        capture_reader_close(&reader);
+        free(per_device);
+        return 1;
+    }
+    printf("indexed %" PRId64 " records in %.1f s: %.1f M records/s, %.0f MB/s, index %.1f MB (%.2f %% of the "
+           "capture)\n", indexed, build_seconds, (double) indexed / build_seconds / 1e6, capture_gb * 1e3 /
+           build_seconds, (double) index.size / 1e6, (double) index.size / (capture_gb * 1e9) * 100.0);
+
+    // Queries for random devices and for random 1 s windows, each also answered once by a full scan
+    uint64_t span = (count + BENCH_RECORDS_PER_MS - 1) / BENCH_RECORDS_PER_MS;
+    int failures = 0;
+    for (int by_mac = 1; by_mac >= 0; by_mac--) {
+        double seconds[2] = {0};
+        uint64_t bytes[2] = {0};
+        uint64_t matches = 0;
+        for (int i = 0; i < BENCH_QUERIES; i++) {
+            query_t query = {.by_mac = by_mac};
+            uint64_t expected;
+            if (by_mac) {
+                uint32_t device = random_next() % devices;
+                bench_mac(device, query.mac);
+                expected = per_device[device];
+            } else {
+                query.from = BENCH_BASE_TIME + (span > 1000 ? random_next() % (span - 1000) : 0);
+                query.to = query.from + 1000;
+                uint64_t first = (query.from - BENCH_BASE_TIME) * BENCH_RECORDS_PER_MS;
+                uint64_t last = (query.to - BENCH_BASE_TIME) * BENCH_RECORDS_PER_MS;
+                expected = (last < count ? last : count) - first;
+            }
+            matches += expected;
+            failures += bench_query(&index, &reader, &query, expected, false, &seconds[0], &bytes[0]) != 0;
+            if (i == 0) {
+                failures += bench_query(&index, &reader, &query, expected, true, &seconds[1], &bytes[1]) != 0;
+            }
+        }
+        printf("%-5s %" PRIu64 " records in %d queries: index %.2f ms and %.1f KB per query, full scan %.0f ms and "
+               "%.0f MB\n", by_mac ? "mac" : "range", matches, BENCH_QUERIES, seconds[0] / BENCH_QUERIES * 1e3,
+               (double) bytes[0] / BENCH_QUERIES / 1e3, seconds[1] * 1e3, (double) bytes[1] / 1e6);
+    }
+    printf("failed queries %d\n", failures);
+
+    capture_index_close(&index);
+    capture_reader_close(&reader);
+    free(per_device);
+    return failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        usage();
+        return 2;
+    }
+
+    const char *command = argv[1];
+    const char *capture_path = argv[2];
+
+    if (strcmp(command, "bench") == 0 && (argc == 4 || argc == 5)) {
+        uint64_t count = strtoull(argv[3], NULL, 10);
+        uint32_t devices = argc == 5 ? (uint32_t) strtoul(argv[4], NULL, 10) : 10000;
+        if (count > 0 && devices > 0) {
+            return command_bench(capture_path, count, devices);
+        }
+        usage();
+        return 2;
+    }
+
+    char index_path[4096];
+    snprintf(index_path, sizeof(index_path), "%s.idx", capture_path);
+
+    if (strcmp(command, "build") == 0 || strcmp(command, "update") == 0) {
+        if (argc > 3) {
+            snprintf(index_path, sizeof(index_path), "%s", argv[3]);
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int64_t records = capture_index_build(capture_path, index_path, strcmp(command, "update") == 0);
+        if (records < 0) {
+            fprintf(stderr, "capidx: %s: %s\n", capture_path, strerror(errno));
+            return 1;
+        }
+        fprintf(stderr, "Indexed %" PRId64 " records in %.1f ms\n", records, elapsed_ms(&start));
+        return 0;
+    }
+
+    query_t query = {0};
+    bool scan = argc > 0 && strcmp(argv[argc - 1], "--scan") == 0;
+    int arguments = argc - (scan ? 1 : 0);
+
+    if (strcmp(command, "mac") == 0 && (arguments == 4 || arguments == 5)) {
+        query.by_mac = true;
+        if (capture_parse_mac(argv[3], query.mac) != 0) {
+            fprintf(stderr, "capidx: invalid MAC address %s\n", argv[3]);
+            return 2;
+        }
+        if (arguments == 5) {
+            snprintf(index_path, sizeof(index_path), "%s", argv[4]);
+        }
+    } else if (strcmp(command, "range") == 0 && (arguments == 5 || arguments == 6)) {
+        query.from = strtoull(argv[3], NULL, 10);
+        query.to = strtoull(argv[4], NULL, 10);
+        if (arguments == 6) {
+            snprintf(index_path, sizeof(index_path), "%s", argv[5]);
+        }
+    } else {
+        usage();
+        return 2;
+    }
+
+    return run_query(capture_path, index_path, &query, scan);
+}
@@ -0,0 +1,471 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "capture_index.h"
+#include "hash.h"
+
+// Posting list of one transmitter while building a segment
+typedef struct {
+    uint8_t mac[6];
+    bool used;
+    uint32_t count;
+    uint64_t last_offset;
+    uint8_t *postings;
+    size_t postings_len;
+    size_t postings_capacity;
+} mac_builder_t;
+
+typedef struct {
+    mac_builder_t *entries;
+    size_t capacity;
+    size_t used;
+} mac_table_t;
+
+static mac_builder_t *mac_table_find(mac_table_t *table, const uint8_t mac[6])
+{
+    size_t mask = table->capacity - 1;
+    size_t slot = (size_t) hash_mac(mac) & mask;
+
+    while (table->entries[slot].used && memcmp(table->entries[slot].mac, mac, 6) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return &table->entries[slot];
+}
+
+static int mac_table_grow(mac_table_t *table)
+{
+    mac_table_t grown = {
+            .entries = calloc(table->capacity * 2, sizeof(mac_builder_t)),
+            .capacity = table->capacity * 2,
+            .used = table->used,
+    };
+    if (grown.entries == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->entries[i].used) {
+            *mac_table_find(&grown, table->entries[i].mac) = table->entries[i];
+        }
+    }
+    free(table->entries);
+    *table = grown;
+    return 0;
+}
+
+static int append_varint(mac_builder_t *entry, uint64_t value)
+{
+    if (entry->postings_capacity - entry->postings_len < 10) {
+        size_t capacity = entry->postings_capacity ? entry->postings_capacity * 2 : 16;
+        uint8_t *postings = realloc(entry->postings, capacity);
+        if (postings == NULL) {
+            return -1;
+        }
+        entry->postings = postings;
+        entry->postings_capacity = capacity;
+    }
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        entry->postings[entry->postings_len++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return 0;
+}
+
+static const uint8_t *read_varint(const uint8_t *data, const uint8_t *end, uint64_t *value)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    while (data < end && shift < 64) {
+        uint8_t byte = *data++;
+        result |= (uint64_t) (byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return data;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+static int compare_macs(const void *a, const void *b)
+{
+    return memcmp(((const capture_index_mac_t *) a)->mac, ((const capture_index_mac_t *) b)->mac, 6);
+}
+
+static int write_all(FILE *file, const void *data, size_t len)
+{
+    return len == 0 || fwrite(data, len, 1, file) == 1 ? 0 : -1;
+}
+
+typedef struct {
+    const capture_index_segment_t *segment;
+    const capture_index_block_t *blocks;
+    const capture_index_mac_t *macs;
+    const uint8_t *postings;
+} segment_view_t;
+
+// Decode the segment at `position`. Returns the position of the next segment, or 0 when there is no complete
+// segment at `position` (end of the index or a segment cut short by an interrupted append). The tables are sized
+// from the header counts, so the counts are checked against each other and the bytes left before they are trusted.
+static size_t segment_at(const capture_index_t *index, size_t position, segment_view_t *view)
+{
+    if (position + sizeof(capture_index_segment_t) > index->size) {
+        return 0;
+    }
+
+    const capture_index_segment_t *segment = (const capture_index_segment_t *) (index->data + position);
+    uint64_t left = index->size - position - sizeof(capture_index_segment_t);
+    uint64_t blocks = ((uint64_t) segment->record_count + CAPTURE_INDEX_BLOCK_RECORDS - 1) /
+                      CAPTURE_INDEX_BLOCK_RECORDS;
+    if (memcmp(segment->magic, "ISEG", 4) != 0 || segment->record_count == 0 || segment->block_count != blocks ||
+        segment->mac_count > segment->record_count || segment->data_end <= segment->data_start ||
+        (uint64_t) segment->block_count * sizeof(capture_index_block_t) +
+        (uint64_t) segment->mac_count * sizeof(capture_index_mac_t) > left) {
+        return 0;
+    }
+    left -= (uint64_t) segment->block_count * sizeof(capture_index_block_t) +
+            (uint64_t) segment->mac_count * sizeof(capture_index_mac_t);
+    if (segment->postings_size > left) {
+        return 0;
+    }
+
+    view->segment = segment;
+    view->blocks = (const capture_index_block_t *) (segment + 1);
+    view->macs = (const capture_index_mac_t *) (view->blocks + segment->block_count);
+    view->postings = (const uint8_t *) (view->macs + segment->mac_count);
+    return (size_t) (view->postings - index->data) + (size_t) segment->postings_size;
+}
+
+// Offset where the existing index stops covering the capture, -1 when the index does not belong to it.
+// `*index_end` is set behind the last complete segment, where the next one is appended.
+static int64_t indexed_end(const char *index_path, const file_header_t *capture_header, size_t *index_end)
+{
+    capture_index_t index;
+    if (capture_index_open(&index, index_path) != 0) {
+        return -1;
+    }
+
+    const capture_index_header_t *header = (const capture_index_header_t *) index.data;
+    int64_t end = (int64_t) sizeof(file_header_t);
+    if (memcmp(&header->capture_header, capture_header, sizeof(file_header_t)) != 0) {
+        end = -1;
+    }
+
+    segment_view_t view;
+    size_t position = sizeof(capture_index_header_t);
+    size_t next;
+    while (end >= 0 && (next = segment_at(&index, position, &view)) != 0) {
+        end = (int64_t) view.segment->data_end;
+        position = next;
+    }
+    *index_end = position;
+
+    capture_index_close(&index);
+    return end;
+}
+
+int64_t capture_index_build(const char *capture_path, const char *index_path, bool append)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, capture_path) != 0) {
+        return -1;
+    }
+    if (reader.kind != CAPTURE_KIND_L2) {
+        capture_reader_close(&reader);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    uint64_t start = reader.data_start;
+    if (append && access(index_path, F_OK) == 0) {
+        size_t index_end;
+        int64_t end = indexed_end(index_path, &reader.header, &index_end);
+        if (end < 0 || (uint64_t) end > reader.file_size) {
+            // Index belongs to another capture, fall back to a full rebuild
+            append = false;
+        } else if (truncate(index_path, (off_t) index_end) != 0) {
+            // Bytes of an interrupted append would hide the new segment behind them
+            capture_reader_close(&reader);
+            return -1;
+        } else {
+            start = (uint64_t) end;
+        }
+    } else {
+        append = false;
+    }
+
+    FILE *file = fopen(index_path, append ? "ab" : "wb");
+    if (file == NULL) {
+        capture_reader_close(&reader);
+        return -1;
+    }
+
+    if (!append) {
+        capture_index_header_t header = {
+                .magic = {'C', 'I', 'D', 'X'},
+                .version = CAPTURE_INDEX_VERSION,
+                .capture_header = reader.header,
+        };
+        write_all(file, &header, sizeof(header));
+    }
+
+    mac_table_t table = {.entries = calloc(1024, sizeof(mac_builder_t)), .capacity = 1024};
+    capture_index_block_t *blocks = NULL;
+    size_t block_capacity = 0;
+    capture_index_segment_t segment = {
+            .magic = {'I', 'S', 'E', 'G'},
+            .data_start = start,
+            .data_end = start,
+            .min_timestamp = UINT64_MAX,
+    };
+    int64_t result = -1;
+
+    if (table.entries == NULL) {
+        goto cleanup;
+    }
+
+    capture_reader_seek(&reader, start, UINT64_MAX);
+
+    capture_record_t record;
+    int rc;
+    while ((rc = capture_reader_next(&reader, &record)) == 1) {
+        uint64_t timestamp = record.l2.timestamp;
+
+        if (segment.record_count % CAPTURE_INDEX_BLOCK_RECORDS == 0) {
+            if (segment.block_count == block_capacity) {
+                block_capacity = block_capacity ? block_capacity * 2 : 64;
+                capture_index_block_t *grown = realloc(blocks, block_capacity * sizeof(*blocks));
+                if (grown == NULL) {
+                    goto cleanup;
+                }
+                blocks = grown;
+            }
+            blocks[segment.block_count++] = (capture_index_block_t) {
+                    .offset = record.offset,
+                    .min_timestamp = UINT64_MAX,
+            };
+        }
+
+        capture_index_block_t *block = &blocks[segment.block_count - 1];
+        if (timestamp < block->min_timestamp) block->min_timestamp = timestamp;
+        if (timestamp > block->max_timestamp) block->max_timestamp = timestamp;
+        if (timestamp < segment.min_timestamp) segment.min_timestamp = timestamp;
+        if (timestamp > segment.max_timestamp) segment.max_timestamp = timestamp;
+
+        const uint8_t *transmitter = capture_record_transmitter(&record);
+        if (transmitter != NULL) {
+            if (table.used * 2 >= table.capacity && mac_table_grow(&table) != 0) {
+                goto cleanup;
+            }
+            mac_builder_t *entry = mac_table_find(&table, transmitter);
+            if (!entry->used) {
+                memcpy(entry->mac, transmitter, 6);
+                entry->used = true;
+                entry->last_offset = start;
+                table.used++;
+            }
+            if (append_varint(entry, record.offset - entry->last_offset) != 0) {
+                goto cleanup;
+            }
+            entry->last_offset = record.offset;
+            entry->count++;
+        }
+
+        segment.record_count++;
+        segment.data_end = record.offset + record.size;
+    }
+    if (rc < 0) {
+        goto cleanup;
+    }
+
+    if (segment.record_count == 0) {
+        // Nothing new to index
+        result = 0;
+        goto cleanup;
+    }
+
+    // Sorted MAC table for binary search at query time
+    capture_index_mac_t *macs = calloc(table.used, sizeof(*macs));
+    if (macs == NULL) {
+        goto cleanup;
+    }
+    size_t mac_count = 0;
+    for (size_t i = 0; i < table.capacity; i++) {
+        if (table.entries[i].used) {
+            memcpy(macs[mac_count].mac, table.entries[i].mac, 6);
+            macs[mac_count].count = table.entries[i].count;
+            mac_count++;
+        }
+    }
+    qsort(macs, mac_count, sizeof(*macs), compare_macs);
+
+    // Posting lists are stored in MAC table order
+    uint64_t postings_size = 0;
+    for (size_t i = 0; i < mac_count; i++) {
+        macs[i].postings_offset = postings_size;
+        postings_size += mac_table_find(&table, macs[i].mac)->postings_len;
+    }
+
+    segment.mac_count = (uint32_t) mac_count;
+    segment.postings_size = postings_size;
+
+    int failed = write_all(file, &segment, sizeof(segment)) ||
+                 write_all(file, blocks, segment.block_count * sizeof(*blocks)) ||
+                 write_all(file, macs, mac_count * sizeof(*macs));
+    for (size_t i = 0; i < mac_count && !failed; i++) {
+        mac_builder_t *entry = mac_table_find(&table, macs[i].mac);
+        failed = write_all(file, entry->postings, entry->postings_len);
+    }
+    free(macs);
+
+    if (!failed) {
+        result = segment.record_count;
+    }
+
+cleanup:
+    if (table.entries) {
+        for (size_t i = 0; i < table.capacity; i++) {
+            free(table.entries[i].postings);
+        }
+        free(table.entries);
+    }
+    free(blocks);
+    if (fclose(file) != 0) {
+        result = -1;
+    }
+    capture_reader_close(&reader);
+    return result;
+}
+
+int capture_index_open(capture_index_t *index, const char *index_path)
+{
+    int fd = open(index_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(capture_index_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    void *data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+
+    const capture_index_header_t *header = data;
+    if (memcmp(header->magic, "CIDX", 4) != 0 || header->version != CAPTURE_INDEX_VERSION) {
+        munmap(data, (size_t) st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+
+    index->data = data;
+    index->size = (size_t) st.st_size;
+    return 0;
+}
+
+void capture_index_close(capture_index_t *index)
+{
+    if (index->data) {
+        munmap((void *) index->data, index->size);
+        index->data = NULL;
+    }
+}
+
+int capture_index_query_mac(const capture_index_t *index, capture_reader_t *reader, const uint8_t mac[6],
+                            capture_index_visit_t visit, void *ctx)
+{
+    segment_view_t view;
+    size_t position = sizeof(capture_index_header_t);
+
+    while ((position = segment_at(index, position, &view)) != 0) {
+        const capture_index_segment_t *segment = view.segment;
+        capture_index_mac_t key;
+        memcpy(key.mac, mac, 6);
+        const capture_index_mac_t *entry = bsearch(&key, view.macs, segment->mac_count, sizeof(*view.macs),
+                                                compare_macs);
+        if (entry == NULL) {
+            continue;
+        }
+
+        const uint8_t *cursor = view.postings + entry->postings_offset;
+        const uint8_t *end = view.postings + segment->postings_size;
+        uint64_t offset = segment->data_start;
+
+        for (uint32_t i = 0; i < entry->count; i++) {
+            uint64_t delta;
+            cursor = read_varint(cursor, end, &delta);
+            if (cursor == NULL) {
+                errno = EINVAL;
+                return -1;
+            }
+            offset += delta;
+
+            capture_record_t record;
+            int rc = capture_reader_read_at(reader, offset, &record);
+            if (rc <= 0) {
+                return rc;
+            }
+            if (visit(&record, ctx)) {
+                return 0;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int capture_index_query_range(const capture_index_t *index, capture_reader_t *reader, uint64_t from, uint64_t to,
+                              capture_index_visit_t visit, void *ctx)
+{
+    segment_view_t view;
+    size_t position = sizeof(capture_index_header_t);
+
+    while ((position = segment_at(index, position, &view)) != 0) {
+        const capture_index_segment_t *segment = view.segment;
+        const capture_index_block_t *blocks = view.blocks;
+
+        if (segment->max_timestamp < from || segment->min_timestamp >= to) {
+            continue;
+        }
+
+        for (uint32_t b = 0; b < segment->block_count; b++) {
+            if (blocks[b].max_timestamp < from || blocks[b].min_timestamp >= to) {
+                continue;
+            }
+
+            // Adjacent matching blocks are read as one range
+            uint32_t last = b;
+            while (last + 1 < segment->block_count && blocks[last + 1].max_timestamp >= from &&
+                   blocks[last + 1].min_timestamp < to) {
+                last++;
+            }
+            uint64_t end = last + 1 < segment->block_count ? blocks[last + 1].offset : segment->data_end;
+
+            capture_reader_seek(reader, blocks[b].offset, end);
+            capture_record_t record;
+            int rc;
+            while ((rc = capture_reader_next(reader, &record)) == 1) {
+                if (record.l2.timestamp >= from && record.l2.timestamp < to && visit(&record, ctx)) {
+                    return 0;
+                }
+            }
+            if (rc < 0) {
+                return -1;
+            }
+            b = last;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef CAPTURE_INDEX_H
+#define CAPTURE_INDEX_H
+
+// Sidecar index for a capture file (<capture>.idx).
+//
+// The index is a header followed by segments, each covering a contiguous byte range of the capture. New data is
+// indexed by appending a segment, so an index can be extended as the capture grows without rewriting it.
+// A segment holds:
+//   - a sparse time table: one block per CAPTURE_INDEX_BLOCK_RECORDS records with its offset and timestamp range
+//   - a MAC table sorted by transmitter address, pointing into
+//   - posting lists of record offsets, delta encoded as LEB128 varints
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "capture_format.h"
+#include "capture_reader.h"
+
+#define CAPTURE_INDEX_VERSION 1
+#define CAPTURE_INDEX_BLOCK_RECORDS 1024
+
+typedef struct __attribute__((packed)) {
+    char magic[4];                 // "CIDX"
+    uint32_t version;
+    file_header_t capture_header;  // Header of the indexed capture, detects a replaced file
+} capture_index_header_t;
+
+typedef struct __attribute__((packed)) {
+    char magic[4];                 // "ISEG"
+    uint32_t record_count;
+    uint64_t data_start;           // Offset of the first covered record
+    uint64_t data_end;             // Offset one past the last covered record
+    uint64_t min_timestamp;
+    uint64_t max_timestamp;
+    uint32_t block_count;
+    uint32_t mac_count;
+    uint64_t postings_size;
+    // Followed by block_count blocks, mac_count MAC entries and postings_size bytes of posting lists
+} capture_index_segment_t;
+
+typedef struct __attribute__((packed)) {
+    uint64_t offset;               // Offset of the first record in the block
+    uint64_t min_timestamp;
+    uint64_t max_timestamp;
+} capture_index_block_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t mac[6];
+    uint16_t reserved;
+    uint32_t count;                // Number of records in the posting list
+    uint64_t postings_offset;      // Offset of the posting list within the segment's postings
+} capture_index_mac_t;
+
+typedef struct {
+    const uint8_t *data;           // Memory mapped index file
+    size_t size;
+} capture_index_t;
+
+// Called for every matching record, a non-zero return stops the query
+typedef int (*capture_index_visit_t)(const capture_record_t *record, void *ctx);
+
+// Index the capture. With `append` an existing index is extended with a segment covering only the new records,
+// after cutting it back to its last complete segment; otherwise the index is rebuilt from scratch. Returns the number of records indexed or -1 on error.
+int64_t capture_index_build(const char *capture_path, const char *index_path, bool append);
+
+int capture_index_open(capture_index_t *index, const char *index_path);
+void capture_index_close(capture_index_t *index);
+
+// Records transmitted by `mac`, in file order
+int capture_index_query_mac(const capture_index_t *index, capture_reader_t *reader, const uint8_t mac[6],
+                            capture_index_visit_t visit, void *ctx);
+
+// Records with from <= timestamp < to, in file order
+int capture_index_query_range(const capture_index_t *index, capture_reader_t *reader, uint64_t from, uint64_t to,
+                              capture_index_visit_t visit, void *ctx);
+
+#endif // CAPTURE_INDEX_H
@@ -0,0 +1,280 @@
+// capjoin - split joined L2 + CSI captures and exercise the firmware's frame join
+//
+//   capjoin split <joined.bin> <l2.bin> <csi.bin>
+//   capjoin bench <frames> [csi-percent] [window-us] [jitter-us]
+//
+// `split` appends the records of a joined capture ("L2CS") to an L2 and a CSI capture, for consumers that expect
+// the two streams of a sniffer built without SNIFFER_JOIN_CSI. The CSI records get the transmitter, RSSI, channel
+// and the timestamp (in seconds) of their L2 part.
+//
+// `bench` feeds interleaved synthetic promiscuous and CSI callbacks of several transmitters through frame_join.c:
+// `csi-percent` of the frames produce CSI, some CSI callbacks lose their L2 callback, and either callback of a frame
+// may come first, after callbacks of the following frames. It checks that every joined pair belongs to one frame
+// and reports the bytes saved against storing both records.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture_reader.h"
+#include "frame_join.h"
+
+#define BENCH_SENDERS 16
+#define BENCH_MIN_GAP_US 20     // Shortest frame airtime
+#define BENCH_MEAN_GAP_US 250   // Mean time between frames
+#define BENCH_REORDER 3         // The second callback of a frame may come after this many later callbacks
+#define BENCH_L2_LOST_PERCENT 2 // CSI callbacks whose promiscuous callback was dropped
+
+static int write_header(FILE *output, const file_header_t *source, capture_format_t format)
+{
+    file_header_t header = *source;
+    memcpy(header.identifier, capture_format_info(format)->identifier, 4);
+    header.version = capture_format_info(format)->version;
+    return fwrite(&header, sizeof(header), 1, output) == 1 ? 0 : -1;
+}
+
+// Existing captures are appended to, new ones start with a header derived from the joined capture
+static FILE *open_output(const char *path, const file_header_t *source, capture_format_t format)
+{
+    FILE *output = fopen(path, "ab");
+    if (output == NULL) {
+        return NULL;
+    }
+    if (ftell(output) == 0 && write_header(output, source, format) != 0) {
+        fclose(output);
+        return NULL;
+    }
+    return output;
+}
+
+static int command_split(const char *joined_path, const char *l2_path, const char *csi_path)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, joined_path) != 0) {
+        fprintf(stderr, "capjoin: %s: %s\n", joined_path, strerror(errno));
+        return 1;
+    }
+    if (reader.format != CAPTURE_FORMAT_JOINED) {
+        fprintf(stderr, "capjoin: %s is not a joined capture\n", joined_path);
+        capture_reader_close(&reader);
+        return 1;
+    }
+
+    FILE *l2 = open_output(l2_path, &reader.header, CAPTURE_FORMAT_L2_RAW);
+    FILE *csi = open_output(csi_path, &reader.header, CAPTURE_FORMAT_CSI);
+    if (l2 == NULL || csi == NULL) {
+        fprintf(stderr, "capjoin: %s: %s\n", l2 == NULL ? l2_path : csi_path, strerror(errno));
+        if (l2) {
+            fclose(l2);
+        }
+        if (csi) {
+            fclose(csi);
+        }
+        capture_reader_close(&reader);
+        return 1;
+    }
+
+    capture_record_t record;
+    uint64_t count = 0;
+    int rc = 0;
+    int result;
+    while ((result = capture_reader_next(&reader, &record)) == 1) {
+        const joined_packet_t *joined = &record.joined;
+        const uint8_t *transmitter = capture_record_transmitter(&record);
+
+        csi_packet_t csi_record;
+        memset(&csi_record, 0, sizeof(csi_record));
+        csi_record.timestamp = joined->frame.timestamp / 1000;
+        if (transmitter) {
+            memcpy(csi_record.mac, transmitter, 6);
+        }
+        csi_record.rssi = joined->frame.rssi;
+        csi_record.channel = joined->frame.channel;
+        csi_record.csi_len = joined->csi_len;
+        memcpy(csi_record.csi_data, joined->csi_data, sizeof(csi_record.csi_data));
+
+        if (fwrite(&joined->frame, sizeof(joined->frame), 1, l2) != 1 ||
+            fwrite(&csi_record, sizeof(csi_record), 1, csi) != 1) {
+            fprintf(stderr, "capjoin: write failed: %s\n", strerror(errno));
+            rc = 1;
+            break;
+        }
+        count++;
+    }
+    if (result < 0) {
+        fprintf(stderr, "capjoin: %s: %s\n", joined_path, strerror(errno));
+        rc = 1;
+    }
+
+    if (fclose(l2) != 0 || fclose(csi) != 0) {
+        rc = 1;
+    }
+    capture_reader_close(&reader);
+    printf("%" PRIu64 " joined records split\n", count);
+    return rc;
+}
+
+typedef struct {
+    uint64_t pairs;
+    uint64_t wrong_pairs;     // Joined records of two different frames
+    uint64_t l2_alone;
+    uint64_t csi_alone;
+} bench_result_t;
+
+// The frame number travels in the timestamp of both records
+static void bench_emit(void *context, const captured_packet_t *l2, const csi_packet_t *csi, uint32_t stamp)
+{
+    (void) stamp;
+    bench_result_t *result = context;
+    if (l2 && csi) {
+        result->pairs++;
+        if (l2->timestamp != csi->timestamp) {
+            result->wrong_pairs++;
+        }
+    } else if (l2) {
+        result->l2_alone++;
+    } else {
+        result->csi_alone++;
+    }
+}
+
+typedef struct {
+    bool l2;
+    uint32_t rx_time;
+    uint8_t sender;
+    uint64_t frame;
+} bench_event_t;
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static int command_bench(uint64_t frames, uint32_t csi_percent, uint32_t window_us, uint32_t jitter_us)
+{
+    bench_event_t *events = malloc(frames * 2 * sizeof(bench_event_t));
+    if (events == NULL) {
+        fprintf(stderr, "capjoin: out of memory\n");
+        return 1;
+    }
+
+    // Callbacks in order of arrival; the rx_ctrl clock starts close to its wrap
+    uint64_t count = 0;
+    uint64_t both = 0;
+    uint64_t l2_events = 0;
+    uint64_t csi_events = 0;
+    uint32_t rx_time = UINT32_MAX - 1000000;
+    for (uint64_t frame = 0; frame < frames; frame++) {
+        rx_time += BENCH_MIN_GAP_US + random_next() % (2 * (BENCH_MEAN_GAP_US - BENCH_MIN_GAP_US));
+        uint8_t sender = (uint8_t) (random_next() % BENCH_SENDERS);
+        bool has_csi = random_next() % 100 < csi_percent;
+        bool has_l2 = !has_csi || random_next() % 100 >= BENCH_L2_LOST_PERCENT;
+        uint32_t jitter = jitter_us ? random_next() % (jitter_us + 1) : 0;
+
+        if (has_l2) {
+            events[count++] = (bench_event_t) {.l2 = true, .rx_time = rx_time, .sender = sender, .frame = frame};
+            l2_events++;
+        }
+        if (has_csi) {
+            events[count++] = (bench_event_t) {.l2 = false, .rx_time = rx_time + jitter, .sender = sender,
+                                               .frame = frame};
+            csi_events++;
+        }
+        both += has_l2 && has_csi;
+
+        // Either callback may come first
+        if (has_l2 && has_csi && random_next() % 2) {
+            bench_event_t swap = events[count - 1];
+            events[count - 1] = events[count - 2];
+            events[count - 2] = swap;
+        }
+    }
+
+    // ...and may be delayed past callbacks of later frames
+    for (uint64_t i = count; i-- > 0;) {
+        uint64_t distance = random_next() % (BENCH_REORDER + 1);
+        if (distance > 0 && i + distance < count) {
+            bench_event_t moved = events[i];
+            memmove(&events[i], &events[i + 1], distance * sizeof(bench_event_t));
+            events[i + distance] = moved;
+        }
+    }
+
+    bench_result_t result = {0};
+    frame_join_t join;
+    frame_join_setup(&join, window_us, bench_emit, &result);
+
+    captured_packet_t l2;
+    csi_packet_t csi;
+    memset(&l2, 0, sizeof(l2));
+    memset(&csi, 0, sizeof(csi));
+    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    uint32_t last_tick = events[0].rx_time;
+    for (uint64_t i = 0; i < count; i++) {
+        const bench_event_t *event = &events[i];
+        mac[5] = event->sender;
+        if ((int32_t) (event->rx_time - last_tick) >= FRAME_JOIN_TICK_MS * 1000) {
+            frame_join_tick(&join);
+            last_tick = event->rx_time;
+        }
+        if (event->l2) {
+            l2.timestamp = event->frame;
+            frame_join_add_l2(&join, event->rx_time, mac, &l2, 0);
+        } else {
+            csi.timestamp = event->frame;
+            frame_join_add_csi(&join, event->rx_time, mac, &csi, 0);
+        }
+    }
+    frame_join_flush(&join);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (double) (end.tv_sec - begin.tv_sec) + (double) (end.tv_nsec - begin.tv_nsec) / 1e9;
+    free(events);
+
+    uint64_t separate = l2_events * sizeof(captured_packet_t) + csi_events * sizeof(csi_packet_t);
+    uint64_t joined = result.pairs * sizeof(joined_packet_t) + result.l2_alone * sizeof(captured_packet_t) +
+                      result.csi_alone * sizeof(csi_packet_t);
+    printf("%" PRIu64 " callbacks (%" PRIu64 " L2, %" PRIu64 " CSI) in %.3f s, %.1f M callbacks/s\n", count,
+           l2_events, csi_events, elapsed, (double) count / elapsed / 1e6);
+    printf("%" PRIu64 " of %" PRIu64 " frames with both callbacks joined, %" PRIu64 " wrong pairs; "
+           "unmatched %" PRIu64 " L2 / %" PRIu64 " CSI\n", result.pairs, both, result.wrong_pairs, result.l2_alone,
+           result.csi_alone);
+    printf("%" PRIu64 " bytes stored instead of %" PRIu64 ": %" PRIu64 " saved (%.1f%%, %zu per joined frame)\n",
+           joined, separate, separate - joined, 100.0 * (double) (separate - joined) / (double) separate,
+           sizeof(captured_packet_t) + sizeof(csi_packet_t) - sizeof(joined_packet_t));
+    return result.wrong_pairs == 0 ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: capjoin split <joined.bin> <l2.bin> <csi.bin>\n"
+                    "       capjoin bench <frames> [csi-percent] [window-us] [jitter-us]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 5 && strcmp(argv[1], "split") == 0) {
+        return command_split(argv[2], argv[3], argv[4]);
+    }
+    if (argc >= 3 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+        uint64_t frames = strtoull(argv[2], NULL, 10);
+        if (frames == 0) {
+            usage();
+            return 2;
+        }
+        return command_bench(frames, argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : 70,
+                             argc > 4 ? (uint32_t) strtoul(argv[4], NULL, 10) : 10,
+                             argc > 5 ? (uint32_t) strtoul(argv[5], NULL, 10) : 0);
+    }
+    usage();
+    return 2;
+}
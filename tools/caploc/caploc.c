@@ -0,0 +1,358 @@
+// caploc - RSSI localisation of transmitters over a floorplan
+//
+//   caploc locate <layout> <window-ms> <capture>... [--threads N]
+//   caploc bench <devices> <windows> [threads] [layout]
+//
+// `locate` merges the captures of the sniffers listed in the layout (format in localise.h) and prints one CSV row
+// per device and window heard by at least two sniffers: window start (ms), MAC, x and y (m), spread (m) and the
+// number of sniffers. Timestamps of the captures must share one clock, see `capsync align`.
+//
+// `bench` places synthetic devices walking through the layout (by default a 40 x 25 m room with eight sniffers),
+// draws the RSSI each sniffer would report from the path-loss model with log-normal shadowing and per-frame fading,
+// and localises every device in every window. It reports the median and 90th percentile error against the true
+// positions, next to the error of placing each device at its strongest sniffer, and the devices x windows per
+// second the worker pool sustains. It fails when the engine is not more accurate than the strongest sniffer.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "localise.h"
+
+#define BENCH_SENSITIVITY (-92.0f)   // Weaker frames are not received
+#define BENCH_FADING_DB 3.0f         // Per-frame fading around the shadowed mean
+#define BENCH_MAX_FRAMES 4           // Frames per device, sniffer and window
+#define BENCH_STEP_M 1.0f            // Largest move of a device between windows
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: caploc locate <layout> <window-ms> <capture>... [--threads N]\n"
+            "       caploc bench <devices> <windows> [threads] [layout]\n");
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_estimate(void *context, const localise_observation_t *observation,
+                           const localise_estimate_t *estimate)
+{
+    (void) context;
+    if (estimate->sniffers < LOCALISE_MIN_SNIFFERS) {
+        return;
+    }
+    const uint8_t *mac = observation->mac;
+    printf("%" PRIu64 ",%02X:%02X:%02X:%02X:%02X:%02X,%.2f,%.2f,%.2f,%d\n", observation->window, mac[0], mac[1],
+           mac[2], mac[3], mac[4], mac[5], estimate->x, estimate->y, estimate->spread, estimate->sniffers);
+}
+
+static int load_grid(const char *path, localise_grid_t *grid)
+{
+    localise_layout_t layout;
+    int line = localise_layout_load(path, &layout);
+    if (line != 0) {
+        if (line < 0) {
+            fprintf(stderr, "caploc: %s: %s\n", path, strerror(errno));
+        } else {
+            fprintf(stderr, "caploc: %s:%d: invalid layout\n", path, line);
+        }
+        return -1;
+    }
+    if (localise_grid_init(grid, &layout) != 0) {
+        fprintf(stderr, "caploc: out of memory\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int command_locate(const char *layout_path, uint32_t window_ms, const char *const *paths, int count,
+                          int threads)
+{
+    localise_grid_t grid;
+    if (load_grid(layout_path, &grid) != 0) {
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    printf("window_ms,mac,x,y,spread,sniffers\n");
+
+    localise_stats_t stats;
+    int failed = -1;
+    int rc = localise_captures(&grid, paths, count, window_ms, threads, print_estimate, NULL, &stats, &failed);
+    localise_grid_free(&grid);
+    if (rc != 0) {
+        if (errno == ENOENT) {
+            fprintf(stderr, "caploc: %s: sniffer not in the layout\n", paths[failed]);
+        } else if (failed >= 0) {
+            fprintf(stderr, "caploc: %s: %s\n", paths[failed], strerror(errno));
+        } else {
+            fprintf(stderr, "caploc: %s\n", strerror(errno));
+        }
+        return 1;
+    }
+
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " windows, %" PRIu64 " device windows, %" PRIu64
+            " located in %.1f s\n", stats.records, stats.windows, stats.observations, stats.estimates,
+            seconds_since(&start));
+    return 0;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static float random_uniform(void)
+{
+    return ((float) random_next() + 0.5f) / 4294967296.0f;
+}
+
+static float random_gaussian(void)
+{
+    return sqrtf(-2.0f * logf(random_uniform())) * cosf(6.2831853f * random_uniform());
+}
+
+static void bench_layout(localise_layout_t *layout)
+{
+    static const float positions[][2] = {
+            {2, 2}, {20, 1}, {38, 2}, {38, 23}, {20, 24}, {2, 23}, {13, 12.5f}, {27, 12.5f},
+    };
+
+    memset(layout, 0, sizeof(*layout));
+    layout->width = 40;
+    layout->height = 25;
+    layout->cell = 0.5f;
+    layout->rssi_1m = -45;
+    layout->exponent = 2.7f;
+    layout->sigma = 6;
+    layout->sniffer_count = (int) (sizeof(positions) / sizeof(positions[0]));
+    for (int s = 0; s < layout->sniffer_count; s++) {
+        layout->sniffers[s].mac[5] = (uint8_t) s;
+        layout->sniffers[s].x = positions[s][0];
+        layout->sniffers[s].y = positions[s][1];
+    }
+}
+
+typedef struct {
+    float x;
+    float y;
+} position_t;
+
+typedef struct {
+    const localise_layout_t *layout;
+    const position_t *truth;     // windows x devices
+    int devices;
+    float *errors;
+    float *baseline;             // Error of the strongest sniffer's position
+    uint64_t count;
+    uint64_t unlocated;
+} bench_t;
+
+static void bench_result(void *context, const localise_observation_t *observation,
+                         const localise_estimate_t *estimate)
+{
+    bench_t *bench = context;
+    if (estimate->sniffers < LOCALISE_MIN_SNIFFERS) {
+        bench->unlocated++;
+        return;
+    }
+
+    uint32_t device;
+    memcpy(&device, observation->mac + 2, sizeof(device));
+    const position_t *truth = &bench->truth[observation->window * (uint64_t) bench->devices + device];
+
+    int strongest = -1;
+    for (int s = 0; s < bench->layout->sniffer_count; s++) {
+        if (observation->frames[s] && (strongest < 0 || observation->rssi[s] > observation->rssi[strongest])) {
+            strongest = s;
+        }
+    }
+    const localise_sniffer_t *sniffer = &bench->layout->sniffers[strongest];
+
+    bench->errors[bench->count] = hypotf(estimate->x - truth->x, estimate->y - truth->y);
+    bench->baseline[bench->count] = hypotf(sniffer->x - truth->x, sniffer->y - truth->y);
+    bench->count++;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+    float fa = *(const float *) a;
+    float fb = *(const float *) b;
+    return (fa > fb) - (fa < fb);
+}
+
+static float percentile(float *values, uint64_t count, double fraction)
+{
+    qsort(values, count, sizeof(float), compare_float);
+    return values[(uint64_t) ((double) (count - 1) * fraction)];
+}
+
+// Observations of every device in one window, RSSI drawn from the model around the true distance
+static localise_observation_t *bench_window(const localise_layout_t *layout, const position_t *positions,
+                                            int devices, uint64_t window)
+{
+    localise_observation_t *observations = calloc((size_t) devices, sizeof(localise_observation_t));
+    if (observations == NULL) {
+        return NULL;
+    }
+
+    for (int d = 0; d < devices; d++) {
+        localise_observation_t *observation = &observations[d];
+        observation->window = window;
+        observation->mac[0] = 0x02;
+        uint32_t device = (uint32_t) d;
+        memcpy(observation->mac + 2, &device, sizeof(device));
+
+        for (int s = 0; s < layout->sniffer_count; s++) {
+            float distance = hypotf(positions[d].x - layout->sniffers[s].x, positions[d].y - layout->sniffers[s].y);
+            float mean = layout->rssi_1m - 10.0f * layout->exponent * log10f(distance > 1.0f ? distance : 1.0f) +
+                         layout->sigma * random_gaussian();
+            int frames = 1 + (int) (random_next() % BENCH_MAX_FRAMES);
+            for (int f = 0; f < frames; f++) {
+                float rssi = roundf(mean + BENCH_FADING_DB * random_gaussian());
+                if (rssi >= BENCH_SENSITIVITY) {
+                    observation->frames[s]++;
+                    observation->rssi[s] += rssi;
+                }
+            }
+            if (observation->frames[s]) {
+                observation->rssi[s] /= observation->frames[s];
+            }
+        }
+    }
+    return observations;
+}
+
+static int command_bench(int devices, uint64_t windows, int threads, const char *layout_path)
+{
+    localise_grid_t grid;
+    if (layout_path) {
+        if (load_grid(layout_path, &grid) != 0) {
+            return 1;
+        }
+    } else {
+        localise_layout_t layout;
+        bench_layout(&layout);
+        if (localise_grid_init(&grid, &layout) != 0) {
+            fprintf(stderr, "caploc: out of memory\n");
+            return 1;
+        }
+    }
+    const localise_layout_t *layout = &grid.layout;
+
+    uint64_t total = windows * (uint64_t) devices;
+    position_t *truth = malloc(total * sizeof(position_t));
+    bench_t bench = {
+            .layout = layout,
+            .truth = truth,
+            .devices = devices,
+            .errors = malloc(total * sizeof(float)),
+            .baseline = malloc(total * sizeof(float)),
+    };
+    if (truth == NULL || bench.errors == NULL || bench.baseline == NULL) {
+        fprintf(stderr, "caploc: out of memory\n");
+        free(truth);
+        free(bench.errors);
+        free(bench.baseline);
+        localise_grid_free(&grid);
+        return 1;
+    }
+
+    // Random walk of every device, kept inside the area
+    for (int d = 0; d < devices; d++) {
+        truth[d].x = random_uniform() * layout->width;
+        truth[d].y = random_uniform() * layout->height;
+    }
+    for (uint64_t w = 1; w < windows; w++) {
+        for (int d = 0; d < devices; d++) {
+            const position_t *previous = &truth[(w - 1) * (uint64_t) devices + (uint64_t) d];
+            position_t *next = &truth[w * (uint64_t) devices + (uint64_t) d];
+            next->x = fminf(fmaxf(previous->x + BENCH_STEP_M * (2 * random_uniform() - 1), 0), layout->width);
+            next->y = fminf(fmaxf(previous->y + BENCH_STEP_M * (2 * random_uniform() - 1), 0), layout->height);
+        }
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double generating = 0;
+
+    localise_pool_t pool;
+    int rc = localise_pool_start(&pool, &grid, threads, bench_result, &bench);
+    for (uint64_t w = 0; rc == 0 && w < windows; w++) {
+        struct timespec window_start;
+        clock_gettime(CLOCK_MONOTONIC, &window_start);
+        localise_observation_t *observations = bench_window(layout, &truth[w * (uint64_t) devices], devices, w);
+        generating += seconds_since(&window_start);
+        rc = observations ? localise_pool_submit(&pool, observations, (size_t) devices) : -1;
+    }
+    if (localise_pool_finish(&pool) != 0) {
+        rc = -1;
+    }
+    double seconds = seconds_since(&start) - generating;
+
+    if (rc == 0 && bench.count > 0) {
+        printf("grid %ux%u cells of %.2f m, %d sniffers, %d threads\n", grid.columns, grid.rows, layout->cell,
+               layout->sniffer_count, threads);
+        printf("%" PRIu64 " device windows in %.2f s: %.0f device windows/s (%.1f s generating excluded)\n", total,
+               seconds, (double) total / seconds, generating);
+        float median_error = percentile(bench.errors, bench.count, 0.5);
+        float p90_error = percentile(bench.errors, bench.count, 0.9);
+        float median_baseline = percentile(bench.baseline, bench.count, 0.5);
+        float p90_baseline = percentile(bench.baseline, bench.count, 0.9);
+        printf("located %" PRIu64 ", too few sniffers %" PRIu64 "\n", bench.count, bench.unlocated);
+        printf("error median %.2f m, p90 %.2f m (strongest sniffer: median %.2f m, p90 %.2f m)\n", median_error,
+               p90_error, median_baseline, p90_baseline);
+        rc = median_error < median_baseline ? 0 : -1;
+    } else {
+        fprintf(stderr, "caploc: no device located\n");
+        rc = -1;
+    }
+
+    free(truth);
+    free(bench.errors);
+    free(bench.baseline);
+    localise_grid_free(&grid);
+    return rc == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 5 && strcmp(argv[1], "locate") == 0) {
+        int threads = 2;
+        int count = 0;
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                threads = atoi(argv[++i]);
+            } else {
+                argv[4 + count++] = argv[i];
+            }
+        }
+        uint32_t window_ms = (uint32_t) strtoul(argv[3], NULL, 10);
+        if (count > 0 && threads > 0 && window_ms > 0) {
+            return command_locate(argv[2], window_ms, (const char *const *) &argv[4], count, threads);
+        }
+    }
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+        int devices = atoi(argv[2]);
+        uint64_t windows = strtoull(argv[3], NULL, 10);
+        int threads = argc >= 5 ? atoi(argv[4]) : 2;
+        if (devices > 0 && windows > 0 && threads > 0) {
+            return command_bench(devices, windows, threads, argc == 6 ? argv[5] : NULL);
+        }
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,572 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture_reader.h"
+#include "localise.h"
+#include "merge.h"
+
+#define TABLE_INITIAL 1024
+
+int localise_layout_load(const char *path, localise_layout_t *layout)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    memset(layout, 0, sizeof(*layout));
+    layout->cell = 0.5f;
+    layout->rssi_1m = -45.0f;
+    layout->exponent = 2.7f;
+    layout->sigma = 6.0f;
+
+    char line[256];
+    int number = 0;
+    int error = 0;
+    while (error == 0 && fgets(line, sizeof(line), file)) {
+        number++;
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char keyword[16];
+        char mac[32];
+        localise_sniffer_t sniffer;
+        if (sscanf(line, "%15s", keyword) != 1) {
+            continue;
+        }
+        if (strcmp(keyword, "area") == 0) {
+            if (sscanf(line, "%*s %f %f", &layout->width, &layout->height) != 2 || layout->width <= 0 ||
+                layout->height <= 0) {
+                error = number;
+            }
+        } else if (strcmp(keyword, "grid") == 0) {
+            if (sscanf(line, "%*s %f", &layout->cell) != 1 || layout->cell <= 0) {
+                error = number;
+            }
+        } else if (strcmp(keyword, "model") == 0) {
+            if (sscanf(line, "%*s %f %f %f", &layout->rssi_1m, &layout->exponent, &layout->sigma) != 3 ||
+                layout->exponent <= 0 || layout->sigma <= 0) {
+                error = number;
+            }
+        } else if (strcmp(keyword, "sniffer") == 0) {
+            if (layout->sniffer_count == LOCALISE_MAX_SNIFFERS ||
+                sscanf(line, "%*s %31s %f %f", mac, &sniffer.x, &sniffer.y) != 3 ||
+                capture_parse_mac(mac, sniffer.mac) != 0) {
+                error = number;
+            } else {
+                layout->sniffers[layout->sniffer_count++] = sniffer;
+            }
+        } else {
+            error = number;
+        }
+    }
+    fclose(file);
+
+    if (error == 0 && (layout->width <= 0 || layout->sniffer_count == 0)) {
+        error = number > 0 ? number : 1;
+    }
+    return error;
+}
+
+int localise_grid_init(localise_grid_t *grid, const localise_layout_t *layout)
+{
+    memset(grid, 0, sizeof(*grid));
+    grid->layout = *layout;
+    grid->columns = (uint32_t) ceilf(layout->width / layout->cell);
+    grid->rows = (uint32_t) ceilf(layout->height / layout->cell);
+    grid->cells = grid->columns * grid->rows;
+
+    grid->expected = malloc((size_t) layout->sniffer_count * grid->cells * sizeof(float));
+    grid->cell_x = malloc(grid->cells * sizeof(float));
+    grid->cell_y = malloc(grid->cells * sizeof(float));
+    if (grid->expected == NULL || grid->cell_x == NULL || grid->cell_y == NULL) {
+        localise_grid_free(grid);
+        return -1;
+    }
+
+    for (uint32_t row = 0; row < grid->rows; row++) {
+        for (uint32_t column = 0; column < grid->columns; column++) {
+            uint32_t c = row * grid->columns + column;
+            grid->cell_x[c] = ((float) column + 0.5f) * layout->cell;
+            grid->cell_y[c] = ((float) row + 0.5f) * layout->cell;
+        }
+    }
+
+    for (int s = 0; s < layout->sniffer_count; s++) {
+        float *expected = grid->expected + (size_t) s * grid->cells;
+        for (uint32_t c = 0; c < grid->cells; c++) {
+            float dx = grid->cell_x[c] - layout->sniffers[s].x;
+            float dy = grid->cell_y[c] - layout->sniffers[s].y;
+            float distance = sqrtf(dx * dx + dy * dy);
+            expected[c] = layout->rssi_1m - 10.0f * layout->exponent * log10f(distance > 1.0f ? distance : 1.0f);
+        }
+    }
+    return 0;
+}
+
+void localise_grid_free(localise_grid_t *grid)
+{
+    free(grid->expected);
+    free(grid->cell_x);
+    free(grid->cell_y);
+    grid->expected = NULL;
+    grid->cell_x = NULL;
+    grid->cell_y = NULL;
+}
+
+// Squared residuals of one sniffer added to every cell; plain loops over contiguous rows that vectorise
+static void accumulate_first(float *restrict distance, const float *restrict expected, float rssi, uint32_t cells)
+{
+    for (uint32_t c = 0; c < cells; c++) {
+        float d = rssi - expected[c];
+        distance[c] = d * d;
+    }
+}
+
+static void accumulate(float *restrict distance, const float *restrict expected, float rssi, uint32_t cells)
+{
+    for (uint32_t c = 0; c < cells; c++) {
+        float d = rssi - expected[c];
+        distance[c] += d * d;
+    }
+}
+
+int localise_estimate(const localise_grid_t *grid, const localise_observation_t *observation, float *scratch,
+                      localise_estimate_t *estimate)
+{
+    const localise_layout_t *layout = &grid->layout;
+    memset(estimate, 0, sizeof(*estimate));
+
+    int heard = 0;
+    for (int s = 0; s < layout->sniffer_count; s++) {
+        if (observation->frames[s] == 0) {
+            continue;
+        }
+        const float *expected = grid->expected + (size_t) s * grid->cells;
+        if (heard == 0) {
+            accumulate_first(scratch, expected, observation->rssi[s], grid->cells);
+        } else {
+            accumulate(scratch, expected, observation->rssi[s], grid->cells);
+        }
+        heard++;
+    }
+    estimate->sniffers = heard;
+    if (heard < LOCALISE_MIN_SNIFFERS) {
+        return -1;
+    }
+
+    float best = scratch[0];
+    for (uint32_t c = 1; c < grid->cells; c++) {
+        best = fminf(best, scratch[c]);
+    }
+
+    // Log-likelihood is -distance / 2 sigma^2, only cells within the cutoff of the best one carry weight. Branch
+    // free so that the loop vectorises, expf included.
+    float scale = -0.5f / (layout->sigma * layout->sigma);
+    float limit = best - LOCALISE_CUTOFF / scale;
+    float weight = 0;
+    float x = 0;
+    float y = 0;
+    float xx = 0;
+    float yy = 0;
+    for (uint32_t c = 0; c < grid->cells; c++) {
+        float w = scratch[c] <= limit ? expf(scale * (scratch[c] - best)) : 0.0f;
+        weight += w;
+        x += w * grid->cell_x[c];
+        y += w * grid->cell_y[c];
+        xx += w * grid->cell_x[c] * grid->cell_x[c];
+        yy += w * grid->cell_y[c] * grid->cell_y[c];
+    }
+    x /= weight;
+    y /= weight;
+    float variance = xx / weight - x * x + yy / weight - y * y;
+
+    estimate->x = x;
+    estimate->y = y;
+    estimate->spread = variance > 0 ? sqrtf(variance) : 0.0f;
+    return 0;
+}
+
+static void *pool_worker(void *arg)
+{
+    localise_pool_t *pool = arg;
+    float *scratch = malloc(pool->grid->cells * sizeof(float));
+
+    pthread_mutex_lock(&pool->lock);
+    if (scratch == NULL) {
+        pool->failed = true;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    while (scratch) {
+        localise_slot_t *slot = &pool->slots[pool->next_to_run % pool->slot_count];
+        while (!pool->failed && !(slot->state == LOCALISE_SLOT_FILLED && slot->sequence == pool->next_to_run) &&
+               !(pool->finished && pool->next_to_run >= pool->submitted)) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+            slot = &pool->slots[pool->next_to_run % pool->slot_count];
+        }
+        if (pool->failed || (pool->finished && pool->next_to_run >= pool->submitted)) {
+            break;
+        }
+
+        pool->next_to_run++;
+        slot->state = LOCALISE_SLOT_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = 0; i < slot->count; i++) {
+            localise_estimate(pool->grid, &slot->observations[i], scratch, &slot->estimates[i]);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        slot->state = LOCALISE_SLOT_DONE;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(scratch);
+    return NULL;
+}
+
+// Wait for the oldest window in flight, pass its results on and free its slot
+static int deliver_oldest(localise_pool_t *pool)
+{
+    localise_slot_t *slot = &pool->slots[pool->delivered % pool->slot_count];
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->failed && slot->state != LOCALISE_SLOT_DONE) {
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+    bool failed = pool->failed;
+    pthread_mutex_unlock(&pool->lock);
+    if (failed) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < slot->count; i++) {
+        pool->callback(pool->context, &slot->observations[i], &slot->estimates[i]);
+    }
+    free(slot->observations);
+    free(slot->estimates);
+    slot->observations = NULL;
+    slot->estimates = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    slot->state = LOCALISE_SLOT_EMPTY;
+    pool->delivered++;
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int localise_pool_start(localise_pool_t *pool, const localise_grid_t *grid, int threads,
+                        localise_result_cb_t callback, void *context)
+{
+    memset(pool, 0, sizeof(*pool));
+    if (threads < 1) {
+        threads = 1;
+    }
+    pool->grid = grid;
+    pool->callback = callback;
+    pool->context = context;
+    pool->slot_count = (size_t) threads * 2;
+    pool->slots = calloc(pool->slot_count, sizeof(localise_slot_t));
+    pool->threads = calloc((size_t) threads, sizeof(pthread_t));
+    if (pool->slots == NULL || pool->threads == NULL) {
+        free(pool->slots);
+        free(pool->threads);
+        return -1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+    for (; pool->started < threads; pool->started++) {
+        if (pthread_create(&pool->threads[pool->started], NULL, pool_worker, pool) != 0) {
+            break;
+        }
+    }
+    if (pool->started == 0) {
+        pool->failed = true;
+        localise_pool_finish(pool);
+        return -1;
+    }
+    return 0;
+}
+
+int localise_pool_submit(localise_pool_t *pool, localise_observation_t *observations, size_t count)
+{
+    if (count == 0) {
+        free(observations);
+        return 0;
+    }
+    if (pool->submitted - pool->delivered == pool->slot_count && deliver_oldest(pool) != 0) {
+        free(observations);
+        return -1;
+    }
+
+    // The slot is owned by this thread until it is marked filled
+    localise_slot_t *slot = &pool->slots[pool->submitted % pool->slot_count];
+    slot->estimates = malloc(count * sizeof(localise_estimate_t));
+    if (slot->estimates == NULL) {
+        free(observations);
+        return -1;
+    }
+    slot->observations = observations;
+    slot->count = count;
+
+    pthread_mutex_lock(&pool->lock);
+    slot->sequence = pool->submitted++;
+    slot->state = LOCALISE_SLOT_FILLED;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+int localise_pool_finish(localise_pool_t *pool)
+{
+    int rc = 0;
+    while (rc == 0 && pool->delivered < pool->submitted) {
+        rc = deliver_oldest(pool);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->finished = true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->started; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    if (pool->failed) {
+        rc = -1;
+    }
+
+    for (size_t i = 0; i < pool->slot_count; i++) {
+        free(pool->slots[i].observations);
+        free(pool->slots[i].estimates);
+    }
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slots);
+    free(pool->threads);
+    pool->slots = NULL;
+    pool->threads = NULL;
+    return rc;
+}
+
+// Devices of the current window: observations in order of first appearance, open addressed table of their MACs
+typedef struct {
+    localise_observation_t *observations;
+    size_t count;
+    size_t capacity;
+    uint32_t *table;        // Observation index + 1, 0 when free
+    size_t table_size;
+} window_t;
+
+static uint32_t mac_hash(const uint8_t *mac)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ mac[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int window_grow(window_t *window)
+{
+    size_t capacity = window->capacity ? window->capacity * 2 : TABLE_INITIAL / 2;
+    localise_observation_t *observations = realloc(window->observations, capacity * sizeof(*observations));
+    uint32_t *table = calloc(capacity * 2, sizeof(uint32_t));
+    if (observations == NULL || table == NULL) {
+        if (observations) {
+            window->observations = observations;
+        }
+        free(table);
+        return -1;
+    }
+
+    free(window->table);
+    window->observations = observations;
+    window->capacity = capacity;
+    window->table = table;
+    window->table_size = capacity * 2;
+    for (size_t i = 0; i < window->count; i++) {
+        size_t slot = mac_hash(observations[i].mac) & (window->table_size - 1);
+        while (table[slot]) {
+            slot = (slot + 1) & (window->table_size - 1);
+        }
+        table[slot] = (uint32_t) i + 1;
+    }
+    return 0;
+}
+
+static localise_observation_t *window_find(window_t *window, uint64_t start, const uint8_t *mac)
+{
+    if (window->count == window->capacity && window_grow(window) != 0) {
+        return NULL;
+    }
+
+    size_t slot = mac_hash(mac) & (window->table_size - 1);
+    while (window->table[slot]) {
+        localise_observation_t *observation = &window->observations[window->table[slot] - 1];
+        if (memcmp(observation->mac, mac, 6) == 0) {
+            return observation;
+        }
+        slot = (slot + 1) & (window->table_size - 1);
+    }
+
+    localise_observation_t *observation = &window->observations[window->count];
+    memset(observation, 0, sizeof(*observation));
+    observation->window = start;
+    memcpy(observation->mac, mac, 6);
+    window->table[slot] = (uint32_t) ++window->count;
+    return observation;
+}
+
+// Turn the RSSI sums into means and hand the window over to the pool
+static int window_submit(window_t *window, localise_pool_t *pool, localise_stats_t *stats)
+{
+    for (size_t i = 0; i < window->count; i++) {
+        localise_observation_t *observation = &window->observations[i];
+        for (int s = 0; s < LOCALISE_MAX_SNIFFERS; s++) {
+            if (observation->frames[s]) {
+                observation->rssi[s] /= observation->frames[s];
+            }
+        }
+    }
+    if (window->count > 0) {
+        stats->windows++;
+        stats->observations += window->count;
+    }
+
+    int rc = localise_pool_submit(pool, window->observations, window->count);
+    window->observations = NULL;
+    window->count = 0;
+    window->capacity = 0;
+    free(window->table);
+    window->table = NULL;
+    window->table_size = 0;
+    return rc;
+}
+
+typedef struct {
+    localise_result_cb_t callback;
+    void *context;
+    localise_stats_t *stats;
+} forward_t;
+
+static void forward_result(void *context, const localise_observation_t *observation,
+                           const localise_estimate_t *estimate)
+{
+    forward_t *forward = context;
+    if (estimate->sniffers >= LOCALISE_MIN_SNIFFERS) {
+        forward->stats->estimates++;
+    }
+    forward->callback(forward->context, observation, estimate);
+}
+
+int localise_captures(const localise_grid_t *grid, const char *const *paths, int count, uint32_t window_ms,
+                      int threads, localise_result_cb_t callback, void *context, localise_stats_t *stats,
+                      int *failed)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (window_ms == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    merge_t merge;
+    if (merge_open(&merge, paths, count, NULL, failed) != 0) {
+        return -1;
+    }
+
+    // Sniffer of every capture, by the Wi-Fi MAC of its header
+    int *sniffer = calloc((size_t) count, sizeof(int));
+    if (sniffer == NULL) {
+        merge_close(&merge);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        sniffer[i] = -1;
+        for (int s = 0; s < grid->layout.sniffer_count; s++) {
+            if (memcmp(grid->layout.sniffers[s].mac, merge.inputs[i].reader.header.wifi_mac, 6) == 0) {
+                sniffer[i] = s;
+            }
+        }
+        if (sniffer[i] < 0) {
+            if (failed) {
+                *failed = i;
+            }
+            free(sniffer);
+            merge_close(&merge);
+            errno = ENOENT;
+            return -1;
+        }
+    }
+
+    forward_t forward = {.callback = callback, .context = context, .stats = stats};
+    localise_pool_t pool;
+    if (localise_pool_start(&pool, grid, threads, forward_result, &forward) != 0) {
+        free(sniffer);
+        merge_close(&merge);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    window_t window = {0};
+    uint64_t current = 0;
+    const capture_record_t *record;
+    int input;
+    int rc;
+    while ((rc = merge_next(&merge, &record, &input)) == 1) {
+        stats->records++;
+        const uint8_t *mac;
+        uint64_t timestamp;
+        int8_t rssi;
+        if (merge.kind == CAPTURE_KIND_L2) {
+            mac = capture_record_transmitter(record);
+            timestamp = record->l2.timestamp;
+            rssi = record->l2.rssi;
+        } else {
+            mac = record->csi.mac;
+            timestamp = record->csi.timestamp * 1000;
+            rssi = record->csi.rssi;
+        }
+        if (mac == NULL) {
+            continue;
+        }
+
+        uint64_t start = timestamp - timestamp % window_ms;
+        if (start != current && window.count > 0 && window_submit(&window, &pool, stats) != 0) {
+            rc = -1;
+            break;
+        }
+        current = start;
+
+        localise_observation_t *observation = window_find(&window, start, mac);
+        if (observation == NULL) {
+            rc = -1;
+            break;
+        }
+        if (observation->frames[sniffer[input]] < UINT16_MAX) {
+            observation->frames[sniffer[input]]++;
+            observation->rssi[sniffer[input]] += rssi;
+        }
+    }
+    if (rc == 0 && window.count > 0 && window_submit(&window, &pool, stats) != 0) {
+        rc = -1;
+    }
+    free(window.observations);
+    free(window.table);
+
+    if (localise_pool_finish(&pool) != 0) {
+        rc = -1;
+    }
+    free(sniffer);
+    merge_close(&merge);
+    if (rc < 0) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#ifndef LOCALISE_H
+#define LOCALISE_H
+
+// RSSI localisation of transmitters on a floorplan from the captures of several sniffers.
+//
+// Every device heard in a time window gets the mean RSSI per sniffer that heard it. The area is divided into a grid,
+// each cell holds the RSSI every sniffer would see from a transmitter there under a log-distance path-loss model:
+//   rssi(d) = rssi_1m - 10 * exponent * log10(max(d, 1 m))
+// The log-likelihood of each cell is the sum over the observing sniffers of -(observed - expected)^2 / 2 sigma^2,
+// computed for the whole grid one sniffer at a time (contiguous float rows, vectorised by the compiler). The
+// estimate is the likelihood weighted mean of the cells, its spread the weighted standard deviation.
+//
+// Layout file, one directive per line, lengths in metres, '#' starts a comment:
+//   area <width> <height>
+//   grid <cell-size>                            (default 0.5)
+//   model <rssi-at-1m> <exponent> <sigma-db>    (default -45 2.7 6)
+//   sniffer <AA:BB:CC:DD:EE:FF> <x> <y>         (Wi-Fi MAC from the header of its captures)
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define LOCALISE_MAX_SNIFFERS 64
+#define LOCALISE_MIN_SNIFFERS 2      // Fewer observing sniffers give no estimate
+#define LOCALISE_CUTOFF 7.0f         // Cells whose log-likelihood is this far below the best are ignored
+
+typedef struct {
+    uint8_t mac[6];
+    float x;
+    float y;
+} localise_sniffer_t;
+
+typedef struct {
+    float width;
+    float height;
+    float cell;
+    float rssi_1m;
+    float exponent;
+    float sigma;
+    int sniffer_count;
+    localise_sniffer_t sniffers[LOCALISE_MAX_SNIFFERS];
+} localise_layout_t;
+
+// Precomputed model of a layout, shared read-only by the worker threads
+typedef struct {
+    localise_layout_t layout;
+    uint32_t columns;
+    uint32_t rows;
+    uint32_t cells;
+    float *expected;    // sniffer_count x cells, expected RSSI
+    float *cell_x;      // cells, centre of each cell
+    float *cell_y;
+} localise_grid_t;
+
+// One device in one window
+typedef struct {
+    uint64_t window;                        // Start of the window, ms
+    uint8_t mac[6];
+    uint16_t frames[LOCALISE_MAX_SNIFFERS]; // Frames heard per sniffer, 0 when not heard
+    float rssi[LOCALISE_MAX_SNIFFERS];      // Mean RSSI per sniffer (dBm)
+} localise_observation_t;
+
+typedef struct {
+    float x;
+    float y;
+    float spread;       // Weighted standard deviation of the position (m)
+    int sniffers;       // Sniffers that heard the device, 0 when no estimate was made
+} localise_estimate_t;
+
+// Parse a layout file. Returns 0, or the number of the offending line (-1 when the file cannot be read).
+int localise_layout_load(const char *path, localise_layout_t *layout);
+
+int localise_grid_init(localise_grid_t *grid, const localise_layout_t *layout);
+void localise_grid_free(localise_grid_t *grid);
+
+// Estimate one position. `scratch` holds grid->cells floats. Returns 0, or -1 when too few sniffers heard it.
+int localise_estimate(const localise_grid_t *grid, const localise_observation_t *observation, float *scratch,
+                      localise_estimate_t *estimate);
+
+typedef void (*localise_result_cb_t)(void *context, const localise_observation_t *observation,
+                                     const localise_estimate_t *estimate);
+
+typedef enum {
+    LOCALISE_SLOT_EMPTY,
+    LOCALISE_SLOT_FILLED,
+    LOCALISE_SLOT_RUNNING,
+    LOCALISE_SLOT_DONE,
+} localise_slot_state_t;
+
+typedef struct {
+    localise_slot_state_t state;
+    uint64_t sequence;
+    localise_observation_t *observations;
+    localise_estimate_t *estimates;
+    size_t count;
+} localise_slot_t;
+
+// Worker pool estimating one time window per job. At most 2 x threads windows are in flight, results are passed
+// to the callback in submission order on the submitting thread.
+typedef struct {
+    const localise_grid_t *grid;
+    localise_result_cb_t callback;
+    void *context;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    localise_slot_t *slots;
+    size_t slot_count;
+    uint64_t submitted;
+    uint64_t delivered;
+    uint64_t next_to_run;
+    bool finished;
+    bool failed;
+    pthread_t *threads;
+    int started;
+} localise_pool_t;
+
+int localise_pool_start(localise_pool_t *pool, const localise_grid_t *grid, int threads,
+                        localise_result_cb_t callback, void *context);
+
+// Hand over the observations of one window, the pool takes ownership of the malloc'd array
+int localise_pool_submit(localise_pool_t *pool, localise_observation_t *observations, size_t count);
+
+// Wait for the windows in flight, deliver their results and stop the workers
+int localise_pool_finish(localise_pool_t *pool);
+
+typedef struct {
+    uint64_t records;       // Records read from the captures
+    uint64_t windows;
+    uint64_t observations;  // Device x window pairs
+    uint64_t estimates;     // Pairs heard by enough sniffers
+} localise_stats_t;
+
+// Merge the captures of the sniffers of the layout by time (capmerge), group the records into windows of
+// `window_ms` and estimate every transmitter of every window. Captures are matched to sniffers by the Wi-Fi MAC in
+// their header. Returns 0, or -1 with errno set; `failed` receives the index of a capture that could not be used.
+int localise_captures(const localise_grid_t *grid, const char *const *paths, int count, uint32_t window_ms,
+                      int threads, localise_result_cb_t callback, void *context, localise_stats_t *stats,
+                      int *failed);
+
+#endif // LOCALISE_H
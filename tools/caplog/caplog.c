@@ -0,0 +1,290 @@
+// caplog - read and exercise raw sector capture logs on a card image
+//
+//   caplog list <image>
+//   caplog extract <image> <region> <capture>
+//   caplog mkimage <image> <size-MiB> <partition-MiB>
+//   caplog bench <image> <log-MiB> <records> [crash-after]
+//
+// `list` walks the logs behind the last MBR partition (L2 first, then CSI), `extract` writes the pending records of
+// one of them as a regular capture file. `mkimage` creates a sparse card image with one FAT partition and free
+// space behind it. `bench` formats a log in that space, appends synthetic L2 records and reports the throughput;
+// with `crash-after`, it stops after that many records without a final commit, as a power loss would, then reopens
+// the log and checks that every record up to the last commit was recovered in order.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "capture_format.h"
+#include "sector_log.h"
+
+#define MAX_REGIONS 8
+#define COMMIT_INTERVAL 1000      // Records between commits in `bench`, the firmware commits every 5 s
+#define BENCH_BLOCK_SECTORS 16    // 8 KiB blocks, the firmware default
+
+static int open_device(const char *path, sector_device_t *device)
+{
+    if (!sector_device_image_open(device, path)) {
+        fprintf(stderr, "caplog: %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Logs follow each other from the first free sector, each superblock tells where the next one starts
+static int find_regions(const sector_device_t *device, uint64_t *starts)
+{
+    uint64_t start = sector_log_free_start(device);
+    int count = 0;
+
+    while (start > 0 && count < MAX_REGIONS) {
+        sector_log_t log;
+        if (!sector_log_open(&log, device, start)) {
+            sector_log_close(&log);
+            break;
+        }
+        starts[count++] = start;
+        start += log.superblock.region_sectors;
+        sector_log_close(&log);
+    }
+    return count;
+}
+
+static int command_list(const char *image)
+{
+    sector_device_t device;
+    if (open_device(image, &device) != 0) {
+        return 1;
+    }
+
+    uint64_t starts[MAX_REGIONS];
+    int count = find_regions(&device, starts);
+    if (count == 0) {
+        printf("no logs behind sector %" PRIu64 "\n", sector_log_free_start(&device));
+    }
+    for (int i = 0; i < count; i++) {
+        sector_log_t log;
+        sector_log_open(&log, &device, starts[i]);
+        file_header_t header;
+        memcpy(&header, log.superblock.header, sizeof(header));
+        printf("%d: sector %" PRIu64 ", %" PRIu64 " blocks of %" PRIu32 " records, %.4s v%" PRIu32 ", "
+               "%" PRIu64 " pending, %" PRIu64 " overwritten, %" PRIu64 " recovered\n",
+               i, starts[i], log.block_count, log.block_capacity, header.identifier, header.version,
+               sector_log_pending(&log), log.checkpoint.overwritten, log.recovered);
+        sector_log_close(&log);
+    }
+
+    sector_device_image_close(&device);
+    return 0;
+}
+
+static int command_extract(const char *image, int region, const char *output_path)
+{
+    sector_device_t device;
+    if (open_device(image, &device) != 0) {
+        return 1;
+    }
+
+    uint64_t starts[MAX_REGIONS];
+    sector_log_t log;
+    if (region < 0 || region >= find_regions(&device, starts) || !sector_log_open(&log, &device, starts[region])) {
+        fprintf(stderr, "caplog: no log %d in %s\n", region, image);
+        sector_device_image_close(&device);
+        return 1;
+    }
+
+    FILE *output = fopen(output_path, "wb");
+    if (output == NULL) {
+        fprintf(stderr, "caplog: %s: %s\n", output_path, strerror(errno));
+        sector_log_close(&log);
+        sector_device_image_close(&device);
+        return 1;
+    }
+
+    uint8_t buffer[64 * 1024];
+    uint64_t size = sector_log_stream_size(&log);
+    uint64_t offset = 0;
+    int rc = 0;
+    while (offset < size) {
+        size_t len = sector_log_stream_read(&log, offset, buffer, sizeof(buffer));
+        if (len == 0 || fwrite(buffer, len, 1, output) != 1) {
+            fprintf(stderr, "caplog: failed to copy the log at offset %" PRIu64 "\n", offset);
+            rc = 1;
+            break;
+        }
+        offset += len;
+    }
+    if (fclose(output) != 0) {
+        rc = 1;
+    }
+
+    printf("%" PRIu64 " records written to %s\n", sector_log_pending(&log), output_path);
+    sector_log_close(&log);
+    sector_device_image_close(&device);
+    return rc;
+}
+
+static int command_mkimage(const char *image, uint64_t size_mib, uint64_t partition_mib)
+{
+    uint64_t sectors = size_mib * 1024 * 1024 / SECTOR_SIZE;
+    uint32_t first = 2048;
+    uint32_t count = (uint32_t) (partition_mib * 1024 * 1024 / SECTOR_SIZE);
+    if (first + (uint64_t) count >= sectors) {
+        fprintf(stderr, "caplog: the partition leaves no free space\n");
+        return 1;
+    }
+
+    uint8_t mbr[SECTOR_SIZE] = {0};
+    uint8_t *entry = mbr + 446;
+    entry[4] = 0x0C;  // FAT32 LBA
+    for (int i = 0; i < 4; i++) {
+        entry[8 + i] = (uint8_t) (first >> (8 * i));
+        entry[12 + i] = (uint8_t) (count >> (8 * i));
+    }
+    mbr[510] = 0x55;
+    mbr[511] = 0xAA;
+
+    int fd = open(image, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || pwrite(fd, mbr, sizeof(mbr), 0) != sizeof(mbr) || ftruncate(fd, (off_t) (sectors * SECTOR_SIZE))) {
+        fprintf(stderr, "caplog: %s: %s\n", image, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    close(fd);
+
+    printf("%s: %" PRIu64 " sectors, partition at %" PRIu32 ", logs from sector %" PRIu64 "\n", image, sectors,
+           first, ((uint64_t) first + count + 7) & ~(uint64_t) 7);
+    return 0;
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int command_bench(const char *image, uint64_t log_mib, uint64_t records, uint64_t crash_after)
+{
+    sector_device_t device;
+    if (open_device(image, &device) != 0) {
+        return 1;
+    }
+
+    uint64_t start = sector_log_free_start(&device);
+    file_header_t header = {0};
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+    header.version = CAPTURE_VERSION_L2_RAW;
+
+    // A fresh log each run: clear the superblock so the previous one is not reused
+    uint8_t zero[SECTOR_SIZE] = {0};
+    sector_log_t log;
+    if (start == 0 || !device.write(device.context, start, 1, zero) ||
+        !sector_log_create(&log, &device, start, log_mib * 1024 * 1024 / SECTOR_SIZE, BENCH_BLOCK_SECTORS,
+                           sizeof(captured_packet_t), &header, sizeof(header))) {
+        fprintf(stderr, "caplog: cannot create a log of %" PRIu64 " MiB behind the partition of %s\n", log_mib, image);
+        sector_device_image_close(&device);
+        return 1;
+    }
+
+    // Every record carries its index as the timestamp, so recovery can be checked
+    captured_packet_t record;
+    memset(&record, 0, sizeof(record));
+    record.header_len = 36;
+    record.payload_len = 128;
+
+    uint64_t limit = crash_after ? crash_after : records;
+    uint64_t durable = 0;
+    uint64_t overwritten = 0;
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    for (uint64_t i = 0; i < limit; i++) {
+        record.timestamp = i;
+        int result = sector_log_append(&log, &record);
+        if (result < 0) {
+            fprintf(stderr, "caplog: append failed at record %" PRIu64 "\n", i);
+            sector_log_close(&log);
+            sector_device_image_close(&device);
+            return 1;
+        }
+        overwritten += (uint64_t) result;
+        if ((i + 1) % COMMIT_INTERVAL == 0) {
+            sector_log_commit(&log);
+            durable = i + 1;
+        }
+    }
+    if (!crash_after) {
+        sector_log_commit(&log);
+        durable = limit;
+    }
+    double elapsed = seconds_since(&begin);
+
+    printf("%" PRIu64 " records (%.1f MiB) in %.3f s, %.1f MiB/s, %" PRIu64 " overwritten\n", limit,
+           (double) limit * sizeof(record) / (1024 * 1024), elapsed,
+           (double) limit * sizeof(record) / (1024 * 1024) / elapsed, overwritten);
+    sector_log_close(&log);
+
+    if (!crash_after) {
+        sector_device_image_close(&device);
+        return 0;
+    }
+
+    // Power loss: the records since the last commit are only on the card if their block filled up
+    if (!sector_log_open(&log, &device, start)) {
+        fprintf(stderr, "caplog: the log did not survive the crash\n");
+        sector_device_image_close(&device);
+        return 1;
+    }
+
+    // The oldest records were overwritten, everything from there to the last commit must be back in order
+    uint64_t pending = sector_log_pending(&log);
+    int rc = overwritten + pending >= durable ? 0 : 1;
+    for (uint64_t i = 0; i < pending && rc == 0; i++) {
+        captured_packet_t recovered;
+        if (sector_log_stream_read(&log, log.superblock.header_len + i * sizeof(recovered), &recovered,
+                                   sizeof(recovered)) != sizeof(recovered) || recovered.timestamp != overwritten + i) {
+            fprintf(stderr, "caplog: record %" PRIu64 " is out of order after recovery\n", overwritten + i);
+            rc = 1;
+        }
+    }
+    printf("after the crash: %" PRIu64 " records pending, %" PRIu64 " committed, %" PRIu64 " rolled forward, "
+           "%" PRIu64 " lost from the open block: %s\n", pending, durable, log.recovered,
+           limit - overwritten - pending, rc == 0 ? "in order" : "LOST RECORDS");
+
+    sector_log_close(&log);
+    sector_device_image_close(&device);
+    return rc;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: caplog list <image>\n"
+                    "       caplog extract <image> <region> <capture>\n"
+                    "       caplog mkimage <image> <size-MiB> <partition-MiB>\n"
+                    "       caplog bench <image> <log-MiB> <records> [crash-after]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "list") == 0) {
+        return command_list(argv[2]);
+    }
+    if (argc == 5 && strcmp(argv[1], "extract") == 0) {
+        return command_extract(argv[2], atoi(argv[3]), argv[4]);
+    }
+    if (argc == 5 && strcmp(argv[1], "mkimage") == 0) {
+        return command_mkimage(argv[2], strtoull(argv[3], NULL, 10), strtoull(argv[4], NULL, 10));
+    }
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "bench") == 0) {
+        return command_bench(argv[2], strtoull(argv[3], NULL, 10), strtoull(argv[4], NULL, 10),
+                             argc == 6 ? strtoull(argv[5], NULL, 10) : 0);
+    }
+    usage();
+    return 2;
+}
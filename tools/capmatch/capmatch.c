@@ -0,0 +1,354 @@
+// capmatch - group the records of several sniffers that observed the same transmission
+//
+//   capmatch group <capture>... [--bucket MS] [--all]
+//   capmatch bench <sniffers> <transmissions> [skew-ms] [bucket-ms]
+//
+// `group` merges the L2 captures by time (capmerge) and prints one CSV row per transmission heard by at least two
+// sniffers (every transmission with --all): first timestamp (ms), transmitter, sequence and fragment number, frame
+// type and subtype, number of sniffers and duplicate copies, then for every capture the RSSI and the delay (ms)
+// after the first observation, empty when it did not hear the frame. The number of distinct transmissions is the
+// deduplicated frame count. Captures should share one clock, see `capsync align`.
+//
+// `bench` simulates transmitters sending sequence numbered frames (one of them fast enough to wrap its sequence
+// number every few seconds, some frames retransmitted), heard by each sniffer with a clock offset of up to
+// +-skew ms. It reports the records/s the index sustains, and the pairwise precision (observations grouped together
+// that belong to the same transmission) and recall (observations of the same transmission grouped together). It
+// fails when the precision is below 1.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dot11.h"
+#include "match.h"
+#include "merge.h"
+
+#define BENCH_TRANSMITTERS 2000
+#define BENCH_RATE 5000              // Transmissions per second
+#define BENCH_FAST_PERCENT 20        // Share of the transmissions from the fast transmitter
+#define BENCH_RETRY_PERCENT 5
+#define BENCH_HEARD_PERCENT 60       // Chance that a sniffer hears a copy
+#define BENCH_DEFAULT_SKEW_MS 5
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: capmatch group <capture>... [--bucket MS] [--all]\n"
+            "       capmatch bench <sniffers> <transmissions> [skew-ms] [bucket-ms]\n");
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+typedef struct {
+    int sniffers;
+    bool all;
+} print_context_t;
+
+static void print_group(void *context, const match_group_t *group)
+{
+    const print_context_t *print = context;
+    if (!print->all && !(group->sniffers & (group->sniffers - 1))) {
+        return;
+    }
+
+    const uint8_t *mac = group->transmitter;
+    printf("%" PRIu64 ",%02X:%02X:%02X:%02X:%02X:%02X,%u,%u,%u,%u,%d,%u", group->timestamp, mac[0], mac[1], mac[2],
+           mac[3], mac[4], mac[5], group->sequence_control >> 4, group->sequence_control & 0x0F, group->frame_type,
+           group->frame_subtype, __builtin_popcountll(group->sniffers), group->duplicates);
+    for (int s = 0; s < print->sniffers; s++) {
+        if (group->sniffers & (1ull << s)) {
+            printf(",%d,%" PRIu64, group->observations[s].rssi, group->observations[s].timestamp - group->timestamp);
+        } else {
+            printf(",,");
+        }
+    }
+    printf("\n");
+}
+
+static int command_group(const char *const *paths, int count, uint32_t bucket_ms, bool all)
+{
+    if (count > MATCH_MAX_SNIFFERS) {
+        fprintf(stderr, "capmatch: at most %d captures\n", MATCH_MAX_SNIFFERS);
+        return 1;
+    }
+
+    merge_t merge;
+    int failed = 0;
+    if (merge_open(&merge, paths, count, NULL, &failed) != 0) {
+        fprintf(stderr, "capmatch: %s: %s\n", paths[failed], errno == EINVAL ? "not a capture of the same kind as "
+                "the first one" : strerror(errno));
+        return 1;
+    }
+    if (merge.kind != CAPTURE_KIND_L2) {
+        fprintf(stderr, "capmatch: CSI records carry no sequence numbers\n");
+        merge_close(&merge);
+        return 1;
+    }
+
+    print_context_t print = {.sniffers = count, .all = all};
+    match_index_t index;
+    if (match_init(&index, bucket_ms, print_group, &print) != 0) {
+        fprintf(stderr, "capmatch: out of memory\n");
+        merge_close(&merge);
+        return 1;
+    }
+
+    printf("timestamp_ms,transmitter,sequence,fragment,frame_type,frame_subtype,sniffers,duplicates");
+    for (int s = 0; s < count; s++) {
+        printf(",rssi_%d,delay_ms_%d", s, s);
+    }
+    printf("\n");
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const capture_record_t *record;
+    int input;
+    int rc;
+    while ((rc = merge_next(&merge, &record, &input)) == 1) {
+        if (match_add(&index, input, &record->l2, record->offset) != 0) {
+            rc = -1;
+            break;
+        }
+    }
+    match_flush(&index);
+    merge_close(&merge);
+
+    const match_stats_t *stats = &index.stats;
+    fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " ineligible, %" PRIu64 " transmissions (%" PRIu64
+            " heard by several sniffers, %.2f sniffers each), %" PRIu64 " duplicates in %.1f s\n", stats->records,
+            stats->ineligible, stats->groups, stats->matched,
+            stats->groups ? (double) stats->observations / (double) stats->groups : 0.0, stats->duplicates,
+            seconds_since(&start));
+    match_free(&index);
+    if (rc < 0) {
+        fprintf(stderr, "capmatch: %s\n", "read error or out of memory");
+        return 1;
+    }
+    return 0;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+// One copy of a transmission as a sniffer reports it
+typedef struct {
+    uint64_t timestamp;
+    uint64_t transmission;   // Ground truth
+    uint16_t transmitter;
+    uint16_t sequence_control;
+    uint8_t sniffer;
+    uint8_t retry;
+    int8_t rssi;
+} bench_copy_t;
+
+static int compare_copies(const void *a, const void *b)
+{
+    const bench_copy_t *ca = a;
+    const bench_copy_t *cb = b;
+    if (ca->timestamp != cb->timestamp) {
+        return ca->timestamp < cb->timestamp ? -1 : 1;
+    }
+    return ca->sniffer - cb->sniffer;
+}
+
+typedef struct {
+    uint64_t grouped_pairs;
+    uint64_t correct_pairs;
+    uint8_t *groups;         // Groups holding an observation of each transmission, saturating
+} bench_result_t;
+
+static void bench_group(void *context, const match_group_t *group)
+{
+    bench_result_t *result = context;
+    uint64_t transmissions[MATCH_MAX_SNIFFERS];
+    int count = 0;
+    for (int s = 0; s < MATCH_MAX_SNIFFERS; s++) {
+        if (group->sniffers & (1ull << s)) {
+            transmissions[count++] = group->observations[s].tag;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        bool first = true;
+        for (int j = 0; j < count; j++) {
+            if (j < i) {
+                first &= transmissions[j] != transmissions[i];
+            } else if (j > i) {
+                result->grouped_pairs++;
+                result->correct_pairs += transmissions[i] == transmissions[j];
+            }
+        }
+        if (first && result->groups[transmissions[i]] < UINT8_MAX) {
+            result->groups[transmissions[i]]++;
+        }
+    }
+}
+
+static int append_copy(bench_copy_t **copies, size_t *count, size_t *capacity, const bench_copy_t *copy)
+{
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 1024 * 1024;
+        bench_copy_t *larger = realloc(*copies, grown * sizeof(bench_copy_t));
+        if (larger == NULL) {
+            return -1;
+        }
+        *copies = larger;
+        *capacity = grown;
+    }
+    (*copies)[(*count)++] = *copy;
+    return 0;
+}
+
+static int command_bench(int sniffers, uint64_t transmissions, uint32_t skew_ms, uint32_t bucket_ms)
+{
+    bench_copy_t *copies = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint16_t *sequences = calloc(BENCH_TRANSMITTERS, sizeof(uint16_t));
+    uint8_t *heard_by = calloc(transmissions, 1);
+    bench_result_t result = {.groups = calloc(transmissions, 1)};
+    int32_t offsets[MATCH_MAX_SNIFFERS];
+    int rc = sequences && heard_by && result.groups ? 0 : -1;
+
+    // Fixed clock offset per sniffer within +-skew, the ground truth pairs are counted while generating
+    for (int s = 0; s < sniffers; s++) {
+        offsets[s] = skew_ms ? (int32_t) (random_next() % (2 * skew_ms + 1)) - (int32_t) skew_ms : 0;
+    }
+    uint64_t true_pairs = 0;
+    uint64_t shared = 0;     // Transmissions heard by several sniffers
+    uint64_t time_us = 1700000000000000ull;
+    for (uint64_t t = 0; rc == 0 && t < transmissions; t++) {
+        time_us += random_next() % (2 * 1000000 / BENCH_RATE + 1);
+        uint16_t transmitter = random_next() % 100 < BENCH_FAST_PERCENT ? 0 :
+                               (uint16_t) (1 + random_next() % (BENCH_TRANSMITTERS - 1));
+        uint16_t sequence_control = (uint16_t) (sequences[transmitter]++ << 4);
+        int copies_sent = random_next() % 100 < BENCH_RETRY_PERCENT ? 2 : 1;
+
+        uint64_t heard = 0;
+        for (int copy = 0; copy < copies_sent; copy++) {
+            uint64_t sent_ms = (time_us + (uint64_t) copy * (1000 + random_next() % 2000)) / 1000;
+            for (int s = 0; s < sniffers; s++) {
+                if (random_next() % 100 >= BENCH_HEARD_PERCENT) {
+                    continue;
+                }
+                heard |= 1ull << s;
+                bench_copy_t copy_heard = {
+                        .timestamp = (uint64_t) ((int64_t) sent_ms + offsets[s]),
+                        .transmission = t,
+                        .transmitter = transmitter,
+                        .sequence_control = sequence_control,
+                        .sniffer = (uint8_t) s,
+                        .retry = (uint8_t) copy,
+                        .rssi = (int8_t) (-40 - (int) (random_next() % 50)),
+                };
+                if (append_copy(&copies, &count, &capacity, &copy_heard) != 0) {
+                    rc = -1;
+                }
+            }
+        }
+        uint64_t k = (uint64_t) __builtin_popcountll(heard);
+        true_pairs += k * (k - 1) / 2;
+        heard_by[t] = (uint8_t) k;
+        shared += k > 1;
+    }
+
+    match_index_t index;
+    if (rc != 0 || match_init(&index, bucket_ms, bench_group, &result) != 0) {
+        fprintf(stderr, "capmatch: out of memory\n");
+        free(copies);
+        free(sequences);
+        free(heard_by);
+        free(result.groups);
+        return 1;
+    }
+    qsort(copies, count, sizeof(bench_copy_t), compare_copies);
+
+    // Records are built from the copies inside the timed loop, as a reader would decode them
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    captured_packet_t record = {.frame_type = 0, .frame_subtype = 4, .header_len = 24, .channel = 6};
+    record.header[0] = (uint8_t) (DOT11_SUBTYPE_PROBE_REQ << 4);
+    memset(record.header + 4, 0xFF, 6);
+    record.header[10] = 0x02;
+    for (size_t i = 0; rc == 0 && i < count; i++) {
+        const bench_copy_t *copy = &copies[i];
+        record.timestamp = copy->timestamp;
+        record.rssi = copy->rssi;
+        record.header[1] = copy->retry ? 0x08 : 0;
+        memcpy(record.header + 14, &copy->transmitter, 2);
+        memcpy(record.header + 22, &copy->sequence_control, 2);
+        rc = match_add(&index, copy->sniffer, &record, copy->transmission);
+    }
+    match_flush(&index);
+    double seconds = seconds_since(&start);
+
+    const match_stats_t *stats = &index.stats;
+    printf("%d sniffers, %" PRIu64 " transmissions, %zu records, skew +-%u ms, bucket %u ms\n", sniffers,
+           transmissions, count, skew_ms, index.bucket_ms);
+    printf("%.2f M records/s, %" PRIu64 " groups (%" PRIu64 " matched), %" PRIu64 " duplicates, ring %u entries\n",
+           (double) count / seconds / 1e6, stats->groups, stats->matched, stats->duplicates, index.capacity);
+
+    // Recall: transmissions heard by several sniffers whose observations all ended up in one group
+    uint64_t whole = 0;
+    for (uint64_t t = 0; t < transmissions; t++) {
+        whole += heard_by[t] > 1 && result.groups[t] == 1;
+    }
+    double precision = result.grouped_pairs ? (double) result.correct_pairs / (double) result.grouped_pairs : 1.0;
+    double recall = shared ? (double) whole / (double) shared : 1.0;
+    printf("pairs: %" PRIu64 " true, %" PRIu64 " grouped, %" PRIu64 " correct: precision %.6f\n", true_pairs,
+           result.grouped_pairs, result.correct_pairs, precision);
+    printf("transmissions heard by several sniffers: %" PRIu64 ", kept in one group: %" PRIu64 ", recall %.6f\n",
+           shared, whole, recall);
+
+    match_free(&index);
+    free(copies);
+    free(sequences);
+    free(heard_by);
+    free(result.groups);
+    return rc == 0 && result.correct_pairs == result.grouped_pairs ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "group") == 0) {
+        uint32_t bucket_ms = MATCH_DEFAULT_BUCKET_MS;
+        bool all = false;
+        int count = 0;
+        for (int i = 2; i < argc; i++) {
+            if (strcmp(argv[i], "--bucket") == 0 && i + 1 < argc) {
+                bucket_ms = (uint32_t) strtoul(argv[++i], NULL, 10);
+            } else if (strcmp(argv[i], "--all") == 0) {
+                all = true;
+            } else {
+                argv[2 + count++] = argv[i];
+            }
+        }
+        if (count > 0 && bucket_ms > 0) {
+            return command_group((const char *const *) &argv[2], count, bucket_ms, all);
+        }
+    }
+    if (argc >= 4 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+        int sniffers = atoi(argv[2]);
+        uint64_t transmissions = strtoull(argv[3], NULL, 10);
+        uint32_t skew_ms = argc >= 5 ? (uint32_t) strtoul(argv[4], NULL, 10) : BENCH_DEFAULT_SKEW_MS;
+        uint32_t bucket_ms = argc == 6 ? (uint32_t) strtoul(argv[5], NULL, 10) : MATCH_DEFAULT_BUCKET_MS;
+        if (sniffers > 0 && sniffers <= MATCH_MAX_SNIFFERS && transmissions > 0 && bucket_ms > 0) {
+            return command_bench(sniffers, transmissions, skew_ms, bucket_ms);
+        }
+    }
+    usage();
+    return 2;
+}
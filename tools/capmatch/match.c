@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include "dot11.h"
+#include "match.h"
+
+#define INITIAL_CAPACITY 1024
+
+static uint32_t key_hash(const uint8_t *transmitter, uint16_t sequence_control, uint8_t frame_type,
+                         uint8_t frame_subtype, uint64_t bucket)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 6; i++) {
+        hash = (hash ^ transmitter[i]) * 16777619u;
+    }
+    hash = (hash ^ sequence_control) * 16777619u;
+    hash = (hash ^ (uint32_t) (frame_type << 4 | frame_subtype)) * 16777619u;
+    hash = (hash ^ (uint32_t) bucket) * 16777619u;
+    hash = (hash ^ (uint32_t) (bucket >> 32)) * 16777619u;
+    return hash;
+}
+
+static uint32_t entry_hash(const match_entry_t *entry)
+{
+    const match_group_t *group = &entry->group;
+    return key_hash(group->transmitter, group->sequence_control, group->frame_type, group->frame_subtype,
+                    entry->bucket);
+}
+
+// Hash chains of every open group, after the ring was reallocated
+static int rebuild_chains(match_index_t *index)
+{
+    uint32_t size = index->capacity * 2;
+    uint32_t *chains = malloc(size * sizeof(uint32_t));
+    if (chains == NULL) {
+        return -1;
+    }
+    memset(chains, 0xFF, size * sizeof(uint32_t));
+    free(index->chains);
+    index->chains = chains;
+    index->chain_mask = size - 1;
+
+    for (uint32_t i = 0; i < index->count; i++) {
+        uint32_t slot = (index->head + i) & (index->capacity - 1);
+        uint32_t *chain = &index->chains[entry_hash(&index->entries[slot]) & index->chain_mask];
+        index->entries[slot].next = *chain;
+        *chain = slot;
+    }
+    return 0;
+}
+
+static int grow(match_index_t *index)
+{
+    uint32_t capacity = index->capacity * 2;
+    match_entry_t *entries = malloc(capacity * sizeof(match_entry_t));
+    if (entries == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < index->count; i++) {
+        entries[i] = index->entries[(index->head + i) & (index->capacity - 1)];
+    }
+    free(index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+    index->head = 0;
+    return rebuild_chains(index);
+}
+
+// Emit the oldest open group and unlink it from its chain
+static void emit_oldest(match_index_t *index)
+{
+    uint32_t slot = index->head;
+    match_entry_t *entry = &index->entries[slot];
+
+    uint32_t *link = &index->chains[entry_hash(entry) & index->chain_mask];
+    while (*link != slot) {
+        link = &index->entries[*link].next;
+    }
+    *link = entry->next;
+
+    index->stats.groups++;
+    if (entry->group.sniffers & (entry->group.sniffers - 1)) {
+        index->stats.matched++;
+    }
+    index->stats.duplicates += entry->group.duplicates;
+    if (index->callback) {
+        index->callback(index->context, &entry->group);
+    }
+
+    index->head = (index->head + 1) & (index->capacity - 1);
+    index->count--;
+}
+
+static match_entry_t *find(match_index_t *index, const dot11_header_t *header, uint64_t bucket, uint64_t timestamp)
+{
+    uint32_t slot = index->chains[key_hash(header->addr2, header->sequence_control, header->type, header->subtype,
+                                           bucket) & index->chain_mask];
+    for (; slot != MATCH_NONE; slot = index->entries[slot].next) {
+        match_entry_t *entry = &index->entries[slot];
+        const match_group_t *group = &entry->group;
+        if (entry->bucket == bucket && group->sequence_control == header->sequence_control &&
+            group->frame_type == header->type && group->frame_subtype == header->subtype &&
+            memcmp(group->transmitter, header->addr2, 6) == 0 &&
+            timestamp - group->timestamp <= index->bucket_ms) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int match_init(match_index_t *index, uint32_t bucket_ms, match_group_cb_t callback, void *context)
+{
+    memset(index, 0, sizeof(*index));
+    index->bucket_ms = bucket_ms > 0 ? bucket_ms : MATCH_DEFAULT_BUCKET_MS;
+    index->callback = callback;
+    index->context = context;
+    index->capacity = INITIAL_CAPACITY;
+    index->entries = malloc(index->capacity * sizeof(match_entry_t));
+    if (index->entries == NULL || rebuild_chains(index) != 0) {
+        match_free(index);
+        return -1;
+    }
+    return 0;
+}
+
+int match_add(match_index_t *index, int sniffer, const captured_packet_t *record, uint64_t tag)
+{
+    index->stats.records++;
+
+    dot11_header_t header;
+    size_t len = record->header_len < sizeof(record->header) ? record->header_len : sizeof(record->header);
+    if (sniffer < 0 || sniffer >= MATCH_MAX_SNIFFERS || !dot11_parse_header(record->header, len, &header) ||
+        !header.has_sequence || header.addr2 == NULL) {
+        index->stats.ineligible++;
+        return 0;
+    }
+
+    uint64_t timestamp = record->timestamp;
+    if (timestamp > index->latest) {
+        index->latest = timestamp;
+        while (index->count > 0 &&
+               index->entries[index->head].group.timestamp + index->bucket_ms < index->latest) {
+            emit_oldest(index);
+        }
+    }
+
+    // The group may have been opened in the bucket before, up to bucket_ms earlier
+    uint64_t bucket = timestamp / index->bucket_ms;
+    match_entry_t *entry = find(index, &header, bucket, timestamp);
+    if (entry == NULL && bucket > 0) {
+        entry = find(index, &header, bucket - 1, timestamp);
+    }
+
+    if (entry == NULL) {
+        if (index->count == index->capacity && grow(index) != 0) {
+            return -1;
+        }
+        uint32_t slot = (index->head + index->count) & (index->capacity - 1);
+        entry = &index->entries[slot];
+        match_group_t *group = &entry->group;
+        memcpy(group->transmitter, header.addr2, 6);
+        group->sequence_control = header.sequence_control;
+        group->frame_type = header.type;
+        group->frame_subtype = header.subtype;
+        group->timestamp = timestamp;
+        group->sniffers = 0;
+        group->duplicates = 0;
+        entry->bucket = bucket;
+
+        uint32_t *chain = &index->chains[entry_hash(entry) & index->chain_mask];
+        entry->next = *chain;
+        *chain = slot;
+        index->count++;
+    }
+
+    match_group_t *group = &entry->group;
+    uint64_t bit = 1ull << sniffer;
+    if (group->sniffers & bit) {
+        group->duplicates++;
+        return 0;
+    }
+    group->sniffers |= bit;
+    group->observations[sniffer] = (match_observation_t) {
+            .timestamp = timestamp,
+            .tag = tag,
+            .rssi = record->rssi,
+    };
+    index->stats.observations++;
+    return 0;
+}
+
+void match_flush(match_index_t *index)
+{
+    while (index->count > 0) {
+        emit_oldest(index);
+    }
+}
+
+void match_free(match_index_t *index)
+{
+    free(index->entries);
+    free(index->chains);
+    index->entries = NULL;
+    index->chains = NULL;
+    index->count = 0;
+}
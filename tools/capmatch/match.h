@@ -0,0 +1,88 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+// Grouping of the records of several sniffers that observed the same transmission.
+//
+// A transmission is identified by its transmitter address, sequence control (sequence and fragment number) and
+// frame type/subtype. Sequence numbers are 12 bits and wrap every 4096 frames of a transmitter, so the key also
+// holds a coarse time bucket (timestamp / bucket_ms): the same sequence number after a wrap lands in a later bucket
+// and opens a new group. A record joins a group of the same key in its own bucket or the one before when the two
+// are at most bucket_ms apart, which absorbs the residual clock offset between sniffers after `capsync align`.
+//
+// Records must be added in timestamp order (as produced by the capmerge library). A group is emitted once the
+// newest record is more than bucket_ms past its first one, so the memory held is bounded by the traffic of about
+// two buckets. Retransmissions carry the sequence control of the original, a sniffer hearing several copies counts
+// them as duplicates and keeps its first. Frames without a transmitter or sequence number (ACK, CTS, other control
+// frames) cannot be matched and are counted as ineligible.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "capture_format.h"
+
+#define MATCH_MAX_SNIFFERS 64
+#define MATCH_DEFAULT_BUCKET_MS 50
+#define MATCH_NONE UINT32_MAX
+
+typedef struct {
+    uint64_t timestamp;      // ms
+    uint64_t tag;            // Caller's reference to the record, e.g. its offset in the capture
+    int8_t rssi;
+} match_observation_t;
+
+typedef struct {
+    uint8_t transmitter[6];
+    uint16_t sequence_control;
+    uint8_t frame_type;
+    uint8_t frame_subtype;
+    uint64_t timestamp;      // First observation (ms)
+    uint64_t sniffers;       // Bit mask of the sniffers in `observations`
+    uint32_t duplicates;     // Further copies heard by a sniffer already in the group
+    match_observation_t observations[MATCH_MAX_SNIFFERS];
+} match_group_t;
+
+typedef void (*match_group_cb_t)(void *context, const match_group_t *group);
+
+typedef struct {
+    uint64_t records;
+    uint64_t ineligible;     // No transmitter or sequence number
+    uint64_t groups;         // Transmissions
+    uint64_t matched;        // Transmissions heard by more than one sniffer
+    uint64_t observations;   // Records kept in groups
+    uint64_t duplicates;
+} match_stats_t;
+
+typedef struct {
+    match_group_t group;
+    uint64_t bucket;
+    uint32_t next;           // Next entry of the same hash chain, MATCH_NONE ends it
+} match_entry_t;
+
+typedef struct {
+    uint32_t bucket_ms;
+    match_group_cb_t callback;
+    void *context;
+
+    // Open groups in creation (time) order, a ring of `capacity` entries
+    match_entry_t *entries;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+
+    uint32_t *chains;        // Hash of (key, bucket) to the first entry of its chain
+    uint32_t chain_mask;
+    uint64_t latest;         // Newest timestamp added
+    match_stats_t stats;
+} match_index_t;
+
+int match_init(match_index_t *index, uint32_t bucket_ms, match_group_cb_t callback, void *context);
+
+// Add the record of `sniffer` (0 .. MATCH_MAX_SNIFFERS - 1), `tag` is passed back in its observation. Groups that
+// can no longer grow are emitted first. Returns 0, or -1 when out of memory.
+int match_add(match_index_t *index, int sniffer, const captured_packet_t *record, uint64_t tag);
+
+// Emit the groups still open, at the end of the input
+void match_flush(match_index_t *index);
+
+void match_free(match_index_t *index);
+
+#endif // MATCH_H
@@ -0,0 +1,366 @@
+// capmerge - merge the captures of several sniffers into one time ordered capture
+//
+//   capmerge merge <output> <capture>... [--threads N] [--batch N]
+//   capmerge bench <directory> <devices> <records-per-device> [threads] [batch]
+//
+// `merge` streams every input through a k-way merge on the record timestamps (see merge.h). All inputs must hold
+// the same kind of records. An output ending in .pcapng gets one interface per sniffer, named after its Wi-Fi MAC
+// and capture path, and every packet names the interface of its sniffer (L2 only). Any other output is a raw
+// capture ("L2PK" or "CSIP", joined records keep their L2 part) with a sidecar <output>.dev holding the index of
+// the sniffer of each record, layout in merge.h. Inputs should already share one clock, see `capsync align`.
+//
+// `bench` writes <devices> synthetic L2 captures into <directory> (existing files of the right size are reused),
+// merges them without writing an output and checks that the records come out ordered by (timestamp, input) and
+// in their original order within every input. It reports the throughput, the read-ahead memory and the peak RSS.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "merge.h"
+#include "pcapng_writer.h"
+
+#define BENCH_MAX_GAP_MS 4
+#define BENCH_MAX_SKEW_MS 1000
+#define BENCH_WRITE_RECORDS 4096
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: capmerge merge <output> <capture>... [--threads N] [--batch N]\n"
+            "       capmerge bench <directory> <devices> <records-per-device> [threads] [batch]\n");
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static long peak_rss_kib(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static bool has_suffix(const char *text, const char *suffix)
+{
+    size_t len = strlen(text);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(text + len - suffix_len, suffix) == 0;
+}
+
+static void print_stats(const merge_t *merge, uint64_t records, double seconds)
+{
+    printf("%" PRIu64 " records from %d captures in %.1f s: %.2f M records/s, %.0f MB/s read\n", records,
+           merge->count, seconds, (double) records / seconds / 1e6, (double) merge->stats.bytes_read / seconds / 1e6);
+    printf("unordered %" PRIu64 ", stalls %" PRIu64 ", read-ahead %.1f MiB, peak RSS %.1f MiB\n",
+           merge->stats.unordered, merge->stats.stalls, (double) merge->stats.buffer_memory / (1024.0 * 1024.0),
+           (double) peak_rss_kib() / 1024.0);
+}
+
+// Header of a raw merged capture: the format of the kind, the earliest start, no single sniffer's addresses
+static int write_header(FILE *output, const merge_t *merge)
+{
+    capture_format_t format = merge->kind == CAPTURE_KIND_L2 ? CAPTURE_FORMAT_L2_RAW : CAPTURE_FORMAT_CSI;
+    file_header_t header = merge->inputs[0].reader.header;
+    memcpy(header.identifier, capture_format_info(format)->identifier, 4);
+    header.version = capture_format_info(format)->version;
+    memset(header.wifi_mac, 0, sizeof(header.wifi_mac));
+    memset(header.bt_mac, 0, sizeof(header.bt_mac));
+    for (int i = 1; i < merge->count; i++) {
+        if (merge->inputs[i].reader.header.start_time < header.start_time) {
+            header.start_time = merge->inputs[i].reader.header.start_time;
+        }
+    }
+    return fwrite(&header, sizeof(header), 1, output) == 1 ? 0 : -1;
+}
+
+static FILE *open_devices(const char *output_path, const merge_t *merge)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.dev", output_path);
+    FILE *devices = fopen(path, "wb");
+    if (devices == NULL) {
+        return NULL;
+    }
+
+    merge_devices_t header = {.magic = {'M', 'D', 'E', 'V'}, .version = MERGE_DEVICES_VERSION,
+            .devices = (uint32_t) merge->count};
+    fwrite(&header, sizeof(header), 1, devices);
+    for (int i = 0; i < merge->count; i++) {
+        fwrite(merge->inputs[i].reader.header.wifi_mac, 6, 1, devices);
+    }
+    return devices;
+}
+
+static void add_interfaces(FILE *pcapng, const merge_t *merge, const char *const *paths)
+{
+    for (int i = 0; i < merge->count; i++) {
+        const uint8_t *mac = merge->inputs[i].reader.header.wifi_mac;
+        char name[256];
+        snprintf(name, sizeof(name), "%02X:%02X:%02X:%02X:%02X:%02X %s", mac[0], mac[1], mac[2], mac[3], mac[4],
+                 mac[5], paths[i]);
+        pcapng_add_interface(pcapng, name);
+    }
+}
+
+static int command_merge(const char *output_path, const char *const *paths, int count,
+                         const merge_options_t *options)
+{
+    bool pcapng = has_suffix(output_path, ".pcapng");
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    merge_t merge;
+    int failed = 0;
+    if (merge_open(&merge, paths, count, options, &failed) != 0) {
+        fprintf(stderr, "capmerge: %s: %s\n", paths[failed], errno == EINVAL ? "not a capture of the same kind as "
+                "the first one" : strerror(errno));
+        return 1;
+    }
+    if (pcapng && merge.kind != CAPTURE_KIND_L2) {
+        fprintf(stderr, "capmerge: pcapng output holds L2 frames only\n");
+        merge_close(&merge);
+        return 1;
+    }
+
+    FILE *output = pcapng ? pcapng_open(output_path) : fopen(output_path, "wb");
+    FILE *devices = NULL;
+    if (output == NULL || (!pcapng && (devices = open_devices(output_path, &merge)) == NULL)) {
+        fprintf(stderr, "capmerge: %s: %s\n", output_path, strerror(errno));
+        if (output) {
+            fclose(output);
+        }
+        merge_close(&merge);
+        return 1;
+    }
+    if (pcapng) {
+        add_interfaces(output, &merge, paths);
+    } else {
+        write_header(output, &merge);
+    }
+
+    const capture_record_t *record;
+    int input;
+    int rc;
+    uint64_t records = 0;
+    while ((rc = merge_next(&merge, &record, &input)) == 1) {
+        if (pcapng) {
+            pcapng_write_l2(output, (uint32_t) input, &record->l2);
+        } else {
+            uint16_t device = (uint16_t) input;
+            if (merge.kind == CAPTURE_KIND_L2) {
+                fwrite(&record->l2, sizeof(record->l2), 1, output);
+            } else {
+                fwrite(&record->csi, sizeof(record->csi), 1, output);
+            }
+            fwrite(&device, sizeof(device), 1, devices);
+        }
+        records++;
+    }
+
+    bool failed_write = ferror(output) != 0;
+    failed_write |= fclose(output) != 0;
+    if (devices) {
+        failed_write |= ferror(devices) != 0;
+        failed_write |= fclose(devices) != 0;
+    }
+    merge_close(&merge);
+    if (rc < 0 || failed_write) {
+        fprintf(stderr, "capmerge: %s\n", rc < 0 ? "read error" : "write error");
+        return 1;
+    }
+
+    print_stats(&merge, records, seconds_since(&start));
+    return 0;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+// One sniffer's capture: beacons and probe requests on an own clock skew, sequence number of the record in the
+// payload. Returns 0 when the file was written or already present.
+static int bench_generate(const char *path, int device, uint64_t count)
+{
+    struct stat st;
+    uint64_t size = sizeof(file_header_t) + count * sizeof(captured_packet_t);
+    if (stat(path, &st) == 0 && (uint64_t) st.st_size == size) {
+        return 0;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    file_header_t header = {.version = capture_format_info(CAPTURE_FORMAT_L2_RAW)->version,
+            .start_time = 1700000000, .wifi_mac = {0x24, 0x0A, 0xC4, 0x00, (uint8_t) (device >> 8),
+                                                   (uint8_t) device}};
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+    fwrite(&header, sizeof(header), 1, file);
+
+    captured_packet_t *records = calloc(BENCH_WRITE_RECORDS, sizeof(captured_packet_t));
+    if (records == NULL) {
+        fclose(file);
+        return -1;
+    }
+    uint64_t timestamp = 1700000000000ull + random_next() % BENCH_MAX_SKEW_MS;
+    for (uint64_t i = 0; i < count;) {
+        uint32_t n = 0;
+        for (; n < BENCH_WRITE_RECORDS && i < count; n++, i++) {
+            captured_packet_t *record = &records[n];
+            bool beacon = random_next() % 4 == 0;
+            timestamp += random_next() % BENCH_MAX_GAP_MS;
+            record->timestamp = timestamp;
+            record->frame_type = 0;
+            record->frame_subtype = beacon ? 8 : 4;
+            record->rssi = (int8_t) (-40 - (int) (random_next() % 50));
+            record->channel = (uint8_t) (1 + random_next() % 13);
+            record->header_len = 24;
+            record->header[0] = (uint8_t) (record->frame_subtype << 4);
+            for (int b = 10; b < 16; b++) {
+                record->header[b] = (uint8_t) random_next();
+            }
+            record->payload_len = 8;
+            memcpy(record->payload, &i, sizeof(i));
+        }
+        if (fwrite(records, sizeof(captured_packet_t), n, file) != n) {
+            break;
+        }
+    }
+    free(records);
+    bool failed = ferror(file) != 0;
+    return fclose(file) == 0 && !failed ? 0 : -1;
+}
+
+static int command_bench(const char *directory, int devices, uint64_t count, const merge_options_t *options)
+{
+    char **paths = calloc((size_t) devices, sizeof(char *));
+    uint64_t *expected = calloc((size_t) devices, sizeof(uint64_t));
+    if (paths == NULL || expected == NULL) {
+        free(paths);
+        free(expected);
+        return 1;
+    }
+
+    int rc = 1;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < devices; i++) {
+        paths[i] = malloc(strlen(directory) + 32);
+        sprintf(paths[i], "%s/sniffer-%03d.bin", directory, i);
+        if (bench_generate(paths[i], i, count) != 0) {
+            fprintf(stderr, "capmerge: %s: %s\n", paths[i], strerror(errno));
+            goto done;
+        }
+    }
+    double total_gb = (double) devices * (double) count * sizeof(captured_packet_t) / 1e9;
+    printf("%d captures of %" PRIu64 " records, %.2f GB, ready in %.1f s\n", devices, count, total_gb,
+           seconds_since(&start));
+
+    merge_t merge;
+    int failed = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (merge_open(&merge, (const char *const *) paths, devices, options, &failed) != 0) {
+        fprintf(stderr, "capmerge: %s: %s\n", paths[failed], strerror(errno));
+        goto done;
+    }
+
+    const capture_record_t *record;
+    int input;
+    int next;
+    uint64_t records = 0;
+    uint64_t last_timestamp = 0;
+    int last_input = 0;
+    uint64_t misordered = 0;
+    while ((next = merge_next(&merge, &record, &input)) == 1) {
+        uint64_t sequence;
+        memcpy(&sequence, record->l2.payload, sizeof(sequence));
+        if (record->l2.timestamp < last_timestamp ||
+            (record->l2.timestamp == last_timestamp && input < last_input) || sequence != expected[input]) {
+            misordered++;
+        }
+        expected[input] = sequence + 1;
+        last_timestamp = record->l2.timestamp;
+        last_input = input;
+        records++;
+    }
+    double seconds = seconds_since(&start);
+    merge_close(&merge);
+
+    print_stats(&merge, records, seconds);
+    uint64_t missing = (uint64_t) devices * count - records;
+    printf("misordered %" PRIu64 ", missing %" PRIu64 "\n", misordered, missing);
+    rc = next < 0 || misordered > 0 || missing > 0 ? 1 : 0;
+
+done:
+    for (int i = 0; i < devices; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(expected);
+    return rc;
+}
+
+// Options after the positional arguments: --threads N, --batch N
+static int parse_options(int argc, char **argv, int first, merge_options_t *options, int *positional)
+{
+    *positional = 0;
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            options->threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            options->batch = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            return -1;
+        } else {
+            argv[first + (*positional)++] = argv[i];
+        }
+    }
+    return options->threads > 0 && options->batch > 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    merge_options_t options = {
+            .threads = MERGE_DEFAULT_THREADS,
+            .batch = MERGE_DEFAULT_BATCH,
+            .read_buffer = MERGE_DEFAULT_READ_BUFFER,
+    };
+
+    if (argc >= 4 && strcmp(argv[1], "merge") == 0) {
+        int positional;
+        if (parse_options(argc, argv, 2, &options, &positional) == 0 && positional >= 2 &&
+            positional - 1 <= UINT16_MAX) {
+            return command_merge(argv[2], (const char *const *) &argv[3], positional - 1, &options);
+        }
+    }
+    if (argc >= 5 && argc <= 7 && strcmp(argv[1], "bench") == 0) {
+        int devices = atoi(argv[3]);
+        uint64_t count = strtoull(argv[4], NULL, 10);
+        if (argc >= 6) {
+            options.threads = atoi(argv[5]);
+        }
+        if (argc == 7) {
+            options.batch = (uint32_t) strtoul(argv[6], NULL, 10);
+        }
+        if (devices > 0 && devices <= UINT16_MAX && count > 0 && options.threads > 0 && options.batch > 0) {
+            return command_bench(argv[2], devices, count, &options);
+        }
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "merge.h"
+
+static uint64_t record_timestamp(capture_kind_t kind, const capture_record_t *record)
+{
+    return kind == CAPTURE_KIND_L2 ? record->l2.timestamp : record->csi.timestamp;
+}
+
+static const capture_record_t *input_record(const merge_input_t *input)
+{
+    return &input->batches[input->read].records[input->position];
+}
+
+// Called with the lock held
+static void request_fill(merge_t *merge, int index)
+{
+    merge_input_t *input = &merge->inputs[index];
+    if (input->queued || input->eof) {
+        return;
+    }
+    input->queued = true;
+    merge->queue[(merge->queue_head + merge->queue_len) % merge->count] = index;
+    merge->queue_len++;
+    pthread_cond_signal(&merge->work);
+}
+
+// Decoder thread: fills the free batches of one input at a time, the lock is released while decoding
+static void *merge_decoder(void *arg)
+{
+    merge_t *merge = arg;
+
+    pthread_mutex_lock(&merge->lock);
+    for (;;) {
+        while (merge->queue_len == 0 && !merge->stop) {
+            pthread_cond_wait(&merge->work, &merge->lock);
+        }
+        if (merge->stop) {
+            break;
+        }
+        int index = merge->queue[merge->queue_head];
+        merge->queue_head = (merge->queue_head + 1) % merge->count;
+        merge->queue_len--;
+
+        merge_input_t *input = &merge->inputs[index];
+        while (!input->batches[input->fill].full && !input->eof) {
+            merge_batch_t *batch = &input->batches[input->fill];
+            pthread_mutex_unlock(&merge->lock);
+
+            uint32_t count = 0;
+            int rc = 1;
+            while (count < merge->options.batch &&
+                   (rc = capture_reader_next(&input->reader, &batch->records[count])) == 1) {
+                count++;
+            }
+
+            pthread_mutex_lock(&merge->lock);
+            batch->count = count;
+            if (count > 0) {
+                batch->full = true;
+                input->fill ^= 1;
+            }
+            if (rc <= 0) {
+                input->eof = true;
+                input->error = rc < 0;
+            }
+            pthread_cond_broadcast(&merge->ready);
+        }
+        input->queued = false;
+        pthread_cond_broadcast(&merge->ready);
+    }
+    pthread_mutex_unlock(&merge->lock);
+    return NULL;
+}
+
+// Wait until the batch to read is decoded. Returns 1, 0 when the input is exhausted, -1 on a read error.
+static int wait_batch(merge_t *merge, merge_input_t *input)
+{
+    int rc;
+    pthread_mutex_lock(&merge->lock);
+    if (!input->batches[input->read].full && !input->eof) {
+        merge->stats.stalls++;
+    }
+    while (!input->batches[input->read].full && !input->eof) {
+        pthread_cond_wait(&merge->ready, &merge->lock);
+    }
+    if (input->batches[input->read].full) {
+        rc = 1;
+    } else {
+        rc = input->error ? -1 : 0;
+    }
+    pthread_mutex_unlock(&merge->lock);
+    return rc;
+}
+
+// Hand the consumed batch back to the decoders and move to the other one
+static int next_batch(merge_t *merge, int index)
+{
+    merge_input_t *input = &merge->inputs[index];
+
+    pthread_mutex_lock(&merge->lock);
+    input->batches[input->read].full = false;
+    input->read ^= 1;
+    input->position = 0;
+    request_fill(merge, index);
+    pthread_mutex_unlock(&merge->lock);
+
+    return wait_batch(merge, input);
+}
+
+static bool heap_less(const merge_t *merge, int a, int b)
+{
+    uint64_t ta = record_timestamp(merge->kind, input_record(&merge->inputs[a]));
+    uint64_t tb = record_timestamp(merge->kind, input_record(&merge->inputs[b]));
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void heap_down(merge_t *merge, int i)
+{
+    for (;;) {
+        int smallest = i;
+        int left = 2 * i + 1;
+        int right = left + 1;
+        if (left < merge->heap_len && heap_less(merge, merge->heap[left], merge->heap[smallest])) {
+            smallest = left;
+        }
+        if (right < merge->heap_len && heap_less(merge, merge->heap[right], merge->heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int swap = merge->heap[i];
+        merge->heap[i] = merge->heap[smallest];
+        merge->heap[smallest] = swap;
+        i = smallest;
+    }
+}
+
+int merge_open(merge_t *merge, const char *const *paths, int count, const merge_options_t *options, int *failed)
+{
+    memset(merge, 0, sizeof(*merge));
+    merge->options = (merge_options_t) {
+            .threads = MERGE_DEFAULT_THREADS,
+            .batch = MERGE_DEFAULT_BATCH,
+            .read_buffer = MERGE_DEFAULT_READ_BUFFER,
+    };
+    if (options) {
+        merge->options = *options;
+    }
+    if (count <= 0 || merge->options.threads <= 0 || merge->options.batch == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    merge->count = count;
+    merge->inputs = calloc((size_t) count, sizeof(merge_input_t));
+    merge->heap = calloc((size_t) count, sizeof(int));
+    merge->queue = calloc((size_t) count, sizeof(int));
+    merge->threads = calloc((size_t) merge->options.threads, sizeof(pthread_t));
+    if (merge->inputs == NULL || merge->heap == NULL || merge->queue == NULL || merge->threads == NULL) {
+        merge_close(merge);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        merge->inputs[i].reader.fd = -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        merge_input_t *input = &merge->inputs[i];
+        if (capture_reader_open_buffered(&input->reader, paths[i], merge->options.read_buffer) != 0) {
+            int error = errno;
+            input->reader.fd = -1;
+            if (failed) {
+                *failed = i;
+            }
+            merge_close(merge);
+            errno = error;
+            return -1;
+        }
+        if (i > 0 && input->reader.kind != merge->kind) {
+            if (failed) {
+                *failed = i;
+            }
+            merge_close(merge);
+            errno = EINVAL;
+            return -1;
+        }
+        merge->kind = input->reader.kind;
+        merge->stats.buffer_memory += input->reader.buffer_capacity;
+
+        for (int b = 0; b < 2; b++) {
+            input->batches[b].records = malloc(merge->options.batch * sizeof(capture_record_t));
+            if (input->batches[b].records == NULL) {
+                merge_close(merge);
+                errno = ENOMEM;
+                return -1;
+            }
+            merge->stats.buffer_memory += merge->options.batch * sizeof(capture_record_t);
+        }
+    }
+
+    pthread_mutex_init(&merge->lock, NULL);
+    pthread_cond_init(&merge->work, NULL);
+    pthread_cond_init(&merge->ready, NULL);
+    for (; merge->started < merge->options.threads; merge->started++) {
+        if (pthread_create(&merge->threads[merge->started], NULL, merge_decoder, merge) != 0) {
+            break;
+        }
+    }
+    if (merge->started == 0) {
+        merge_close(merge);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    pthread_mutex_lock(&merge->lock);
+    for (int i = 0; i < count; i++) {
+        request_fill(merge, i);
+    }
+    pthread_mutex_unlock(&merge->lock);
+
+    // The heap starts with every input that has a first batch
+    for (int i = 0; i < count; i++) {
+        int rc = wait_batch(merge, &merge->inputs[i]);
+        if (rc < 0) {
+            if (failed) {
+                *failed = i;
+            }
+            merge_close(merge);
+            errno = EIO;
+            return -1;
+        }
+        if (rc == 1) {
+            merge->heap[merge->heap_len++] = i;
+        }
+    }
+    for (int i = merge->heap_len / 2 - 1; i >= 0; i--) {
+        heap_down(merge, i);
+    }
+    return 0;
+}
+
+int merge_next(merge_t *merge, const capture_record_t **record, int *input)
+{
+    if (merge->advance) {
+        merge->advance = false;
+        int index = merge->heap[0];
+        merge_input_t *top = &merge->inputs[index];
+        merge->stats.records++;
+
+        int rc = 1;
+        if (++top->position == top->batches[top->read].count) {
+            rc = next_batch(merge, index);
+        }
+        if (rc < 0) {
+            return -1;
+        }
+        if (rc == 0) {
+            merge->heap[0] = merge->heap[--merge->heap_len];
+        } else {
+            uint64_t timestamp = record_timestamp(merge->kind, input_record(top));
+            if (timestamp < top->last_timestamp) {
+                merge->stats.unordered++;
+            }
+        }
+        heap_down(merge, 0);
+    }
+
+    if (merge->heap_len == 0) {
+        return 0;
+    }
+
+    int index = merge->heap[0];
+    merge_input_t *top = &merge->inputs[index];
+    *record = input_record(top);
+    *input = index;
+    top->last_timestamp = record_timestamp(merge->kind, *record);
+    merge->advance = true;
+    return 1;
+}
+
+void merge_close(merge_t *merge)
+{
+    if (merge->started > 0) {
+        pthread_mutex_lock(&merge->lock);
+        merge->stop = true;
+        pthread_cond_broadcast(&merge->work);
+        pthread_mutex_unlock(&merge->lock);
+        for (int i = 0; i < merge->started; i++) {
+            pthread_join(merge->threads[i], NULL);
+        }
+        pthread_cond_destroy(&merge->ready);
+        pthread_cond_destroy(&merge->work);
+        pthread_mutex_destroy(&merge->lock);
+        merge->started = 0;
+    }
+
+    for (int i = 0; merge->inputs && i < merge->count; i++) {
+        merge_input_t *input = &merge->inputs[i];
+        merge->stats.bytes_read += input->reader.bytes_read;
+        capture_reader_close(&input->reader);
+        free(input->batches[0].records);
+        free(input->batches[1].records);
+    }
+    free(merge->inputs);
+    free(merge->heap);
+    free(merge->queue);
+    free(merge->threads);
+    merge->inputs = NULL;
+    merge->heap = NULL;
+    merge->queue = NULL;
+    merge->threads = NULL;
+}
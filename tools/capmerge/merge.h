@@ -0,0 +1,97 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+// K-way merge of the captures of several sniffers into one stream ordered by timestamp.
+//
+// Every input is read ahead by a pool of decoder threads into two batches of decoded records: while the merge
+// consumes one batch, a decoder refills the other. Memory is bounded by the inputs, not their size:
+//   inputs x (read buffer + 2 x batch x sizeof(capture_record_t))
+// Ties are broken by input index, so the output is deterministic. Inputs are expected in capture order; a record
+// older than its predecessor in the same input is passed through where it comes and counted as `unordered`.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "capture_reader.h"
+
+#define MERGE_DEFAULT_THREADS 2
+#define MERGE_DEFAULT_BATCH 512                  // Records
+#define MERGE_DEFAULT_READ_BUFFER (256 * 1024)   // Bytes
+
+// Sidecar of a merged capture (<output>.dev) tagging every record with the sniffer it came from:
+//   merge_devices_t, devices x 6 byte Wi-Fi MAC, records x uint16 device index
+#define MERGE_DEVICES_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    char magic[4];       // "MDEV"
+    uint32_t version;
+    uint32_t devices;
+} merge_devices_t;
+
+typedef struct {
+    int threads;         // Decoder threads
+    uint32_t batch;      // Records per read-ahead batch
+    size_t read_buffer;  // Bytes of each input's file buffer
+} merge_options_t;
+
+typedef struct {
+    uint64_t records;
+    uint64_t bytes_read;
+    uint64_t unordered;      // Records older than their predecessor in the same input
+    uint64_t stalls;         // Times the merge waited for a decoder
+    size_t buffer_memory;    // Bytes of read buffers and batches
+} merge_stats_t;
+
+typedef struct {
+    capture_record_t *records;
+    uint32_t count;
+    bool full;
+} merge_batch_t;
+
+typedef struct {
+    capture_reader_t reader;
+    merge_batch_t batches[2];
+    uint32_t fill;           // Batch the decoder fills next
+    uint32_t read;           // Batch the merge reads
+    uint32_t position;       // Next record of the batch being read
+    bool queued;             // Waiting for or being filled by a decoder
+    bool eof;
+    bool error;
+    uint64_t last_timestamp;
+} merge_input_t;
+
+typedef struct {
+    merge_input_t *inputs;
+    int count;
+    capture_kind_t kind;
+    merge_options_t options;
+    merge_stats_t stats;
+
+    int *heap;               // Inputs with records left, ordered by (timestamp, index)
+    int heap_len;
+    bool advance;            // The record at the top of the heap was returned
+
+    // Refill requests, served by the decoders in order
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t ready;
+    int *queue;
+    int queue_head;
+    int queue_len;
+    bool stop;
+    pthread_t *threads;
+    int started;
+} merge_t;
+
+// Open `count` captures of the same kind (L2 or CSI). `options` may be NULL for the defaults.
+// Returns 0, or -1 with errno set; `failed` receives the index of the input that could not be opened.
+int merge_open(merge_t *merge, const char *const *paths, int count, const merge_options_t *options, int *failed);
+
+// Next record in timestamp order and the index of its input. The record stays valid until the next call.
+// Returns 1, 0 after the last record, -1 on a read error.
+int merge_next(merge_t *merge, const capture_record_t **record, int *input);
+
+void merge_close(merge_t *merge);
+
+#endif // MERGE_H
@@ -0,0 +1,442 @@
+// capstream - receive the serial capture stream of a sniffer built with SNIFFER_STORE_SERIAL
+//
+//   capstream receive <tty> <baud> <directory> [pcapng]
+//   capstream bench <records> [baud]
+//
+// `receive` writes the L2 and CSI records to <directory>/l2.bin and csi.bin, the same capture files the sniffer
+// would write to its card, until interrupted. With `pcapng`, raw L2 records are also written to l2.pcapng with a
+// radiotap header carrying channel and RSSI. Lost records are detected from the per-stream sequence numbers, frames
+// with a bad CRC are dropped. `bench` streams synthetic L2 records through a pseudo terminal with the firmware's
+// encoder and this receiver, and reports the sustained records/s of the framing and what a link of `baud` carries.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "capture_format.h"
+#include "pcapng_writer.h"
+#include "serial_frame.h"
+
+#define STATUS_INTERVAL_S 5
+#define READ_BUFFER (64 * 1024)
+#define BENCH_TIMEOUT_MS 2000
+
+typedef struct {
+    const char *name;
+    FILE *capture;
+    FILE *pcapng;               // Raw L2 records only
+    bool started;               // A header frame was received
+    file_header_t header;
+    capture_format_t format;
+    uint32_t record_size;
+    uint32_t next_sequence;
+    uint64_t records;
+    uint64_t lost;              // Gaps in the sequence numbers
+    uint64_t skipped;           // Records before the first header frame
+    uint64_t restarts;          // The sequence went back, the sniffer restarted
+} stream_state_t;
+
+typedef struct {
+    stream_state_t streams[2];
+    serial_frame_decoder_t decoder;
+    const char *directory;      // NULL: count only
+    bool pcapng;
+    uint64_t bad_length;
+} receiver_t;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int signal)
+{
+    (void) signal;
+    stop = 1;
+}
+
+static bool open_outputs(receiver_t *receiver, stream_state_t *stream, const uint8_t *header, size_t header_len)
+{
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s.bin", receiver->directory, stream->name);
+    stream->capture = fopen(path, "wb");
+    if (stream->capture == NULL || fwrite(header, header_len, 1, stream->capture) != 1) {
+        fprintf(stderr, "capstream: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if (receiver->pcapng && stream->format == CAPTURE_FORMAT_L2_RAW) {
+        snprintf(path, sizeof(path), "%s/%s.pcapng", receiver->directory, stream->name);
+        stream->pcapng = pcapng_open(path);
+        if (stream->pcapng == NULL) {
+            fprintf(stderr, "capstream: %s: %s\n", path, strerror(errno));
+            return false;
+        }
+        pcapng_add_interface(stream->pcapng, NULL);
+    } else if (receiver->pcapng && stream->format == CAPTURE_FORMAT_L2_PROJECTED) {
+        fprintf(stderr, "capstream: projected L2 records carry no frame bytes, writing no pcapng\n");
+    }
+    return true;
+}
+
+// Sequence of the next record on the stream: gaps are lost records, a step back is a restarted sniffer
+static void advance_sequence(stream_state_t *stream, uint32_t sequence)
+{
+    if (sequence < stream->next_sequence) {
+        stream->restarts++;
+    } else {
+        stream->lost += sequence - stream->next_sequence;
+    }
+    stream->next_sequence = sequence;
+}
+
+static bool handle_header(receiver_t *receiver, stream_state_t *stream, const serial_frame_t *frame)
+{
+    if (frame->payload_len < sizeof(file_header_t)) {
+        receiver->bad_length++;
+        return true;
+    }
+
+    file_header_t header;
+    memcpy(&header, frame->payload, sizeof(header));
+    if (stream->started) {
+        if (memcmp(header.identifier, stream->header.identifier, 4) != 0) {
+            fprintf(stderr, "capstream: %s stream changed to %.4s, restart the receiver\n", stream->name,
+                    header.identifier);
+            return false;
+        }
+        advance_sequence(stream, frame->header.sequence);
+        return true;
+    }
+
+    capture_format_t format = capture_format_find(header.identifier);
+    if (format == CAPTURE_FORMAT_COUNT || header.version < capture_format_info(format)->oldest ||
+        header.version > capture_format_info(format)->version) {
+        fprintf(stderr, "capstream: unsupported %s stream %.4s v%" PRIu32 "\n", stream->name, header.identifier,
+                header.version);
+        return false;
+    }
+
+    stream->header = header;
+    stream->format = format;
+    stream->record_size = capture_format_info(format)->record_size;
+    if (format == CAPTURE_FORMAT_L2_PROJECTED) {
+        uint32_t schema;
+        if (frame->payload_len < sizeof(header) + sizeof(schema)) {
+            receiver->bad_length++;
+            return true;
+        }
+        memcpy(&schema, frame->payload + sizeof(header), sizeof(schema));
+        stream->record_size = projection_record_size(schema);
+    }
+    if (receiver->directory && !open_outputs(receiver, stream, frame->payload, frame->payload_len)) {
+        return false;
+    }
+
+    stream->started = true;
+    stream->next_sequence = frame->header.sequence;
+    fprintf(stderr, "capstream: %s stream %.4s v%" PRIu32 " from %02x:%02x:%02x:%02x:%02x:%02x\n", stream->name,
+            header.identifier, header.version, header.wifi_mac[0], header.wifi_mac[1], header.wifi_mac[2],
+            header.wifi_mac[3], header.wifi_mac[4], header.wifi_mac[5]);
+    return true;
+}
+
+static void handle_record(receiver_t *receiver, stream_state_t *stream, const serial_frame_t *frame)
+{
+    if (!stream->started) {
+        stream->skipped++;
+        return;
+    }
+    if (frame->payload_len != stream->record_size) {
+        receiver->bad_length++;
+        return;
+    }
+
+    advance_sequence(stream, frame->header.sequence);
+    stream->next_sequence++;
+    stream->records++;
+
+    if (stream->capture) {
+        fwrite(frame->payload, frame->payload_len, 1, stream->capture);
+    }
+    if (stream->pcapng) {
+        captured_packet_t record;
+        memcpy(&record, frame->payload, sizeof(record));
+        pcapng_write_l2(stream->pcapng, 0, &record);
+    }
+}
+
+static void receiver_init(receiver_t *receiver, const char *directory, bool pcapng)
+{
+    memset(receiver, 0, sizeof(*receiver));
+    receiver->streams[SERIAL_STREAM_L2].name = "l2";
+    receiver->streams[SERIAL_STREAM_CSI].name = "csi";
+    receiver->directory = directory;
+    receiver->pcapng = pcapng;
+    serial_frame_decoder_init(&receiver->decoder);
+}
+
+// Returns false on a fatal stream error
+static bool receiver_feed(receiver_t *receiver, const uint8_t *data, size_t len)
+{
+    const uint8_t *end = data + len;
+    serial_frame_t frame;
+    while (serial_frame_decode(&receiver->decoder, &data, end, &frame)) {
+        if (frame.header.stream > SERIAL_STREAM_CSI) {
+            receiver->bad_length++;
+            continue;
+        }
+        stream_state_t *stream = &receiver->streams[frame.header.stream];
+        if (frame.header.kind == SERIAL_FRAME_HEADER) {
+            if (!handle_header(receiver, stream, &frame)) {
+                return false;
+            }
+        } else if (frame.header.kind == SERIAL_FRAME_RECORD) {
+            handle_record(receiver, stream, &frame);
+        }
+    }
+    return true;
+}
+
+static void receiver_close(receiver_t *receiver)
+{
+    for (int i = 0; i < 2; i++) {
+        stream_state_t *stream = &receiver->streams[i];
+        if (stream->capture) {
+            fclose(stream->capture);
+        }
+        if (stream->pcapng) {
+            fclose(stream->pcapng);
+        }
+        if (stream->started || stream->skipped) {
+            printf("%s: %" PRIu64 " records, %" PRIu64 " lost, %" PRIu64 " before the first header, "
+                   "%" PRIu64 " restarts\n", stream->name, stream->records, stream->lost, stream->skipped,
+                   stream->restarts);
+        }
+    }
+    printf("%" PRIu64 " bad frames, %" PRIu64 " with a bad length\n", receiver->decoder.errors, receiver->bad_length);
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static speed_t baud_constant(unsigned long baud)
+{
+    switch (baud) {
+        case 115200: return B115200;
+        case 230400: return B230400;
+        #ifdef B460800
+        case 460800: return B460800;
+        case 921600: return B921600;
+        #endif
+        #ifdef B1000000
+        case 1000000: return B1000000;
+        case 1500000: return B1500000;
+        case 2000000: return B2000000;
+        case 3000000: return B3000000;
+        case 4000000: return B4000000;
+        #endif
+        default: return B0;
+    }
+}
+
+static bool make_raw(int fd, unsigned long baud)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    if (baud) {
+        speed_t speed = baud_constant(baud);
+        if (speed == B0) {
+            errno = EINVAL;
+            return false;
+        }
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+    }
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+static int command_receive(const char *tty, unsigned long baud, const char *directory, bool pcapng)
+{
+    int fd = open(tty, O_RDONLY | O_NOCTTY);
+    if (fd < 0 || !make_raw(fd, baud)) {
+        fprintf(stderr, "capstream: %s at %lu baud: %s\n", tty, baud, strerror(errno));
+        return 1;
+    }
+    mkdir(directory, 0755);
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    receiver_t receiver;
+    receiver_init(&receiver, directory, pcapng);
+
+    static uint8_t buffer[READ_BUFFER];
+    struct timespec status;
+    clock_gettime(CLOCK_MONOTONIC, &status);
+    uint64_t status_records = 0;
+    int rc = 0;
+    while (!stop) {
+        ssize_t len = read(fd, buffer, sizeof(buffer));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            fprintf(stderr, "capstream: %s: %s\n", tty, len < 0 ? strerror(errno) : "closed");
+            rc = 1;
+            break;
+        }
+        if (!receiver_feed(&receiver, buffer, (size_t) len)) {
+            rc = 1;
+            break;
+        }
+
+        double elapsed = seconds_since(&status);
+        if (elapsed >= STATUS_INTERVAL_S) {
+            uint64_t records = receiver.streams[0].records + receiver.streams[1].records;
+            fprintf(stderr, "capstream: %.0f records/s, %" PRIu64 " lost\n", (double) (records - status_records) /
+                    elapsed, receiver.streams[0].lost + receiver.streams[1].lost);
+            status_records = records;
+            clock_gettime(CLOCK_MONOTONIC, &status);
+        }
+    }
+
+    close(fd);
+    receiver_close(&receiver);
+    return rc;
+}
+
+typedef struct {
+    int fd;
+    uint64_t records;
+    uint64_t wire_bytes;
+} bench_writer_t;
+
+// The sniffer side: synthetic L2 records, encoded with the firmware's encoder
+static void *bench_write(void *argument)
+{
+    bench_writer_t *writer = argument;
+    static uint8_t chunk[READ_BUFFER];
+    size_t fill = 0;
+
+    file_header_t header = {0};
+    memcpy(header.identifier, capture_format_info(CAPTURE_FORMAT_L2_RAW)->identifier, 4);
+    header.version = CAPTURE_VERSION_L2_RAW;
+    fill += serial_frame_encode(SERIAL_FRAME_HEADER, SERIAL_STREAM_L2, 0, &header, sizeof(header), chunk);
+
+    // Zero bytes in the records exercise the COBS blocks
+    captured_packet_t record;
+    memset(&record, 0, sizeof(record));
+    record.header_len = 24;
+    record.payload_len = 96;
+    for (size_t i = 0; i < sizeof(record.payload); i++) {
+        record.payload[i] = (uint8_t) (i % 7 == 0 ? 0 : i);
+    }
+
+    for (uint64_t i = 0; i < writer->records; i++) {
+        record.timestamp = i;
+        record.channel = (uint8_t) (1 + i % 13);
+        fill += serial_frame_encode(SERIAL_FRAME_RECORD, SERIAL_STREAM_L2, (uint32_t) i, &record, sizeof(record),
+                                    chunk + fill);
+        if (fill > sizeof(chunk) - SERIAL_FRAME_MAX_ENCODED || i + 1 == writer->records) {
+            for (size_t written = 0; written < fill;) {
+                ssize_t len = write(writer->fd, chunk + written, fill - written);
+                if (len <= 0) {
+                    return NULL;
+                }
+                written += (size_t) len;
+            }
+            writer->wire_bytes += fill;
+            fill = 0;
+        }
+    }
+    return NULL;
+}
+
+static int command_bench(uint64_t records, unsigned long baud)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    int slave = -1;
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0 ||
+        (slave = open(ptsname(master), O_RDONLY | O_NOCTTY)) < 0 || !make_raw(slave, 0) || !make_raw(master, 0)) {
+        fprintf(stderr, "capstream: pseudo terminal: %s\n", strerror(errno));
+        return 1;
+    }
+
+    receiver_t receiver;
+    receiver_init(&receiver, NULL, false);
+    bench_writer_t writer = {.fd = master, .records = records};
+
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    pthread_t thread;
+    pthread_create(&thread, NULL, bench_write, &writer);
+
+    static uint8_t buffer[READ_BUFFER];
+    stream_state_t *stream = &receiver.streams[SERIAL_STREAM_L2];
+    while (stream->records + stream->lost < records) {
+        struct pollfd pfd = {.fd = slave, .events = POLLIN};
+        if (poll(&pfd, 1, BENCH_TIMEOUT_MS) <= 0) {
+            fprintf(stderr, "capstream: the stream stalled\n");
+            break;
+        }
+        ssize_t len = read(slave, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+        receiver_feed(&receiver, buffer, (size_t) len);
+    }
+    double elapsed = seconds_since(&begin);
+    pthread_join(thread, NULL);
+    close(slave);
+    close(master);
+
+    double wire_per_record = (double) writer.wire_bytes / (double) records;
+    printf("%" PRIu64 " records of %zu bytes in %.3f s: %.0f records/s, %.1f MiB/s on the wire\n", stream->records,
+           sizeof(captured_packet_t), elapsed, (double) stream->records / elapsed,
+           (double) writer.wire_bytes / elapsed / (1024 * 1024));
+    printf("%.1f wire bytes per record (%.1f%% framing), %lu baud carries %.0f records/s\n", wire_per_record,
+           100.0 * (wire_per_record / sizeof(captured_packet_t) - 1), baud,
+           (double) baud / 10 / wire_per_record);
+    receiver_close(&receiver);
+    return stream->records == records && receiver.decoder.errors == 0 ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: capstream receive <tty> <baud> <directory> [pcapng]\n"
+                    "       capstream bench <records> [baud]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if ((argc == 5 || argc == 6) && strcmp(argv[1], "receive") == 0) {
+        if (argc == 6 && strcmp(argv[5], "pcapng") != 0) {
+            usage();
+            return 2;
+        }
+        return command_receive(argv[2], strtoul(argv[3], NULL, 10), argv[4], argc == 6);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "bench") == 0) {
+        return command_bench(strtoull(argv[2], NULL, 10), argc == 4 ? strtoul(argv[3], NULL, 10) : 2000000);
+    }
+    usage();
+    return 2;
+}
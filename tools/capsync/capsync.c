@@ -0,0 +1,462 @@
+// capsync - align captures of several sniffers using reference AP beacon TSF samples
+//
+//   capsync fit <summary.bin>
+//   capsync align <reference-summary.bin> <summary.bin> <capture> <output> [bssid]
+//   capsync check [devices] [hours]
+//
+// `fit` prints the clock model of every reference AP in a summary stream. `align` rewrites the record timestamps
+// of a capture into the wall clock of the reference sniffer: local time -> AP TSF (this sniffer's model) -> wall
+// clock of the reference sniffer (inverse of its model). Without a BSSID the AP with the most samples on both
+// sniffers is used.
+//
+// The models are fitted on rx_timestamp, one segment per boot (see clock_model.h).
+//
+// `check` simulates <devices> sniffers (default 4) hearing one reference AP for <hours> (default 24). Every sniffer
+// has its own crystal error (up to 20 ppm) and reboots every 90 minutes with an own phase. A reboot restarts
+// rx_timestamp (which wraps once per boot) and steps the wall clock to SNTP time with an error of up to 5 ms. The
+// callback reads the wall clock after a latency of 300 us on average with rare spikes of up to 20 ms. The models
+// are fitted from the simulated samples and the ms timestamps every sniffer gave to the same transmissions are
+// aligned onto sniffer 0. Fails when a segment is missing, a skew is off by 0.1 ppm or more, or the 99th percentile
+// of the alignment error exceeds 2 ms (both timestamps are truncated to ms).
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "capture_reader.h"
+#include "clock_model.h"
+
+#define MAX_RESIDUAL_US 2000.0
+#define MAX_BSSIDS 64
+
+#define CHECK_HOUR_US 3600000000ull
+#define CHECK_EPOCH_US 1700000000000000ull
+#define CHECK_BOOT_US (90 * 60000000ull)     // Longer than 2^32 us, rx_timestamp wraps within a boot
+#define CHECK_WIFI_START_US 1500000ull       // Restart until Wi-Fi starts and rx_timestamp counts from zero
+#define CHECK_MANAGEMENT_US 20000000ull      // Boot, SNTP and upload before capture starts
+#define CHECK_DWELL_US 1000000ull            // SNIFFER_CHANNEL_HOP_INTERVAL
+#define CHECK_HOP_CHANNELS 13
+#define CHECK_EVENTS_PER_HOUR 3600
+
+typedef struct {
+    uint8_t bssid[6];
+    size_t count;
+} bssid_count_t;
+
+static size_t count_bssids(const tsf_sync_summary_t *samples, size_t count, bssid_count_t *bssids)
+{
+    size_t distinct = 0;
+    for (size_t i = 0; i < count; i++) {
+        size_t j = 0;
+        while (j < distinct && memcmp(bssids[j].bssid, samples[i].bssid, 6) != 0) {
+            j++;
+        }
+        if (j == distinct) {
+            if (distinct == MAX_BSSIDS) {
+                continue;
+            }
+            memcpy(bssids[distinct].bssid, samples[i].bssid, 6);
+            bssids[distinct++].count = 0;
+        }
+        bssids[j].count++;
+    }
+    return distinct;
+}
+
+static size_t count_of(const bssid_count_t *bssids, size_t distinct, const uint8_t bssid[6])
+{
+    for (size_t i = 0; i < distinct; i++) {
+        if (memcmp(bssids[i].bssid, bssid, 6) == 0) {
+            return bssids[i].count;
+        }
+    }
+    return 0;
+}
+
+static void print_model(const clock_model_t *model)
+{
+    printf("%02X:%02X:%02X:%02X:%02X:%02X  %6zu samples  %3zu segments  skew %+9.3f ppm  residual %8.1f us\n",
+           model->bssid[0], model->bssid[1], model->bssid[2], model->bssid[3], model->bssid[4], model->bssid[5],
+           model->samples, model->segment_count, (model->skew - 1.0) * 1e6, model->residual);
+}
+
+static int command_fit(const char *summary_path)
+{
+    tsf_sync_summary_t *samples;
+    long count = clock_samples_load(summary_path, &samples);
+    if (count < 0) {
+        fprintf(stderr, "capsync: %s: %s\n", summary_path, strerror(errno));
+        return 1;
+    }
+
+    bssid_count_t bssids[MAX_BSSIDS];
+    size_t distinct = count_bssids(samples, (size_t) count, bssids);
+    for (size_t i = 0; i < distinct; i++) {
+        clock_model_t model;
+        if (clock_model_fit(&model, samples, (size_t) count, bssids[i].bssid, MAX_RESIDUAL_US) == 0) {
+            print_model(&model);
+            clock_model_free(&model);
+        }
+    }
+
+    free(samples);
+    return 0;
+}
+
+// Record timestamp (in units of `unit_us`) of a sniffer -> AP TSF -> wall clock of the reference sniffer
+static uint64_t align_timestamp(const clock_model_t *device, const clock_model_t *reference, uint64_t timestamp,
+                                uint64_t unit_us)
+{
+    // Timestamps are truncated to whole units, the middle of the unit is the best estimate
+    double tsf = clock_model_to_reference(device, timestamp * unit_us + unit_us / 2);
+    return clock_model_from_reference(reference, tsf) / unit_us;
+}
+
+// Copy the capture with every record timestamp (first field of all record formats) mapped through the models. L2
+// records are stamped in ms, CSI records in whole seconds.
+static int rewrite_capture(const char *capture_path, const char *output_path, const clock_model_t *device,
+                           const clock_model_t *reference)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, capture_path) != 0) {
+        fprintf(stderr, "capsync: %s: %s\n", capture_path, strerror(errno));
+        return 1;
+    }
+    uint64_t data_start = reader.data_start;
+    uint32_t record_size = reader.record_size;
+    uint64_t unit_us = reader.kind == CAPTURE_KIND_CSI ? 1000000 : 1000;
+    capture_reader_close(&reader);
+
+    FILE *input = fopen(capture_path, "rb");
+    FILE *output = fopen(output_path, "wb");
+    uint8_t *record = malloc(record_size > data_start ? record_size : data_start);
+    if (input == NULL || output == NULL || record == NULL) {
+        fprintf(stderr, "capsync: %s\n", strerror(errno));
+        if (input) {
+            fclose(input);
+        }
+        if (output) {
+            fclose(output);
+        }
+        free(record);
+        return 1;
+    }
+
+    int rc = fread(record, data_start, 1, input) == 1 && fwrite(record, data_start, 1, output) == 1 ? 0 : 1;
+    uint64_t records = 0;
+    double total_shift = 0;
+    while (rc == 0 && fread(record, record_size, 1, input) == 1) {
+        uint64_t timestamp;
+        memcpy(&timestamp, record, sizeof(timestamp));
+
+        uint64_t aligned = align_timestamp(device, reference, timestamp, unit_us);
+        total_shift += (double) (int64_t) (aligned - timestamp) * (double) unit_us / 1000;
+        memcpy(record, &aligned, sizeof(aligned));
+
+        if (fwrite(record, record_size, 1, output) != 1) {
+            rc = 1;
+        }
+        records++;
+    }
+    if (rc != 0 || ferror(input)) {
+        fprintf(stderr, "capsync: failed to copy %s\n", capture_path);
+        rc = 1;
+    }
+
+    printf("%" PRIu64 " records aligned, mean shift %.1f ms\n", records,
+           records ? total_shift / (double) records : 0.0);
+
+    free(record);
+    fclose(input);
+    if (fclose(output) != 0) {
+        rc = 1;
+    }
+    return rc;
+}
+
+static int command_align(const char *reference_path, const char *device_path, const char *capture_path,
+                         const char *output_path, const char *bssid_text)
+{
+    tsf_sync_summary_t *reference_samples;
+    tsf_sync_summary_t *device_samples;
+    long reference_count = clock_samples_load(reference_path, &reference_samples);
+    if (reference_count < 0) {
+        fprintf(stderr, "capsync: %s: %s\n", reference_path, strerror(errno));
+        return 1;
+    }
+    long device_count = clock_samples_load(device_path, &device_samples);
+    if (device_count < 0) {
+        fprintf(stderr, "capsync: %s: %s\n", device_path, strerror(errno));
+        free(reference_samples);
+        return 1;
+    }
+
+    // Pick the AP heard best by both sniffers unless one was given
+    uint8_t bssid[6];
+    if (bssid_text) {
+        if (capture_parse_mac(bssid_text, bssid) != 0) {
+            fprintf(stderr, "capsync: invalid BSSID %s\n", bssid_text);
+            free(reference_samples);
+            free(device_samples);
+            return 1;
+        }
+    } else {
+        bssid_count_t reference_bssids[MAX_BSSIDS];
+        bssid_count_t device_bssids[MAX_BSSIDS];
+        size_t reference_distinct = count_bssids(reference_samples, (size_t) reference_count, reference_bssids);
+        size_t device_distinct = count_bssids(device_samples, (size_t) device_count, device_bssids);
+        size_t best = 0;
+        for (size_t i = 0; i < reference_distinct; i++) {
+            size_t common = count_of(device_bssids, device_distinct, reference_bssids[i].bssid);
+            if (common > reference_bssids[i].count) {
+                common = reference_bssids[i].count;
+            }
+            if (common > best) {
+                best = common;
+                memcpy(bssid, reference_bssids[i].bssid, 6);
+            }
+        }
+        if (best == 0) {
+            fprintf(stderr, "capsync: no reference AP heard by both sniffers\n");
+            free(reference_samples);
+            free(device_samples);
+            return 1;
+        }
+    }
+
+    clock_model_t reference = {0};
+    clock_model_t device = {0};
+    int fitted = clock_model_fit(&reference, reference_samples, (size_t) reference_count, bssid, MAX_RESIDUAL_US) ==
+                 0 && clock_model_fit(&device, device_samples, (size_t) device_count, bssid, MAX_RESIDUAL_US) == 0;
+    free(reference_samples);
+    free(device_samples);
+    if (!fitted) {
+        fprintf(stderr, "capsync: not enough samples to fit both clock models\n");
+        clock_model_free(&reference);
+        return 1;
+    }
+
+    printf("reference: ");
+    print_model(&reference);
+    printf("device:    ");
+    print_model(&device);
+    int rc = rewrite_capture(capture_path, output_path, &device, &reference);
+    clock_model_free(&reference);
+    clock_model_free(&device);
+    return rc;
+}
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return (uint32_t) (random_state >> 32);
+}
+
+static double random_unit(void)
+{
+    return (double) random_next() / 4294967296.0;
+}
+
+typedef struct {
+    double ppm;               // Crystal error, shared by the Wi-Fi and wall clocks
+    uint64_t phase;           // Offset of the reboot cycle (µs of true time)
+    double sntp_error[64];    // Wall clock error after the SNTP sync of every boot (µs)
+} check_device_t;
+
+// Boot of `device` at true time t, or -1 while it is booting and does not capture
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static int64_t check_boot(const check_device_t *device, uint64_t t)
+{
+    uint64_t cycle = (t + CHECK_BOOT_US - device->phase) / CHECK_BOOT_US;
+    uint64_t since_boot = (t + CHECK_BOOT_US - device->phase) % CHECK_BOOT_US;
+    return since_boot < CHECK_MANAGEMENT_US ? -1 : (int64_t) cycle;
+}
+
+static uint64_t check_since_boot(const check_device_t *device, uint64_t t)
+{
+    return (uint64_t) ((double) ((t + CHECK_BOOT_US - device->phase) % CHECK_BOOT_US) * (1.0 + device->ppm * 1e-6));
+}
+
+// Wall clock of `device` at true time t, stepped to SNTP time at every boot
+static uint64_t check_wall(const check_device_t *device, uint64_t t)
+{
+    uint64_t boot_start = t - (t + CHECK_BOOT_US - device->phase) % CHECK_BOOT_US;
+    int64_t cycle = (int64_t) ((t + CHECK_BOOT_US - device->phase) / CHECK_BOOT_US);
+    return CHECK_EPOCH_US + boot_start + (uint64_t) (int64_t) device->sntp_error[cycle % 64] +
+           check_since_boot(device, t);
+}
+
+// Callback latency between reception and reading the wall clock
+static uint64_t check_latency(void)
+{
+    if (random_next() % 1000 < 3) {
+        return 5000 + random_next() % 15000;
+    }
+    return (uint64_t) (-300.0 * log(1.0 - random_unit()));
+}
+
+static int command_check(int devices, int hours)
+{
+    static const uint8_t bssid[6] = {0x02, 0xAB, 0x00, 0x00, 0x00, 0x01};
+    const double ap_ppm = 7.5;
+    uint64_t duration = (uint64_t) hours * CHECK_HOUR_US;
+
+    check_device_t *device = calloc((size_t) devices, sizeof(check_device_t));
+    size_t capacity = (size_t) (duration / (CHECK_DWELL_US * CHECK_HOP_CHANNELS) + 1);
+    tsf_sync_summary_t *samples = malloc(capacity * sizeof(tsf_sync_summary_t));
+    size_t events = (size_t) hours * CHECK_EVENTS_PER_HOUR;
+    uint64_t *stamps = malloc(events * (size_t) devices * sizeof(uint64_t));
+    clock_model_t *models = calloc((size_t) devices, sizeof(clock_model_t));
+    double *errors = malloc(events * sizeof(double));
+    double *raw = malloc(events * sizeof(double));
+    if (device == NULL || samples == NULL || stamps == NULL || models == NULL || errors == NULL || raw == NULL) {
+        fprintf(stderr, "capsync: out of memory\n");
+        free(device);
+        free(samples);
+        free(stamps);
+        free(models);
+        free(errors);
+        free(raw);
+        return 1;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int failures = 0;
+    for (int d = 0; d < devices; d++) {
+        device[d].ppm = (random_unit() * 2.0 - 1.0) * 20.0;
+        device[d].phase = random_next() % CHECK_BOOT_US;
+        for (int b = 0; b < 64; b++) {
+            device[d].sntp_error[b] = (random_unit() * 2.0 - 1.0) * 5000.0;
+        }
+
+        // One beacon of the AP per dwell on its channel, heard 9 times out of 10
+        size_t count = 0;
+        size_t segments = 0;
+        int64_t last_boot = -1;
+        for (uint64_t t = device[d].phase % CHECK_DWELL_US; t < duration; t += CHECK_DWELL_US * CHECK_HOP_CHANNELS) {
+            uint64_t heard = t + random_next() % CHECK_DWELL_US;
+            int64_t boot = check_boot(&device[d], heard);
+            if (boot < 0 || random_next() % 10 == 0) {
+                continue;
+            }
+            segments += boot != last_boot;
+            last_boot = boot;
+            uint64_t since_boot = check_since_boot(&device[d], heard);
+            tsf_sync_summary_t *sample = &samples[count++];
+            memcpy(sample->bssid, bssid, 6);
+            sample->channel = 6;
+            sample->rssi = -60;
+            sample->dwell = (uint32_t) (since_boot / CHECK_DWELL_US);
+            sample->tsf = 5000000000ull + (uint64_t) ((double) heard * (1.0 + ap_ppm * 1e-6));
+            sample->rx_timestamp = (since_boot - CHECK_WIFI_START_US) % CLOCK_WRAP_US;
+            sample->wall_clock = check_wall(&device[d], heard + check_latency());
+        }
+
+        if (clock_model_fit(&models[d], samples, count, bssid, MAX_RESIDUAL_US) != 0) {
+            fprintf(stderr, "capsync: sniffer %d: no clock model\n", d);
+            failures++;
+            continue;
+        }
+        double expected = ((1.0 + ap_ppm * 1e-6) / (1.0 + device[d].ppm * 1e-6) - 1.0) * 1e6;
+        bool complete = models[d].segment_count == segments &&
+                        fabs((models[d].skew - 1.0) * 1e6 - expected) < 0.1;
+        failures += !complete;
+        printf("sniffer %d: crystal %+6.2f ppm, %zu samples in %zu boots, %zu segments, skew %+7.3f ppm "
+               "(expected %+7.3f), residual %.1f us%s\n", d, device[d].ppm, count, segments,
+               models[d].segment_count, (models[d].skew - 1.0) * 1e6, expected, models[d].residual,
+               complete ? "" : "  FAIL");
+    }
+
+    // Transmissions heard by every sniffer, stamped in ms from the wall clock in the callback
+    size_t heard = 0;
+    for (size_t e = 0; e < events; e++) {
+        uint64_t t = (uint64_t) ((double) duration * random_unit());
+        bool capturing = true;
+        for (int d = 0; d < devices; d++) {
+            capturing &= check_boot(&device[d], t) >= 0;
+        }
+        if (!capturing) {
+            continue;
+        }
+        for (int d = 0; d < devices; d++) {
+            stamps[heard * (size_t) devices + (size_t) d] = check_wall(&device[d], t + check_latency()) / 1000;
+        }
+        heard++;
+    }
+
+    for (int d = 1; d < devices && failures == 0; d++) {
+        for (size_t e = 0; e < heard; e++) {
+            uint64_t reference = stamps[e * (size_t) devices];
+            uint64_t stamp = stamps[e * (size_t) devices + (size_t) d];
+            errors[e] = fabs((double) (int64_t) (align_timestamp(&models[d], &models[0], stamp, 1000) - reference));
+            raw[e] = fabs((double) (int64_t) (stamp - reference));
+        }
+        qsort(errors, heard, sizeof(double), compare_doubles);
+        qsort(raw, heard, sizeof(double), compare_doubles);
+        double p99 = errors[heard * 99 / 100];
+        failures += p99 > 2.0;
+        printf("sniffer %d onto 0: %zu transmissions, error median %.0f / p99 %.0f / max %.0f ms aligned, "
+               "median %.0f / p99 %.0f ms unaligned%s\n", d, heard, errors[heard / 2], p99, errors[heard - 1],
+               raw[heard / 2], raw[heard * 99 / 100], p99 > 2.0 ? "  FAIL" : "");
+    }
+    printf("%.2f s, %s\n", seconds_since(&start), failures ? "FAILED" : "ok");
+
+    for (int d = 0; d < devices; d++) {
+        clock_model_free(&models[d]);
+    }
+    free(device);
+    free(samples);
+    free(stamps);
+    free(models);
+    free(errors);
+    free(raw);
+    return failures > 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: capsync fit <summary.bin>\n"
+                    "       capsync align <reference-summary.bin> <summary.bin> <capture> <output> [bssid]\n"
+                    "       capsync check [devices] [hours]\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 3 && strcmp(argv[1], "fit") == 0) {
+        return command_fit(argv[2]);
+    }
+    if ((argc == 6 || argc == 7) && strcmp(argv[1], "align") == 0) {
+        return command_align(argv[2], argv[3], argv[4], argv[5], argc == 7 ? argv[6] : NULL);
+    }
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], "check") == 0) {
+        int devices = argc > 2 ? atoi(argv[2]) : 4;
+        int hours = argc > 3 ? atoi(argv[3]) : 24;
+        if (devices >= 2 && hours >= 1 && hours <= 48) {
+            return command_check(devices, hours);
+        }
+    }
+    usage();
+    return 2;
+}
@@ -0,0 +1,275 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "capture_reader.h"
+#include "dot11.h"
+
+#define READ_BUFFER_SIZE (1024 * 1024)
+
+// Copy a field of `size` bytes made of little-endian elements of `element` bytes into host order
+static const uint8_t *decode_field(void *field, size_t size, size_t element, const uint8_t *in)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    (void) element;
+    memcpy(field, in, size);
+#else
+    uint8_t *out = field;
+    for (size_t i = 0; i < size; i += element) {
+        for (size_t b = 0; b < element; b++) {
+            out[i + b] = in[i + element - 1 - b];
+        }
+    }
+#endif
+    return in + size;
+}
+
+// Record decoders generated from the field lists of capture_format.h
+#define DECODE_FIELD(record, type, name, dimension) \
+    in = decode_field(&out->name, sizeof(out->name), sizeof(type), in);
+
+static void decode_captured_packet(const uint8_t *in, captured_packet_t *out)
+{
+    CAPTURED_PACKET_FIELDS(DECODE_FIELD)
+}
+
+static void decode_csi_packet(const uint8_t *in, csi_packet_t *out)
+{
+    CSI_PACKET_FIELDS(DECODE_FIELD)
+}
+
+static void decode_joined_packet(const uint8_t *in, joined_packet_t *out)
+{
+    decode_captured_packet(in, &out->frame);
+    in += sizeof(captured_packet_t);
+    JOINED_PACKET_FIELDS(DECODE_FIELD)
+}
+
+static void decode_projected(uint32_t schema, const uint8_t *data, captured_packet_t *packet)
+{
+    projected_packet_t projected;
+    const uint8_t *in = data;
+    projected_packet_t *out = &projected;
+    PROJECTED_PACKET_FIELDS(DECODE_FIELD)
+
+    memset(packet, 0, sizeof(*packet));
+    packet->timestamp = projected.timestamp;
+    packet->frame_type = (projected.frame_type >> 4) & 0x03;
+    packet->frame_subtype = projected.frame_type & 0x0F;
+    packet->rssi = projected.rssi;
+    packet->channel = projected.channel;
+
+    packet->header[0] = (uint8_t) (packet->frame_subtype << 4 | packet->frame_type << 2);
+    projection_decode(schema, in, packet->header);
+
+    if (packet->frame_type != DOT11_TYPE_CTRL) {
+        packet->header_len = 24;
+    } else if (packet->frame_subtype == DOT11_SUBTYPE_CTS || packet->frame_subtype == DOT11_SUBTYPE_ACK) {
+        packet->header_len = 10;
+    } else {
+        packet->header_len = 16;
+    }
+}
+
+static int decode_record(const capture_reader_t *reader, const uint8_t *data, uint64_t offset,
+                         capture_record_t *record)
+{
+    record->offset = offset;
+    record->size = reader->record_size;
+    if (reader->schema) {
+        decode_projected(reader->schema, data, &record->l2);
+    } else if (reader->format == CAPTURE_FORMAT_JOINED) {
+        decode_joined_packet(data, &record->joined);
+    } else if (reader->kind == CAPTURE_KIND_L2) {
+        decode_captured_packet(data, &record->l2);
+    } else {
+        decode_csi_packet(data, &record->csi);
+    }
+    return 1;
+}
+
+int capture_reader_open(capture_reader_t *reader, const char *path)
+{
+    return capture_reader_open_buffered(reader, path, READ_BUFFER_SIZE);
+}
+
+int capture_reader_open_buffered(capture_reader_t *reader, const char *path, size_t buffer_size)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0) {
+        close(reader->fd);
+        return -1;
+    }
+    reader->file_size = (uint64_t) st.st_size;
+
+    uint8_t header[sizeof(file_header_t)];
+    if (pread(reader->fd, header, sizeof(header), 0) != sizeof(header)) {
+        close(reader->fd);
+        errno = EINVAL;
+        return -1;
+    }
+    const uint8_t *in = header;
+    file_header_t *out = &reader->header;
+    FILE_HEADER_FIELDS(DECODE_FIELD)
+
+    reader->data_start = sizeof(file_header_t);
+
+    // Version negotiation: every version of the format from its oldest decodable one up to the one we know
+    reader->format = capture_format_find(reader->header.identifier);
+    if (reader->format == CAPTURE_FORMAT_COUNT) {
+        close(reader->fd);
+        errno = EINVAL;
+        return -1;
+    }
+    const capture_format_info_t *info = capture_format_info(reader->format);
+    if (reader->header.version < info->oldest || reader->header.version > info->version) {
+        close(reader->fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+    reader->record_size = info->record_size;
+
+    // Dictionary coded records depend on the definitions before them in their segment, `capdict expand` turns the
+    // capture into raw records first
+    if (reader->format == CAPTURE_FORMAT_L2_DICT) {
+        close(reader->fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (reader->format == CAPTURE_FORMAT_L2_RAW || reader->format == CAPTURE_FORMAT_JOINED) {
+        reader->kind = CAPTURE_KIND_L2;
+    } else if (reader->format == CAPTURE_FORMAT_L2_PROJECTED) {
+        reader->kind = CAPTURE_KIND_L2;
+        if (pread(reader->fd, &reader->schema, sizeof(reader->schema), (off_t) reader->data_start) !=
+            sizeof(reader->schema) || reader->schema == 0) {
+            close(reader->fd);
+            errno = EINVAL;
+            return -1;
+        }
+        reader->data_start += sizeof(reader->schema);
+        reader->record_size = projection_record_size(reader->schema);
+    } else {
+        reader->kind = CAPTURE_KIND_CSI;
+    }
+
+    reader->buffer_capacity = buffer_size > reader->record_size ? buffer_size : reader->record_size;
+    reader->buffer = malloc(reader->buffer_capacity);
+    if (reader->buffer == NULL) {
+        close(reader->fd);
+        return -1;
+    }
+
+    return capture_reader_seek(reader, reader->data_start, UINT64_MAX);
+}
+
+void capture_reader_close(capture_reader_t *reader)
+{
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+int capture_reader_seek(capture_reader_t *reader, uint64_t offset, uint64_t end)
+{
+    if (offset < reader->data_start) {
+        errno = EINVAL;
+        return -1;
+    }
+    reader->buffer_offset = offset;
+    reader->buffer_len = 0;
+    reader->buffer_pos = 0;
+    reader->limit = end;
+    return 0;
+}
+
+int capture_reader_next(capture_reader_t *reader, capture_record_t *record)
+{
+    if (reader->buffer_len - reader->buffer_pos < reader->record_size) {
+        // Refill, keeping the partial record at the start of the buffer
+        size_t remaining = reader->buffer_len - reader->buffer_pos;
+        memmove(reader->buffer, reader->buffer + reader->buffer_pos, remaining);
+        reader->buffer_offset += reader->buffer_pos;
+        reader->buffer_pos = 0;
+        reader->buffer_len = remaining;
+
+        while (reader->buffer_len < reader->buffer_capacity) {
+            uint64_t position = reader->buffer_offset + reader->buffer_len;
+            if (position >= reader->limit) {
+                break;
+            }
+            size_t wanted = reader->buffer_capacity - reader->buffer_len;
+            if (reader->limit - position < wanted) {
+                wanted = (size_t) (reader->limit - position);
+            }
+
+            ssize_t n = pread(reader->fd, reader->buffer + reader->buffer_len, wanted, (off_t) position);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -1;
+            }
+            if (n == 0) {
+                break;
+            }
+            reader->buffer_len += (size_t) n;
+            reader->bytes_read += (uint64_t) n;
+        }
+
+        if (reader->buffer_len < reader->record_size) {
+            return 0;
+        }
+    }
+
+    uint64_t offset = reader->buffer_offset + reader->buffer_pos;
+    decode_record(reader, reader->buffer + reader->buffer_pos, offset, record);
+    reader->buffer_pos += reader->record_size;
+    return 1;
+}
+
+int capture_reader_read_at(capture_reader_t *reader, uint64_t offset, capture_record_t *record)
+{
+    uint8_t data[sizeof(capture_record_t)];
+
+    ssize_t n = pread(reader->fd, data, reader->record_size, (off_t) offset);
+    if (n < 0) {
+        return -1;
+    }
+    reader->bytes_read += (uint64_t) n;
+    if ((size_t) n < reader->record_size) {
+        return 0;
+    }
+    return decode_record(reader, data, offset, record);
+}
+
+const uint8_t *capture_record_transmitter(const capture_record_t *record)
+{
+    return dot11_transmitter(record->l2.header, record->l2.header_len);
+}
+
+int capture_parse_mac(const char *text, uint8_t mac[6])
+{
+    unsigned int bytes[6];
+    if (sscanf(text, "%2x:%2x:%2x:%2x:%2x:%2x", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4],
+               &bytes[5]) != 6) {
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        mac[i] = (uint8_t) bytes[i];
+    }
+    return 0;
+}
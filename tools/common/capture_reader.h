@@ -0,0 +1,71 @@
+#ifndef CAPTURE_READER_H
+#define CAPTURE_READER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "capture_format.h"
+
+typedef enum {
+    CAPTURE_KIND_L2,
+    CAPTURE_KIND_CSI,
+} capture_kind_t;
+
+// One decoded record, independent of the on-card format version. Projected L2 records are expanded into a
+// synthetic MAC header carrying the stored fields, with no payload. Joined records are L2 records whose CSI is
+// available in `joined`, `l2` reads their L2 part.
+typedef struct {
+    uint64_t offset;  // Byte offset of the record in the capture file
+    uint32_t size;    // Encoded size of the record in the capture file
+    union {
+        captured_packet_t l2;
+        csi_packet_t csi;
+        joined_packet_t joined;
+    };
+} capture_record_t;
+
+typedef struct {
+    int fd;
+    file_header_t header;
+    capture_format_t format;
+    capture_kind_t kind;
+    uint32_t record_size;  // Encoded size of one record
+    uint32_t schema;       // Projection schema of "L2PR" captures, 0 for raw records
+    uint64_t data_start;   // Offset of the first record
+    uint64_t file_size;
+
+    // Sequential read buffer
+    uint8_t *buffer;
+    size_t buffer_capacity;
+    size_t buffer_len;
+    size_t buffer_pos;
+    uint64_t buffer_offset;  // File offset of buffer[0]
+    uint64_t limit;          // Sequential reads stop at this offset
+
+    uint64_t bytes_read;     // I/O statistics
+} capture_reader_t;
+
+// Open a capture file and validate its header. Returns 0 on success, -1 with errno set on failure (ENOTSUP for a
+// format version this build cannot decode, or a dictionary coded capture).
+int capture_reader_open(capture_reader_t *reader, const char *path);
+// Same with a sequential read buffer of `buffer_size` bytes instead of the default 1 MiB, at least one record
+int capture_reader_open_buffered(capture_reader_t *reader, const char *path, size_t buffer_size);
+void capture_reader_close(capture_reader_t *reader);
+
+// Position the sequential reader at a record boundary and read until `end` (UINT64_MAX for the end of the file)
+int capture_reader_seek(capture_reader_t *reader, uint64_t offset, uint64_t end);
+
+// Read the next record. Returns 1 when a record was read, 0 at the end of the file, -1 on error.
+// A truncated trailing record (capture interrupted mid-write) is treated as the end of the file.
+int capture_reader_next(capture_reader_t *reader, capture_record_t *record);
+
+// Read a single record at a known offset without disturbing the sequential position (pread)
+int capture_reader_read_at(capture_reader_t *reader, uint64_t offset, capture_record_t *record);
+
+// Transmitter address of an L2 record, NULL when the frame has none
+const uint8_t *capture_record_transmitter(const capture_record_t *record);
+
+// Parse "AA:BB:CC:DD:EE:FF", returns 0 on success
+int capture_parse_mac(const char *text, uint8_t mac[6]);
+
+#endif // CAPTURE_READER_H
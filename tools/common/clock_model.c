@@ -0,0 +1,262 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clock_model.h"
+#include "summary_reader.h"
+
+long clock_samples_load(const char *summary_path, tsf_sync_summary_t **samples)
+{
+    summary_reader_t reader;
+    if (summary_reader_open(&reader, summary_path) != 0) {
+        return -1;
+    }
+
+    uint8_t *body = malloc(SUMMARY_MAX_BODY);
+    size_t count = 0;
+    size_t capacity = 0;
+    *samples = NULL;
+
+    summary_record_header_t record;
+    int rc;
+    while (body && (rc = summary_reader_next(&reader, &record, body)) == 1) {
+        if (record.type != SUMMARY_RECORD_TSF_SYNC || record.length < sizeof(tsf_sync_summary_t)) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            tsf_sync_summary_t *grown = realloc(*samples, capacity * sizeof(tsf_sync_summary_t));
+            if (grown == NULL) {
+                rc = -1;
+                break;
+            }
+            *samples = grown;
+        }
+        memcpy(&(*samples)[count++], body, sizeof(tsf_sync_summary_t));
+    }
+
+    free(body);
+    summary_reader_close(&reader);
+    if (body == NULL || rc < 0) {
+        free(*samples);
+        *samples = NULL;
+        return -1;
+    }
+    return (long) count;
+}
+
+// Unwrap a 32-bit rx_timestamp to the value nearest `estimate`
+static uint64_t unwrap(uint64_t rx_timestamp, int64_t estimate)
+{
+    double wraps = round((double) (estimate - (int64_t) rx_timestamp) / (double) CLOCK_WRAP_US);
+    return rx_timestamp + (uint64_t) ((int64_t) wraps * (int64_t) CLOCK_WRAP_US);
+}
+
+static int64_t wall_offset(const tsf_sync_summary_t *sample, uint64_t local)
+{
+    return (int64_t) (sample->wall_clock - local);
+}
+
+// Split the samples of `bssid` into segments: `segment` gets the segment number of every sample (SIZE_MAX for other
+// BSSIDs) and `local` its unwrapped rx_timestamp. Returns the number of segments.
+static size_t split_segments(const tsf_sync_summary_t *samples, size_t count, const uint8_t bssid[6],
+                             size_t *segment, uint64_t *local)
+{
+    size_t segments = 0;
+    size_t members = 0;
+    int64_t baseline = 0;
+    const tsf_sync_summary_t *last = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        const tsf_sync_summary_t *sample = &samples[i];
+        segment[i] = SIZE_MAX;
+        if (memcmp(sample->bssid, bssid, 6) != 0) {
+            continue;
+        }
+
+        bool start = last == NULL || sample->dwell < last->dwell;
+        if (!start) {
+            local[i] = unwrap(sample->rx_timestamp, wall_offset(sample, 0) - baseline);
+            int64_t difference = wall_offset(sample, local[i]);
+            if (llabs(difference - baseline) > CLOCK_SEGMENT_STEP_US) {
+                // A step when the next sample agrees with the new difference, otherwise a late callback
+                size_t next = i + 1;
+                while (next < count && memcmp(samples[next].bssid, bssid, 6) != 0) {
+                    next++;
+                }
+                if (next < count && samples[next].dwell >= sample->dwell) {
+                    uint64_t next_local = unwrap(samples[next].rx_timestamp,
+                                                 wall_offset(&samples[next], 0) - difference);
+                    int64_t next_difference = wall_offset(&samples[next], next_local);
+                    start = llabs(next_difference - difference) <= CLOCK_SEGMENT_STEP_US &&
+                            llabs(next_difference - baseline) > CLOCK_SEGMENT_STEP_US;
+                }
+                // After a late first callback the segment only moves its baseline
+                if (start && members == 1) {
+                    start = false;
+                    baseline = difference;
+                }
+            } else if (difference < baseline) {
+                baseline = difference;
+            }
+        }
+        if (start) {
+            local[i] = sample->rx_timestamp;
+            baseline = wall_offset(sample, local[i]);
+            segments++;
+            members = 0;
+        }
+        segment[i] = segments - 1;
+        members++;
+        last = sample;
+    }
+    return segments;
+}
+
+static double segment_to_reference(const clock_segment_t *segment, uint64_t local)
+{
+    double x = (double) (int64_t) (local - segment->local_origin);
+    return (double) segment->reference_origin + segment->skew * x + segment->offset;
+}
+
+// Samples of segment `index`, within `max_residual` of `previous` when given
+static bool sample_used(size_t index, size_t sample_segment, const tsf_sync_summary_t *sample, uint64_t local,
+                        const clock_segment_t *previous, double max_residual)
+{
+    if (sample_segment != index) {
+        return false;
+    }
+    return !previous || fabs(segment_to_reference(previous, local) - (double) sample->tsf) <= max_residual;
+}
+
+static int fit_pass(clock_segment_t *model, size_t index, const tsf_sync_summary_t *samples, size_t count,
+                    const size_t *segment, const uint64_t *local, const clock_segment_t *previous,
+                    double max_residual)
+{
+    double sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const tsf_sync_summary_t *sample = &samples[i];
+        if (!sample_used(index, segment[i], sample, local[i], previous, max_residual)) {
+            continue;
+        }
+        // Centre on the first sample so the sums keep their precision
+        if (n == 0) {
+            model->local_origin = local[i];
+            model->reference_origin = sample->tsf;
+        }
+        double x = (double) (int64_t) (local[i] - model->local_origin);
+        double y = (double) (int64_t) (sample->tsf - model->reference_origin);
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        n++;
+    }
+
+    double denominator = (double) n * sum_xx - sum_x * sum_x;
+    if (n < 2 || denominator == 0) {
+        return -1;
+    }
+    model->skew = ((double) n * sum_xy - sum_x * sum_y) / denominator;
+    model->offset = (sum_y - model->skew * sum_x) / (double) n;
+    model->samples = n;
+
+    // The wall clock range and offset of the kept samples
+    double sum_squares = 0;
+    bool first = true;
+    for (size_t i = 0; i < count; i++) {
+        if (!sample_used(index, segment[i], &samples[i], local[i], previous, max_residual)) {
+            continue;
+        }
+        double residual = segment_to_reference(model, local[i]) - (double) samples[i].tsf;
+        sum_squares += residual * residual;
+        int64_t difference = wall_offset(&samples[i], local[i]);
+        if (first || difference < model->wall_offset) {
+            model->wall_offset = difference;
+        }
+        model->wall_end = samples[i].wall_clock;
+        first = false;
+    }
+    model->residual = sqrt(sum_squares / (double) n);
+    return 0;
+}
+
+int clock_model_fit(clock_model_t *model, const tsf_sync_summary_t *samples, size_t count, const uint8_t bssid[6],
+                    double max_residual)
+{
+    memset(model, 0, sizeof(*model));
+    memcpy(model->bssid, bssid, 6);
+
+    size_t *segment = malloc((count ? count : 1) * sizeof(size_t));
+    uint64_t *local = malloc((count ? count : 1) * sizeof(uint64_t));
+    size_t segments = segment && local ? split_segments(samples, count, bssid, segment, local) : 0;
+    model->segments = segments ? calloc(segments, sizeof(clock_segment_t)) : NULL;
+    if (model->segments == NULL) {
+        free(segment);
+        free(local);
+        return -1;
+    }
+
+    double sum_squares = 0;
+    double sum_skew = 0;
+    for (size_t index = 0; index < segments; index++) {
+        clock_segment_t first = {0};
+        if (fit_pass(&first, index, samples, count, segment, local, NULL, 0) != 0) {
+            continue;
+        }
+        clock_segment_t *fitted = &model->segments[model->segment_count];
+        if (first.residual <= max_residual) {
+            *fitted = first;
+        } else if (fit_pass(fitted, index, samples, count, segment, local, &first, max_residual) != 0) {
+            continue;
+        }
+        // The segment starts where its rx_timestamp was zero (the boot), but not before the one ahead of it ended
+        fitted->wall_start = (uint64_t) fitted->wall_offset;
+        if (model->segment_count > 0 && fitted->wall_start < model->segments[model->segment_count - 1].wall_end) {
+            fitted->wall_start = model->segments[model->segment_count - 1].wall_end;
+        }
+        fitted->reference_start = segment_to_reference(fitted, fitted->wall_start - (uint64_t) fitted->wall_offset);
+        model->samples += fitted->samples;
+        sum_squares += fitted->residual * fitted->residual * (double) fitted->samples;
+        sum_skew += fitted->skew * (double) fitted->samples;
+        model->segment_count++;
+    }
+
+    free(segment);
+    free(local);
+    if (model->segment_count == 0) {
+        clock_model_free(model);
+        return -1;
+    }
+    model->skew = sum_skew / (double) model->samples;
+    model->residual = sqrt(sum_squares / (double) model->samples);
+    return 0;
+}
+
+void clock_model_free(clock_model_t *model)
+{
+    free(model->segments);
+    model->segments = NULL;
+    model->segment_count = 0;
+}
+
+double clock_model_to_reference(const clock_model_t *model, uint64_t wall)
+{
+    const clock_segment_t *segment = &model->segments[0];
+    for (size_t i = 1; i < model->segment_count && model->segments[i].wall_start <= wall; i++) {
+        segment = &model->segments[i];
+    }
+    return segment_to_reference(segment, wall - (uint64_t) segment->wall_offset);
+}
+
+uint64_t clock_model_from_reference(const clock_model_t *model, double reference)
+{
+    const clock_segment_t *segment = &model->segments[0];
+    for (size_t i = 1; i < model->segment_count && model->segments[i].reference_start <= reference; i++) {
+        segment = &model->segments[i];
+    }
+    double x = (reference - (double) segment->reference_origin - segment->offset) / segment->skew;
+    return segment->local_origin + (uint64_t) (int64_t) llround(x) + (uint64_t) segment->wall_offset;
+}
@@ -0,0 +1,61 @@
+#ifndef CLOCK_MODEL_H
+#define CLOCK_MODEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "capture_format.h"
+
+// Model of a reference AP clock (TSF) against a sniffer's clocks, both in µs.
+//
+// The TSF is fitted against rx_timestamp, the Wi-Fi clock latched when the beacon was received, not against the
+// wall clock read later in the callback, so callback latency does not enter the fit. rx_timestamp is 32 bits wide
+// (wraps every 71.6 minutes) and restarts on every boot, and SNTP steps the wall clock on every boot, so the
+// samples are split into segments over which `wall clock - rx_timestamp` is constant. Within a segment:
+//   reference = reference_origin + skew * (local - local_origin) + offset
+//   local     = wall clock - wall_offset
+// where local is the unwrapped rx_timestamp and wall_offset the smallest difference seen (the callback only ever
+// reads the wall clock after the frame was received). Capture records carry wall-clock timestamps, which are
+// mapped into the segment they fall into. A new segment starts when the dwell counter goes back (reboot) or the
+// difference moves by more than CLOCK_SEGMENT_STEP_US for two samples in a row (SNTP step, Wi-Fi restart).
+#define CLOCK_SEGMENT_STEP_US 2000
+#define CLOCK_WRAP_US (1ULL << 32)
+
+typedef struct {
+    uint64_t wall_start;       // Wall clock at the boot (rx_timestamp zero) or the end of the segment before
+    uint64_t wall_end;         // Wall clock of the last sample
+    double reference_start;    // Reference clock at wall_start
+    int64_t wall_offset;
+    uint64_t local_origin;
+    uint64_t reference_origin;
+    double skew;
+    double offset;
+    size_t samples;            // Samples kept after outlier rejection
+    double residual;           // RMS residual of the kept samples (µs)
+} clock_segment_t;
+
+typedef struct {
+    uint8_t bssid[6];
+    clock_segment_t *segments; // In time order, malloc'd
+    size_t segment_count;
+    size_t samples;
+    double skew;               // Mean of the segments, weighted by samples
+    double residual;           // RMS residual over all segments
+} clock_model_t;
+
+// Load all TSF sync samples of a summary stream. Returns the number of samples (*samples is malloc'd, free it),
+// or -1 on error.
+long clock_samples_load(const char *summary_path, tsf_sync_summary_t **samples);
+
+// Fit the model of `bssid` by least squares, per segment. Samples further than `max_residual` µs from a first fit
+// of their segment (TSF reset) are dropped and the segment is refitted. Segments with fewer than two samples are
+// left out. Returns 0 on success, -1 when no segment could be fitted or out of memory.
+int clock_model_fit(clock_model_t *model, const tsf_sync_summary_t *samples, size_t count, const uint8_t bssid[6],
+                    double max_residual);
+void clock_model_free(clock_model_t *model);
+
+// Map a wall-clock time of the sniffer to the reference clock and back, through the last segment that started
+// before it (or the first one). A boot captures from its start, before the first beacon of the AP is heard.
+double clock_model_to_reference(const clock_model_t *model, uint64_t wall);
+uint64_t clock_model_from_reference(const clock_model_t *model, double reference);
+
+#endif // CLOCK_MODEL_H
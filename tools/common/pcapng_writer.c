@@ -0,0 +1,96 @@
+#include <string.h>
+#include "pcapng_writer.h"
+
+#define LINKTYPE_IEEE802_11_RADIOTAP 127
+#define RADIOTAP_CHANNEL_2GHZ 0x0080
+#define OPTION_IF_NAME 2
+
+// Radiotap header in front of every packet: channel (bit 3) and antenna signal in dBm (bit 5)
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t pad;
+    uint16_t len;
+    uint32_t present;
+    uint16_t frequency;
+    uint16_t channel_flags;
+    int8_t signal;
+} radiotap_t;
+
+static void pcapng_block(FILE *file, uint32_t type, const void *body, uint32_t len)
+{
+    uint32_t total = 12 + ((len + 3) & ~3u);
+    uint8_t pad[3] = {0};
+    fwrite(&type, 4, 1, file);
+    fwrite(&total, 4, 1, file);
+    fwrite(body, len, 1, file);
+    fwrite(pad, total - 12 - len, 1, file);
+    fwrite(&total, 4, 1, file);
+}
+
+FILE *pcapng_open(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // Section header: byte order magic, version 1.0, unknown section length
+    uint8_t section[16];
+    uint32_t magic = 0x1A2B3C4D;
+    uint16_t version[2] = {1, 0};
+    int64_t length = -1;
+    memcpy(section, &magic, 4);
+    memcpy(section + 4, version, 4);
+    memcpy(section + 8, &length, 8);
+    pcapng_block(file, 0x0A0D0D0A, section, sizeof(section));
+    return file;
+}
+
+void pcapng_add_interface(FILE *file, const char *name)
+{
+    // Interface description: link type, snap length 0 (unlimited), then options ending with opt_endofopt
+    uint8_t interface[8 + 4 + 256 + 4] = {0};
+    uint16_t linktype = LINKTYPE_IEEE802_11_RADIOTAP;
+    memcpy(interface, &linktype, 2);
+    uint32_t len = 8;
+
+    if (name) {
+        uint16_t option[2] = {OPTION_IF_NAME, (uint16_t) strnlen(name, 255)};
+        memcpy(interface + len, option, sizeof(option));
+        memcpy(interface + len + sizeof(option), name, option[1]);
+        len += sizeof(option) + ((option[1] + 3u) & ~3u);
+        len += 4;  // opt_endofopt, already zero
+    }
+    pcapng_block(file, 1, interface, len);
+}
+
+void pcapng_write_l2(FILE *file, uint32_t interface_id, const captured_packet_t *record)
+{
+    uint16_t header_len = record->header_len < sizeof(record->header) ? record->header_len : sizeof(record->header);
+    uint16_t payload_len = record->payload_len < sizeof(record->payload) ? record->payload_len :
+                           sizeof(record->payload);
+
+    radiotap_t radiotap = {
+            .len = sizeof(radiotap_t),
+            .present = (1u << 3) | (1u << 5),
+            .frequency = record->channel == 14 ? 2484 : 2407 + 5 * record->channel,
+            .channel_flags = RADIOTAP_CHANNEL_2GHZ,
+            .signal = record->rssi,
+    };
+
+    // Enhanced packet: interface, timestamp (us), captured and original length, then the packet
+    uint8_t block[20 + sizeof(radiotap_t) + sizeof(record->header) + sizeof(record->payload)];
+    uint64_t timestamp = record->timestamp * 1000;
+    uint32_t timestamp_high = (uint32_t) (timestamp >> 32);
+    uint32_t timestamp_low = (uint32_t) timestamp;
+    uint32_t len = sizeof(radiotap_t) + header_len + payload_len;
+    memcpy(block, &interface_id, 4);
+    memcpy(block + 4, &timestamp_high, 4);
+    memcpy(block + 8, &timestamp_low, 4);
+    memcpy(block + 12, &len, 4);
+    memcpy(block + 16, &len, 4);
+    memcpy(block + 20, &radiotap, sizeof(radiotap));
+    memcpy(block + 20 + sizeof(radiotap), record->header, header_len);
+    memcpy(block + 20 + sizeof(radiotap) + header_len, record->payload, payload_len);
+    pcapng_block(file, 6, block, 20 + len);
+}
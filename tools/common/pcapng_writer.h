@@ -0,0 +1,19 @@
+#ifndef PCAPNG_WRITER_H
+#define PCAPNG_WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "capture_format.h"
+
+// pcapng output of L2 records: 802.11 frames behind a radiotap header carrying channel and RSSI, microsecond
+// timestamps. Each interface description stands for one sniffer; packets name theirs by index in order of addition.
+
+// Create the file and write the section header
+FILE *pcapng_open(const char *path);
+
+// Add an interface, `name` (if_name option) may be NULL
+void pcapng_add_interface(FILE *file, const char *name);
+
+void pcapng_write_l2(FILE *file, uint32_t interface_id, const captured_packet_t *record);
+
+#endif // PCAPNG_WRITER_H
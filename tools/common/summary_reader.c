@@ -0,0 +1,39 @@
+#include <errno.h>
+#include <string.h>
+#include "summary_reader.h"
+
+int summary_reader_open(summary_reader_t *reader, const char *path)
+{
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        return -1;
+    }
+
+    if (fread(&reader->header, sizeof(reader->header), 1, reader->file) != 1 ||
+        memcmp(reader->header.identifier, "SUMM", 4) != 0) {
+        fclose(reader->file);
+        reader->file = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void summary_reader_close(summary_reader_t *reader)
+{
+    if (reader->file) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+int summary_reader_next(summary_reader_t *reader, summary_record_header_t *record, uint8_t *body)
+{
+    if (fread(record, sizeof(*record), 1, reader->file) != 1) {
+        return ferror(reader->file) ? -1 : 0;
+    }
+    if (record->length > 0 && fread(body, record->length, 1, reader->file) != 1) {
+        return ferror(reader->file) ? -1 : 0;
+    }
+    return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef SUMMARY_READER_H
+#define SUMMARY_READER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "capture_format.h"
+
+#define SUMMARY_MAX_BODY 65535
+
+// Sequential reader of the summary stream (summary.bin)
+typedef struct {
+    FILE *file;
+    file_header_t header;
+} summary_reader_t;
+
+// Open a summary stream and validate its header. Returns 0 on success, -1 with errno set on failure.
+int summary_reader_open(summary_reader_t *reader, const char *path);
+void summary_reader_close(summary_reader_t *reader);
+
+// Read the next record into `record` and its body into `body` (SUMMARY_MAX_BODY bytes). Returns 1 when a record
+// was read, 0 at the end of the stream (including a truncated trailing record), -1 on error.
+int summary_reader_next(summary_reader_t *reader, summary_record_header_t *record, uint8_t *body);
+
+#endif // SUMMARY_READER_H
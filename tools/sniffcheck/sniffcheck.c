@@ -0,0 +1,2011 @@
+// sniffcheck - host checks and benchmarks of the firmware modules that build without ESP-IDF
+//
+//   sniffcheck hll [precision] [trials]
+//   sniffcheck dot11
+//   sniffcheck dedup [cache-size]
+//   sniffcheck shed [seconds]
+//   sniffcheck rate [seconds]
+//   sniffcheck digest <directory> [records]
+//   sniffcheck ring <directory>
+//   sniffcheck airtime
+//   sniffcheck latency [records]
+//   sniffcheck format <directory> [records]
+//   sniffcheck beacon [aps] [minutes]
+//
+// Every subcommand compiles the firmware's own source (see CMakeLists.txt), checks its results against a reference
+// on synthetic input, reports the cost per operation on this machine and exits with 1 when a check fails. The
+// timings are relative: the ESP32 runs the same code one to two orders of magnitude slower.
+//
+// `hll` fills sketches of the given precision (default 10, the firmware's default) with 100 to 1M distinct MACs
+// and compares the relative RMS error of the estimates over <trials> seeds (default 64) with the 1.04 / sqrt(m)
+// standard error of HyperLogLog, then times hll_add_hash and hll_estimate.
+//
+// `dot11` parses a table of MAC headers (management, data with and without addr4, QoS and HT control, every
+// control frame layout, truncated frames), checks header length, address positions, sequence control and QoS TID,
+// and that dot11_transmitter agrees with the parsed addr2. Whole frames (beacon, probe request, QoS data with HT
+// control, 4-address QoS data, ACK, RTS) are then parsed and compared with their known addresses, flags, duration,
+// sequence and fragment numbers and TID. Last, it times dot11_parse_header over the table.
+//
+// `dedup` replays synthetic traffic of access points and their clients (QoS data on several TIDs, management and
+// non-QoS frames with their own sequence counter) with retry bursts of up to 7 copies, interleaved with other
+// traffic, and 5 % of all transmissions missed by the sniffer, through a retransmission cache of <cache-size>
+// entries (default 256, the firmware's default). Originals reported as duplicates fail the check, duplicates
+// missed after an eviction are reported. The same traffic is run keyed by transmitter only, the key used before
+// TIDs were told apart, to show the originals that would be dropped. Also reports the cost per lookup.
+//
+// `shed` simulates the L2 queue (100 entries, the firmware's default) for <seconds> (default 600): steady
+// management, control and data traffic, a 2 s data flood every 10 s, and a writer draining 2000 records/s that
+// stalls for 50 to 250 ms about every 2 s, as an SD card does. It runs the same arrivals with drop-at-queue-full
+// only and through load_shedder_decide with the default watermarks, and fails unless shedding keeps more of the
+// management frames than drop-at-queue-full, overall and during the floods. Management frames are never shed, the
+// ones lost with shedding arrive while a stall has filled the queue.
+//
+// `rate` offers the CSI rate limiter (32 sources, 10 frames/s, burst of 20, the firmware's defaults) one AP
+// flooding at 500 frames/s, sources just above and below the rate and a whitelisted source for <seconds> (default
+// 60). It fails unless every limited source gets min(offered, rate * seconds + burst) frames within 2 %, so the flood
+// takes nothing from the others, and the whitelisted source gets all of its frames. A second run with 4x more
+// sources than table slots fails if eviction lets them exceed their budget, or if the slots pass less than their
+// share of it. Also reports the cost per frame.
+//
+// `digest` checks crc32c_update against the CRC-32C check value, then appends <records> L2 records (default 1M)
+// to a file in <directory> the way sdcard_writer.c does (fwrite and fflush per record), once plain and once with
+// block_digest_update. It checks every manifest CRC against the written file and reports the hashing time per
+// record and its share of the writer path. The host writes into the page cache, an SD card is far slower, so the
+// share on the sniffer is smaller than reported here.
+//
+// `ring` creates a ring store of 8 segments in <directory> and appends numbered records, committing every 50, until
+// it has wrapped several times. It then appends past a segment boundary without a final commit and closes the file,
+// as a power loss does, reopens the store and checks that the records up to the last commit come back in order and
+// that `overwritten` counts the records given up. Writing continues after ring_store_create finds the store, then
+// the newest superblock copy is corrupted (a torn commit) and the store must fall back to the commit before. Last,
+// ring_store_release must leave only the records appended after it.
+//
+// `airtime` compares airtime_estimate_us with TXTIME values of IEEE 802.11 (DSSS/CCK with long and short
+// preamble, ERP-OFDM and HT mixed format with 1 and 2 streams, 20/40 MHz and short guard interval, all with the
+// 2.4 GHz signal extension where it applies) and checks that unknown rates give 0. Also times the estimator.
+//
+// `latency` checks the bucket edges of the latency histogram for every value up to 2^27 µs: buckets are contiguous
+// and increasing, every value lies within its bucket, and buckets are at most 12.5 % wider than their lower edge.
+// It then records <records> synthetic latencies (default 1M, log-normal with a slow tail and SD card stalls),
+// compares p50 and p99 with the exact percentiles (never below them, at most one bucket above) including latencies
+// beyond the last bucket, and times latency_histogram_add and a percentile query.
+//
+// `format` checks the record layouts generated from the field lists of capture_format.h: every field of a list
+// starts where the one before ended (offsetof against the running sum of the field sizes), each list fills its
+// struct exactly, the sizes match the documented on-card sizes and CAPTURE_FORMATS reports them. It then writes
+// <records> random records (default 100000) in every fixed-size format to files in <directory>, reads them back
+// with capture_reader and compares every field, and times the host decoder. Last, it times the firmware encoders
+// against the hand-written code they replaced, in interleaved runs: the generated projection (schema known at
+// compile time) fails if it is slower than the memcpy fill of the raw record or the old per-field projection from
+// the parsed header. The projection with the schema known at run time is reported too.
+//
+// `beacon` simulates <aps> access points (default 100) beaconing every 102.4 ms, mostly on channels 1, 6 and 11,
+// heard for <minutes> (default 60) by a sniffer hopping over 13 channels with 1 s dwells. TIM and BSS load change
+// with every beacon, the rest of the IEs about every 30 minutes per AP. Beacons go through the beacon tracker with
+// the firmware's defaults (60 s windows, 128 tracked BSSIDs). Fails when the first beacon of an AP in a window or a
+// beacon with changed IEs is not kept, when a beacon that only changed TIM or BSS load is kept for a tracked AP,
+// or when the aggregates do not add up. Reports the L2 capture bytes with raw records with and without the
+// tracker, the summary records included, and the cost per beacon.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "airtime.h"
+#include "beacon_tracker.h"
+#include "block_digest.h"
+#include "capture_reader.h"
+#include "dedup_cache.h"
+#include "dot11.h"
+#include "hash.h"
+#include "hll.h"
+#include "latency.h"
+#include "load_shedder.h"
+#include "rate_limiter.h"
+#include "ring_store.h"
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: sniffcheck hll [precision] [trials]\n"
+            "       sniffcheck dot11\n"
+            "       sniffcheck dedup [cache-size]\n"
+            "       sniffcheck shed [seconds]\n"
+            "       sniffcheck rate [seconds]\n"
+            "       sniffcheck digest <directory> [records]\n"
+            "       sniffcheck ring <directory>\n"
+            "       sniffcheck airtime\n"
+            "       sniffcheck latency [records]\n"
+            "       sniffcheck format <directory> [records]\n"
+            "       sniffcheck beacon [aps] [minutes]\n");
+}
+
+static uint64_t random_next(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void random_mac(uint8_t mac[6])
+{
+    uint64_t value = random_next();
+    memcpy(mac, &value, 6);
+}
+
+// Keeps the compiler from dropping a timed loop whose result is otherwise unused
+static volatile uint64_t sink;
+
+static int check_hll(int precision, int trials)
+{
+    static const uint32_t cardinalities[] = {100, 1000, 10000, 100000, 1000000};
+    uint32_t count = HLL_REGISTER_COUNT(precision);
+    uint8_t *registers = malloc(count);
+    if (registers == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        return 1;
+    }
+    hll_t hll;
+    hll_init(&hll, (uint8_t) precision, registers);
+
+    // Below ~2.5 m the estimator switches to linear counting, whose error is lower than the HLL bound, so the same
+    // limit holds at every cardinality. 1.5 sigma of slack covers the sampling error of the RMS over the trials.
+    double bound = 1.04 / sqrt((double) count);
+    double limit = bound * (1.0 + 1.5 / sqrt((double) trials));
+    int failed = 0;
+    printf("precision %d: %" PRIu32 " registers, standard error %.2f %%, limit %.2f %%\n", precision, count,
+           bound * 100.0, limit * 100.0);
+    printf("%10s %10s %10s %10s\n", "distinct", "bias %", "rms %", "max %");
+
+    for (size_t c = 0; c < sizeof(cardinalities) / sizeof(cardinalities[0]); c++) {
+        uint32_t distinct = cardinalities[c];
+        double sum = 0.0;
+        double squares = 0.0;
+        double worst = 0.0;
+        for (int trial = 0; trial < trials; trial++) {
+            hll_reset(&hll);
+            for (uint32_t i = 0; i < distinct; i++) {
+                uint8_t mac[6];
+                random_mac(mac);
+                hll_add_hash(&hll, hash_mac(mac));
+            }
+            double error = (hll_estimate(&hll) - distinct) / distinct;
+            sum += error;
+            squares += error * error;
+            worst = fmax(worst, fabs(error));
+        }
+        double rms = sqrt(squares / trials);
+        printf("%10" PRIu32 " %10.2f %10.2f %10.2f%s\n", distinct, sum / trials * 100.0, rms * 100.0,
+               worst * 100.0, rms > limit ? "  FAIL" : "");
+        failed |= rms > limit;
+    }
+
+    // Insert cost of one MAC, hashing included as in the L2 callback
+    enum { INSERTS = 1 << 24, MACS = 1 << 12 };
+    static uint8_t macs[MACS][6];
+    for (int i = 0; i < MACS; i++) {
+        random_mac(macs[i]);
+    }
+    hll_reset(&hll);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < INSERTS; i++) {
+        hll_add_hash(&hll, hash_mac(macs[i & (MACS - 1)]) + i);
+    }
+    double seconds = seconds_since(&start);
+    printf("hll_add_hash: %.1f ns per insert (hash_mac included)\n", seconds / INSERTS * 1e9);
+
+    enum { ESTIMATES = 1 << 12 };
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double total = 0.0;
+    for (int i = 0; i < ESTIMATES; i++) {
+        total += hll_estimate(&hll);
+    }
+    seconds = seconds_since(&start);
+    sink = (uint64_t) total;
+    printf("hll_estimate: %.2f us per estimate\n", seconds / ESTIMATES * 1e6);
+
+    free(registers);
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+// One header of the parse table. Frame byte i holds i outside the frame control, so an address is identified by
+// its offset and the sequence control always reads 0x1716. Offsets of absent addresses are 0.
+typedef struct {
+    const char *name;
+    uint8_t frame_control[2];
+    uint8_t len;
+    bool valid;
+    uint8_t header_len;
+    uint8_t addr[4];
+} dot11_case_t;
+
+#define FC(type, subtype) (uint8_t) ((type) << 2 | (subtype) << 4)
+
+static const dot11_case_t dot11_cases[] = {
+        {"beacon", {FC(DOT11_TYPE_MGMT, DOT11_SUBTYPE_BEACON), 0}, 24, true, 24, {4, 10, 16, 0}},
+        {"probe request", {FC(DOT11_TYPE_MGMT, DOT11_SUBTYPE_PROBE_REQ), 0}, 24, true, 24, {4, 10, 16, 0}},
+        {"mgmt + HT control", {FC(DOT11_TYPE_MGMT, 13), DOT11_FLAG_ORDER}, 28, true, 28,
+                {4, 10, 16, 0}},
+        {"mgmt truncated", {FC(DOT11_TYPE_MGMT, DOT11_SUBTYPE_BEACON), 0}, 23, false, 24, {0}},
+        {"mgmt + HT control truncated", {FC(DOT11_TYPE_MGMT, 13), DOT11_FLAG_ORDER}, 27, false,
+                28, {0}},
+        {"data", {FC(DOT11_TYPE_DATA, 0), DOT11_FLAG_TO_DS}, 24, true, 24, {4, 10, 16, 0}},
+        {"data + order", {FC(DOT11_TYPE_DATA, 0), DOT11_FLAG_ORDER}, 24, true, 24, {4, 10, 16, 0}},
+        {"null", {FC(DOT11_TYPE_DATA, 4), DOT11_FLAG_TO_DS | DOT11_FLAG_PWR_MGMT}, 24, true, 24, {4, 10, 16, 0}},
+        {"data addr4", {FC(DOT11_TYPE_DATA, 0), DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS}, 30, true, 30,
+                {4, 10, 16, 24}},
+        {"data addr4 truncated", {FC(DOT11_TYPE_DATA, 0), DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS}, 29, false, 30, {0}},
+        {"QoS data", {FC(DOT11_TYPE_DATA, 8), DOT11_FLAG_FROM_DS}, 26, true, 26, {4, 10, 16, 0}},
+        {"QoS null", {FC(DOT11_TYPE_DATA, 12), DOT11_FLAG_TO_DS}, 26, true, 26, {4, 10, 16, 0}},
+        {"QoS data + HT control", {FC(DOT11_TYPE_DATA, 8), DOT11_FLAG_ORDER}, 30, true, 30, {4, 10, 16, 0}},
+        {"QoS data addr4", {FC(DOT11_TYPE_DATA, 8), DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS}, 32, true, 32,
+                {4, 10, 16, 24}},
+        {"QoS data addr4 + HT control", {FC(DOT11_TYPE_DATA, 8), DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS |
+                DOT11_FLAG_ORDER}, 36, true, 36, {4, 10, 16, 24}},
+        {"QoS data addr4 + HT control truncated", {FC(DOT11_TYPE_DATA, 8), DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS |
+                DOT11_FLAG_ORDER}, 35, false, 36, {0}},
+        {"ACK", {FC(DOT11_TYPE_CTRL, DOT11_SUBTYPE_ACK), 0}, 10, true, 10, {4, 0, 0, 0}},
+        {"CTS", {FC(DOT11_TYPE_CTRL, DOT11_SUBTYPE_CTS), 0}, 10, true, 10, {4, 0, 0, 0}},
+        {"control wrapper", {FC(DOT11_TYPE_CTRL, DOT11_SUBTYPE_CTRL_WRAPPER), 0}, 16, true, 10, {4, 0, 0, 0}},
+        {"RTS", {FC(DOT11_TYPE_CTRL, 11), 0}, 16, true, 16, {4, 10, 0, 0}},
+        {"block ack request", {FC(DOT11_TYPE_CTRL, 8), 0}, 16, true, 16, {4, 10, 0, 0}},
+        {"block ack", {FC(DOT11_TYPE_CTRL, 9), 0}, 16, true, 16, {4, 10, 0, 0}},
+        {"PS-Poll", {FC(DOT11_TYPE_CTRL, 10), 0}, 16, true, 16, {4, 10, 0, 0}},
+        {"RTS truncated", {FC(DOT11_TYPE_CTRL, 11), 0}, 15, false, 16, {0}},
+        {"frame control only", {FC(DOT11_TYPE_MGMT, DOT11_SUBTYPE_BEACON), 0}, 9, false, 0, {0}},
+};
+
+// Whole frames as they arrive in the promiscuous callback, FCS included: a beacon, a retried probe request from a
+// randomised MAC, protected QoS data with HT control from a station, a mesh 4-address QoS data fragment, an ACK and
+// an RTS.
+static const uint8_t dot11_beacon[] = {
+        0x80, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb2,
+        0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb2, 0x30, 0x6e, 0x9c, 0x4f, 0x1e, 0x2b, 0x05, 0x00, 0x00, 0x00,
+        0x64, 0x00, 0x31, 0x04, 0x00, 0x08, 0x6d, 0x6f, 0x6e, 0x61, 0x64, 0x6c, 0x61, 0x62, 0x01, 0x08,
+        0x82, 0x84, 0x8b, 0x96, 0x24, 0x30, 0x48, 0x6c, 0x03, 0x01, 0x06, 0x05, 0x04, 0x00, 0x01, 0x00,
+        0x00, 0x14, 0x32, 0xc1, 0x79,
+};
+static const uint8_t dot11_probe_request[] = {
+        0x40, 0x08, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xda, 0xa1, 0x19, 0x6b, 0x3f, 0x07,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xb0, 0x4c, 0x00, 0x00, 0x01, 0x04, 0x02, 0x04, 0x0b, 0x16,
+        0x32, 0x08, 0x0c, 0x12, 0x18, 0x24, 0x30, 0x48, 0x60, 0x6c, 0x03, 0x01, 0x0b, 0x2d, 0x1a, 0xef,
+        0x01, 0x1b, 0xff, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7f, 0x08, 0x00, 0x00, 0x08, 0x04, 0x01,
+        0x00, 0x00, 0x40, 0x51, 0xd2, 0xbb, 0x30,
+};
+static const uint8_t dot11_qos_data_ht[] = {
+        0x88, 0xc1, 0x30, 0x00, 0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb2, 0x3c, 0x22, 0xfb, 0x7a, 0x10, 0xc4,
+        0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb0, 0x40, 0xa2, 0x05, 0x00, 0x0b, 0x00, 0x00, 0x00, 0x2f, 0x01,
+        0x00, 0x20, 0x00, 0x00, 0x00, 0x00, 0x5b, 0xe1, 0xc0, 0x7f, 0x3a, 0x9d, 0x44, 0xe2, 0x81, 0x7b,
+        0x06, 0xc9, 0xad, 0x1f, 0x33, 0x20, 0xe3, 0x79, 0x4c, 0x0a, 0x5b, 0xd8, 0x1f, 0x66, 0xf2, 0x62,
+        0xc3, 0xc0,
+};
+static const uint8_t dot11_qos_data_addr4[] = {
+        0x88, 0x03, 0x2c, 0x00, 0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb3, 0x24, 0xa4, 0x3c, 0x11, 0x02, 0x7e,
+        0x3c, 0x22, 0xfb, 0x7a, 0x10, 0xc4, 0x82, 0x11, 0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb0, 0x86, 0x00,
+        0xaa, 0xaa, 0x03, 0x00, 0x00, 0x00, 0x08, 0x00, 0x45, 0x00, 0x00, 0x3c, 0x1c, 0x46, 0x40, 0x00,
+        0x40, 0x06, 0x85, 0x85, 0xcf, 0x52,
+};
+static const uint8_t dot11_ack[] = {
+        0xd4, 0x00, 0x00, 0x00, 0x3c, 0x22, 0xfb, 0x7a, 0x10, 0xc4, 0x2f, 0x94, 0x03, 0xa3,
+};
+static const uint8_t dot11_rts[] = {
+        0xb4, 0x00, 0x9e, 0x00, 0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb2, 0x3c, 0x22, 0xfb, 0x7a, 0x10, 0xc4,
+        0x27, 0x85, 0x2b, 0xa9,
+};
+
+// Expected parse of one whole frame. Addresses beyond `addresses` are absent, sequence -1 and tid -1 mean no
+// sequence or QoS control.
+typedef struct {
+    const char *name;
+    const uint8_t *frame;
+    uint8_t len;
+    uint8_t type;
+    uint8_t subtype;
+    uint8_t flags;
+    uint16_t duration;
+    uint8_t header_len;
+    uint8_t addresses;
+    uint8_t addr[4][6];
+    int16_t sequence;
+    uint8_t fragment;
+    int8_t tid;
+} dot11_frame_case_t;
+
+#define AP_MAC      {0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb2}
+#define STATION_MAC {0x3c, 0x22, 0xfb, 0x7a, 0x10, 0xc4}
+#define BROADCAST   {0xff, 0xff, 0xff, 0xff, 0xff, 0xff}
+#define FRAME(name) dot11_##name, sizeof(dot11_##name)
+
+static const dot11_frame_case_t dot11_frames[] = {
+        {"beacon", FRAME(beacon), DOT11_TYPE_MGMT, DOT11_SUBTYPE_BEACON, 0, 0, 24, 3,
+                {BROADCAST, AP_MAC, AP_MAC}, 1763, 0, -1},
+        {"probe request", FRAME(probe_request), DOT11_TYPE_MGMT, DOT11_SUBTYPE_PROBE_REQ, DOT11_FLAG_RETRY, 0, 24, 3,
+                {BROADCAST, {0xda, 0xa1, 0x19, 0x6b, 0x3f, 0x07}, BROADCAST}, 1227, 0, -1},
+        {"QoS data + HT control", FRAME(qos_data_ht), DOT11_TYPE_DATA, 8,
+                DOT11_FLAG_TO_DS | DOT11_FLAG_PROTECTED | DOT11_FLAG_ORDER, 48, 30, 3,
+                {AP_MAC, STATION_MAC, {0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb0}}, 2596, 0, 5},
+        {"QoS data addr4", FRAME(qos_data_addr4), DOT11_TYPE_DATA, 8, DOT11_FLAG_TO_DS | DOT11_FLAG_FROM_DS, 44, 32, 4,
+                {{0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb3}, {0x24, 0xa4, 0x3c, 0x11, 0x02, 0x7e}, STATION_MAC,
+                 {0x24, 0xa4, 0x3c, 0x9e, 0x51, 0xb0}}, 280, 2, 6},
+        {"ACK", FRAME(ack), DOT11_TYPE_CTRL, DOT11_SUBTYPE_ACK, 0, 0, 10, 1, {STATION_MAC}, -1, 0, -1},
+        {"RTS", FRAME(rts), DOT11_TYPE_CTRL, 11, 0, 158, 16, 2, {AP_MAC, STATION_MAC}, -1, 0, -1},
+};
+
+static bool check_dot11_frame(const dot11_frame_case_t *test)
+{
+    dot11_header_t header;
+    if (!dot11_parse_header(test->frame, test->len, &header)) {
+        return false;
+    }
+    bool ok = header.type == test->type && header.subtype == test->subtype && header.flags == test->flags &&
+              header.duration == test->duration && header.header_len == test->header_len;
+    const uint8_t *addresses[4] = {header.addr1, header.addr2, header.addr3, header.addr4};
+    for (int a = 0; a < 4; a++) {
+        ok &= a < test->addresses ? addresses[a] != NULL && memcmp(addresses[a], test->addr[a], 6) == 0
+                                  : addresses[a] == NULL;
+    }
+    ok &= header.has_sequence == (test->sequence >= 0);
+    ok &= !header.has_sequence || (header.sequence_control >> 4 == test->sequence &&
+                                   (header.sequence_control & 0x0F) == test->fragment);
+    ok &= header.has_qos == (test->tid >= 0) && (!header.has_qos || header.tid == test->tid);
+    ok &= dot11_transmitter(test->frame, test->len) == header.addr2;
+    return ok;
+}
+
+static void dot11_frame(const dot11_case_t *test, uint8_t frame[40])
+{
+    for (int i = 0; i < 40; i++) {
+        frame[i] = (uint8_t) i;
+    }
+    frame[0] = test->frame_control[0];
+    frame[1] = test->frame_control[1];
+}
+
+static int check_dot11(void)
+{
+    size_t count = sizeof(dot11_cases) / sizeof(dot11_cases[0]);
+    int failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        const dot11_case_t *test = &dot11_cases[i];
+        uint8_t frame[40];
+        dot11_frame(test, frame);
+
+        dot11_header_t header;
+        bool valid = dot11_parse_header(frame, test->len, &header);
+        const uint8_t *addresses[4] = {header.addr1, header.addr2, header.addr3, header.addr4};
+        bool ok = valid == test->valid;
+        if (valid) {
+            ok &= header.type == dot11_frame_type(frame) && header.subtype == dot11_frame_subtype(frame);
+            ok &= header.flags == test->frame_control[1] && header.header_len == test->header_len;
+            for (int a = 0; a < 4; a++) {
+                ok &= test->addr[a] ? addresses[a] == frame + test->addr[a] : addresses[a] == NULL;
+            }
+            ok &= header.has_sequence == (header.type != DOT11_TYPE_CTRL);
+            ok &= !header.has_sequence || header.sequence_control == 0x1716;
+            ok &= header.has_qos == (header.type == DOT11_TYPE_DATA && (header.subtype & 0x08));
+            ok &= !header.has_qos || header.tid == (header.addr4 ? 30 : 24) % 16;
+            ok &= dot11_transmitter(frame, test->len) == header.addr2;
+        }
+        if (!ok) {
+            printf("FAIL %s: valid %d, header %u bytes\n", test->name, valid, header.header_len);
+            failures++;
+        }
+    }
+    printf("%zu headers parsed, %d failed\n", count, failures);
+
+    size_t frame_count = sizeof(dot11_frames) / sizeof(dot11_frames[0]);
+    int frame_failures = 0;
+    for (size_t i = 0; i < frame_count; i++) {
+        if (!check_dot11_frame(&dot11_frames[i])) {
+            printf("FAIL %s frame\n", dot11_frames[i].name);
+            frame_failures++;
+        }
+    }
+    printf("%zu whole frames parsed, %d failed\n", frame_count, frame_failures);
+    failures += frame_failures;
+
+    enum { PARSES = 1 << 24 };
+    uint8_t frames[sizeof(dot11_cases) / sizeof(dot11_cases[0])][40];
+    for (size_t i = 0; i < count; i++) {
+        dot11_frame(&dot11_cases[i], frames[i]);
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < PARSES; i++) {
+        size_t c = i % count;
+        dot11_header_t header;
+        total += dot11_parse_header(frames[c], dot11_cases[c].len, &header) ? header.header_len : 0;
+    }
+    double seconds = seconds_since(&start);
+    sink = total;
+    printf("dot11_parse_header: %.1f ns per header\n", seconds / PARSES * 1e9);
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+#define DEDUP_APS 16
+#define DEDUP_CLIENTS_PER_AP 8
+#define DEDUP_PHONES 64
+#define DEDUP_BROADCAST 0xFFFF
+#define DEDUP_FRAMES 2000000
+#define DEDUP_PENDING 64
+
+// A sequence counter: QoS data per (transmitter, receiver, TID), management and non-QoS data per transmitter
+typedef struct {
+    uint16_t transmitter;
+    uint16_t receiver;
+    uint8_t space;
+    uint16_t *counter;
+} dedup_stream_t;
+
+typedef struct {
+    uint16_t transmitter;
+    uint16_t receiver;
+    uint8_t space;
+    uint16_t sequence_control;
+    bool retry;
+    bool duplicate;          // An earlier copy of the same frame was heard
+} dedup_frame_t;
+
+typedef struct {
+    dedup_frame_t frame;
+    uint32_t original;
+    uint8_t delay;
+} dedup_pending_t;
+
+static void dedup_mac(uint16_t device, uint8_t mac[6])
+{
+    if (device == DEDUP_BROADCAST) {
+        memset(mac, 0xFF, 6);
+        return;
+    }
+    uint8_t value[6] = {0x02, 0xDD, 0x00, 0x00, (uint8_t) (device >> 8), (uint8_t) device};
+    memcpy(mac, value, 6);
+}
+
+// Frames as heard by the sniffer, with the ground truth of which are duplicates
+static dedup_frame_t *dedup_traffic(uint32_t *count)
+{
+    enum { CLIENTS = DEDUP_APS * DEDUP_CLIENTS_PER_AP, DEVICES = DEDUP_APS + CLIENTS + DEDUP_PHONES };
+    static uint16_t counters[DEVICES * 3 + CLIENTS * 4];
+    static dedup_stream_t streams[DEVICES + CLIENTS * 4];
+    uint32_t stream_count = 0;
+    uint32_t counter_count = 0;
+    for (uint16_t ap = 0; ap < DEDUP_APS; ap++) {
+        streams[stream_count++] = (dedup_stream_t) {ap, DEDUP_BROADCAST, DEDUP_SPACE_NON_QOS, &counters[ap]};
+    }
+    counter_count = DEVICES;
+    for (uint16_t client = 0; client < CLIENTS; client++) {
+        uint16_t device = DEDUP_APS + client;
+        uint16_t ap = client / DEDUP_CLIENTS_PER_AP;
+        // Downlink on best effort and voice, uplink on best effort, and the client's null frames
+        streams[stream_count++] = (dedup_stream_t) {ap, device, 0, &counters[counter_count++]};
+        streams[stream_count++] = (dedup_stream_t) {ap, device, 6, &counters[counter_count++]};
+        streams[stream_count++] = (dedup_stream_t) {device, ap, 0, &counters[counter_count++]};
+        streams[stream_count++] = (dedup_stream_t) {device, ap, DEDUP_SPACE_NON_QOS, &counters[device]};
+        // Management frames of the AP to the client share the AP's non-QoS counter
+        streams[stream_count++] = (dedup_stream_t) {ap, device, DEDUP_SPACE_NON_QOS, &counters[ap]};
+    }
+    for (uint16_t phone = 0; phone < DEDUP_PHONES; phone++) {
+        uint16_t device = DEDUP_APS + CLIENTS + phone;
+        streams[stream_count++] = (dedup_stream_t) {device, DEDUP_BROADCAST, DEDUP_SPACE_NON_QOS, &counters[device]};
+    }
+    // Recently associated devices, the counters of one transmitter run close to each other
+    for (uint32_t i = 0; i < counter_count; i++) {
+        counters[i] = (uint16_t) (random_next() % 64);
+    }
+
+    dedup_frame_t *frames = malloc(DEDUP_FRAMES * sizeof(dedup_frame_t));
+    bool *heard = calloc(DEDUP_FRAMES, sizeof(bool));
+    if (frames == NULL || heard == NULL) {
+        free(frames);
+        free(heard);
+        return NULL;
+    }
+
+    dedup_pending_t pending[DEDUP_PENDING];
+    uint32_t pending_count = 0;
+    uint32_t originals = 0;
+    uint32_t n = 0;
+    while (n < DEDUP_FRAMES) {
+        // Copies that are due go out before the next new frame
+        bool sent_copy = false;
+        for (uint32_t i = 0; i < pending_count && !sent_copy; i++) {
+            if (pending[i].delay-- > 0) {
+                continue;
+            }
+            dedup_frame_t frame = pending[i].frame;
+            uint32_t original = pending[i].original;
+            pending[i] = pending[--pending_count];
+            sent_copy = true;
+            if (random_next() % 100 >= 5) {
+                frame.duplicate = heard[original];
+                heard[original] = true;
+                frames[n++] = frame;
+            }
+        }
+        if (sent_copy) {
+            continue;
+        }
+
+        const dedup_stream_t *stream = &streams[random_next() % stream_count];
+        dedup_frame_t frame = {
+                .transmitter = stream->transmitter,
+                .receiver = stream->receiver,
+                .space = stream->space,
+                .sequence_control = (uint16_t) (*stream->counter << 4),
+        };
+        *stream->counter = (*stream->counter + 1) & 0x0FFF;
+        uint32_t original = originals++;
+        if (random_next() % 100 >= 5) {
+            heard[original] = true;
+            frames[n++] = frame;
+        }
+
+        // One in ten frames is not acknowledged and retried up to 7 times
+        if (random_next() % 10 == 0 && frame.receiver != DEDUP_BROADCAST) {
+            uint32_t copies = 1 + random_next() % 7;
+            frame.retry = true;
+            for (uint32_t c = 0; c < copies && pending_count < DEDUP_PENDING; c++) {
+                pending[pending_count++] = (dedup_pending_t) {frame, original, (uint8_t) (c + random_next() % 4)};
+            }
+        }
+    }
+
+    free(heard);
+    *count = n;
+    return frames;
+}
+
+static void dedup_run(const dedup_frame_t *frames, uint32_t count, uint32_t cache_size, bool transmitter_only,
+                      bool *results, double *seconds)
+{
+    dedup_entry_t *entries = malloc(cache_size * sizeof(dedup_entry_t));
+    if (entries == NULL) {
+        return;
+    }
+    dedup_cache_t cache;
+    dedup_cache_init(&cache, entries, cache_size);
+    static const uint8_t none[6];
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < count; i++) {
+        const dedup_frame_t *frame = &frames[i];
+        uint8_t transmitter[6];
+        uint8_t receiver[6];
+        dedup_mac(frame->transmitter, transmitter);
+        dedup_mac(frame->receiver, receiver);
+        if (transmitter_only) {
+            results[i] = dedup_cache_check(&cache, transmitter, none, DEDUP_SPACE_NON_QOS, frame->sequence_control,
+                                           frame->retry);
+        } else {
+            results[i] = dedup_cache_check(&cache, transmitter, receiver, frame->space, frame->sequence_control,
+                                           frame->retry);
+        }
+    }
+    *seconds = seconds_since(&start);
+    free(entries);
+}
+
+static int check_dedup(uint32_t cache_size)
+{
+    uint32_t count;
+    dedup_frame_t *frames = dedup_traffic(&count);
+    bool *results = malloc(DEDUP_FRAMES * sizeof(bool));
+    if (frames == NULL || results == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        free(frames);
+        free(results);
+        return 1;
+    }
+    uint32_t duplicates = 0;
+    uint32_t retries = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        duplicates += frames[i].duplicate;
+        retries += frames[i].retry;
+    }
+    printf("%" PRIu32 " frames heard, %" PRIu32 " with the retry bit, %" PRIu32 " duplicates, cache of %" PRIu32
+           " entries\n", count, retries, duplicates, cache_size);
+
+    int failed = 0;
+    for (int transmitter_only = 0; transmitter_only <= 1; transmitter_only++) {
+        double seconds = 0.0;
+        dedup_run(frames, count, cache_size, transmitter_only, results, &seconds);
+        uint32_t dropped = 0;
+        uint32_t missed = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            dropped += results[i] && !frames[i].duplicate;
+            missed += !results[i] && frames[i].duplicate;
+        }
+        printf("%-32s originals dropped %" PRIu32 ", duplicates missed %" PRIu32 " (%.2f %%), %.1f ns per frame\n",
+               transmitter_only ? "transmitter key:" : "transmitter, receiver, TID key:", dropped, missed,
+               (double) missed / duplicates * 100.0, seconds / count * 1e9);
+        if (!transmitter_only) {
+            failed = dropped > 0;
+        }
+    }
+
+    free(frames);
+    free(results);
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+#define SHED_QUEUE_SIZE 100
+#define SHED_SLOTS_PER_SECOND 10000   // 100 us simulation steps
+#define SHED_WRITER_RATE 2000          // Records/s drained between stalls
+
+typedef struct {
+    uint64_t offered[3];
+    uint64_t kept[3];
+    uint64_t flood_offered;            // Management frames offered during a data flood
+    uint64_t flood_kept;
+    uint64_t queue_full;
+    uint64_t payloads_dropped;
+} shed_result_t;
+
+static void shed_run(int seconds, bool shedding, shed_result_t *result)
+{
+    // Frames per second of management, control and data traffic, and of data during a flood
+    static const double rates[3] = {300.0, 200.0, 1000.0};
+    const double flood_rate = 8000.0;
+
+    load_shedder_t shedder;
+    load_shedder_init(&shedder, SHED_QUEUE_SIZE, 50, 70, 90, 8);
+    memset(result, 0, sizeof(*result));
+    random_state = 0x9E3779B97F4A7C15ull;
+
+    uint32_t occupancy = 0;
+    double drain = 0.0;
+    uint32_t stall = 0;
+    for (uint64_t slot = 0; slot < (uint64_t) seconds * SHED_SLOTS_PER_SECOND; slot++) {
+        bool flood = slot % (10 * SHED_SLOTS_PER_SECOND) < 2 * SHED_SLOTS_PER_SECOND;
+
+        // Arrivals of this step in a random type order
+        int first = (int) (random_next() % 3);
+        for (int t = 0; t < 3; t++) {
+            uint8_t type = (uint8_t) ((first + t) % 3);
+            double rate = type == DOT11_TYPE_DATA && flood ? flood_rate : rates[type];
+            double expected = rate / SHED_SLOTS_PER_SECOND;
+            uint32_t arrivals = (uint32_t) expected;
+            arrivals += (double) (random_next() % 1000000) / 1e6 < expected - arrivals;
+
+            for (uint32_t a = 0; a < arrivals; a++) {
+                result->offered[type]++;
+                result->flood_offered += flood && type == DOT11_TYPE_MGMT;
+                shed_action_t action = shedding ? load_shedder_decide(&shedder, occupancy, type) : SHED_KEEP;
+                if (action == SHED_DROP_SAMPLED || action == SHED_DROP_NON_MGMT) {
+                    continue;
+                }
+                if (occupancy == SHED_QUEUE_SIZE) {
+                    result->queue_full++;
+                    continue;
+                }
+                occupancy++;
+                result->kept[type]++;
+                result->flood_kept += flood && type == DOT11_TYPE_MGMT;
+                result->payloads_dropped += action == SHED_DROP_PAYLOAD && type == DOT11_TYPE_MGMT;
+            }
+        }
+
+        // The writer stalls for 50 to 250 ms about every 2 s, otherwise drains at its steady rate
+        if (stall > 0) {
+            stall--;
+        } else if (random_next() % (2 * SHED_SLOTS_PER_SECOND) == 0) {
+            stall = (50 + random_next() % 201) * SHED_SLOTS_PER_SECOND / 1000;
+        } else {
+            drain += (double) SHED_WRITER_RATE / SHED_SLOTS_PER_SECOND;
+            while (drain >= 1.0 && occupancy > 0) {
+                occupancy--;
+                drain -= 1.0;
+            }
+            if (occupancy == 0) {
+                drain = 0.0;
+            }
+        }
+    }
+}
+
+static double percent(uint64_t part, uint64_t whole)
+{
+    return whole > 0 ? (double) part / (double) whole * 100.0 : 100.0;
+}
+
+static int check_shed(int seconds)
+{
+    shed_result_t results[2];
+    static const char *names[2] = {"drop at queue full", "load shedding"};
+    printf("%-20s %8s %8s %8s %10s %10s %10s\n", "policy", "mgmt %", "ctrl %", "data %", "flood mgmt", "queue full",
+           "mgmt trunc");
+    for (int shedding = 0; shedding <= 1; shedding++) {
+        shed_result_t *result = &results[shedding];
+        shed_run(seconds, shedding, result);
+        printf("%-20s %8.2f %8.2f %8.2f %9.2f%% %10" PRIu64 " %10" PRIu64 "\n", names[shedding],
+               percent(result->kept[DOT11_TYPE_MGMT], result->offered[DOT11_TYPE_MGMT]),
+               percent(result->kept[DOT11_TYPE_CTRL], result->offered[DOT11_TYPE_CTRL]),
+               percent(result->kept[DOT11_TYPE_DATA], result->offered[DOT11_TYPE_DATA]),
+               percent(result->flood_kept, result->flood_offered), result->queue_full, result->payloads_dropped);
+    }
+
+    int failed = results[1].kept[DOT11_TYPE_MGMT] <= results[0].kept[DOT11_TYPE_MGMT] ||
+                 results[1].flood_kept <= results[0].flood_kept;
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+#define RATE_TABLE 32
+#define RATE_LIMIT 10
+#define RATE_BURST 20
+#define RATE_MAX_SOURCES (4 * RATE_TABLE)
+
+typedef struct {
+    uint8_t mac[6];
+    uint32_t rate;           // Offered frames per second
+    uint64_t offered;
+    uint64_t admitted;
+} rate_source_t;
+
+// Offers every source's frames at random times within each ms for `seconds`
+static void rate_run(rate_limiter_t *limiter, rate_source_t *sources, int count, int seconds)
+{
+    for (int64_t ms = 0; ms < (int64_t) seconds * 1000; ms++) {
+        for (int i = 0; i < count; i++) {
+            rate_source_t *source = &sources[i];
+            if (random_next() % 1000 >= source->rate) {
+                continue;
+            }
+            source->offered++;
+            source->admitted += rate_limiter_admit(limiter, source->mac, ms * 1000 + random_next() % 1000);
+        }
+    }
+}
+
+static void rate_sources(rate_source_t *sources, int count, const uint32_t *rates, int rate_count)
+{
+    for (int i = 0; i < count; i++) {
+        memset(&sources[i], 0, sizeof(sources[i]));
+        uint8_t mac[6] = {0x02, 0xCC, 0x00, 0x00, (uint8_t) (i >> 8), (uint8_t) i};
+        memcpy(sources[i].mac, mac, 6);
+        sources[i].rate = rates[i % rate_count];
+    }
+}
+
+static int check_rate(int seconds)
+{
+    static rate_limiter_entry_t entries[RATE_TABLE];
+    static rate_source_t sources[RATE_MAX_SOURCES];
+    rate_limiter_t limiter;
+
+    // Source 0 floods, 1 is whitelisted, the rest send at 1 to 15 frames/s
+    static const uint32_t rates[] = {500, 200, 1, 5, 9, 11, 15, 5, 9, 11, 15, 1, 5, 9, 11, 15};
+    int count = (int) (sizeof(rates) / sizeof(rates[0]));
+    rate_sources(sources, count, rates, count);
+    rate_limiter_init(&limiter, entries, RATE_TABLE, RATE_LIMIT, RATE_BURST);
+    char whitelist[32];
+    snprintf(whitelist, sizeof(whitelist), "%02x:%02x:%02x:%02x:%02x:%02x", sources[1].mac[0], sources[1].mac[1],
+             sources[1].mac[2], sources[1].mac[3], sources[1].mac[4], sources[1].mac[5]);
+    rate_limiter_set_whitelist(&limiter, whitelist);
+    rate_run(&limiter, sources, count, seconds);
+
+    int failures = 0;
+    uint64_t budget = (uint64_t) RATE_LIMIT * seconds + RATE_BURST;
+    printf("%d sources for %d s at %d frames/s, burst %d\n", count, seconds, RATE_LIMIT, RATE_BURST);
+    printf("%8s %10s %10s %10s\n", "rate", "offered", "admitted", "expected");
+    for (int i = 0; i < count; i++) {
+        const rate_source_t *source = &sources[i];
+        uint64_t expected = i == 1 || source->offered < budget ? source->offered : budget;
+        bool ok = (double) source->admitted >= (double) expected * 0.98 &&
+                  (double) source->admitted <= (double) expected * 1.02;
+        failures += !ok;
+        printf("%8" PRIu32 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "%s%s\n", source->rate, source->offered,
+               source->admitted, expected, i == 1 ? "  whitelisted" : "", ok ? "" : "  FAIL");
+    }
+
+    // More sources than slots: evicted sources must not come back with a full bucket and exceed their budget
+    static const uint32_t churn_rates[] = {15};
+    rate_sources(sources, RATE_MAX_SOURCES, churn_rates, 1);
+    rate_limiter_init(&limiter, entries, RATE_TABLE, RATE_LIMIT, RATE_BURST);
+    rate_run(&limiter, sources, RATE_MAX_SOURCES, seconds);
+    uint64_t offered = 0;
+    uint64_t admitted = 0;
+    for (int i = 0; i < RATE_MAX_SOURCES; i++) {
+        offered += sources[i].offered;
+        admitted += sources[i].admitted;
+    }
+    double churn = (double) admitted / (double) (budget * RATE_MAX_SOURCES);
+    // Each slot still passes its own rate, so the table as a whole admits its share of the budget
+    bool churn_ok = churn <= 1.0 && churn >= (double) RATE_TABLE / RATE_MAX_SOURCES * 0.95;
+    printf("%d sources at 15 frames/s in %d slots: admitted %.1f %% of the budget%s\n", RATE_MAX_SOURCES, RATE_TABLE,
+           churn * 100.0, churn_ok ? "" : "  FAIL");
+    failures += !churn_ok;
+
+    enum { FRAMES = 1 << 24 };
+    rate_limiter_init(&limiter, entries, RATE_TABLE, RATE_LIMIT, RATE_BURST);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < FRAMES; i++) {
+        total += rate_limiter_admit(&limiter, sources[i % count].mac, (int64_t) i * 10);
+    }
+    double elapsed = seconds_since(&start);
+    sink = total + offered;
+    printf("rate_limiter_admit: %.1f ns per frame\n", elapsed / FRAMES * 1e9);
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+// Appends `count` records like the firmware's sink_append, with or without the digest. Returns the seconds taken.
+static double digest_write(const char *path, const captured_packet_t *records, uint32_t count, bool digest)
+{
+    char manifest_path[4096];
+    snprintf(manifest_path, sizeof(manifest_path), "%s.man", path);
+    remove(path);
+    remove(manifest_path);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return -1.0;
+    }
+    block_digest_t block_digest;
+    if (digest && !block_digest_open(&block_digest, path, manifest_path)) {
+        fclose(file);
+        return -1.0;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < count; i++) {
+        const captured_packet_t *record = &records[i % 4096];
+        size_t written = fwrite(record, sizeof(*record), 1, file);
+        fflush(file);
+        if (digest && written == 1) {
+            block_digest_update(&block_digest, record, sizeof(*record));
+        }
+    }
+    double seconds = seconds_since(&start);
+
+    if (digest) {
+        block_digest_close(&block_digest);
+    }
+    return fclose(file) == 0 ? seconds : -1.0;
+}
+
+// Every CRC of the manifest against the blocks of the data file
+static int digest_verify(const char *path, uint32_t *blocks)
+{
+    char manifest_path[4096];
+    snprintf(manifest_path, sizeof(manifest_path), "%s.man", path);
+    FILE *data = fopen(path, "rb");
+    FILE *manifest = fopen(manifest_path, "rb");
+    manifest_header_t header;
+    int mismatches = -1;
+    if (data && manifest && fread(&header, sizeof(header), 1, manifest) == 1 &&
+        memcmp(header.identifier, "BCRC", 4) == 0 && header.block_size == BLOCK_DIGEST_SIZE) {
+        mismatches = 0;
+        *blocks = 0;
+        static uint8_t block[BLOCK_DIGEST_SIZE];
+        uint32_t crc;
+        while (fread(&crc, sizeof(crc), 1, manifest) == 1) {
+            if (fread(block, BLOCK_DIGEST_SIZE, 1, data) != 1 ||
+                ~crc32c_update(CRC32C_INIT, block, BLOCK_DIGEST_SIZE) != crc) {
+                mismatches++;
+            }
+            (*blocks)++;
+        }
+    }
+    if (data) {
+        fclose(data);
+    }
+    if (manifest) {
+        fclose(manifest);
+    }
+    return mismatches;
+}
+
+static int check_digest(const char *directory, uint32_t count)
+{
+    uint32_t check = ~crc32c_update(CRC32C_INIT, "123456789", 9);
+    printf("CRC-32C of \"123456789\": %08" PRIX32 " (expected E3069283)\n", check);
+    int failed = check != 0xE3069283;
+
+    captured_packet_t *records = calloc(4096, sizeof(captured_packet_t));
+    if (records == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < 4096; i++) {
+        uint8_t *bytes = (uint8_t *) &records[i];
+        for (size_t b = 0; b < sizeof(captured_packet_t); b++) {
+            bytes[b] = (uint8_t) random_next();
+        }
+    }
+
+    char path[4000];
+    snprintf(path, sizeof(path), "%s/sniffcheck-digest.bin", directory);
+    double plain = digest_write(path, records, count, false);
+    double digested = digest_write(path, records, count, true);
+    uint32_t blocks = 0;
+    int mismatches = plain < 0 || digested < 0 ? -1 : digest_verify(path, &blocks);
+    if (mismatches < 0) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        free(records);
+        return 1;
+    }
+    printf("%" PRIu32 " blocks in the manifest, %d mismatched\n", blocks, mismatches);
+    failed |= mismatches > 0 || blocks != (uint64_t) count * sizeof(captured_packet_t) / BLOCK_DIGEST_SIZE;
+
+    enum { HASHES = 1 << 20 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint32_t crc = CRC32C_INIT;
+    for (uint32_t i = 0; i < HASHES; i++) {
+        crc = crc32c_update(crc, &records[i % 4096], sizeof(captured_packet_t));
+    }
+    double hashing = seconds_since(&start);
+    sink = crc;
+
+    double mb = (double) count * sizeof(captured_packet_t) / 1e6;
+    printf("writer path: %.2f us per record plain, %.2f us with the digest (+%.1f %%), %.0f MB/s vs %.0f MB/s\n",
+           plain / count * 1e6, digested / count * 1e6, (digested - plain) / plain * 100.0, mb / plain,
+           mb / digested);
+    printf("crc32c_update: %.0f ns per %zu byte record, %.0f MB/s\n", hashing / HASHES * 1e9,
+           sizeof(captured_packet_t), (double) HASHES * sizeof(captured_packet_t) / hashing / 1e6);
+
+    char manifest_path[4096];
+    snprintf(manifest_path, sizeof(manifest_path), "%s.man", path);
+    remove(path);
+    remove(manifest_path);
+    free(records);
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
+
+#define RING_SEGMENTS 8
+#define RING_SEGMENT_SIZE 1000     // Not a multiple of the record size, segments end with unused bytes
+#define RING_COMMIT_EVERY 50
+
+typedef struct {
+    uint64_t sequence;
+    uint64_t check;
+    uint8_t padding[8];
+} ring_record_t;
+
+static const char ring_header[] = "sniffcheck ring";
+
+// Appends and the state that the store must come back with after a power loss
+typedef struct {
+    ring_store_t ring;
+    uint64_t sequence;             // Sequence number of the next record
+    uint64_t overwritten;          // Sum of the ring_store_append results
+    uint64_t committed[2];         // Sequence number after the last commit and the one before
+    uint64_t committed_overwritten[2];
+} ring_test_t;
+
+static void ring_committed(ring_test_t *test)
+{
+    test->committed[1] = test->committed[0];
+    test->committed_overwritten[1] = test->committed_overwritten[0];
+    test->committed[0] = test->sequence;
+    test->committed_overwritten[0] = test->overwritten;
+}
+
+static bool ring_append(ring_test_t *test, uint64_t count, bool commit)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        // Appending to a full tail segment moves to the next one and commits
+        bool switches = test->ring.superblock.tail_records == test->ring.segment_capacity;
+        if (switches) {
+            test->committed[1] = test->committed[0];
+            test->committed_overwritten[1] = test->committed_overwritten[0];
+            test->committed[0] = test->sequence;
+        }
+        ring_record_t record = {.sequence = test->sequence, .check = test->sequence * 0x9E3779B97F4A7C15ull};
+        memset(record.padding, (int) test->sequence, sizeof(record.padding));
+        int overwritten = ring_store_append(&test->ring, &record);
+        if (overwritten < 0) {
+            return false;
+        }
+        test->overwritten += (uint64_t) overwritten;
+        if (switches) {
+            test->committed_overwritten[0] = test->overwritten;
+        }
+        test->sequence++;
+        if (commit && test->sequence % RING_COMMIT_EVERY == 0) {
+            if (!ring_store_commit(&test->ring)) {
+                return false;
+            }
+            ring_committed(test);
+        }
+    }
+    return true;
+}
+
+// The upload stream of the store must be the header and the records [first, end) in order
+static bool ring_verify(const char *stage, ring_store_t *ring, uint64_t first, uint64_t end, uint64_t overwritten)
+{
+    uint64_t pending = ring_store_pending(ring);
+    bool ok = pending == end - first && ring->superblock.overwritten == overwritten &&
+              ring_store_stream_size(ring) == sizeof(ring_header) + pending * sizeof(ring_record_t);
+
+    // Read in chunks that do not line up with records or segments
+    uint8_t stream[sizeof(ring_header) + 2048 * sizeof(ring_record_t)];
+    uint64_t size = ring_store_stream_size(ring);
+    size_t done = 0;
+    while (ok && done < size && size <= sizeof(stream)) {
+        size_t chunk = ring_store_stream_read(ring, done, stream + done, 333);
+        if (chunk == 0) {
+            break;
+        }
+        done += chunk;
+    }
+    ok = ok && done == size && memcmp(stream, ring_header, sizeof(ring_header)) == 0;
+
+    uint64_t misplaced = 0;
+    for (uint64_t i = 0; ok && i < pending; i++) {
+        ring_record_t record;
+        memcpy(&record, stream + sizeof(ring_header) + i * sizeof(record), sizeof(record));
+        misplaced += record.sequence != first + i || record.check != record.sequence * 0x9E3779B97F4A7C15ull;
+    }
+    ok = ok && misplaced == 0;
+
+    printf("%-30s %4" PRIu64 " pending, records %" PRIu64 "..%" PRIu64 ", %" PRIu64 " overwritten%s\n", stage,
+           pending, first, first + pending - 1, ring->superblock.overwritten, ok ? "" : "  FAIL");
+    return ok;
+}
+
+static int check_ring(const char *directory)
+{
+    char path[4000];
+    snprintf(path, sizeof(path), "%s/sniffcheck-ring.bin", directory);
+    remove(path);
+
+    uint64_t size = RING_STORE_DATA_START + RING_SEGMENTS * RING_SEGMENT_SIZE;
+    ring_test_t test = {0};
+    int failures = 0;
+    if (!ring_store_create(&test.ring, path, size, RING_SEGMENT_SIZE, sizeof(ring_record_t), ring_header,
+                           sizeof(ring_header)) || !test.ring.formatted) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    uint32_t capacity = test.ring.segment_capacity;
+
+    // Wrap several times, then lose the records appended after the last commit
+    bool written = ring_append(&test, 25 * capacity + 10, true) && ring_append(&test, capacity + 5, false);
+    ring_store_close(&test.ring);
+    if (!written || !ring_store_open(&test.ring, path)) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    failures += !ring_verify("power loss without a commit", &test.ring, test.committed_overwritten[0],
+                             test.committed[0], test.committed_overwritten[0]);
+    failures += test.committed_overwritten[0] == 0;
+    ring_store_close(&test.ring);
+
+    // The next boot finds the store and continues after the last committed record
+    test.sequence = test.committed[0];
+    test.overwritten = test.committed_overwritten[0];
+    if (!ring_store_create(&test.ring, path, size, RING_SEGMENT_SIZE, sizeof(ring_record_t), ring_header,
+                           sizeof(ring_header))) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    failures += test.ring.formatted;
+    written = ring_append(&test, 3 * capacity + 7, true) && ring_store_commit(&test.ring);
+    ring_committed(&test);
+    ring_store_close(&test.ring);
+    if (!written || !ring_store_open(&test.ring, path)) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    failures += !ring_verify("reopened after more appends", &test.ring, test.overwritten, test.sequence,
+                             test.overwritten);
+
+    // A torn write of the newest superblock copy
+    long slot = (long) (test.ring.superblock.generation % 2) * RING_STORE_SUPERBLOCK_SLOT;
+    uint8_t garbage[16];
+    memset(garbage, 0x5A, sizeof(garbage));
+    bool torn = fseek(test.ring.file, slot + 8, SEEK_SET) == 0 && fwrite(garbage, sizeof(garbage), 1, test.ring.file);
+    ring_store_close(&test.ring);
+    if (!torn || !ring_store_open(&test.ring, path)) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    failures += !ring_verify("torn superblock", &test.ring, test.committed_overwritten[1], test.committed[1],
+                             test.committed_overwritten[1]);
+
+    // After an upload only new records are pending
+    test.sequence = test.committed[1];
+    written = ring_store_release(&test.ring) && ring_store_pending(&test.ring) == 0;
+    uint64_t released = test.sequence;
+    written = written && ring_append(&test, capacity / 2, false) && ring_store_commit(&test.ring);
+    ring_store_close(&test.ring);
+    if (!written || !ring_store_open(&test.ring, path)) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    failures += !ring_verify("released", &test.ring, released, test.sequence, 0);
+    ring_store_close(&test.ring);
+
+    remove(path);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+typedef struct {
+    const char *name;
+    airtime_phy_t phy;          // sig_mode, rate, mcs, cwb, sgi
+    uint32_t length;            // PSDU bytes including FCS
+    uint32_t expected;          // µs
+} airtime_case_t;
+
+// TXTIME of IEEE 802.11-2020 15.3.4, 17.4.3 and 19.4.3 worked out by hand. ERP-OFDM and HT in 2.4 GHz add the
+// 6 µs signal extension.
+static const airtime_case_t airtime_cases[] = {
+        {"ACK, 1 Mbit/s",                 {0, 0x00, 0, 0, 0}, 14,   304},   // 192 + 14 * 8 / 1
+        {"ACK, 2 Mbit/s",                 {0, 0x01, 0, 0, 0}, 14,   248},   // 192 + 56
+        {"ACK, 2 Mbit/s short",           {0, 0x05, 0, 0, 0}, 14,   152},   // 96 + 56
+        {"ACK, 11 Mbit/s short",          {0, 0x07, 0, 0, 0}, 14,   107},   // 96 + ceil(112 / 11)
+        {"1500 B, 5.5 Mbit/s",            {0, 0x02, 0, 0, 0}, 1500, 2374},  // 192 + ceil(12000 / 5.5)
+        {"1500 B, 11 Mbit/s",             {0, 0x03, 0, 0, 0}, 1500, 1283},  // 192 + ceil(12000 / 11)
+        {"ACK, 6 Mbit/s",                 {0, 0x0B, 0, 0, 0}, 14,   50},    // 20 + 4 * 6 symbols + 6
+        {"ACK, 24 Mbit/s",                {0, 0x09, 0, 0, 0}, 14,   34},    // 20 + 4 * 2 + 6
+        {"1500 B, 54 Mbit/s",             {0, 0x0C, 0, 0, 0}, 1500, 250},   // 20 + 4 * 56 + 6
+        {"1500 B, 9 Mbit/s",              {0, 0x0F, 0, 0, 0}, 1500, 1362},  // 20 + 4 * 334 + 6
+        {"ACK, MCS 0",                    {1, 0, 0, 0, 0},    14,   66},    // 36 + 4 * 6 + 6
+        {"1500 B, MCS 7",                 {1, 0, 7, 0, 0},    1500, 230},   // 36 + 4 * 47 + 6
+        {"1500 B, MCS 7 SGI",             {1, 0, 7, 0, 1},    1500, 214},   // 36 + 4 * ceil(47 * 0.9) + 6
+        {"1500 B, MCS 7 40 MHz",          {1, 0, 7, 1, 0},    1500, 134},   // 36 + 4 * 23 + 6
+        {"1500 B, MCS 15 40 MHz SGI",     {1, 0, 15, 1, 1},   1500, 90},    // 40 + 4 * ceil(12 * 0.9) + 6
+        {"1500 B, MCS 8",                 {1, 0, 8, 0, 0},    1500, 974},   // 40 + 4 * 232 + 6
+        {"unknown DSSS rate",             {0, 0x04, 0, 0, 0}, 14,   0},
+        {"3 streams",                     {1, 0, 16, 0, 0},   14,   0},
+};
+
+static int check_airtime(void)
+{
+    int failures = 0;
+    size_t count = sizeof(airtime_cases) / sizeof(airtime_cases[0]);
+    for (size_t i = 0; i < count; i++) {
+        const airtime_case_t *test = &airtime_cases[i];
+        uint32_t estimate = airtime_estimate_us(&test->phy, test->length);
+        if (estimate != test->expected) {
+            printf("%-32s %5" PRIu32 " us, expected %5" PRIu32 " us  FAIL\n", test->name, estimate, test->expected);
+            failures++;
+        }
+    }
+    printf("%zu TXTIME cases, %d failed\n", count, failures);
+
+    enum { ESTIMATES = 1 << 24 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < ESTIMATES; i++) {
+        total += airtime_estimate_us(&airtime_cases[i % count].phy, 14 + i % 1500);
+    }
+    double seconds = seconds_since(&start);
+    sink = total;
+    printf("airtime_estimate_us: %.1f ns per frame\n", seconds / ESTIMATES * 1e9);
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+static int compare_uint32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+// Every value maps to a bucket whose range holds it, buckets follow each other without gaps
+static int latency_edges(void)
+{
+    int failures = 0;
+    uint32_t previous = 0;
+    for (uint32_t value = 0; value < (1u << 27); value++) {
+        uint32_t bucket = latency_bucket_of(value);
+        uint32_t limit = latency_bucket_limit(bucket);
+        bool first = value == 0 || bucket != previous;
+        if (bucket >= LATENCY_BUCKETS || value > limit || (value > 0 && bucket != previous && bucket != previous + 1)) {
+            if (failures++ < 8) {
+                printf("value %" PRIu32 ": bucket %" PRIu32 ", upper edge %" PRIu32 "  FAIL\n", value, bucket, limit);
+            }
+        }
+        // The first value of a bucket is its lower edge, the bucket may be 12.5 % of it wide
+        if (first && bucket < LATENCY_BUCKETS - 1 && value >= LATENCY_SUB_BUCKETS &&
+            (uint64_t) (limit - value + 1) * 8 > value) {
+            if (failures++ < 8) {
+                printf("bucket %" PRIu32 ": %" PRIu32 " to %" PRIu32 " us is too wide  FAIL\n", bucket, value, limit);
+            }
+        }
+        previous = bucket;
+    }
+    if (latency_bucket_of(UINT32_MAX) != LATENCY_BUCKETS - 1 || latency_bucket_limit(LATENCY_BUCKETS - 1) != UINT32_MAX) {
+        printf("latencies beyond the last edge are not in the open last bucket  FAIL\n");
+        failures++;
+    }
+    printf("%d buckets, %s\n", LATENCY_BUCKETS, failures ? "edges FAILED" : "edges contiguous and within 12.5 %");
+    return failures;
+}
+
+// Histogram percentile of `latencies` against the exact one
+static int latency_compare(const char *name, uint32_t *latencies, uint32_t count)
+{
+    static latency_histogram_t histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    for (uint32_t i = 0; i < count; i++) {
+        latency_histogram_add(&histogram, latencies[i], 1);
+    }
+    qsort(latencies, count, sizeof(uint32_t), compare_uint32);
+
+    int failures = 0;
+    const uint32_t permilles[] = {500, 990};
+    for (int i = 0; i < 2; i++) {
+        uint32_t exact = latencies[((uint64_t) count * permilles[i] + 999) / 1000 - 1];
+        uint32_t reported = latency_histogram_percentile(&histogram, permilles[i]);
+        uint32_t limit = latency_bucket_limit(latency_bucket_of(exact));
+        bool ok = reported >= exact && reported <= limit && reported <= latencies[count - 1];
+        failures += !ok;
+        printf("%-22s p%-2u exact %9" PRIu32 " us, reported %9" PRIu32 " us (%+.1f %%)%s\n", name,
+               permilles[i] / 10, exact, reported, ((double) reported / exact - 1.0) * 100.0, ok ? "" : "  FAIL");
+    }
+    failures += histogram.max != latencies[count - 1] || histogram.count != count;
+    return failures;
+}
+
+static int check_latency(uint32_t count)
+{
+    int failures = latency_edges();
+
+    uint32_t *latencies = malloc(count * sizeof(uint32_t));
+    if (latencies == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        return 1;
+    }
+
+    // Writer latency: log-normal around 2 ms, 2 % slow writes around 40 ms, 0.2 % card stalls up to 1.5 s
+    for (uint32_t i = 0; i < count; i++) {
+        double u1 = ((double) (random_next() >> 11) + 0.5) / 9007199254740992.0;
+        double u2 = (double) (random_next() >> 11) / 9007199254740992.0;
+        double normal = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        uint32_t choice = (uint32_t) (random_next() % 1000);
+        double median = choice < 2 ? 400000.0 : choice < 22 ? 40000.0 : 2000.0;
+        double latency = median * exp(0.6 * normal);
+        latencies[i] = latency < 1500000.0 ? (uint32_t) latency : 1500000;
+    }
+    failures += latency_compare("writer", latencies, count);
+
+    // Small values get exact buckets
+    for (uint32_t i = 0; i < count; i++) {
+        latencies[i] = (uint32_t) (random_next() % 12);
+    }
+    failures += latency_compare("below 12 us", latencies, count);
+
+    // Every latency beyond the last bucket edge must not be reported lower than it was
+    for (uint32_t i = 0; i < count; i++) {
+        latencies[i] = 70000000u + (uint32_t) (random_next() % 100000000u);
+    }
+    failures += latency_compare("70 to 170 s", latencies, count);
+
+    // Overhead of recording in the writer path and of a report
+    static latency_histogram_t histogram;
+    memset(&histogram, 0, sizeof(histogram));
+    enum { RECORDS = 1 << 24, QUERIES = 1 << 16 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < RECORDS; i++) {
+        latency_histogram_add(&histogram, (uint32_t) (i * 2654435761u) >> 10, 1);
+    }
+    double adding = seconds_since(&start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < QUERIES; i++) {
+        histogram.count += i & 1;
+        total += latency_histogram_percentile(&histogram, 990);
+    }
+    double querying = seconds_since(&start);
+    sink = total + histogram.buckets[0];
+    printf("latency_histogram_add: %.1f ns per record, percentile: %.0f ns per query, %zu bytes per histogram\n",
+           adding / RECORDS * 1e9, querying / QUERIES * 1e9, sizeof(latency_histogram_t));
+
+    free(latencies);
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+typedef struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+    size_t element;
+} format_field_t;
+
+#define FORMAT_FIELD(record, type, name, dimension) \
+    {#name, offsetof(record, name), sizeof(((record *) 0)->name), sizeof(type)},
+
+static const format_field_t captured_packet_fields[] = {CAPTURED_PACKET_FIELDS(FORMAT_FIELD)};
+static const format_field_t csi_packet_fields[] = {CSI_PACKET_FIELDS(FORMAT_FIELD)};
+static const format_field_t joined_packet_fields[] = {JOINED_PACKET_FIELDS(FORMAT_FIELD)};
+static const format_field_t l2_dict_frame_fields[] = {L2_DICT_FRAME_FIELDS(FORMAT_FIELD)};
+static const format_field_t projected_packet_fields[] = {PROJECTED_PACKET_FIELDS(FORMAT_FIELD)};
+static const format_field_t file_header_fields[] = {FILE_HEADER_FIELDS(FORMAT_FIELD)};
+
+#define FORMAT_LAYOUT(record, fields, start, expected) \
+    {#record, fields, sizeof(fields) / sizeof(fields[0]), start, sizeof(record), expected}
+
+// On-card sizes; a change here is a format change and needs a version bump in CAPTURE_FORMATS
+static const struct {
+    const char *record;
+    const format_field_t *fields;
+    size_t count;
+    size_t start;       // Offset of the first field of the list
+    size_t size;
+    size_t expected;
+} format_layouts[] = {
+        FORMAT_LAYOUT(captured_packet_t, captured_packet_fields, 0, 180),
+        FORMAT_LAYOUT(csi_packet_t, csi_packet_fields, 0, 146),
+        FORMAT_LAYOUT(joined_packet_t, joined_packet_fields, sizeof(captured_packet_t), 310),
+        FORMAT_LAYOUT(l2_dict_frame_t, l2_dict_frame_fields, 0, 16),
+        FORMAT_LAYOUT(projected_packet_t, projected_packet_fields, 0, 11),
+        FORMAT_LAYOUT(file_header_t, file_header_fields, 0, 28),
+};
+
+#define FORMAT_RECORD_SIZE(format, identifier, version, oldest, record) sizeof(record),
+static const size_t format_record_sizes[] = {CAPTURE_FORMATS(FORMAT_RECORD_SIZE)};
+
+#define FORMAT_PROJECTION(field, bit, offset, size) {#field, bit, offset, size},
+static const struct {
+    const char *name;
+    uint32_t bit;
+    uint32_t offset;
+    uint32_t size;
+} format_projection[] = {PROJECTION_FIELDS(FORMAT_PROJECTION)};
+
+static int format_layout(void)
+{
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(format_layouts) / sizeof(format_layouts[0]); i++) {
+        size_t next = format_layouts[i].start;
+        for (size_t f = 0; f < format_layouts[i].count; f++) {
+            const format_field_t *field = &format_layouts[i].fields[f];
+            if (field->offset != next || field->size % field->element != 0) {
+                printf("%s.%s at %zu, expected %zu  FAIL\n", format_layouts[i].record, field->name, field->offset,
+                       next);
+                failures++;
+            }
+            next = field->offset + field->size;
+        }
+        bool ok = next == format_layouts[i].size && format_layouts[i].size == format_layouts[i].expected;
+        failures += !ok;
+        printf("%-20s %2zu fields, %3zu bytes%s\n", format_layouts[i].record, format_layouts[i].count,
+               format_layouts[i].size, ok ? "" : "  FAIL");
+    }
+
+    for (int format = 0; format < CAPTURE_FORMAT_COUNT; format++) {
+        const capture_format_info_t *info = capture_format_info((capture_format_t) format);
+        if (info->record_size != format_record_sizes[format] || capture_format_find(info->identifier) != (capture_format_t) format ||
+            info->oldest > info->version) {
+            printf("format %s: record size %" PRIu32 ", versions %" PRIu32 "-%" PRIu32 "  FAIL\n", info->identifier,
+                   info->record_size, info->oldest, info->version);
+            failures++;
+        }
+    }
+
+    // Projection fields come in the order of their bits and lie within the 24-byte MAC header
+    uint32_t total = 0;
+    for (size_t i = 0; i < sizeof(format_projection) / sizeof(format_projection[0]); i++) {
+        if (format_projection[i].bit != i || format_projection[i].offset + format_projection[i].size > 24) {
+            printf("projection field %s: bit %" PRIu32 ", bytes %" PRIu32 "-%" PRIu32 "  FAIL\n",
+                   format_projection[i].name, format_projection[i].bit, format_projection[i].offset,
+                   format_projection[i].offset + format_projection[i].size - 1);
+            failures++;
+        }
+        total += format_projection[i].size;
+        if (projection_record_size(1u << i) != sizeof(projected_packet_t) + format_projection[i].size) {
+            failures++;
+        }
+    }
+    if (PROJECTION_MAX_RECORD_SIZE != sizeof(projected_packet_t) + total ||
+        projection_record_size(UINT32_MAX) != PROJECTION_MAX_RECORD_SIZE) {
+        printf("projected record size %zu, expected %zu  FAIL\n", PROJECTION_MAX_RECORD_SIZE,
+               sizeof(projected_packet_t) + total);
+        failures++;
+    }
+    return failures;
+}
+
+static void format_random(void *record, size_t size)
+{
+    uint8_t *bytes = record;
+    for (size_t i = 0; i < size; i++) {
+        bytes[i] = (uint8_t) random_next();
+    }
+}
+
+// Write `count` records of `size` bytes from `records` behind the header of `format`
+static bool format_write(const char *path, capture_format_t format, uint32_t schema, const void *records,
+                         size_t size, uint32_t count, file_header_t *header)
+{
+    const capture_format_info_t *info = capture_format_info(format);
+    memset(header, 0, sizeof(*header));
+    memcpy(header->identifier, info->identifier, 4);
+    header->version = info->version;
+    header->start_time = 1700000000 + random_next() % 100000000;
+    format_random(header->wifi_mac, 6);
+    format_random(header->bt_mac, 6);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(header, sizeof(*header), 1, file) == 1 &&
+              (schema == 0 || fwrite(&schema, sizeof(schema), 1, file) == 1) &&
+              fwrite(records, size, count, file) == count;
+    return fclose(file) == 0 && ok;
+}
+
+// A projected record decodes to its fields at their place in an otherwise empty MAC header
+static bool format_projected_equal(uint32_t schema, const uint8_t *record, const uint8_t *original_header,
+                                   uint32_t header_len, const captured_packet_t *decoded)
+{
+    projected_packet_t projected;
+    memcpy(&projected, record, sizeof(projected));
+    bool equal = decoded->timestamp == projected.timestamp && decoded->rssi == projected.rssi &&
+                 decoded->channel == projected.channel && decoded->payload_len == 0 &&
+                 (decoded->frame_type << 4 | decoded->frame_subtype) == projected.frame_type;
+    static const uint8_t zero[24];
+    for (size_t i = 0; i < sizeof(format_projection) / sizeof(format_projection[0]); i++) {
+        uint32_t offset = format_projection[i].offset;
+        uint32_t size = format_projection[i].size;
+        if (schema & (1u << format_projection[i].bit)) {
+            const uint8_t *expected = offset + size <= header_len ? original_header + offset : zero;
+            equal = equal && memcmp(decoded->header + offset, expected, size) == 0;
+        }
+    }
+    return equal;
+}
+
+// Read the file back and count the records that differ from what was written
+static int64_t format_read(const char *path, capture_format_t format, uint32_t schema, const uint8_t *records,
+                           size_t size, const uint8_t *headers, const uint32_t *header_lens, uint32_t count,
+                           const file_header_t *header, double *seconds)
+{
+    capture_reader_t reader;
+    if (capture_reader_open(&reader, path) != 0) {
+        return -1;
+    }
+    int64_t differing = memcmp(&reader.header, header, sizeof(*header)) != 0 || reader.format != format ||
+                        reader.schema != schema || reader.record_size != size;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    static capture_record_t record;
+    uint32_t read = 0;
+    while (capture_reader_next(&reader, &record) == 1) {
+        const uint8_t *written = records + (size_t) read * size;
+        bool equal;
+        if (format == CAPTURE_FORMAT_L2_PROJECTED) {
+            equal = format_projected_equal(schema, written, headers + (size_t) read * 24, header_lens[read],
+                                           &record.l2);
+        } else if (format == CAPTURE_FORMAT_CSI) {
+            equal = memcmp(&record.csi, written, size) == 0;
+        } else {
+            equal = memcmp(&record.joined, written, size) == 0;
+        }
+        differing += !equal;
+        read++;
+    }
+    *seconds = seconds_since(&start);
+    capture_reader_close(&reader);
+    return differing + (read != count ? count : 0);
+}
+
+static int format_round_trip(const char *directory, capture_format_t format, uint32_t schema, uint32_t count)
+{
+    const capture_format_info_t *info = capture_format_info(format);
+    size_t size = schema ? projection_record_size(schema) : info->record_size;
+    uint8_t *records = malloc((size_t) count * size);
+    uint8_t *headers = malloc((size_t) count * 24);
+    uint32_t *header_lens = malloc((size_t) count * sizeof(uint32_t));
+    if (records == NULL || headers == NULL || header_lens == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        free(records);
+        free(headers);
+        free(header_lens);
+        return 1;
+    }
+
+    format_random(records, (size_t) count * size);
+    if (schema) {
+        // Encode like the firmware, with headers as short as control frames so some fields are zero filled
+        format_random(headers, (size_t) count * 24);
+        for (uint32_t i = 0; i < count; i++) {
+            projected_packet_t *record = (projected_packet_t *) (records + (size_t) i * size);
+            record->frame_type &= 0x3F;
+            header_lens[i] = 10 + (uint32_t) (random_next() % 15);
+            projection_encode(schema, headers + (size_t) i * 24, header_lens[i], (uint8_t *) (record + 1));
+        }
+    }
+
+    char path[4000];
+    snprintf(path, sizeof(path), "%s/sniffcheck-format.bin", directory);
+    file_header_t header;
+    double seconds = 0;
+    int64_t differing = format_write(path, format, schema, records, size, count, &header) ?
+                        format_read(path, format, schema, records, size, headers, header_lens, count, &header,
+                                    &seconds) : -1;
+    remove(path);
+    free(records);
+    free(headers);
+    free(header_lens);
+    if (differing < 0) {
+        fprintf(stderr, "sniffcheck: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    printf("%s v%" PRIu32 " schema %02" PRIX32 ": %3zu bytes, %" PRId64 " of %" PRIu32 " records differ, "
+           "decoded in %.0f ns per record%s\n", info->identifier, info->version, schema, size, differing, count,
+           seconds / count * 1e9, differing ? "  FAIL" : "");
+    return differing > 0;
+}
+
+// Runtime schema for the encoder benchmark, so the compiler cannot fold it
+static volatile uint32_t format_runtime_schema = PROJECTION_FIELD_SEQUENCE | PROJECTION_FIELD_ADDR2;
+
+#define FORMAT_BENCH_FRAMES 4096
+#define FORMAT_BENCH_ENCODES (1 << 22)
+#define FORMAT_BENCH_RUNS 5
+#define FORMAT_BENCH_NOISE 1.05     // Timing noise between equal encoders, best of runs on a loaded machine
+
+// The per-field projection l2_sniffer.c had before the field table, from the parsed header
+static uint8_t *format_project_address(uint8_t *field, const uint8_t *address)
+{
+    if (address) {
+        memcpy(field, address, 6);
+    } else {
+        memset(field, 0, 6);
+    }
+    return field + 6;
+}
+
+static void format_project_by_hand(uint32_t schema, const dot11_header_t *header, uint8_t *field)
+{
+    if (schema & PROJECTION_FIELD_FLAGS) {
+        *field++ = header->flags;
+    }
+    if (schema & PROJECTION_FIELD_DURATION) {
+        memcpy(field, &header->duration, 2);
+        field += 2;
+    }
+    if (schema & PROJECTION_FIELD_SEQUENCE) {
+        memcpy(field, &header->sequence_control, 2);
+        field += 2;
+    }
+    if (schema & PROJECTION_FIELD_ADDR1) {
+        field = format_project_address(field, header->addr1);
+    }
+    if (schema & PROJECTION_FIELD_ADDR2) {
+        field = format_project_address(field, header->addr2);
+    }
+    if (schema & PROJECTION_FIELD_ADDR3) {
+        format_project_address(field, header->addr3);
+    }
+}
+
+typedef enum {
+    FORMAT_ENCODE_RAW,           // Hand-written memcpy fill of captured_packet_t, as copy_packet does
+    FORMAT_ENCODE_BY_HAND,       // Projected record, fields copied one by one from the parsed header
+    FORMAT_ENCODE_GENERATED,     // Projected record, projection_encode with the schema known at compile time
+    FORMAT_ENCODE_RUNTIME,       // Projected record, projection_encode with the schema known at run time
+    FORMAT_ENCODE_COUNT,
+} format_encoder_t;
+
+// Seconds per record of one run of an encoder
+static double format_encode_time(format_encoder_t encoder, uint8_t frames[][64], const dot11_header_t *headers)
+{
+    static captured_packet_t packet;
+    static uint8_t projected[PROJECTION_MAX_RECORD_SIZE];
+    projected_packet_t *fixed = (projected_packet_t *) projected;
+    uint32_t schema = format_runtime_schema;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < FORMAT_BENCH_ENCODES; i++) {
+        const uint8_t *frame = frames[i % FORMAT_BENCH_FRAMES];
+        if (encoder == FORMAT_ENCODE_RAW) {
+            packet.timestamp = i;
+            packet.frame_type = frame[0] >> 2 & 0x03;
+            packet.frame_subtype = frame[0] >> 4;
+            packet.rssi = (int8_t) frame[1];
+            packet.channel = 6;
+            packet.header_len = 24;
+            memcpy(packet.header, frame, 24);
+            packet.payload_len = 40;
+            memcpy(packet.payload, frame + 24, 40);
+            sink += packet.header[i % 24];
+            continue;
+        }
+        fixed->timestamp = i;
+        fixed->frame_type = (uint8_t) ((frame[0] & 0x0C) << 2 | frame[0] >> 4);
+        fixed->rssi = (int8_t) frame[1];
+        fixed->channel = 6;
+        uint8_t *fields = projected + sizeof(projected_packet_t);
+        if (encoder == FORMAT_ENCODE_BY_HAND) {
+            format_project_by_hand(PROJECTION_FIELD_SEQUENCE | PROJECTION_FIELD_ADDR2,
+                                   &headers[i % FORMAT_BENCH_FRAMES], fields);
+        } else if (encoder == FORMAT_ENCODE_GENERATED) {
+            projection_encode(PROJECTION_FIELD_SEQUENCE | PROJECTION_FIELD_ADDR2, frame, 24, fields);
+        } else {
+            projection_encode(schema, frame, 24, fields);
+        }
+        sink += projected[i % 8] + fields[i % 8];
+    }
+    return seconds_since(&start) / FORMAT_BENCH_ENCODES;
+}
+
+// Times the encoders of the firmware write path against the hand-written ones they replaced. Returns the failures:
+// the generated projection may be no slower than the memcpy fill of the raw record or the per-field projection,
+// within FORMAT_BENCH_NOISE.
+static int format_bench(void)
+{
+    static uint8_t frames[FORMAT_BENCH_FRAMES][64];
+    static dot11_header_t headers[FORMAT_BENCH_FRAMES];
+    format_random(frames, sizeof(frames));
+    for (int i = 0; i < FORMAT_BENCH_FRAMES; i++) {
+        frames[i][0] = (uint8_t) (DOT11_SUBTYPE_PROBE_REQ << 4);
+        frames[i][1] = 0;
+        dot11_parse_header(frames[i], sizeof(frames[i]), &headers[i]);
+    }
+
+    // Best of interleaved runs, so a slow phase of the machine does not fall on one encoder only
+    double seconds[FORMAT_ENCODE_COUNT];
+    for (int run = 0; run < FORMAT_BENCH_RUNS; run++) {
+        for (int encoder = 0; encoder < FORMAT_ENCODE_COUNT; encoder++) {
+            double time = format_encode_time((format_encoder_t) encoder, frames, headers);
+            if (run == 0 || time < seconds[encoder]) {
+                seconds[encoder] = time;
+            }
+        }
+    }
+
+    double raw_ratio = seconds[FORMAT_ENCODE_GENERATED] / seconds[FORMAT_ENCODE_RAW];
+    double hand_ratio = seconds[FORMAT_ENCODE_GENERATED] / seconds[FORMAT_ENCODE_BY_HAND];
+    printf("encode: raw record memcpy fill %.1f ns, projection (sequence, addr2) by hand %.1f ns, generated %.1f ns "
+           "(%.1f ns with the schema known at run time)\n", seconds[FORMAT_ENCODE_RAW] * 1e9,
+           seconds[FORMAT_ENCODE_BY_HAND] * 1e9, seconds[FORMAT_ENCODE_GENERATED] * 1e9,
+           seconds[FORMAT_ENCODE_RUNTIME] * 1e9);
+    printf("generated encoder: %.2fx the time of the memcpy fill%s, %.2fx the time of the projection by hand%s\n",
+           raw_ratio, raw_ratio <= FORMAT_BENCH_NOISE ? "" : "  FAIL", hand_ratio,
+           hand_ratio <= FORMAT_BENCH_NOISE ? "" : "  FAIL");
+    return (raw_ratio > FORMAT_BENCH_NOISE) + (hand_ratio > FORMAT_BENCH_NOISE);
+}
+
+static int check_format(const char *directory, uint32_t count)
+{
+    int failures = format_layout();
+    failures += format_round_trip(directory, CAPTURE_FORMAT_L2_RAW, 0, count);
+    failures += format_round_trip(directory, CAPTURE_FORMAT_CSI, 0, count);
+    failures += format_round_trip(directory, CAPTURE_FORMAT_JOINED, 0, count);
+    failures += format_round_trip(directory, CAPTURE_FORMAT_L2_PROJECTED, UINT32_MAX >> (32 - 6), count);
+    failures += format_round_trip(directory, CAPTURE_FORMAT_L2_PROJECTED,
+                                  PROJECTION_FIELD_SEQUENCE | PROJECTION_FIELD_ADDR2, count);
+    failures += format_bench();
+
+    printf("%s\n", failures ? "FAILED" : "ok");
+    return failures > 0;
+}
+
+#define BEACON_INTERVAL_US 102400
+#define BEACON_WINDOW_US 60000000ull    // CONFIG_SNIFFER_BEACON_WINDOW
+#define BEACON_TABLE_SIZE 128           // CONFIG_SNIFFER_BEACON_TABLE_SIZE
+#define BEACON_DWELL_US 1000000ull      // CONFIG_SNIFFER_CHANNEL_HOP_INTERVAL
+#define BEACON_MAX_LEN 256
+
+typedef struct {
+    uint8_t frame[BEACON_MAX_LEN];
+    uint32_t len;
+    uint32_t phase;                     // µs within the beacon interval
+    uint8_t channel;
+    int8_t rssi;
+    uint32_t tim;                       // Offsets of the TIM and BSS load elements in the frame
+    uint32_t bss_load;
+    uint32_t ht_operation;              // Offset of the HT operation element, changed on reconfiguration
+    uint32_t version;                   // Configuration, bumped on every change of the IEs
+    uint32_t heard_version;             // Configuration of the last beacon heard in the current window
+    uint64_t heard_window;              // Window of that beacon, plus one (0: none heard yet)
+} beacon_ap_t;
+
+static uint32_t beacon_element(uint8_t *frame, uint32_t offset, uint8_t id, uint8_t len)
+{
+    frame[offset] = id;
+    frame[offset + 1] = len;
+    for (uint32_t i = 0; i < len; i++) {
+        frame[offset + 2 + i] = (uint8_t) random_next();
+    }
+    return offset + 2 + len;
+}
+
+// Beacon frame of an AP: MAC header, fixed fields, SSID, rates, DS parameter, TIM, country, BSS load, HT
+// capabilities, HT operation and WMM, then the FCS
+static void beacon_build(beacon_ap_t *ap, uint32_t index)
+{
+    uint8_t *frame = ap->frame;
+    memset(frame, 0, sizeof(ap->frame));
+    frame[0] = DOT11_SUBTYPE_BEACON << 4;
+    memset(frame + 4, 0xFF, 6);
+    random_mac(frame + 10);
+    frame[10] = 0x02;
+    frame[11] = (uint8_t) (index >> 8);
+    frame[12] = (uint8_t) index;
+    memcpy(frame + 16, frame + 10, 6);
+    uint32_t offset = DOT11_MGMT_HEADER_LEN + 12;
+    offset = beacon_element(frame, offset, 0, (uint8_t) (6 + random_next() % 20));
+    offset = beacon_element(frame, offset, 1, 8);
+    offset = beacon_element(frame, offset, 3, 1);
+    frame[offset - 1] = ap->channel;
+    ap->tim = offset;
+    offset = beacon_element(frame, offset, 5, 4);
+    offset = beacon_element(frame, offset, 7, 6);
+    ap->bss_load = offset;
+    offset = beacon_element(frame, offset, 11, 5);
+    offset = beacon_element(frame, offset, 45, 26);
+    ap->ht_operation = offset;
+    offset = beacon_element(frame, offset, 61, 22);
+    offset = beacon_element(frame, offset, 221, 24);
+    ap->len = offset + DOT11_FCS_LEN;
+}
+
+static int compare_beacon_phase(const void *a, const void *b)
+{
+    const beacon_ap_t *x = a;
+    const beacon_ap_t *y = b;
+    return (x->phase > y->phase) - (x->phase < y->phase);
+}
+
+typedef struct {
+    uint64_t heard;
+    uint64_t kept;
+    uint64_t untracked;
+    uint64_t summary_bytes;
+    uint64_t windows;
+    uint64_t aggregated;               // Beacons in the aggregates
+    uint64_t aggregated_stored;
+    int failures;
+} beacon_result_t;
+
+static void beacon_window_end(beacon_window_t *window, beacon_aggregate_t *aggregates, beacon_result_t *result,
+                              uint64_t heard, uint64_t kept)
+{
+    uint16_t count = beacon_window_aggregate(window, aggregates);
+    uint64_t beacons = 0;
+    uint64_t stored = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        beacons += aggregates[i].beacons;
+        stored += aggregates[i].stored;
+    }
+    // Every beacon heard is in an aggregate or untracked, and so is every beacon kept
+    if (beacons + window->untracked != heard || stored + window->untracked != kept) {
+        if (result->failures++ < 8) {
+            printf("window %" PRIu64 ": %" PRIu64 " beacons aggregated + %" PRIu32 " untracked, %" PRIu64
+                   " heard  FAIL\n", result->windows, beacons, window->untracked, heard);
+        }
+    }
+    result->aggregated += beacons;
+    result->aggregated_stored += stored;
+    result->summary_bytes += sizeof(summary_record_header_t) + sizeof(beacon_summary_t) +
+                             count * sizeof(beacon_aggregate_t);
+    result->windows++;
+}
+
+static int check_beacon(uint32_t count, uint32_t minutes)
+{
+    beacon_ap_t *aps = calloc(count, sizeof(beacon_ap_t));
+    beacon_entry_t *entries = calloc(BEACON_TABLE_SIZE, sizeof(beacon_entry_t));
+    beacon_aggregate_t *aggregates = calloc(BEACON_TABLE_SIZE, sizeof(beacon_aggregate_t));
+    if (aps == NULL || entries == NULL || aggregates == NULL) {
+        fprintf(stderr, "sniffcheck: out of memory\n");
+        free(aps);
+        free(entries);
+        free(aggregates);
+        return 1;
+    }
+
+    static const uint8_t common_channels[3] = {1, 6, 11};
+    for (uint32_t i = 0; i < count; i++) {
+        beacon_ap_t *ap = &aps[i];
+        ap->channel = random_next() % 10 < 7 ? common_channels[random_next() % 3] : (uint8_t) (1 + random_next() % 13);
+        ap->rssi = (int8_t) (-40 - (int) (random_next() % 50));
+        ap->phase = (uint32_t) (random_next() % BEACON_INTERVAL_US);
+        beacon_build(ap, i);
+    }
+    qsort(aps, count, sizeof(beacon_ap_t), compare_beacon_phase);
+
+    beacon_window_t window;
+    beacon_window_setup(&window, entries, BEACON_TABLE_SIZE, 0);
+    beacon_result_t result = {0};
+    uint64_t window_heard = 0;
+    uint64_t window_kept = 0;
+    uint64_t current = 0;
+
+    uint64_t duration = (uint64_t) minutes * 60000000ull;
+    for (uint64_t interval = 0; interval * BEACON_INTERVAL_US < duration; interval++) {
+        for (uint32_t i = 0; i < count; i++) {
+            beacon_ap_t *ap = &aps[i];
+            uint64_t t = interval * BEACON_INTERVAL_US + ap->phase;
+
+            // Every beacon: DTIM count, traffic bitmap, station count and utilisation; rarely a reconfiguration
+            ap->frame[ap->tim + 2] = (uint8_t) (interval % 3);
+            ap->frame[ap->tim + 5] = (uint8_t) random_next();
+            ap->frame[ap->bss_load + 2] = (uint8_t) random_next();
+            ap->frame[ap->bss_load + 4] = (uint8_t) random_next();
+            if (random_next() % (1800000000ull / BEACON_INTERVAL_US) == 0) {
+                ap->frame[ap->ht_operation + 3] ^= (uint8_t) (1 + random_next() % 255);
+                ap->version++;
+            }
+
+            uint8_t dwell = (uint8_t) (t / BEACON_DWELL_US % 13 + 1);
+            if (ap->channel != dwell || random_next() % 10 == 0) {
+                continue;
+            }
+
+            uint64_t window_index = t / BEACON_WINDOW_US;
+            if (window_index != current) {
+                beacon_window_end(&window, aggregates, &result, window_heard, window_kept);
+                beacon_window_reset(&window, window_index * BEACON_WINDOW_US / 1000);
+                current = window_index;
+                window_heard = 0;
+                window_kept = 0;
+            }
+
+            bool expected = ap->heard_window != window_index + 1 || ap->heard_version != ap->version;
+            ap->heard_window = window_index + 1;
+            ap->heard_version = ap->version;
+            uint32_t untracked = window.untracked;
+
+            bool keep = beacon_window_keep(&window, ap->frame, ap->len, ap->rssi, ap->channel);
+
+            bool tracked = window.untracked == untracked;
+            if (keep != expected && (tracked || !keep)) {
+                if (result.failures++ < 8) {
+                    printf("beacon of AP %" PRIu32 " at %.1f s: %s, expected %s  FAIL\n", i, (double) t / 1e6,
+                           keep ? "kept" : "summarised", expected ? "kept" : "summarised");
+                }
+            }
+            result.heard++;
+            result.kept += keep;
+            result.untracked += !tracked;
+            window_heard++;
+            window_kept += keep;
+        }
+    }
+    beacon_window_end(&window, aggregates, &result, window_heard, window_kept);
+
+    // Cost per beacon in the L2 callback, with the whole population in one window
+    enum { KEEPS = 1 << 22 };
+    beacon_window_reset(&window, 0);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t i = 0; i < KEEPS; i++) {
+        const beacon_ap_t *ap = &aps[i % count];
+        sink += beacon_window_keep(&window, ap->frame, ap->len, ap->rssi, ap->channel);
+    }
+    double keeping = seconds_since(&start);
+
+    uint64_t without = result.heard * sizeof(captured_packet_t);
+    uint64_t with = result.kept * sizeof(captured_packet_t) + result.summary_bytes;
+    printf("%" PRIu32 " APs, %" PRIu32 " min: %" PRIu64 " beacons heard, %" PRIu64 " kept (%" PRIu64
+           " untracked), %" PRIu64 " windows\n", count, minutes, result.heard, result.kept, result.untracked,
+           result.windows);
+    printf("raw L2 records: %.2f MB without the tracker, %.2f MB with it (%.3f MB summary), %.1f %% less\n",
+           without / 1e6, with / 1e6, result.summary_bytes / 1e6, (1.0 - (double) with / without) * 100.0);
+    printf("beacon_window_keep: %.0f ns per beacon\n", keeping / KEEPS * 1e9);
+
+    free(aps);
+    free(entries);
+    free(aggregates);
+    printf("%s\n", result.failures ? "FAILED" : "ok");
+    return result.failures > 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "hll") == 0 && argc <= 4) {
+        int precision = argc > 2 ? atoi(argv[2]) : 10;
+        int trials = argc > 3 ? atoi(argv[3]) : 64;
+        if (precision < 4 || precision > 14 || trials < 1) {
+            fprintf(stderr, "sniffcheck: precision must be 4 to 14 and trials at least 1\n");
+            return 1;
+        }
+        return check_hll(precision, trials);
+    }
+    if (argc == 2 && strcmp(argv[1], "dot11") == 0) {
+        return check_dot11();
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "dedup") == 0) {
+        uint32_t cache_size = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 256;
+        if (cache_size < 1) {
+            fprintf(stderr, "sniffcheck: the cache needs at least one entry\n");
+            return 1;
+        }
+        return check_dedup(cache_size);
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "shed") == 0) {
+        int seconds = argc > 2 ? atoi(argv[2]) : 600;
+        if (seconds < 1) {
+            fprintf(stderr, "sniffcheck: simulate at least one second\n");
+            return 1;
+        }
+        return check_shed(seconds);
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "rate") == 0) {
+        int seconds = argc > 2 ? atoi(argv[2]) : 60;
+        if (seconds < 1) {
+            fprintf(stderr, "sniffcheck: simulate at least one second\n");
+            return 1;
+        }
+        return check_rate(seconds);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "digest") == 0) {
+        uint32_t count = argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : 1000000;
+        if (count < 1) {
+            fprintf(stderr, "sniffcheck: write at least one record\n");
+            return 1;
+        }
+        return check_digest(argv[2], count);
+    }
+    if (argc == 3 && strcmp(argv[1], "ring") == 0) {
+        return check_ring(argv[2]);
+    }
+    if (argc == 2 && strcmp(argv[1], "airtime") == 0) {
+        return check_airtime();
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "latency") == 0) {
+        uint32_t count = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 1000000;
+        if (count < 1000) {
+            fprintf(stderr, "sniffcheck: record at least 1000 latencies\n");
+            return 1;
+        }
+        return check_latency(count);
+    }
+    if ((argc == 3 || argc == 4) && strcmp(argv[1], "format") == 0) {
+        uint32_t count = argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : 100000;
+        if (count < 1) {
+            fprintf(stderr, "sniffcheck: write at least one record\n");
+            return 1;
+        }
+        return check_format(argv[2], count);
+    }
+    if (argc >= 2 && argc <= 4 && strcmp(argv[1], "beacon") == 0) {
+        uint32_t count = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 100;
+        uint32_t minutes = argc > 3 ? (uint32_t) strtoul(argv[3], NULL, 10) : 60;
+        if (count < 1 || count > 65536 || minutes < 1) {
+            fprintf(stderr, "sniffcheck: simulate 1 to 65536 APs for at least one minute\n");
+            return 1;
+        }
+        return check_beacon(count, minutes);
+    }
+
+    usage();
+    return 1;
+}